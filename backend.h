@@ -0,0 +1,85 @@
+// Monitor Brightness Backends
+// Dan Jackson, 2020.
+
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define BACKEND_KEY_LENGTH 128
+#define BACKEND_DESCRIPTION_LENGTH 128
+#define BACKEND_IDENTITY_LENGTH 64
+#define BACKEND_MAX_LEVELS 101
+
+typedef struct _backend_t backend_t;
+
+// Common header at the start of each backend's own device structure
+typedef struct _backend_device_t
+{
+	backend_t *backend;
+	struct _backend_device_t *next;						// Enumeration list
+	char key[BACKEND_KEY_LENGTH];						// Identity to associate devices from different backends with the same monitor, e.g. DISPLAY\ACME1234\9&abcdef9&0&UID12345
+	char bus[BACKEND_KEY_LENGTH];						// Devices sharing a bus (e.g. on the same display adapter) have the same value, empty if independent
+	wchar_t description[BACKEND_DESCRIPTION_LENGTH];	// Acme 1234
+	char identity[BACKEND_IDENTITY_LENGTH];				// Stable across connections and ports (e.g. from the EDID: ACM-1234-0001E240), empty if unknown
+	uint64_t lastCommand;								// Time of the last VCP command (PlatformTimeMicroseconds), for spacing
+	bool lastCommandSet;								// The last VCP command was a set (MCCS requires 50 ms after one, however fast the device otherwise is)
+	int commandInterval;								// Spacing learned for this device (microseconds, see vcp.c), 0 until its first VCP command
+	int successCount;									// Consecutive successful VCP commands since the spacing last changed
+	int output;											// BACKEND_OUTPUT_*: whether it is on a built-in panel (e.g. an LVDS or embedded DisplayPort output), which an attaching backend may control
+	bool unsupported;									// Set by vcpGet()/vcpSet() when the command failed only because the monitor replied that it does not support the feature (not a bus error), or by capabilitiesString() if there is none to fetch
+	void *owner;										// Set by the user of the device (e.g. the monitor it is part of), for changes reported by watch()
+} backend_device_t;
+
+typedef void (*backend_changed_t)(backend_device_t *device, int value, void *context);
+
+// Brightness capabilities of a device (raw values)
+typedef struct
+{
+	bool hasBrightness;
+	int minimum;
+	int maximum;
+	int current;
+	int levelCount;										// Number of accepted values in levels[], 0 if every value from minimum to maximum is accepted
+	int levels[BACKEND_MAX_LEVELS];
+} backend_caps_t;
+
+// Kind of output a device is on (backend_device_t.output)
+#define BACKEND_OUTPUT_UNKNOWN 0	// Not known (e.g. the display configuration could not be queried), so an attaching backend may control it
+#define BACKEND_OUTPUT_EXTERNAL 1
+#define BACKEND_OUTPUT_INTERNAL 2	// A built-in panel
+
+#define BACKEND_FLAG_ATTACH 0x01	// Devices do not create monitors, but add brightness control to the monitor with the same key from another backend
+
+struct _backend_t
+{
+	const char *name;
+	int flags;
+	int readDeadline;													// Milliseconds a refresh waits for a read once its bus is free, 0 for the default
+	int commandInterval;												// Microseconds required between VCP commands to a device, 0 if none
+	void *context;														// Backend instance state
+
+	// List the present devices (linked by 'next').  Devices in 'existing' (from a previous enumeration) that are unchanged are returned as-is, without being probed again, and their entry set to NULL.  The caller closes any remaining.
+	backend_device_t *(*enumerate)(backend_t *backend, backend_device_t **existing, int existingCount);
+	bool (*capabilities)(backend_device_t *device, backend_caps_t *caps);	// Probe (may be slow)
+	bool (*get)(backend_device_t *device, int *value);
+	bool (*set)(backend_device_t *device, int value);
+	void (*close)(backend_device_t *device);
+	void (*dump)(backend_device_t *device, FILE *file);					// Optional
+	void (*shutdown)(backend_t *backend);								// Optional, release any shared resources
+	bool (*vcpGet)(backend_device_t *device, uint8_t code, int *current, int *maximum);	// Optional, raw VCP feature access
+	bool (*vcpSet)(backend_device_t *device, uint8_t code, int value);					// Optional
+	bool (*capabilitiesString)(backend_device_t *device, char *buffer, size_t size);	// Optional, MCCS capabilities string (used with vcpGet instead of capabilities, and cached by identity)
+	bool incomplete;													// Set by enumerate() when the devices could not be listed (e.g. a service not yet started), so an empty list is not conclusive
+	bool (*watch)(backend_t *backend, backend_changed_t callback, void *context);	// Optional, report brightness changed elsewhere (e.g. hotkeys) from a background thread as it happens, stopped by a NULL callback (get() need not query the device while watching)
+};
+
+#ifdef _WIN32
+extern backend_t ddcciBackend;		// backend_ddcci.c: DDC/CI (generally external monitors)
+extern backend_t wmiBackend;		// backend_wmi.c: WMI (generally internal panels)
+#endif
+
+#endif
@@ -0,0 +1,443 @@
+// Monitor Brightness - DDC/CI Backend
+// Dan Jackson, 2020.
+
+// Generally external monitors (DCC/CI): https://docs.microsoft.com/en-us/windows/win32/api/highlevelmonitorconfigurationapi/nf-highlevelmonitorconfigurationapi-setmonitorbrightness
+
+#ifdef _WIN32
+
+#define _WIN32_WINNT 0x0601	// 0x0400 (0x0601 for QueryDisplayConfig())
+
+#include <windows.h>
+#include <tchar.h>
+
+#include <stdio.h>
+
+#include <highlevelmonitorconfigurationapi.h>
+#include <lowlevelmonitorconfigurationapi.h>
+#include <physicalmonitorenumerationapi.h>
+
+// MSC-Specific Pragmas
+#ifdef _MSC_VER
+#pragma comment(lib, "Dxva2.lib")
+#endif
+
+#ifndef ERROR_GRAPHICS_DDCCI_VCP_NOT_SUPPORTED
+#define ERROR_GRAPHICS_DDCCI_VCP_NOT_SUPPORTED 0xC0262584L	// winerror.h (not in every SDK): the monitor replied that the VCP code is unsupported
+#endif
+
+#include "backend.h"
+#include "edid.h"
+#include "trace.h"
+#include "lookup.h"
+
+typedef struct
+{
+	backend_device_t base;
+
+	HMONITOR hMonitor;												// Logical monitor
+	DWORD physicalIndex;											// Index of the physical monitor on the logical monitor
+	MONITORINFOEX monitorInfo;										// Logical HMONITOR
+	DISPLAY_DEVICE displayDevice;									// Standard display device information
+	DISPLAY_DEVICE displayDeviceInterface;							// DeviceID is set using EDD_GET_DEVICE_INTERFACE_NAME
+	PHYSICAL_MONITOR physicalMonitor;								// Physical monitor
+	TCHAR adapterId[BACKEND_KEY_LENGTH];							// DeviceID of the display adapter
+	TCHAR wmiInstancePrefix[BACKEND_KEY_LENGTH];					// Assumed prefix of the WMI instance path
+} ddcci_device_t;
+
+typedef struct
+{
+	backend_t *backend;
+	backend_device_t **existing;
+	int existingCount;
+	lookup_t existingPaths;											// Entries of 'existing' by device interface path
+	backend_device_t *list;
+	backend_device_t *last;
+} ddcci_enum_state_t;
+
+static void DdcciNarrow(char *dst, size_t count, const TCHAR *src)
+{
+	if (WideCharToMultiByte(CP_UTF8, 0, src, -1, dst, (int)count, NULL, NULL) == 0) dst[0] = '\0';
+}
+
+// The adapter DeviceID (e.g. PCI\VEN_8086&DEV_1234&...) for a display device name (e.g. \\.\DISPLAY1), shared by all outputs of the same GPU
+static void AdapterIdFromDeviceName(const TCHAR *deviceName, TCHAR *adapterId, size_t count)
+{
+	DISPLAY_DEVICE adapter;
+	for (DWORD i = 0; ; i++)
+	{
+		memset(&adapter, 0, sizeof(adapter));
+		adapter.cb = sizeof(adapter);
+		if (!EnumDisplayDevices(NULL, i, &adapter, 0)) break;
+		if (_tcscmp(adapter.DeviceName, deviceName) == 0 && adapter.DeviceID[0] != TEXT('\0'))
+		{
+			_tcscpy_s(adapterId, count, adapter.DeviceID);
+			return;
+		}
+	}
+	// Otherwise, treat as its own adapter
+	_tcscpy_s(adapterId, count, deviceName);
+}
+
+// Remove and return an existing device with the same identity (logical monitor, physical index and device interface)
+static ddcci_device_t *DdcciTake(ddcci_enum_state_t *enumState, HMONITOR hMonitor, DWORD physicalIndex, const TCHAR *deviceInterfaceId)
+{
+	backend_device_t **entry;
+	uint32_t hash = LookupHash(deviceInterfaceId, _tcslen(deviceInterfaceId) * sizeof(TCHAR));
+	for (int cursor = 0; (entry = (backend_device_t **)LookupNext(&enumState->existingPaths, hash, &cursor)) != NULL; )
+	{
+		ddcci_device_t *device = (ddcci_device_t *)*entry;
+		if (device == NULL) continue;
+		if (device->hMonitor == hMonitor && device->physicalIndex == physicalIndex && _tcscmp(device->displayDeviceInterface.DeviceID, deviceInterfaceId) == 0)
+		{
+			*entry = NULL;
+			return device;
+		}
+	}
+	return NULL;
+}
+
+// Whether the monitor with this device interface (e.g. \\?\DISPLAY#ACME1234#...) is on a built-in output (internal, LVDS or embedded DisplayPort), BACKEND_OUTPUT_UNKNOWN if it cannot be found
+static int DdcciOutput(const TCHAR *deviceInterfaceId)
+{
+	int output = BACKEND_OUTPUT_UNKNOWN;
+	UINT32 pathCount = 0, modeCount = 0;
+	if (deviceInterfaceId[0] == TEXT('\0') || GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &pathCount, &modeCount) != ERROR_SUCCESS) return BACKEND_OUTPUT_UNKNOWN;
+	DISPLAYCONFIG_PATH_INFO *paths = (DISPLAYCONFIG_PATH_INFO *)calloc(pathCount + 1, sizeof(DISPLAYCONFIG_PATH_INFO));
+	DISPLAYCONFIG_MODE_INFO *modes = (DISPLAYCONFIG_MODE_INFO *)calloc(modeCount + 1, sizeof(DISPLAYCONFIG_MODE_INFO));
+	if (paths != NULL && modes != NULL && QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &pathCount, paths, &modeCount, modes, NULL) == ERROR_SUCCESS)
+	{
+		for (UINT32 i = 0; i < pathCount; i++)
+		{
+			DISPLAYCONFIG_TARGET_DEVICE_NAME target;
+			memset(&target, 0, sizeof(target));
+			target.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_TARGET_NAME;
+			target.header.size = sizeof(target);
+			target.header.adapterId = paths[i].targetInfo.adapterId;
+			target.header.id = paths[i].targetInfo.id;
+			if (DisplayConfigGetDeviceInfo(&target.header) != ERROR_SUCCESS) continue;
+			if (_tcsicmp(target.monitorDevicePath, deviceInterfaceId) != 0) continue;
+			DISPLAYCONFIG_VIDEO_OUTPUT_TECHNOLOGY technology = paths[i].targetInfo.outputTechnology;
+			if (technology == DISPLAYCONFIG_OUTPUT_TECHNOLOGY_INTERNAL || technology == DISPLAYCONFIG_OUTPUT_TECHNOLOGY_LVDS || technology == DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DISPLAYPORT_EMBEDDED || technology == DISPLAYCONFIG_OUTPUT_TECHNOLOGY_UDI_EMBEDDED) output = BACKEND_OUTPUT_INTERNAL;
+			else if (technology != DISPLAYCONFIG_OUTPUT_TECHNOLOGY_OTHER) output = BACKEND_OUTPUT_EXTERNAL;
+			break;
+		}
+	}
+	free(modes);
+	free(paths);
+	return output;
+}
+
+// Stable identity from the monitor's EDID, as stored in the registry for the device instance (e.g. DISPLAY\ACME1234\9&abcdef9&0&UID12345)
+static void DdcciIdentity(const TCHAR *instance, char *identity, size_t size)
+{
+	identity[0] = '\0';
+	if (instance[0] == TEXT('\0')) return;
+
+	TCHAR keyName[MAX_PATH];
+	_sntprintf_s(keyName, _countof(keyName), _TRUNCATE, TEXT("SYSTEM\\CurrentControlSet\\Enum\\%s\\Device Parameters"), instance);
+	HKEY hKey = NULL;
+	if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, keyName, 0, KEY_READ, &hKey) != ERROR_SUCCESS) return;
+
+	BYTE edid[256];
+	DWORD type = 0, length = sizeof(edid);
+	LONG result = RegQueryValueEx(hKey, TEXT("EDID"), NULL, &type, edid, &length);
+	RegCloseKey(hKey);
+	if (result != ERROR_SUCCESS || type != REG_BINARY) return;
+
+	edid_info_t info;
+	if (!EdidParse(edid, length, &info)) return;
+	EdidIdentity(&info, identity, size);
+}
+
+static ddcci_device_t *DdcciCreate(backend_t *backend, HMONITOR hMonitor, DWORD physicalIndex, MONITORINFOEX monitorInfo, DISPLAY_DEVICE displayDevice, DISPLAY_DEVICE displayDeviceInterface, PHYSICAL_MONITOR physicalMonitor, const TCHAR *adapterId)
+{
+	ddcci_device_t *device = (ddcci_device_t *)calloc(1, sizeof(ddcci_device_t));
+	device->base.backend = backend;
+	device->hMonitor = hMonitor;
+	device->physicalIndex = physicalIndex;
+	device->monitorInfo = monitorInfo;
+	device->displayDevice = displayDevice;
+	device->displayDeviceInterface = displayDeviceInterface;
+	device->physicalMonitor = physicalMonitor;
+	_tcscpy_s(device->adapterId, _countof(device->adapterId), adapterId);
+
+	// monitor->displayDeviceInterface.DeviceID: \\?\DISPLAY#ACME1234#9&abcdef9&0&UID12345#{abcdef01-abcd-abcd-abcd-abcdef012345}
+	// WMI instance is: DISPLAY\ACME1234\9&abcdef9&0&UID12345_0
+	// WMI PATH: WmiMonitorBrightnessMethods.InstanceName="DISPLAY\ACME1234\9&abcdef9&0&UID12345_0"
+	// Determine WMI instance prefix from device interface name (used as the key to associate the WMI device)
+	if (device->displayDeviceInterface.DeviceID[0] != '\0')
+	{
+		TCHAR *src = device->displayDeviceInterface.DeviceID;
+		// Remove a prefix of "\\?\"
+		if (src[0] == TEXT('\\') && src[1] == TEXT('\\') && src[2] == TEXT('?') && src[3] == TEXT('\\')) src += 4;
+		TCHAR *dst = device->wmiInstancePrefix;
+		TCHAR *end = device->wmiInstancePrefix + _countof(device->wmiInstancePrefix) - 1;
+		for (;;)
+		{
+			TCHAR c = *src++;
+			// Hash (#) turns in to backslash (\), unless followed by open curly brace ({) which ends the string
+			if (c == TEXT('#'))
+			{
+				if (*src == TEXT('{')) c = 0;
+				else c = TEXT('\\');
+			}
+			if (dst >= end) c = 0;
+			*dst++ = c;
+			if (c == 0) break;
+		}
+	}
+
+	DdcciNarrow(device->base.key, sizeof(device->base.key), device->wmiInstancePrefix);
+	DdcciNarrow(device->base.bus, sizeof(device->base.bus), device->adapterId);
+	DdcciIdentity(device->wmiInstancePrefix, device->base.identity, sizeof(device->base.identity));
+	device->base.output = DdcciOutput(device->displayDeviceInterface.DeviceID);
+	wcsncpy(device->base.description, device->physicalMonitor.szPhysicalMonitorDescription, BACKEND_DESCRIPTION_LENGTH - 1);
+
+	return device;
+}
+
+static BOOL CALLBACK DdcciEnumProc(HMONITOR hMonitor, HDC hDC, LPRECT lpRect, LPARAM lParam)
+{
+	ddcci_enum_state_t *enumState = (ddcci_enum_state_t *)lParam;
+	uint64_t trace = TraceBegin();
+
+	DWORD dwNumberOfPhysicalMonitors = 0;
+	BOOL bResult = GetNumberOfPhysicalMonitorsFromHMONITOR(hMonitor, &dwNumberOfPhysicalMonitors);
+	if (!bResult)
+	{
+		fprintf(stderr, "ERROR: Failed GetNumberOfPhysicalMonitorsFromHMONITOR().\n");
+		TraceEnd(trace, "ddcci", "MonitorEnumProc", NULL, -1);
+		return TRUE;	// continue anyway
+	}
+
+	// Find which display device(s) are given to this monitor (the same for all physical monitors on this logical monitor)
+	MONITORINFOEX monitorInfo;
+	memset(&monitorInfo, 0, sizeof(monitorInfo));
+	monitorInfo.cbSize = sizeof(monitorInfo);
+	bResult = GetMonitorInfo(hMonitor, (LPMONITORINFO)&monitorInfo);
+
+	// Identify the display adapter driving this logical monitor
+	TCHAR adapterId[BACKEND_KEY_LENGTH];
+	AdapterIdFromDeviceName(monitorInfo.szDevice, adapterId, _countof(adapterId));
+
+	// Physical monitor handles are only fetched if there are any monitors not already known
+	PHYSICAL_MONITOR *physicalMonitors = NULL;
+	bool physicalFailed = false;
+
+	for (DWORD i = 0; i < dwNumberOfPhysicalMonitors; i++)
+	{
+		// ...this might to be the same index as for EnumDisplayDevices?  Perhaps not if multiple video cards?
+		// ...we're only using the additional information to link the WMI interface to a monitor.
+		DISPLAY_DEVICE displayDevice;
+		memset(&displayDevice, 0, sizeof(displayDevice));
+		displayDevice.cb = sizeof(displayDevice);
+		EnumDisplayDevices(monitorInfo.szDevice, i, &displayDevice, 0);
+
+		DISPLAY_DEVICE displayDeviceInterface;
+		memset(&displayDeviceInterface, 0, sizeof(displayDeviceInterface));
+		displayDeviceInterface.cb = sizeof(displayDeviceInterface);
+		EnumDisplayDevices(monitorInfo.szDevice, i, &displayDeviceInterface, EDD_GET_DEVICE_INTERFACE_NAME);
+
+		// Keep an unchanged device (with its handle)...
+		ddcci_device_t *device = DdcciTake(enumState, hMonitor, i, displayDeviceInterface.DeviceID);
+		if (device != NULL)
+		{
+			device->monitorInfo = monitorInfo;
+			device->displayDevice = displayDevice;
+		}
+		else
+		{
+			// ...otherwise, open a new one
+			if (physicalMonitors == NULL && !physicalFailed)
+			{
+				physicalMonitors = (PHYSICAL_MONITOR *)calloc(dwNumberOfPhysicalMonitors, sizeof(PHYSICAL_MONITOR));
+				bResult = GetPhysicalMonitorsFromHMONITOR(hMonitor, dwNumberOfPhysicalMonitors, physicalMonitors);
+				if (!bResult)
+				{
+					fprintf(stderr, "ERROR: Failed GetPhysicalMonitorsFromHMONITOR().\n");	// continue anyway
+					free(physicalMonitors);
+					physicalMonitors = NULL;
+					physicalFailed = true;
+				}
+			}
+			if (physicalMonitors == NULL) continue;
+
+			device = DdcciCreate(enumState->backend, hMonitor, i, monitorInfo, displayDevice, displayDeviceInterface, physicalMonitors[i], adapterId);
+			physicalMonitors[i].hPhysicalMonitor = NULL;	// Now owned by the device
+		}
+
+		// Add to end of list
+		device->base.next = NULL;
+		if (enumState->last == NULL) enumState->list = &device->base; else enumState->last->next = &device->base;
+		enumState->last = &device->base;
+	}
+
+	// Release any duplicate handles for monitors that were already known
+	if (physicalMonitors != NULL)
+	{
+		for (DWORD i = 0; i < dwNumberOfPhysicalMonitors; i++)
+		{
+			if (physicalMonitors[i].hPhysicalMonitor != NULL) DestroyPhysicalMonitor(physicalMonitors[i].hPhysicalMonitor);
+		}
+		free(physicalMonitors);
+	}
+
+	TraceEnd(trace, "ddcci", "MonitorEnumProc", NULL, (int)dwNumberOfPhysicalMonitors);
+	return TRUE;
+}
+
+static backend_device_t *DdcciEnumerate(backend_t *backend, backend_device_t **existing, int existingCount)
+{
+	ddcci_enum_state_t state = {0};
+	state.backend = backend;
+	state.existing = existing;
+	state.existingCount = existingCount;
+	LookupInit(&state.existingPaths, existingCount);
+	for (int i = 0; i < existingCount; i++)
+	{
+		const TCHAR *path = ((ddcci_device_t *)existing[i])->displayDeviceInterface.DeviceID;
+		LookupAdd(&state.existingPaths, LookupHash(path, _tcslen(path) * sizeof(TCHAR)), &existing[i]);
+	}
+	EnumDisplayMonitors(NULL, NULL, DdcciEnumProc, (LPARAM)&state);
+	LookupFree(&state.existingPaths);
+	return state.list;
+}
+
+static bool DdcciCapabilities(backend_device_t *device, backend_caps_t *caps)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	memset(caps, 0, sizeof(*caps));
+
+	DWORD dwMonitorCapabilities = 0, dwSupportedColorTemperatures = 0;
+	uint64_t trace = TraceBegin();
+	BOOL bResult = GetMonitorCapabilities(ddcciDevice->physicalMonitor.hPhysicalMonitor, &dwMonitorCapabilities, &dwSupportedColorTemperatures);
+	TraceEnd(trace, "ddcci", "GetMonitorCapabilities", device->key, bResult ? 1 : 0);
+	// This will fail if DDC/CI not supported (e.g. for internal panels) -- but the WMI interface may still be supported
+	//if (!bResult) { _ftprintf(stderr, TEXT("WARNING: GetMonitorCapabilities() failed: 0x%08x\n"), GetLastError()); } // 0x1f = ERROR_GEN_FAILURE
+	if (!bResult) return false;
+	if ((dwMonitorCapabilities & MC_CAPS_BRIGHTNESS) == 0) return true;
+
+	DWORD dwMinimumBrightness = 0, dwCurrentBrightness = 0, dwMaximumBrightness = 0;
+	trace = TraceBegin();
+	bResult = GetMonitorBrightness(ddcciDevice->physicalMonitor.hPhysicalMonitor, &dwMinimumBrightness, &dwCurrentBrightness, &dwMaximumBrightness);
+	TraceEnd(trace, "ddcci", "GetMonitorBrightness", device->key, bResult ? 1 : 0);
+	caps->hasBrightness = true;
+	if (bResult)
+	{
+		caps->minimum = dwMinimumBrightness;
+		caps->current = dwCurrentBrightness;
+		caps->maximum = dwMaximumBrightness;
+	}
+	return true;
+}
+
+static bool DdcciGet(backend_device_t *device, int *value)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	DWORD dwMinimumBrightness = 0, dwCurrentBrightness = 0, dwMaximumBrightness = 0;
+	uint64_t trace = TraceBegin();
+	BOOL bResult = GetMonitorBrightness(ddcciDevice->physicalMonitor.hPhysicalMonitor, &dwMinimumBrightness, &dwCurrentBrightness, &dwMaximumBrightness);
+	TraceEnd(trace, "ddcci", "GetMonitorBrightness", device->key, bResult ? 1 : 0);
+	//if (!bResult) { _ftprintf(stderr, TEXT("WARNING: GetMonitorBrightness() failed (perhaps the monitor does not support DDC/CI?): 0x%08x\n"), GetLastError()); }
+	if (!bResult) return false;
+	*value = (int)dwCurrentBrightness;
+	return true;
+}
+
+static bool DdcciSet(backend_device_t *device, int value)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	uint64_t trace = TraceBegin();
+	BOOL bResult = SetMonitorBrightness(ddcciDevice->physicalMonitor.hPhysicalMonitor, (DWORD)value);
+	TraceEnd(trace, "ddcci", "SetMonitorBrightness", device->key, bResult ? 1 : 0);
+	return bResult ? true : false;
+}
+
+static bool DdcciVcpGet(backend_device_t *device, uint8_t code, int *current, int *maximum)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	MC_VCP_CODE_TYPE type = MC_SET_PARAMETER;
+	DWORD dwCurrentValue = 0, dwMaximumValue = 0;
+	uint64_t trace = TraceBegin();
+	BOOL bResult = GetVCPFeatureAndVCPFeatureReply(ddcciDevice->physicalMonitor.hPhysicalMonitor, (BYTE)code, &type, &dwCurrentValue, &dwMaximumValue);
+	TraceEnd(trace, "ddcci", "GetVCPFeatureAndVCPFeatureReply", device->key, bResult ? 1 : 0);
+	device->unsupported = !bResult && GetLastError() == (DWORD)ERROR_GRAPHICS_DDCCI_VCP_NOT_SUPPORTED;
+	if (!bResult) return false;
+	*current = (int)dwCurrentValue;
+	*maximum = (int)dwMaximumValue;
+	return true;
+}
+
+static bool DdcciVcpSet(backend_device_t *device, uint8_t code, int value)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	uint64_t trace = TraceBegin();
+	BOOL bResult = SetVCPFeature(ddcciDevice->physicalMonitor.hPhysicalMonitor, (BYTE)code, (DWORD)value);
+	TraceEnd(trace, "ddcci", "SetVCPFeature", device->key, bResult ? 1 : 0);
+	return bResult ? true : false;
+}
+
+static bool DdcciCapabilitiesString(backend_device_t *device, char *buffer, size_t size)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	DWORD dwLength = 0;
+	uint64_t trace = TraceBegin();
+	BOOL bResult = GetCapabilitiesStringLength(ddcciDevice->physicalMonitor.hPhysicalMonitor, &dwLength);
+	TraceEnd(trace, "ddcci", "GetCapabilitiesStringLength", device->key, bResult ? (int)dwLength : -1);
+	if (!bResult) return false;
+	if (dwLength == 0 || dwLength > size) return false;
+	trace = TraceBegin();
+	bResult = CapabilitiesRequestAndCapabilitiesReply(ddcciDevice->physicalMonitor.hPhysicalMonitor, buffer, dwLength);
+	TraceEnd(trace, "ddcci", "CapabilitiesRequestAndCapabilitiesReply", device->key, bResult ? 1 : 0);
+	if (!bResult) return false;
+	buffer[dwLength - 1] = '\0';
+	return true;
+}
+
+static void DdcciClose(backend_device_t *device)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	DestroyPhysicalMonitors(1, &ddcciDevice->physicalMonitor);
+	free(ddcciDevice);
+}
+
+static void DdcciDump(backend_device_t *device, FILE *file)
+{
+	ddcci_device_t *ddcciDevice = (ddcci_device_t *)device;
+	_ftprintf(file, TEXT("PHYSICAL_MONITOR: description=%ls\n"), ddcciDevice->physicalMonitor.szPhysicalMonitorDescription); // Acme 1234
+	_ftprintf(file, TEXT("ADAPTER: adapterId=%s\n"), ddcciDevice->adapterId);		// PCI\VEN_8086&DEV_1234&SUBSYS_12345678&REV_01
+	_ftprintf(file, TEXT("MONITOR: monitorInfo.dwFlags=0x%08x\n"), ddcciDevice->monitorInfo.dwFlags);	// MONITORINFOF_PRIMARY=0x00000001
+	_ftprintf(file, TEXT("MONITOR: monitorInfo.szDevice=%s\n"), ddcciDevice->monitorInfo.szDevice);		// \\.\DISPLAY1
+
+	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceName=%s\n"), ddcciDevice->displayDevice.DeviceName);		// \\.\DISPLAY1\Monitor0
+	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceString=%s\n"), ddcciDevice->displayDevice.DeviceString);	// Acme 1234
+	_ftprintf(file, TEXT("DISPLAY: displayDevice.StateFlags=0x%08x\n"), ddcciDevice->displayDevice.StateFlags);	// DISPLAY_DEVICE_ACTIVE=0x00000001, DISPLAY_DEVICE_ATTACHED=0x00000002
+	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceID=%s\n"), ddcciDevice->displayDevice.DeviceID);			// MONITOR\ACME1234\{01234567-0123-0123-0123-0123456789ab}\0001
+	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceKey=%s\n"), ddcciDevice->displayDevice.DeviceKey);		// \Registry\Machine\System\CurrentControlSet\Control\Class\{01234567-0123-0123-0123-0123456789ab}\0001
+
+	_ftprintf(file, TEXT("DISPLAY: displayDeviceInterface.DeviceID=%s\n"), ddcciDevice->displayDeviceInterface.DeviceID);	// \\?\DISPLAY#ACME1234#9&abcdef9&0&UID12345#{abcdef01-abcd-abcd-abcd-abcdef012345}
+
+	_ftprintf(file, TEXT("WMI: wmiInstancePrefix=%s\n"), ddcciDevice->wmiInstancePrefix);	// prefix (i.e. without trailing "_0" etc): DISPLAY\ACME1234\9&abcdef9&0&UID12345
+	_ftprintf(file, TEXT("EDID: identity=%hs\n"), device->identity);	// ACM-1234-0001E240
+}
+
+backend_t ddcciBackend =
+{
+	"ddcci",
+	0,
+	250,
+	50000,		// DDC/CI: 50 ms between commands
+	NULL,
+	DdcciEnumerate,
+	DdcciCapabilities,
+	DdcciGet,
+	DdcciSet,
+	DdcciClose,
+	DdcciDump,
+	NULL,
+	DdcciVcpGet,
+	DdcciVcpSet,
+	DdcciCapabilitiesString,
+};
+
+#endif
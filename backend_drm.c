@@ -0,0 +1,297 @@
+// Monitor Brightness - Linux DRM Connector Backend
+// Dan Jackson, 2020.
+
+// The Linux counterpart of the DDC/CI backend's monitor enumeration: each /sys/class/drm/card<N>-<connector>/ that is connected and enabled,
+// identified from its raw edid attribute and mapped to its DDC bus (the ddc link, or an i2c-N entry in the connector directory).
+// Enumeration only reads a few small attribute files -- there is no bus traffic until a VCP command, when the /dev/i2c-N device is opened.
+// Internal panels (eDP, LVDS, DSI) are left to the sysfs backlight backend, as they have no DDC/CI.
+
+#if defined(__linux__)
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "edid.h"
+#include "vcp.h"
+#include "ddc.h"
+#include "backend_drm.h"
+
+#define DRM_PATH_LENGTH 512
+#define DRM_EDID_LENGTH (EDID_BLOCK_LENGTH * 4)	// Base block and extensions (only the base block is parsed)
+
+typedef struct
+{
+	backend_t backend;
+	char root[DRM_PATH_LENGTH];
+	char deviceRoot[DRM_PATH_LENGTH];
+} drm_state_t;
+
+typedef struct
+{
+	backend_device_t base;
+	char connector[BACKEND_KEY_LENGTH];	// Connector directory, e.g. card0-DP-1
+	char i2c[DRM_PATH_LENGTH];			// Bus adapter, e.g. i2c-5 (empty if unknown)
+	ddc_transport_t *transport;			// Opened on first use
+	bool warned;						// Reported failing to open the bus
+} drm_device_t;
+
+static const char *drmInternal[] = { "eDP", "LVDS", "DSI", NULL };
+
+// Join a directory and entry name, returns false if too long
+static bool DrmPath(char *buffer, size_t size, const char *directory, const char *name)
+{
+	size_t directoryLength = strlen(directory), nameLength = strlen(name);
+	if (directoryLength + nameLength + 2 > size) return false;
+	memcpy(buffer, directory, directoryLength);
+	buffer[directoryLength] = '/';
+	memcpy(buffer + directoryLength + 1, name, nameLength + 1);
+	return true;
+}
+
+// Contents of a small attribute file, returns the length read, or -1
+static ssize_t DrmReadFile(const char *path, void *buffer, size_t size)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return -1;
+	ssize_t total = 0;
+	while ((size_t)total < size)
+	{
+		ssize_t length = read(fd, (char *)buffer + total, size - (size_t)total);
+		if (length <= 0) break;
+		total += length;
+	}
+	close(fd);
+	return total;
+}
+
+// Whether a text attribute starts with the expected value (e.g. status is "connected\n")
+static bool DrmAttribute(const char *path, const char *expected)
+{
+	char buffer[32] = {0};
+	if (DrmReadFile(path, buffer, sizeof(buffer) - 1) < 0) return false;
+	return strncmp(buffer, expected, strlen(expected)) == 0 && (buffer[strlen(expected)] == '\0' || buffer[strlen(expected)] == '\n');
+}
+
+// Connector directory names are card<N>-<type>-<index> (the card<N> entries themselves are the devices)
+static bool DrmIsConnector(const char *name)
+{
+	if (strncmp(name, "card", 4) != 0) return false;
+	const char *p = name + 4;
+	if (*p < '0' || *p > '9') return false;
+	while (*p >= '0' && *p <= '9') p++;
+	if (*p != '-') return false;
+	p++;
+	for (int i = 0; drmInternal[i] != NULL; i++)
+	{
+		size_t length = strlen(drmInternal[i]);
+		if (strncmp(p, drmInternal[i], length) == 0 && p[length] == '-') return false;
+	}
+	return true;
+}
+
+// The connector's DDC adapter name (i2c-N): the ddc link (e.g. ../../../../i2c-5), otherwise an i2c-N entry (e.g. DisplayPort AUX channels)
+static bool DrmFindBus(const char *connectorPath, char *buffer, size_t size)
+{
+	char path[DRM_PATH_LENGTH];
+	char target[DRM_PATH_LENGTH];
+	ssize_t length = DrmPath(path, sizeof(path), connectorPath, "ddc") ? readlink(path, target, sizeof(target) - 1) : -1;
+	if (length > 0)
+	{
+		target[length] = '\0';
+		const char *name = strrchr(target, '/');
+		name = (name != NULL) ? name + 1 : target;
+		if (strncmp(name, "i2c-", 4) == 0) { snprintf(buffer, size, "%s", name); return true; }
+	}
+
+	bool found = false;
+	DIR *dir = opendir(connectorPath);
+	if (dir == NULL) return false;
+	struct dirent *entry;
+	while (!found && (entry = readdir(dir)) != NULL)
+	{
+		if (strncmp(entry->d_name, "i2c-", 4) != 0) continue;
+		snprintf(buffer, size, "%s", entry->d_name);
+		found = true;
+	}
+	closedir(dir);
+	return found;
+}
+
+static drm_device_t *DrmOpen(backend_t *backend, const char *connectorPath, const char *connector, const edid_info_t *info, const char *identity)
+{
+	drm_state_t *state = (drm_state_t *)backend->context;
+	drm_device_t *device = (drm_device_t *)calloc(1, sizeof(drm_device_t));
+	if (device == NULL) return NULL;
+	device->base.backend = backend;
+	snprintf(device->connector, sizeof(device->connector), "%s", connector);
+	if (!DrmFindBus(connectorPath, device->i2c, sizeof(device->i2c))) device->i2c[0] = '\0';
+
+	snprintf(device->base.key, sizeof(device->base.key), "drm/%s", connector);
+	device->base.output = BACKEND_OUTPUT_EXTERNAL;	// Internal connectors are not listed
+	if (device->i2c[0] != '\0' && !DrmPath(device->base.bus, sizeof(device->base.bus), state->deviceRoot, device->i2c)) device->base.bus[0] = '\0';
+	snprintf(device->base.identity, sizeof(device->base.identity), "%s", identity);
+	EdidDescription(info, device->base.description, BACKEND_DESCRIPTION_LENGTH);
+	return device;
+}
+
+static backend_device_t *DrmEnumerate(backend_t *backend, backend_device_t **existing, int existingCount)
+{
+	drm_state_t *state = (drm_state_t *)backend->context;
+	backend_device_t *list = NULL, *last = NULL;
+
+	DIR *dir = opendir(state->root);
+	if (dir == NULL) return NULL;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (!DrmIsConnector(entry->d_name)) continue;
+
+		char connectorPath[DRM_PATH_LENGTH];
+		char path[DRM_PATH_LENGTH];
+		if (!DrmPath(connectorPath, sizeof(connectorPath), state->root, entry->d_name)) continue;
+
+		// Only active outputs (as EnumDisplayMonitors() on Windows)
+		if (!DrmPath(path, sizeof(path), connectorPath, "status") || !DrmAttribute(path, "connected")) continue;
+		if (!DrmPath(path, sizeof(path), connectorPath, "enabled") || !DrmAttribute(path, "enabled")) continue;
+
+		uint8_t data[DRM_EDID_LENGTH];
+		edid_info_t info;
+		ssize_t length = DrmPath(path, sizeof(path), connectorPath, "edid") ? DrmReadFile(path, data, sizeof(data)) : -1;
+		if (length < EDID_BLOCK_LENGTH || !EdidParse(data, (size_t)length, &info)) continue;
+		char identity[BACKEND_IDENTITY_LENGTH];
+		EdidIdentity(&info, identity, sizeof(identity));
+
+		// Keep an existing device (the same display on the same connector)...
+		drm_device_t *device = NULL;
+		for (int i = 0; i < existingCount; i++)
+		{
+			drm_device_t *previous = (drm_device_t *)existing[i];
+			if (previous != NULL && strcmp(previous->connector, entry->d_name) == 0 && strcmp(previous->base.identity, identity) == 0)
+			{
+				device = previous;
+				existing[i] = NULL;
+				break;
+			}
+		}
+
+		// ...or add a new one
+		if (device == NULL) device = DrmOpen(backend, connectorPath, entry->d_name, &info, identity);
+		if (device == NULL) continue;
+
+		device->base.next = NULL;
+		if (last == NULL) list = &device->base; else last->next = &device->base;
+		last = &device->base;
+	}
+	closedir(dir);
+
+	return list;
+}
+
+static ddc_transport_t *DrmTransport(backend_device_t *device)
+{
+	drm_device_t *drmDevice = (drm_device_t *)device;
+	if (drmDevice->transport == NULL && device->bus[0] != '\0')
+	{
+		drmDevice->transport = DdcI2cOpen(device->bus);
+		if (drmDevice->transport == NULL && !drmDevice->warned)
+		{
+			fprintf(stderr, "WARNING: Cannot open DDC bus (requires i2c-dev and access): %s\n", device->bus);
+			drmDevice->warned = true;
+		}
+	}
+	return drmDevice->transport;
+}
+
+static bool DrmVcpGet(backend_device_t *device, uint8_t code, int *current, int *maximum)
+{
+	ddc_transport_t *transport = DrmTransport(device);
+	if (transport == NULL) return false;
+	bool success = DdcGetVcp(transport, code, current, maximum);
+	device->unsupported = transport->unsupported;
+	return success;
+}
+
+static bool DrmVcpSet(backend_device_t *device, uint8_t code, int value)
+{
+	ddc_transport_t *transport = DrmTransport(device);
+	return transport != NULL && DdcSetVcp(transport, code, value);
+}
+
+static bool DrmCapabilities(backend_device_t *device, backend_caps_t *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+	if (!DrmVcpGet(device, VCP_BRIGHTNESS, &caps->current, &caps->maximum)) return false;
+	caps->hasBrightness = true;
+	return true;
+}
+
+static bool DrmGet(backend_device_t *device, int *value)
+{
+	int maximum;
+	return DrmVcpGet(device, VCP_BRIGHTNESS, value, &maximum);
+}
+
+static bool DrmSet(backend_device_t *device, int value)
+{
+	return DrmVcpSet(device, VCP_BRIGHTNESS, value);
+}
+
+static bool DrmCapabilitiesString(backend_device_t *device, char *buffer, size_t size)
+{
+	ddc_transport_t *transport = DrmTransport(device);
+	return transport != NULL && DdcCapabilities(transport, buffer, size);
+}
+
+static void DrmClose(backend_device_t *device)
+{
+	drm_device_t *drmDevice = (drm_device_t *)device;
+	if (drmDevice->transport != NULL) drmDevice->transport->close(drmDevice->transport);
+	free(drmDevice);
+}
+
+static void DrmDump(backend_device_t *device, FILE *file)
+{
+	drm_device_t *drmDevice = (drm_device_t *)device;
+	drm_state_t *state = (drm_state_t *)device->backend->context;
+	fprintf(file, "DRM: connector=%s/%s\n", state->root, drmDevice->connector);	// /sys/class/drm/card0-DP-1
+	fprintf(file, "DRM: bus=%s\n", device->bus);									// /dev/i2c-5
+	fprintf(file, "DRM: identity=%s\n", device->identity);							// ACM-1234-0001E240
+}
+
+backend_t *DrmBackendCreate(const char *root, const char *deviceRoot)
+{
+	drm_state_t *state = (drm_state_t *)calloc(1, sizeof(drm_state_t));
+	if (state == NULL) return NULL;
+	snprintf(state->root, sizeof(state->root), "%s", (root != NULL) ? root : DRM_ROOT);
+	snprintf(state->deviceRoot, sizeof(state->deviceRoot), "%s", (deviceRoot != NULL) ? deviceRoot : DRM_DEVICE_ROOT);
+
+	state->backend.name = "drm";
+	state->backend.flags = 0;
+	state->backend.readDeadline = 250;
+	state->backend.commandInterval = 50000;		// DDC/CI: 50 ms between commands
+	state->backend.context = state;
+	state->backend.enumerate = DrmEnumerate;
+	state->backend.capabilities = DrmCapabilities;
+	state->backend.get = DrmGet;
+	state->backend.set = DrmSet;
+	state->backend.close = DrmClose;
+	state->backend.dump = DrmDump;
+	state->backend.shutdown = NULL;
+	state->backend.vcpGet = DrmVcpGet;
+	state->backend.vcpSet = DrmVcpSet;
+	state->backend.capabilitiesString = DrmCapabilitiesString;
+	return &state->backend;
+}
+
+void DrmBackendDestroy(backend_t *backend)
+{
+	free(backend->context);
+}
+
+#endif
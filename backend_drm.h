@@ -0,0 +1,17 @@
+// Monitor Brightness - Linux DRM Connector Backend
+// Dan Jackson, 2020.
+
+#ifndef _BACKEND_DRM_H
+#define _BACKEND_DRM_H
+
+#include "backend.h"
+
+#define DRM_ROOT "/sys/class/drm"
+#define DRM_DEVICE_ROOT "/dev"
+
+// External displays on the DRM connectors under the given root (NULL for DRM_ROOT, or e.g. a temporary directory tree for testing),
+// controlled over DDC/CI on each connector's I2C bus in the device directory (NULL for DRM_DEVICE_ROOT)
+backend_t *DrmBackendCreate(const char *root, const char *deviceRoot);
+void DrmBackendDestroy(backend_t *backend);
+
+#endif
@@ -0,0 +1,449 @@
+// Simulated Monitor Backend
+// Dan Jackson, 2020.
+
+// Models DDC/CI-like monitors with per-call latency and jitter, raw ranges, discrete levels, VCP features, transient failures and hotplug, against a virtual clock.
+// Used to measure and exercise the brightness pipeline without any real monitors attached.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "backend_sim.h"
+#include "vcp.h"
+
+typedef struct
+{
+	char name[BACKEND_KEY_LENGTH];
+	platform_mutex_t mutex;				// Held for the duration of each call on the bus
+} sim_bus_t;
+
+typedef struct
+{
+	sim_monitor_t config;
+	wchar_t description[BACKEND_DESCRIPTION_LENGTH];
+	char bus[BACKEND_KEY_LENGTH];
+	char capabilities[256];
+	int busIndex;
+	int connected;						// -1 = use the configured times, 0 = forced disconnected, 1 = forced connected
+	uint32_t random;
+	sim_stats_t stats;
+	int64_t lastCommandEnd;				// Time the previous get or set completed, 0 if none
+	int failNext;						// Gets and sets still to fail (SimBackendFailNext())
+	int ignoreNext;						// Brightness sets still to be acknowledged without being applied (SimBackendIgnoreNext())
+	int features[256];					// VCP feature values (other than brightness)
+	int featureMaximum[256];			// 0 if the feature is not supported
+} sim_monitor_state_t;
+
+typedef struct
+{
+	backend_t backend;
+	platform_mutex_t lock;
+	double timeScale;
+	uint64_t startTime;					// Real time at creation
+	int64_t offset;						// Virtual time added by SimBackendAdvance() (and each call, when not blocking)
+	unsigned int seed;
+	int monitorCount;
+	sim_monitor_state_t monitors[SIM_MAX_MONITORS];
+	int busCount;
+	sim_bus_t buses[SIM_MAX_MONITORS];
+} sim_state_t;
+
+typedef struct
+{
+	backend_device_t base;
+	int index;
+} sim_device_t;
+
+typedef enum { SIM_CAPS, SIM_GET, SIM_SET } sim_call_t;
+
+// xorshift32
+static uint32_t SimRandom(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Virtual time (must hold the lock)
+static int64_t SimTime(sim_state_t *state)
+{
+	int64_t now = state->offset;
+	if (state->timeScale > 0)
+	{
+		now += (int64_t)((double)(PlatformTimeMicroseconds() - state->startTime) / state->timeScale);
+	}
+	return now;
+}
+
+// (must hold the lock)
+static bool SimConnected(sim_state_t *state, sim_monitor_state_t *monitor)
+{
+	if (monitor->connected >= 0) return monitor->connected != 0;
+	int64_t now = SimTime(state);
+	if (now < monitor->config.connectAt) return false;
+	if (monitor->config.disconnectAt != 0 && now >= monitor->config.disconnectAt) return false;
+	return true;
+}
+
+// Nearest accepted raw value
+static int SimQuantize(const sim_monitor_t *config, int value)
+{
+	if (value < config->minimum) value = config->minimum;
+	if (value > config->maximum) value = config->maximum;
+	if (config->levelCount > 1)
+	{
+		int range = config->maximum - config->minimum;
+		int step = ((value - config->minimum) * (config->levelCount - 1) * 2 + range) / (2 * range);
+		value = config->minimum + step * range / (config->levelCount - 1);
+	}
+	return value;
+}
+
+// A code of 0 (or VCP_BRIGHTNESS) is the brightness value
+static bool SimCall(sim_device_t *device, sim_call_t call, uint8_t code, int *value, int *maximum)
+{
+	sim_state_t *state = (sim_state_t *)device->base.backend->context;
+	sim_monitor_state_t *monitor = &state->monitors[device->index];
+	bool success = true;
+
+	// Monitors on the same bus are serialized for the whole call
+	PlatformMutexLock(&state->buses[monitor->busIndex].mutex);
+
+	PlatformMutexLock(&state->lock);
+	int latency = (call == SIM_CAPS) ? monitor->config.capsLatency : (call == SIM_GET) ? monitor->config.readLatency : monitor->config.writeLatency;
+	if (monitor->config.jitter > 0)
+	{
+		latency += (int)(SimRandom(&monitor->random) % (uint32_t)(2 * monitor->config.jitter + 1)) - monitor->config.jitter;
+	}
+	if (latency < 0) latency = 0;
+	if (monitor->config.failurePercent > 0 && (int)(SimRandom(&monitor->random) % 100) < monitor->config.failurePercent) success = false;
+	if (call != SIM_CAPS && monitor->failNext > 0)
+	{
+		monitor->failNext--;
+		success = false;
+	}
+	if (call != SIM_CAPS && monitor->config.minimumGap > 0 && monitor->lastCommandEnd != 0 && SimTime(state) < monitor->lastCommandEnd + monitor->config.minimumGap)
+	{
+		monitor->stats.gapFailures++;
+		success = false;
+	}
+	if (state->timeScale <= 0) state->offset += latency;
+	PlatformMutexUnlock(&state->lock);
+
+	if (state->timeScale > 0 && latency > 0)
+	{
+		PlatformSleepMicroseconds((uint64_t)(latency * state->timeScale));
+	}
+
+	PlatformMutexLock(&state->lock);
+	if (call != SIM_CAPS) monitor->lastCommandEnd = SimTime(state);
+	if (!SimConnected(state, monitor)) success = false;
+	bool brightness = (code == 0 || code == VCP_BRIGHTNESS);
+	bool unsupported = (call != SIM_CAPS) && (brightness ? !monitor->config.hasBrightness : monitor->featureMaximum[code] <= 0);
+	device->base.unsupported = success && unsupported;	// Answered, but not supported
+	if (unsupported) success = false;
+	if (!success)
+	{
+		monitor->stats.failures++;
+	}
+	else if (call == SIM_CAPS)
+	{
+		monitor->stats.capsCalls++;
+	}
+	else if (call == SIM_GET)
+	{
+		monitor->stats.reads++;
+		*value = brightness ? monitor->stats.value : monitor->features[code];
+		if (maximum != NULL) *maximum = brightness ? monitor->config.maximum : monitor->featureMaximum[code];
+	}
+	else if (call == SIM_SET)
+	{
+		monitor->stats.writes++;
+		if (brightness && monitor->ignoreNext > 0)
+		{
+			monitor->ignoreNext--;
+		}
+		else if (brightness)
+		{
+			monitor->stats.value = SimQuantize(&monitor->config, *value);
+			monitor->stats.lastWriteTime = SimTime(state);
+		}
+		else
+		{
+			monitor->features[code] = (*value < 0) ? 0 : (*value > monitor->featureMaximum[code]) ? monitor->featureMaximum[code] : *value;
+		}
+	}
+	PlatformMutexUnlock(&state->lock);
+
+	PlatformMutexUnlock(&state->buses[monitor->busIndex].mutex);
+	return success;
+}
+
+static backend_device_t *SimEnumerate(backend_t *backend, backend_device_t **existing, int existingCount)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	backend_device_t *list = NULL, *last = NULL;
+
+	PlatformMutexLock(&state->lock);
+	for (int index = 0; index < state->monitorCount; index++)
+	{
+		sim_monitor_state_t *monitor = &state->monitors[index];
+		if (!SimConnected(state, monitor)) continue;
+
+		// Reuse the existing device
+		sim_device_t *device = NULL;
+		for (int i = 0; i < existingCount; i++)
+		{
+			if (existing[i] != NULL && ((sim_device_t *)existing[i])->index == index)
+			{
+				device = (sim_device_t *)existing[i];
+				existing[i] = NULL;
+				break;
+			}
+		}
+
+		if (device == NULL)
+		{
+			device = (sim_device_t *)calloc(1, sizeof(sim_device_t));
+			device->base.backend = backend;
+			device->index = index;
+			snprintf(device->base.key, sizeof(device->base.key), "SIM\\%d", index);
+			snprintf(device->base.bus, sizeof(device->base.bus), "%s", monitor->bus);
+			snprintf(device->base.identity, sizeof(device->base.identity), "SIM-%04X-%08X", index, state->seed);
+			wcsncpy(device->base.description, monitor->description, BACKEND_DESCRIPTION_LENGTH - 1);
+		}
+
+		device->base.next = NULL;
+		if (last == NULL) list = &device->base; else last->next = &device->base;
+		last = &device->base;
+	}
+	PlatformMutexUnlock(&state->lock);
+
+	return list;
+}
+
+static bool SimCapabilities(backend_device_t *device, backend_caps_t *caps)
+{
+	sim_device_t *simDevice = (sim_device_t *)device;
+	sim_state_t *state = (sim_state_t *)device->backend->context;
+	const sim_monitor_t *config = &state->monitors[simDevice->index].config;
+
+	memset(caps, 0, sizeof(*caps));
+	if (!SimCall(simDevice, SIM_CAPS, 0, NULL, NULL)) return false;
+	if (!config->hasBrightness) return true;
+
+	caps->hasBrightness = true;
+	caps->minimum = config->minimum;
+	caps->maximum = config->maximum;
+	if (config->levelCount > 1 && config->levelCount <= BACKEND_MAX_LEVELS)
+	{
+		caps->levelCount = config->levelCount;
+		for (int i = 0; i < config->levelCount; i++)
+		{
+			caps->levels[i] = config->minimum + i * (config->maximum - config->minimum) / (config->levelCount - 1);
+		}
+	}
+	return SimCall(simDevice, SIM_GET, 0, &caps->current, NULL);
+}
+
+static bool SimGet(backend_device_t *device, int *value)
+{
+	return SimCall((sim_device_t *)device, SIM_GET, 0, value, NULL);
+}
+
+static bool SimSet(backend_device_t *device, int value)
+{
+	return SimCall((sim_device_t *)device, SIM_SET, 0, &value, NULL);
+}
+
+static bool SimVcpGet(backend_device_t *device, uint8_t code, int *current, int *maximum)
+{
+	return SimCall((sim_device_t *)device, SIM_GET, code, current, maximum);
+}
+
+static bool SimVcpSet(backend_device_t *device, uint8_t code, int value)
+{
+	return SimCall((sim_device_t *)device, SIM_SET, code, &value, NULL);
+}
+
+static bool SimCapabilitiesString(backend_device_t *device, char *buffer, size_t size)
+{
+	sim_device_t *simDevice = (sim_device_t *)device;
+	sim_state_t *state = (sim_state_t *)device->backend->context;
+	const char *capabilities = state->monitors[simDevice->index].capabilities;
+	if (capabilities[0] == '\0') { device->unsupported = true; return false; }	// None, so the backend's capabilities() is used
+	if (strlen(capabilities) >= size) return false;
+	if (!SimCall(simDevice, SIM_CAPS, 0, NULL, NULL)) return false;
+	strcpy(buffer, capabilities);
+	return true;
+}
+
+static void SimClose(backend_device_t *device)
+{
+	free(device);
+}
+
+static void SimDump(backend_device_t *device, FILE *file)
+{
+	sim_device_t *simDevice = (sim_device_t *)device;
+	sim_state_t *state = (sim_state_t *)device->backend->context;
+	const sim_monitor_t *config = &state->monitors[simDevice->index].config;
+	fprintf(file, "SIM: index=%d\n", simDevice->index);
+	fprintf(file, "SIM: range=%d-%d levels=%d\n", config->minimum, config->maximum, config->levelCount);
+	fprintf(file, "SIM: latency=%d/%d/%d us (caps/read/write) jitter=%d us failure=%d%% gap=%d us\n", config->capsLatency, config->readLatency, config->writeLatency, config->jitter, config->failurePercent, config->minimumGap);
+	fprintf(file, "SIM: identity=%s capabilities=%s\n", device->identity, state->monitors[simDevice->index].capabilities);
+}
+
+backend_t *SimBackendCreate(double timeScale, unsigned int seed)
+{
+	sim_state_t *state = (sim_state_t *)calloc(1, sizeof(sim_state_t));
+	if (state == NULL) return NULL;
+	PlatformMutexInit(&state->lock);
+	state->timeScale = timeScale;
+	state->startTime = PlatformTimeMicroseconds();
+	state->seed = seed;
+
+	state->backend.name = "sim";
+	state->backend.flags = 0;
+	state->backend.readDeadline = 0;
+	state->backend.commandInterval = (timeScale > 0) ? (int)(50000 * timeScale) : 0;	// DDC/CI spacing (in real time)
+	state->backend.context = state;
+	state->backend.enumerate = SimEnumerate;
+	state->backend.capabilities = SimCapabilities;
+	state->backend.get = SimGet;
+	state->backend.set = SimSet;
+	state->backend.close = SimClose;
+	state->backend.dump = SimDump;
+	state->backend.shutdown = NULL;
+	state->backend.vcpGet = SimVcpGet;
+	state->backend.vcpSet = SimVcpSet;
+	state->backend.capabilitiesString = SimCapabilitiesString;
+	return &state->backend;
+}
+
+void SimBackendDestroy(backend_t *backend)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	for (int i = 0; i < state->busCount; i++)
+	{
+		PlatformMutexDestroy(&state->buses[i].mutex);
+	}
+	PlatformMutexDestroy(&state->lock);
+	free(state);
+}
+
+int SimBackendAdd(backend_t *backend, const sim_monitor_t *config)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	int index = -1;
+
+	PlatformMutexLock(&state->lock);
+	if (state->monitorCount < SIM_MAX_MONITORS && config->maximum >= config->minimum)
+	{
+		index = state->monitorCount;
+		sim_monitor_state_t *monitor = &state->monitors[index];
+		memset(monitor, 0, sizeof(*monitor));
+		monitor->config = *config;
+		if (config->description != NULL) wcsncpy(monitor->description, config->description, BACKEND_DESCRIPTION_LENGTH - 1);
+		else swprintf(monitor->description, BACKEND_DESCRIPTION_LENGTH, L"Simulated %d", index);
+		monitor->config.description = monitor->description;
+		if (config->bus != NULL) snprintf(monitor->bus, sizeof(monitor->bus), "%s", config->bus);
+		monitor->config.bus = monitor->bus;
+		monitor->connected = -1;
+		monitor->random = (state->seed ^ (uint32_t)(index * 2654435761u)) | 1;
+		monitor->stats.value = SimQuantize(config, config->initial);
+		monitor->featureMaximum[VCP_CONTRAST] = 100;
+		monitor->features[VCP_CONTRAST] = 50;
+		monitor->featureMaximum[VCP_VOLUME] = 100;
+		monitor->features[VCP_VOLUME] = 30;
+		monitor->featureMaximum[VCP_POWER_MODE] = 5;
+		monitor->features[VCP_POWER_MODE] = 1;
+		if (config->capabilities != NULL) snprintf(monitor->capabilities, sizeof(monitor->capabilities), "%s", config->capabilities);
+		else if (config->minimum == 0 && config->levelCount == 0) snprintf(monitor->capabilities, sizeof(monitor->capabilities), "(prot(monitor)type(lcd)model(SIM%d)cmds(01 02 03 07 0C F3)vcp(%s12 62 D6(01 04 05))mccs_ver(2.2))", index, config->hasBrightness ? "10 " : "");
+		monitor->config.capabilities = monitor->capabilities;
+
+		// Find or add the bus (an unnamed bus is not shared)
+		monitor->busIndex = -1;
+		for (int i = 0; monitor->bus[0] != '\0' && i < state->busCount; i++)
+		{
+			if (strcmp(state->buses[i].name, monitor->bus) == 0) monitor->busIndex = i;
+		}
+		if (monitor->busIndex < 0)
+		{
+			monitor->busIndex = state->busCount++;
+			memcpy(state->buses[monitor->busIndex].name, monitor->bus, sizeof(state->buses[monitor->busIndex].name));
+			PlatformMutexInit(&state->buses[monitor->busIndex].mutex);
+		}
+		state->monitorCount++;
+	}
+	PlatformMutexUnlock(&state->lock);
+
+	return index;
+}
+
+void SimBackendSetConnected(backend_t *backend, int index, bool connected)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	PlatformMutexLock(&state->lock);
+	if (index >= 0 && index < state->monitorCount) state->monitors[index].connected = connected ? 1 : 0;
+	PlatformMutexUnlock(&state->lock);
+}
+
+void SimBackendSetValue(backend_t *backend, int index, int value)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	PlatformMutexLock(&state->lock);
+	if (index >= 0 && index < state->monitorCount) state->monitors[index].stats.value = SimQuantize(&state->monitors[index].config, value);
+	PlatformMutexUnlock(&state->lock);
+}
+
+void SimBackendFailNext(backend_t *backend, int index, int count)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	PlatformMutexLock(&state->lock);
+	if (index >= 0 && index < state->monitorCount) state->monitors[index].failNext = count;
+	PlatformMutexUnlock(&state->lock);
+}
+
+void SimBackendIgnoreNext(backend_t *backend, int index, int count)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	PlatformMutexLock(&state->lock);
+	if (index >= 0 && index < state->monitorCount) state->monitors[index].ignoreNext = count;
+	PlatformMutexUnlock(&state->lock);
+}
+
+int64_t SimBackendTime(backend_t *backend)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	PlatformMutexLock(&state->lock);
+	int64_t now = SimTime(state);
+	PlatformMutexUnlock(&state->lock);
+	return now;
+}
+
+void SimBackendAdvance(backend_t *backend, int64_t microseconds)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	PlatformMutexLock(&state->lock);
+	state->offset += microseconds;
+	PlatformMutexUnlock(&state->lock);
+}
+
+bool SimBackendStats(backend_t *backend, int index, sim_stats_t *stats)
+{
+	sim_state_t *state = (sim_state_t *)backend->context;
+	bool valid = false;
+	PlatformMutexLock(&state->lock);
+	if (index >= 0 && index < state->monitorCount)
+	{
+		*stats = state->monitors[index].stats;
+		valid = true;
+	}
+	PlatformMutexUnlock(&state->lock);
+	return valid;
+}
@@ -0,0 +1,57 @@
+// Simulated Monitor Backend
+// Dan Jackson, 2020.
+
+#ifndef _BACKEND_SIM_H
+#define _BACKEND_SIM_H
+
+#include <stdint.h>
+
+#include "backend.h"
+
+#define SIM_MAX_MONITORS 256
+
+// Simulated monitor model (times are in virtual microseconds)
+typedef struct
+{
+	const wchar_t *description;
+	const char *bus;					// Calls to monitors on the same named bus are serialized, NULL for an independent bus
+	bool hasBrightness;
+	int minimum;
+	int maximum;
+	int initial;
+	int levelCount;						// Evenly spaced discrete levels from minimum to maximum, 0 for continuous
+	int capsLatency;
+	int readLatency;
+	int writeLatency;
+	int jitter;							// Up to +/- this is added to each latency
+	int failurePercent;					// Chance of each call failing transiently
+	int minimumGap;						// A get or set starting sooner than this after the previous one completed fails (as a monitor dropping commands sent too quickly), 0 for none
+	int64_t connectAt;					// Time the monitor is connected
+	int64_t disconnectAt;				// Time the monitor is disconnected, 0 for never
+	const char *capabilities;			// MCCS capabilities string, NULL to generate one (only for a continuous range from 0, as DDC/CI), "" for none
+} sim_monitor_t;
+
+typedef struct
+{
+	int capsCalls;
+	int reads;
+	int writes;
+	int failures;
+	int gapFailures;					// Failures from commands sent within the minimum gap
+	int value;							// Current raw value
+	int64_t lastWriteTime;				// Time the last successful write completed
+} sim_stats_t;
+
+// A time scale of 1.0 runs in real time (calls block for their latency), 0.01 runs 100x faster, and 0 never blocks (the clock is only advanced by each call's latency and SimBackendAdvance()).
+backend_t *SimBackendCreate(double timeScale, unsigned int seed);
+void SimBackendDestroy(backend_t *backend);
+int SimBackendAdd(backend_t *backend, const sim_monitor_t *monitor);	// Returns the index, or -1 if full
+void SimBackendSetConnected(backend_t *backend, int index, bool connected);	// Hotplug now (overrides the connect/disconnect times)
+void SimBackendSetValue(backend_t *backend, int index, int value);	// Brightness changed on the monitor itself (e.g. its own buttons)
+void SimBackendFailNext(backend_t *backend, int index, int count);	// The next gets and sets fail (as a monitor not replying), 0 to stop
+void SimBackendIgnoreNext(backend_t *backend, int index, int count);	// The next brightness sets are acknowledged but not applied (as a monitor dropping a command)
+int64_t SimBackendTime(backend_t *backend);
+void SimBackendAdvance(backend_t *backend, int64_t microseconds);
+bool SimBackendStats(backend_t *backend, int index, sim_stats_t *stats);
+
+#endif
@@ -0,0 +1,196 @@
+// Monitor Brightness - Linux sysfs Backlight Backend
+// Dan Jackson, 2020.
+
+// Generally internal panels: /sys/class/backlight/<device>/{brightness,max_brightness}, the counterpart of the WMI backend.
+// The brightness file of each device is kept open, so each read or write is a single pread()/pwrite() system call.
+
+#if defined(__linux__)
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend_sysfs.h"
+
+#define SYSFS_PATH_LENGTH 512
+
+typedef struct
+{
+	backend_t backend;
+	char root[SYSFS_PATH_LENGTH];
+} sysfs_state_t;
+
+typedef struct
+{
+	backend_device_t base;
+	char name[BACKEND_KEY_LENGTH];		// Device directory, e.g. intel_backlight
+	int brightnessFd;					// brightness (read/write, or read-only without permission)
+	int maximum;						// max_brightness
+} sysfs_device_t;
+
+// Integer value of an open attribute file
+static bool SysfsReadFd(int fd, int *value)
+{
+	char buffer[32];
+	ssize_t length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+	if (length <= 0) return false;
+	buffer[length] = '\0';
+	char *end = NULL;
+	long result = strtol(buffer, &end, 10);
+	if (end == buffer) return false;
+	*value = (int)result;
+	return true;
+}
+
+static bool SysfsReadFile(const char *path, int *value)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	bool success = SysfsReadFd(fd, value);
+	close(fd);
+	return success;
+}
+
+static sysfs_device_t *SysfsOpen(backend_t *backend, const char *root, const char *name)
+{
+	char path[SYSFS_PATH_LENGTH];
+	int maximum = 0;
+	snprintf(path, sizeof(path), "%s/%s/max_brightness", root, name);
+	if (!SysfsReadFile(path, &maximum) || maximum <= 0) return NULL;
+
+	snprintf(path, sizeof(path), "%s/%s/brightness", root, name);
+	int brightnessFd = open(path, O_RDWR | O_CLOEXEC);
+	if (brightnessFd < 0)
+	{
+		// Writing generally requires root or a udev rule granting access
+		if (errno == EACCES) fprintf(stderr, "WARNING: No write access to backlight: %s\n", path);
+		brightnessFd = open(path, O_RDONLY | O_CLOEXEC);
+		if (brightnessFd < 0) return NULL;
+	}
+
+	sysfs_device_t *device = (sysfs_device_t *)calloc(1, sizeof(sysfs_device_t));
+	if (device == NULL) { close(brightnessFd); return NULL; }
+	device->base.backend = backend;
+	snprintf(device->name, sizeof(device->name), "%s", name);
+	device->brightnessFd = brightnessFd;
+	device->maximum = maximum;
+
+	snprintf(device->base.key, sizeof(device->base.key), "backlight/%s", name);
+	device->base.output = BACKEND_OUTPUT_INTERNAL;
+	// The device name widened (sysfs names are ASCII in practice, other bytes are replaced)
+	size_t length = 0;
+	for (const char *p = name; *p != '\0' && length + 1 < BACKEND_DESCRIPTION_LENGTH; p++)
+	{
+		device->base.description[length++] = (*p >= 0x20 && *p < 0x7f) ? (wchar_t)*p : L'?';
+	}
+	device->base.description[length] = L'\0';
+	return device;
+}
+
+static backend_device_t *SysfsEnumerate(backend_t *backend, backend_device_t **existing, int existingCount)
+{
+	sysfs_state_t *state = (sysfs_state_t *)backend->context;
+	backend_device_t *list = NULL, *last = NULL;
+
+	DIR *dir = opendir(state->root);
+	if (dir == NULL) return NULL;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] == '.') continue;
+
+		// Keep an existing device...
+		sysfs_device_t *device = NULL;
+		for (int i = 0; i < existingCount; i++)
+		{
+			if (existing[i] != NULL && strcmp(((sysfs_device_t *)existing[i])->name, entry->d_name) == 0)
+			{
+				device = (sysfs_device_t *)existing[i];
+				existing[i] = NULL;
+				break;
+			}
+		}
+
+		// ...or open a new one
+		if (device == NULL) device = SysfsOpen(backend, state->root, entry->d_name);
+		if (device == NULL) continue;
+
+		device->base.next = NULL;
+		if (last == NULL) list = &device->base; else last->next = &device->base;
+		last = &device->base;
+	}
+	closedir(dir);
+
+	return list;
+}
+
+static bool SysfsGet(backend_device_t *device, int *value)
+{
+	return SysfsReadFd(((sysfs_device_t *)device)->brightnessFd, value);
+}
+
+static bool SysfsCapabilities(backend_device_t *device, backend_caps_t *caps)
+{
+	sysfs_device_t *sysfsDevice = (sysfs_device_t *)device;
+	memset(caps, 0, sizeof(*caps));
+	caps->hasBrightness = true;
+	caps->minimum = 0;
+	caps->maximum = sysfsDevice->maximum;
+	return SysfsGet(device, &caps->current);
+}
+
+static bool SysfsSet(backend_device_t *device, int value)
+{
+	sysfs_device_t *sysfsDevice = (sysfs_device_t *)device;
+	char buffer[16];
+	int length = snprintf(buffer, sizeof(buffer), "%d\n", value);	// Terminated, as a shorter value does not truncate a regular file (e.g. a test tree)
+	return pwrite(sysfsDevice->brightnessFd, buffer, (size_t)length, 0) == length;
+}
+
+static void SysfsClose(backend_device_t *device)
+{
+	sysfs_device_t *sysfsDevice = (sysfs_device_t *)device;
+	close(sysfsDevice->brightnessFd);
+	free(sysfsDevice);
+}
+
+static void SysfsDump(backend_device_t *device, FILE *file)
+{
+	sysfs_device_t *sysfsDevice = (sysfs_device_t *)device;
+	sysfs_state_t *state = (sysfs_state_t *)device->backend->context;
+	fprintf(file, "SYSFS: path=%s/%s\n", state->root, sysfsDevice->name);	// /sys/class/backlight/intel_backlight
+	fprintf(file, "SYSFS: max_brightness=%d\n", sysfsDevice->maximum);
+}
+
+backend_t *SysfsBackendCreate(const char *root)
+{
+	sysfs_state_t *state = (sysfs_state_t *)calloc(1, sizeof(sysfs_state_t));
+	if (state == NULL) return NULL;
+	snprintf(state->root, sizeof(state->root), "%s", (root != NULL) ? root : SYSFS_BACKLIGHT_ROOT);
+
+	state->backend.name = "sysfs";
+	state->backend.flags = 0;
+	state->backend.readDeadline = 0;
+	state->backend.commandInterval = 0;
+	state->backend.context = state;
+	state->backend.enumerate = SysfsEnumerate;
+	state->backend.capabilities = SysfsCapabilities;
+	state->backend.get = SysfsGet;
+	state->backend.set = SysfsSet;
+	state->backend.close = SysfsClose;
+	state->backend.dump = SysfsDump;
+	return &state->backend;
+}
+
+void SysfsBackendDestroy(backend_t *backend)
+{
+	free(backend->context);
+}
+
+#endif
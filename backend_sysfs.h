@@ -0,0 +1,15 @@
+// Monitor Brightness - Linux sysfs Backlight Backend
+// Dan Jackson, 2020.
+
+#ifndef _BACKEND_SYSFS_H
+#define _BACKEND_SYSFS_H
+
+#include "backend.h"
+
+#define SYSFS_BACKLIGHT_ROOT "/sys/class/backlight"
+
+// Backlight devices (generally internal panels) under the given root (NULL for SYSFS_BACKLIGHT_ROOT, or e.g. a temporary directory tree for testing)
+backend_t *SysfsBackendCreate(const char *root);
+void SysfsBackendDestroy(backend_t *backend);
+
+#endif
@@ -0,0 +1,798 @@
+// Monitor Brightness - WMI Backend
+// Dan Jackson, 2020.
+
+// Generally internal monitors (WMI): https://docs.microsoft.com/en-us/windows/win32/wmicoreprov/wmisetbrightness-method-in-class-wmimonitorbrightnessmethods?redirectedfrom=MSDN  /  https://stackoverflow.com/questions/47333195/change-brightness-using-wmi  /  https://devblogs.microsoft.com/scripting/use-powershell-to-report-and-set-monitor-brightness/
+
+#ifdef _WIN32
+
+#define _WIN32_WINNT 0x0600	// 0x0400
+#define _WIN32_DCOM
+
+#include <windows.h>
+#include <tchar.h>
+
+#include <stdio.h>
+
+#ifdef GetObject	// Otherwise defined as GetObjectW
+#undef GetObject
+#endif
+
+#include <wbemidl.h>
+#include <wbemcli.h>
+
+// MSC-Specific Pragmas
+#ifdef _MSC_VER
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "oleaut32.lib")
+#pragma comment(lib, "wbemuuid.lib")
+#endif
+
+#include "backend.h"
+#include "platform.h"
+#include "trace.h"
+#include "lookup.h"
+
+#define WMI_QUERY_LENGTH 512
+#define WMI_WATCH_RETRY 5000	// Milliseconds before subscribing again after a failure (e.g. the service restarting)
+
+typedef struct _wmi_device_t
+{
+	backend_device_t base;
+	wchar_t instanceName[BACKEND_KEY_LENGTH];						// DISPLAY\ACME1234\9&abcdef9&0&UID12345_0
+	BSTR methodPath;												// Resolved __RELPATH of the WmiMonitorBrightnessMethods instance (lazily, on first set)
+	backend_caps_t caps;											// As found when enumerated
+	int cached;														// Brightness last read, set or reported by an event...
+	int cachedGeneration;											// ...valid while the subscription it was seen under continues (see wmi_watch_t)
+	struct _wmi_device_t *nextOpen;									// Open devices, for events
+} wmi_device_t;
+
+// Subscription to WmiMonitorBrightnessEvent on a thread of its own, with its own connection (waiting for events would otherwise hold the session).
+// While subscribed, each device's cached value is kept current, so reads do not need to query.
+typedef struct
+{
+	SRWLOCK lock;									// Protects the open devices, their cached values, the generation and the callback
+	wmi_device_t *devices;							// Every open device (linked by 'nextOpen')
+	backend_changed_t callback;
+	void *context;
+	int generation;									// Of the current subscription, 0 while not subscribed
+	int subscriptions;								// Successful subscriptions (so each has a new generation)
+	platform_thread_t thread;
+	bool started;
+	HANDLE stopEvent;								// Set to stop the thread (cancelling the subscription)
+} wmi_watch_t;
+
+static wmi_watch_t wmiWatch = { SRWLOCK_INIT };
+
+// Long-lived WMI connection: connecting, setting the proxy security and fetching the method class are relatively slow, so are only done once and re-established after a failed call.
+typedef struct
+{
+	SRWLOCK lock;									// Serializes use of the session (and the shared in-parameters instance)
+	IWbemLocator *locator;
+	IWbemServices *services;						// Connection to ROOT\WMI
+	IWbemClassObject *methodsClass;					// WmiMonitorBrightnessMethods class
+	IWbemClassObject *inParams;						// Spawned instance of the WmiSetBrightness() in-parameters (Timeout already set)
+	BSTR bstrMethodName;							// "WmiSetBrightness"
+} wmi_session_t;
+
+static wmi_session_t wmiSession = { SRWLOCK_INIT };
+
+// Release any session objects (must hold the lock)
+static void WmiSessionReset(wmi_session_t *session)
+{
+	if (session->inParams) { session->inParams->lpVtbl->Release(session->inParams); session->inParams = NULL; }
+	if (session->methodsClass) { session->methodsClass->lpVtbl->Release(session->methodsClass); session->methodsClass = NULL; }
+	if (session->services) { session->services->lpVtbl->Release(session->services); session->services = NULL; }
+	if (session->locator) { session->locator->lpVtbl->Release(session->locator); session->locator = NULL; }
+	if (session->bstrMethodName) { SysFreeString(session->bstrMethodName); session->bstrMethodName = NULL; }
+}
+
+// Connect to WMI if not already connected (must hold the lock)
+static bool WmiSessionConnect(wmi_session_t *session)
+{
+	HRESULT hr = 0;
+
+	if (session->services) return true;
+	WmiSessionReset(session);
+
+	// Create locator
+	uint64_t trace = TraceBegin();
+	hr = CoCreateInstance(&CLSID_WbemLocator, 0, CLSCTX_INPROC_SERVER, &IID_IWbemLocator, (LPVOID *)&session->locator);
+	TraceEnd(trace, "wmi", "CoCreateInstance", NULL, (int)hr);
+	if (FAILED(hr) || !session->locator) { fprintf(stderr, "ERROR: Failed CoCreateInstance(CLSID_WbemLocator).\n"); session->locator = NULL; return false; }
+
+	// Connect to WMI
+	BSTR bstrResource = SysAllocString(L"ROOT\\WMI"); // "\\\\.\\ROOT\\wmi"
+	trace = TraceBegin();
+	hr = session->locator->lpVtbl->ConnectServer(session->locator, bstrResource, NULL, NULL, NULL, 0, NULL, NULL, &session->services);
+	TraceEnd(trace, "wmi", "ConnectServer", NULL, (int)hr);
+	SysFreeString(bstrResource);
+	if (FAILED(hr) || !session->services) { fprintf(stderr, "ERROR: Failed ConnectServer().\n"); session->services = NULL; WmiSessionReset(session); return false; }
+
+	// Proxy security levels
+	hr = CoSetProxyBlanket((IUnknown *)session->services, RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE, NULL, RPC_C_AUTHN_LEVEL_CALL, RPC_C_IMP_LEVEL_IMPERSONATE, NULL, EOAC_NONE);
+	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed CoSetProxyBlanket().\n"); WmiSessionReset(session); return false; }
+
+	return true;
+}
+
+// Run a WQL query, reconnecting and retrying once if the existing connection has failed (must hold the lock)
+static IEnumWbemClassObject *WmiSessionQuery(wmi_session_t *session, const wchar_t *query)
+{
+	IEnumWbemClassObject *results = NULL;
+	for (int attempt = 0; attempt < 2 && results == NULL; attempt++)
+	{
+		if (!WmiSessionConnect(session)) return NULL;
+		BSTR bstrQuery = SysAllocString(query);
+		BSTR bstrQueryLanguage = SysAllocString(L"WQL");
+		uint64_t trace = TraceBegin();
+		HRESULT hr = session->services->lpVtbl->ExecQuery(session->services, bstrQueryLanguage, bstrQuery, WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY, NULL, &results);
+		TraceEnd(trace, "wmi", "ExecQuery", NULL, (int)hr);
+		SysFreeString(bstrQueryLanguage);
+		SysFreeString(bstrQuery);
+		if (FAILED(hr))
+		{
+			fprintf(stderr, "ERROR: Failed ExecQuery() = 0x%08x\n", (unsigned int)hr);
+			results = NULL;
+			WmiSessionReset(session);
+		}
+	}
+	return results;
+}
+
+// Fetch the method class and prepare the in-parameters instance (must hold the lock)
+static bool WmiSessionPrepareMethod(wmi_session_t *session)
+{
+	HRESULT hr = 0;
+
+	if (session->inParams) return true;
+	if (!WmiSessionConnect(session)) return false;
+
+	session->bstrMethodName = SysAllocString(L"WmiSetBrightness");
+
+	BSTR bstrClassName = SysAllocString(L"WmiMonitorBrightnessMethods");
+	hr = session->services->lpVtbl->GetObject(session->services, bstrClassName, 0, NULL, &session->methodsClass, NULL);
+	SysFreeString(bstrClassName);
+	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed GetObject().\n"); session->methodsClass = NULL; WmiSessionReset(session); return false; }
+
+	IWbemClassObject* pInParamsDefinition = NULL;
+	hr = session->methodsClass->lpVtbl->GetMethod(session->methodsClass, session->bstrMethodName, 0, &pInParamsDefinition, NULL);
+	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed GetMethod().\n"); WmiSessionReset(session); return false; }
+
+	hr = pInParamsDefinition->lpVtbl->SpawnInstance(pInParamsDefinition, 0, &session->inParams);
+	pInParamsDefinition->lpVtbl->Release(pInParamsDefinition);
+	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed SpawnInstance().\n"); session->inParams = NULL; WmiSessionReset(session); return false; }
+
+	VARIANT vtParam1;
+	VariantInit(&vtParam1);
+	vtParam1.vt = VT_I4;	// uint32
+	vtParam1.intVal = 1;	// seconds
+	hr = session->inParams->lpVtbl->Put(session->inParams, L"Timeout", 0, &vtParam1, CIM_UINT32);
+	VariantClear(&vtParam1);
+	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed Put(vtParam1).\n"); WmiSessionReset(session); return false; }
+
+	return true;
+}
+
+// WQL query for a single instance of a class (backslashes in the instance name are escaped)
+static void WmiInstanceQuery(wchar_t *query, size_t count, const wchar_t *className, const wchar_t *instanceName)
+{
+	size_t length = (size_t)swprintf(query, count, L"SELECT * FROM %ls WHERE InstanceName='", className);
+	for (const wchar_t *src = instanceName; *src != L'\0' && length + 4 < count; src++)
+	{
+		if (*src == L'\\' || *src == L'\'') query[length++] = L'\\';
+		query[length++] = *src;
+	}
+	query[length++] = L'\'';
+	query[length] = L'\0';
+}
+
+// Brightness capabilities from a WmiMonitorBrightness instance
+static void WmiResultCaps(IWbemClassObject *result, backend_caps_t *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+
+	VARIANT vtCurrentBrightness;
+	result->lpVtbl->Get(result, L"CurrentBrightness", 0, &vtCurrentBrightness, 0, 0);
+
+	VARIANT vtLevels;
+	result->lpVtbl->Get(result, L"Levels", 0, &vtLevels, 0, 0);	// count of levels
+
+	VARIANT vtLevel;
+	result->lpVtbl->Get(result, L"Level", 0, &vtLevel, 0, 0);		// array of possible levels
+
+	caps->hasBrightness = true;
+	caps->current = vtCurrentBrightness.intVal;
+	// Without the list of levels, assume minimum of 0 and singly incrementing levels up to maximum
+	caps->minimum = 0;
+	caps->maximum = caps->minimum + vtLevels.intVal - 1;
+
+	if (vtLevel.vt != VT_NULL && vtLevel.vt != VT_EMPTY && (vtLevel.vt & VT_ARRAY))
+	{
+		SAFEARRAY *pSafeArray = vtLevel.parray;
+		long lLower, lUpper;
+		SafeArrayGetLBound(pSafeArray, 1, &lLower);
+		SafeArrayGetUBound(pSafeArray, 1, &lUpper);
+
+		UINT32 first = 0, last = 0;
+		SafeArrayGetElement(pSafeArray, &lLower, &first);
+		SafeArrayGetElement(pSafeArray, &lUpper, &last);
+		if (last > first)
+		{
+			// Take actual minimum and maximum...
+			caps->minimum = first;
+			caps->maximum = last;
+
+			// ...and the accepted values
+			if (lUpper - lLower + 1 <= BACKEND_MAX_LEVELS)
+			{
+				for (long i = lLower; i <= lUpper; i++)
+				{
+					UINT32 level = 0;
+					SafeArrayGetElement(pSafeArray, &i, &level);
+					caps->levels[caps->levelCount++] = (int)level;
+				}
+			}
+		}
+	}
+
+	VariantClear(&vtCurrentBrightness);
+	VariantClear(&vtLevels);
+	VariantClear(&vtLevel);
+}
+
+// String from a WmiMonitorID uint16[] property (zero-padded characters)
+static void WmiVariantString(VARIANT *variant, wchar_t *buffer, size_t count)
+{
+	size_t length = 0;
+	if ((variant->vt & VT_ARRAY) && variant->parray != NULL)
+	{
+		long lLower = 0, lUpper = -1;
+		SafeArrayGetLBound(variant->parray, 1, &lLower);
+		SafeArrayGetUBound(variant->parray, 1, &lUpper);
+		for (long i = lLower; i <= lUpper && length + 1 < count; i++)
+		{
+			UINT32 c = 0;
+			SafeArrayGetElement(variant->parray, &i, &c);
+			if (c == 0) break;
+			buffer[length++] = (wchar_t)c;
+		}
+	}
+	buffer[length] = L'\0';
+}
+
+// Identity (as from the EDID, e.g. ACM-1234-0001E240) and friendly name from the WmiMonitorID instance (must hold the lock)
+static void WmiMonitorIdentity(wmi_session_t *session, wmi_device_t *device)
+{
+	wchar_t query[WMI_QUERY_LENGTH];
+	WmiInstanceQuery(query, WMI_QUERY_LENGTH, L"WmiMonitorID", device->instanceName);
+	uint64_t trace = TraceBegin();
+	IEnumWbemClassObject *results = WmiSessionQuery(session, query);
+	if (results == NULL)
+	{
+		TraceEnd(trace, "wmi", "WmiMonitorID", device->base.key, -1);
+		return;
+	}
+
+	IWbemClassObject *result = NULL;
+	ULONG returnedCount = 0;
+	if (results->lpVtbl->Next(results, WBEM_INFINITE, 1, &result, &returnedCount) == S_OK)
+	{
+		const wchar_t *properties[] = { L"ManufacturerName", L"ProductCodeID", L"SerialNumberID", L"UserFriendlyName" };
+		wchar_t values[4][BACKEND_DESCRIPTION_LENGTH];
+		for (int i = 0; i < 4; i++)
+		{
+			VARIANT vtValue;
+			values[i][0] = L'\0';
+			if (SUCCEEDED(result->lpVtbl->Get(result, properties[i], 0, &vtValue, 0, 0)))
+			{
+				WmiVariantString(&vtValue, values[i], BACKEND_DESCRIPTION_LENGTH);
+				VariantClear(&vtValue);
+			}
+		}
+
+		// The serial is the serial number descriptor if present, otherwise the numeric serial in decimal (converted to match EdidIdentity())
+		wchar_t *serial = values[2];
+		bool numeric = serial[0] != L'\0';
+		for (wchar_t *p = serial; *p != L'\0'; p++)
+		{
+			if (*p < L'0' || *p > L'9') numeric = false;
+			if (*p == L' ') *p = L'_';
+		}
+		if (values[0][0] != L'\0' && values[1][0] != L'\0')
+		{
+			if (numeric) snprintf(device->base.identity, sizeof(device->base.identity), "%ls-%ls-%08lX", values[0], values[1], wcstoul(serial, NULL, 10));
+			else snprintf(device->base.identity, sizeof(device->base.identity), "%ls-%ls-%ls", values[0], values[1], serial);
+		}
+		if (values[3][0] != L'\0') swprintf(device->base.description, BACKEND_DESCRIPTION_LENGTH, L"%ls", values[3]);
+
+		result->lpVtbl->Release(result);
+	}
+	results->lpVtbl->Release(results);
+	TraceEnd(trace, "wmi", "WmiMonitorID", device->base.key, device->base.identity[0] != '\0' ? 1 : 0);
+}
+
+static backend_device_t *WmiEnumerate(backend_t *backend, backend_device_t **existing, int existingCount)
+{
+	wmi_session_t *session = &wmiSession;
+	backend_device_t *list = NULL, *last = NULL;
+
+	// Existing devices by instance name
+	lookup_t existingNames;
+	LookupInit(&existingNames, existingCount);
+	for (int i = 0; i < existingCount; i++)
+	{
+		const wchar_t *name = ((wmi_device_t *)existing[i])->instanceName;
+		LookupAdd(&existingNames, LookupHash(name, wcslen(name) * sizeof(wchar_t)), &existing[i]);
+	}
+
+	uint64_t trace = TraceBegin();
+	int count = 0;
+	AcquireSRWLockExclusive(&session->lock);
+	IEnumWbemClassObject *results = WmiSessionQuery(session, L"SELECT * FROM WmiMonitorBrightness");
+	backend->incomplete = (results == NULL);	// e.g. the WMI service is still starting: not the same as no devices
+	if (results != NULL)
+	{
+		IWbemClassObject *result = NULL;
+		ULONG returnedCount = 0;
+		while (results->lpVtbl->Next(results, WBEM_INFINITE, 1, &result, &returnedCount) == S_OK)
+		{
+			VARIANT vtInstanceName;
+			result->lpVtbl->Get(result, L"InstanceName", 0, &vtInstanceName, 0, 0);
+			if (vtInstanceName.vt == VT_BSTR)
+			{
+				// Keep an existing device...
+				wmi_device_t *device = NULL;
+				backend_device_t **entry;
+				uint32_t hash = LookupHash(vtInstanceName.bstrVal, wcslen(vtInstanceName.bstrVal) * sizeof(wchar_t));
+				for (int cursor = 0; (entry = (backend_device_t **)LookupNext(&existingNames, hash, &cursor)) != NULL; )
+				{
+					if (*entry != NULL && wcscmp(((wmi_device_t *)*entry)->instanceName, vtInstanceName.bstrVal) == 0)
+					{
+						device = (wmi_device_t *)*entry;
+						*entry = NULL;
+						break;
+					}
+				}
+
+				// ...or create a new one
+				if (device == NULL)
+				{
+					device = (wmi_device_t *)calloc(1, sizeof(wmi_device_t));
+					device->base.backend = backend;
+					wcsncpy(device->instanceName, vtInstanceName.bstrVal, BACKEND_KEY_LENGTH - 1);
+					WmiResultCaps(result, &device->caps);
+
+					// The key is the instance name without the trailing "_0" etc, e.g. DISPLAY\ACME1234\9&abcdef9&0&UID12345
+					if (WideCharToMultiByte(CP_UTF8, 0, device->instanceName, -1, device->base.key, sizeof(device->base.key), NULL, NULL) == 0) device->base.key[0] = '\0';
+					char *suffix = strrchr(device->base.key, '_');
+					if (suffix != NULL) *suffix = '\0';
+					swprintf(device->base.description, BACKEND_DESCRIPTION_LENGTH, L"%ls", device->instanceName);
+					WmiMonitorIdentity(session, device);
+
+					AcquireSRWLockExclusive(&wmiWatch.lock);
+					device->nextOpen = wmiWatch.devices;
+					wmiWatch.devices = device;
+					ReleaseSRWLockExclusive(&wmiWatch.lock);
+				}
+
+				device->base.next = NULL;
+				if (last == NULL) list = &device->base; else last->next = &device->base;
+				last = &device->base;
+				count++;
+			}
+			VariantClear(&vtInstanceName);
+			result->lpVtbl->Release(result);
+		}
+		results->lpVtbl->Release(results);
+	}
+	ReleaseSRWLockExclusive(&session->lock);
+	TraceEnd(trace, "wmi", "WmiMonitorBrightness", NULL, backend->incomplete ? -1 : count);
+	LookupFree(&existingNames);
+
+	return list;
+}
+
+static bool WmiCapabilities(backend_device_t *device, backend_caps_t *caps)
+{
+	// Already read when enumerated
+	*caps = ((wmi_device_t *)device)->caps;
+	return true;
+}
+
+static bool WmiGet(backend_device_t *device, int *value)
+{
+	wmi_device_t *wmiDevice = (wmi_device_t *)device;
+	wmi_session_t *session = &wmiSession;
+	bool success = false;
+
+	// While subscribed to events, a value already known is current
+	AcquireSRWLockShared(&wmiWatch.lock);
+	bool cached = wmiWatch.generation != 0 && wmiDevice->cachedGeneration == wmiWatch.generation;
+	if (cached) *value = wmiDevice->cached;
+	ReleaseSRWLockShared(&wmiWatch.lock);
+	if (cached)
+	{
+		TraceInstant("wmi", "CachedBrightness", device->key);
+		return true;
+	}
+
+	wchar_t query[WMI_QUERY_LENGTH];
+	WmiInstanceQuery(query, WMI_QUERY_LENGTH, L"WmiMonitorBrightness", wmiDevice->instanceName);
+
+	uint64_t trace = TraceBegin();
+	AcquireSRWLockExclusive(&session->lock);
+	IEnumWbemClassObject *results = WmiSessionQuery(session, query);
+	if (results != NULL)
+	{
+		IWbemClassObject *result = NULL;
+		ULONG returnedCount = 0;
+		if (results->lpVtbl->Next(results, WBEM_INFINITE, 1, &result, &returnedCount) == S_OK)
+		{
+			VARIANT vtCurrentBrightness;
+			if (SUCCEEDED(result->lpVtbl->Get(result, L"CurrentBrightness", 0, &vtCurrentBrightness, 0, 0)))
+			{
+				*value = vtCurrentBrightness.intVal;
+				success = true;
+				VariantClear(&vtCurrentBrightness);
+			}
+			result->lpVtbl->Release(result);
+		}
+		results->lpVtbl->Release(results);
+	}
+	ReleaseSRWLockExclusive(&session->lock);
+	TraceEnd(trace, "wmi", "CurrentBrightness", device->key, success ? 1 : 0);
+
+	// Unless an event has reported a newer value in the meantime
+	AcquireSRWLockExclusive(&wmiWatch.lock);
+	if (success && wmiWatch.generation != 0 && wmiDevice->cachedGeneration != wmiWatch.generation)
+	{
+		wmiDevice->cached = *value;
+		wmiDevice->cachedGeneration = wmiWatch.generation;
+	}
+	ReleaseSRWLockExclusive(&wmiWatch.lock);
+
+	return success;
+}
+
+// Resolve the path of the device's WmiMonitorBrightnessMethods instance (must hold the lock)
+static bool WmiResolveMethodPath(wmi_session_t *session, wmi_device_t *device)
+{
+	// NOTE WMI PATH=WmiMonitorBrightnessMethods.InstanceName="DISPLAY\ACME1234\9&abcdef9&0&UID12345_0"
+	wchar_t query[WMI_QUERY_LENGTH];
+	WmiInstanceQuery(query, WMI_QUERY_LENGTH, L"WmiMonitorBrightnessMethods", device->instanceName);
+	IEnumWbemClassObject *results = WmiSessionQuery(session, query);
+	if (results == NULL) return false;
+
+	IWbemClassObject *result = NULL;
+	ULONG returnedCount = 0;
+	if (results->lpVtbl->Next(results, WBEM_INFINITE, 1, &result, &returnedCount) == S_OK)
+	{
+		// Keep the "this" pointer to the object instance to call methods on
+		VARIANT vtThis;
+		if (SUCCEEDED(result->lpVtbl->Get(result, L"__RELPATH", 0, &vtThis, NULL, NULL)) && vtThis.vt == VT_BSTR)	// "__RELPATH" / "__PATH"
+		{
+			// PATH=    WmiMonitorBrightnessMethods.InstanceName="DISPLAY\\XXX1234\\0&abcdef0&0&UID0123456_0"
+			device->methodPath = SysAllocString(vtThis.bstrVal);
+		}
+		VariantClear(&vtThis);
+		result->lpVtbl->Release(result);
+	}
+	results->lpVtbl->Release(results);
+
+	return device->methodPath != NULL;
+}
+
+static bool WmiSet(backend_device_t *device, int value)
+{
+	wmi_device_t *wmiDevice = (wmi_device_t *)device;
+	wmi_session_t *session = &wmiSession;
+	HRESULT hr = 0;
+	bool success = false;
+
+	uint64_t trace = TraceBegin();
+	AcquireSRWLockExclusive(&session->lock);
+	for (int attempt = 0; attempt < 2 && !success; attempt++)
+	{
+		// Resolve the method instance path once per device
+		if (wmiDevice->methodPath == NULL && !WmiResolveMethodPath(session, wmiDevice))
+		{
+			fprintf(stderr, "ERROR: WMI method instance not found.\n");
+			break;
+		}
+
+		if (!WmiSessionPrepareMethod(session)) continue;
+
+		VARIANT vtParam2;
+		VariantInit(&vtParam2);
+		vtParam2.vt = VT_UI1;	// uint8
+		vtParam2.intVal = value;
+		hr = session->inParams->lpVtbl->Put(session->inParams, L"Brightness", 0, &vtParam2, CIM_UINT8);
+		VariantClear(&vtParam2);
+		if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed Put(vtParam2).\n"); WmiSessionReset(session); continue; }
+
+		// Execute Method
+		IWbemClassObject* pOutParams = NULL;
+		hr = session->services->lpVtbl->ExecMethod(session->services, wmiDevice->methodPath, session->bstrMethodName, 0, NULL, session->inParams, &pOutParams, NULL);
+		if (pOutParams) pOutParams->lpVtbl->Release(pOutParams);
+		if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed ExecMethod() = 0x%08x / 0x%08x\n", (unsigned int)hr, (unsigned int)GetLastError()); WmiSessionReset(session); continue; } // WBEM_E_INVALID_METHOD_PARAMETERS = 0x8004102F
+
+		success = true;
+	}
+	ReleaseSRWLockExclusive(&session->lock);
+	TraceEnd(trace, "wmi", "WmiSetBrightness", device->key, success ? 1 : 0);
+
+	// The event for the change follows, but a read before then should not return the previous value
+	AcquireSRWLockExclusive(&wmiWatch.lock);
+	if (success && wmiWatch.generation != 0)
+	{
+		wmiDevice->cached = value;
+		wmiDevice->cachedGeneration = wmiWatch.generation;
+	}
+	ReleaseSRWLockExclusive(&wmiWatch.lock);
+
+	return success;
+}
+
+static void WmiClose(backend_device_t *device)
+{
+	wmi_device_t *wmiDevice = (wmi_device_t *)device;
+
+	// Waits for any event being reported for the device
+	AcquireSRWLockExclusive(&wmiWatch.lock);
+	for (wmi_device_t **link = &wmiWatch.devices; *link != NULL; link = &(*link)->nextOpen)
+	{
+		if (*link == wmiDevice)
+		{
+			*link = wmiDevice->nextOpen;
+			break;
+		}
+	}
+	ReleaseSRWLockExclusive(&wmiWatch.lock);
+
+	if (wmiDevice->methodPath != NULL) SysFreeString(wmiDevice->methodPath);
+	free(wmiDevice);
+}
+
+static void WmiDump(backend_device_t *device, FILE *file)
+{
+	wmi_device_t *wmiDevice = (wmi_device_t *)device;
+	fprintf(file, "WMI: wmiInstance=%ls\n", wmiDevice->instanceName);				// DISPLAY\ACME1234\9&abcdef9&0&UID12345_0
+	fprintf(file, "WMI: wmiMethodPath=%ls\n", wmiDevice->methodPath != NULL ? wmiDevice->methodPath : L"");
+	fprintf(file, "WMI: identity=%s\n", device->identity);											// ACM-1234-0001E240
+}
+
+// A WmiMonitorBrightnessEvent: update the device's cached value and report the change
+static void WmiWatchEvent(wmi_watch_t *watch, IWbemClassObject *event)
+{
+	VARIANT vtInstanceName, vtBrightness;
+	VariantInit(&vtInstanceName);
+	VariantInit(&vtBrightness);
+	if (SUCCEEDED(event->lpVtbl->Get(event, L"InstanceName", 0, &vtInstanceName, 0, 0)) && vtInstanceName.vt == VT_BSTR && SUCCEEDED(event->lpVtbl->Get(event, L"Brightness", 0, &vtBrightness, 0, 0)))
+	{
+		int value = -1;
+		if (vtBrightness.vt == VT_UI1) value = vtBrightness.bVal;		// uint8
+		else if (vtBrightness.vt == VT_I4) value = vtBrightness.lVal;
+		AcquireSRWLockExclusive(&watch->lock);
+		for (wmi_device_t *device = watch->devices; device != NULL && value >= 0; device = device->nextOpen)
+		{
+			if (wcscmp(device->instanceName, vtInstanceName.bstrVal) != 0) continue;
+			TraceInstant("wmi", "WmiMonitorBrightnessEvent", device->base.key);
+			device->cached = value;
+			device->cachedGeneration = watch->generation;
+			if (watch->callback != NULL) watch->callback(&device->base, value, watch->context);
+			break;
+		}
+		ReleaseSRWLockExclusive(&watch->lock);
+	}
+	VariantClear(&vtBrightness);
+	VariantClear(&vtInstanceName);
+}
+
+// Receives the events of an asynchronous subscription (on a WMI thread)
+typedef struct
+{
+	IWbemObjectSink base;
+	LONG references;
+	wmi_watch_t *watch;
+	HANDLE ended;									// Set once the subscription completes (it has failed or been cancelled)
+	HRESULT status;
+} wmi_sink_t;
+
+static HRESULT STDMETHODCALLTYPE WmiSinkQueryInterface(IWbemObjectSink *This, REFIID riid, void **ppvObject)
+{
+	if (!IsEqualIID(riid, &IID_IUnknown) && !IsEqualIID(riid, &IID_IWbemObjectSink))
+	{
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	*ppvObject = This;
+	This->lpVtbl->AddRef(This);
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE WmiSinkAddRef(IWbemObjectSink *This)
+{
+	wmi_sink_t *sink = (wmi_sink_t *)This;
+	return (ULONG)InterlockedIncrement(&sink->references);
+}
+
+static ULONG STDMETHODCALLTYPE WmiSinkRelease(IWbemObjectSink *This)
+{
+	wmi_sink_t *sink = (wmi_sink_t *)This;
+	LONG references = InterlockedDecrement(&sink->references);
+	if (references == 0)
+	{
+		CloseHandle(sink->ended);
+		free(sink);
+	}
+	return (ULONG)references;
+}
+
+static HRESULT STDMETHODCALLTYPE WmiSinkIndicate(IWbemObjectSink *This, long lObjectCount, IWbemClassObject **apObjArray)
+{
+	wmi_sink_t *sink = (wmi_sink_t *)This;
+	for (long i = 0; i < lObjectCount; i++) WmiWatchEvent(sink->watch, apObjArray[i]);
+	return WBEM_S_NO_ERROR;
+}
+
+static HRESULT STDMETHODCALLTYPE WmiSinkSetStatus(IWbemObjectSink *This, long lFlags, HRESULT hResult, BSTR strParam, IWbemClassObject *pObjParam)
+{
+	wmi_sink_t *sink = (wmi_sink_t *)This;
+	if (lFlags == WBEM_STATUS_COMPLETE)
+	{
+		sink->status = hResult;
+		SetEvent(sink->ended);
+	}
+	return WBEM_S_NO_ERROR;
+}
+
+static IWbemObjectSinkVtbl wmiSinkVtbl =
+{
+	WmiSinkQueryInterface,
+	WmiSinkAddRef,
+	WmiSinkRelease,
+	WmiSinkIndicate,
+	WmiSinkSetStatus,
+};
+
+static wmi_sink_t *WmiSinkCreate(wmi_watch_t *watch)
+{
+	wmi_sink_t *sink = (wmi_sink_t *)calloc(1, sizeof(wmi_sink_t));
+	if (sink == NULL) return NULL;
+	sink->base.lpVtbl = &wmiSinkVtbl;
+	sink->references = 1;
+	sink->watch = watch;
+	sink->status = WBEM_S_NO_ERROR;
+	sink->ended = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (sink->ended == NULL)
+	{
+		free(sink);
+		return NULL;
+	}
+	return sink;
+}
+
+// Subscribe (asynchronously, and again after any failure) and wait, without polling, until stopped
+static void WmiWatchThread(void *context)
+{
+	wmi_watch_t *watch = (wmi_watch_t *)context;
+	TraceThreadName("wmi events");
+
+	for (;;)
+	{
+		IWbemLocator *locator = NULL;
+		IWbemServices *services = NULL;
+		wmi_sink_t *sink = NULL;
+
+		uint64_t trace = TraceBegin();
+		HRESULT hr = CoCreateInstance(&CLSID_WbemLocator, 0, CLSCTX_INPROC_SERVER, &IID_IWbemLocator, (LPVOID *)&locator);
+		if (SUCCEEDED(hr))
+		{
+			BSTR bstrResource = SysAllocString(L"ROOT\\WMI");
+			hr = locator->lpVtbl->ConnectServer(locator, bstrResource, NULL, NULL, NULL, 0, NULL, NULL, &services);
+			SysFreeString(bstrResource);
+		}
+		if (SUCCEEDED(hr)) hr = CoSetProxyBlanket((IUnknown *)services, RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE, NULL, RPC_C_AUTHN_LEVEL_CALL, RPC_C_IMP_LEVEL_IMPERSONATE, NULL, EOAC_NONE);
+		if (SUCCEEDED(hr))
+		{
+			sink = WmiSinkCreate(watch);
+			if (sink == NULL) hr = E_OUTOFMEMORY;
+		}
+		if (SUCCEEDED(hr))
+		{
+			BSTR bstrQuery = SysAllocString(L"SELECT * FROM WmiMonitorBrightnessEvent");
+			BSTR bstrQueryLanguage = SysAllocString(L"WQL");
+			hr = services->lpVtbl->ExecNotificationQueryAsync(services, bstrQueryLanguage, bstrQuery, 0, NULL, &sink->base);
+			SysFreeString(bstrQueryLanguage);
+			SysFreeString(bstrQuery);
+		}
+		TraceEnd(trace, "wmi", "ExecNotificationQueryAsync", NULL, (int)hr);
+		if (FAILED(hr))
+		{
+			fprintf(stderr, "ERROR: Failed to subscribe to WMI brightness events = 0x%08x\n", (unsigned int)hr);
+		}
+		else
+		{
+			AcquireSRWLockExclusive(&watch->lock);
+			watch->generation = ++watch->subscriptions;
+			ReleaseSRWLockExclusive(&watch->lock);
+
+			HANDLE handles[2] = { watch->stopEvent, sink->ended };
+			DWORD wait = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+			if (wait == WAIT_OBJECT_0) services->lpVtbl->CancelAsyncCall(services, &sink->base);
+			else fprintf(stderr, "WARNING: WMI brightness events ended = 0x%08x\n", (unsigned int)sink->status);
+
+			// Cached values may be missing changes from here on
+			AcquireSRWLockExclusive(&watch->lock);
+			watch->generation = 0;
+			ReleaseSRWLockExclusive(&watch->lock);
+		}
+		if (sink != NULL) sink->base.lpVtbl->Release(&sink->base);
+		if (services != NULL) services->lpVtbl->Release(services);
+		if (locator != NULL) locator->lpVtbl->Release(locator);
+
+		if (WaitForSingleObject(watch->stopEvent, WMI_WATCH_RETRY) != WAIT_TIMEOUT) break;
+	}
+}
+
+static bool WmiWatch(backend_t *backend, backend_changed_t callback, void *context)
+{
+	wmi_watch_t *watch = &wmiWatch;
+	AcquireSRWLockExclusive(&watch->lock);
+	watch->callback = callback;
+	watch->context = context;
+	ReleaseSRWLockExclusive(&watch->lock);
+
+	if (callback != NULL && !watch->started)
+	{
+		watch->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		watch->started = watch->stopEvent != NULL && PlatformThreadCreate(&watch->thread, WmiWatchThread, watch);
+		if (!watch->started)
+		{
+			fprintf(stderr, "ERROR: Cannot start the WMI event thread.\n");
+			if (watch->stopEvent != NULL) CloseHandle(watch->stopEvent);
+			watch->stopEvent = NULL;
+		}
+		return watch->started;
+	}
+	if (callback == NULL && watch->started)
+	{
+		SetEvent(watch->stopEvent);
+		PlatformThreadJoin(&watch->thread);
+		CloseHandle(watch->stopEvent);
+		watch->stopEvent = NULL;
+		watch->started = false;
+	}
+	return true;
+}
+
+static void WmiShutdown(backend_t *backend)
+{
+	WmiWatch(backend, NULL, NULL);
+	AcquireSRWLockExclusive(&wmiSession.lock);
+	WmiSessionReset(&wmiSession);
+	ReleaseSRWLockExclusive(&wmiSession.lock);
+}
+
+backend_t wmiBackend =
+{
+	"wmi",
+	BACKEND_FLAG_ATTACH,
+	500,
+	0,
+	NULL,
+	WmiEnumerate,
+	WmiCapabilities,
+	WmiGet,
+	WmiSet,
+	WmiClose,
+	WmiDump,
+	WmiShutdown,
+	NULL,
+	NULL,
+	NULL,
+	false,
+	WmiWatch,
+};
+
+#endif
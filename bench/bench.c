@@ -0,0 +1,586 @@
+// Brightness Pipeline Benchmarks
+// Dan Jackson, 2020.
+
+// Runs the monitor pipeline (monitor.c) against the simulated backend, reporting times on the simulated clock (i.e. as if real monitors had the configured latencies).
+// The DDC/CI protocol itself (ddc.c) is measured against an in-process fake monitor (ddc_fake.c) on the same scaled clock.
+//
+//   bench [--monitors 1,4,16,64] [--time-scale 0.1] [--caps-latency 50000] [--read-latency 40000] [--write-latency 50000] [--jitter 5000]
+//         [--min-gap 80000] [--failure 0] [--verify 100] [--per-bus 2] [--events 500] [--rate 1000] [--fade 1000] [--seed 1] [--csv results.csv] [--json results.json] [--trace trace.json]
+//
+// Latencies (and the minimum command gap of every other monitor) are in microseconds, the fade duration in milliseconds.
+// The failure rate is the percentage of calls to each monitor failing transiently, and verify the percentage of write bursts read back.  A time scale of 0.1 runs the simulated monitors 10x faster than real time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "monitor.h"
+#include "backend_sim.h"
+#include "mccs.h"
+#include "ddc.h"
+#include "ddc_fake.h"
+#include "trace.h"
+
+#define BENCH_MAX_COUNTS 16
+#define BENCH_MAX_RESULTS 256
+#define BENCH_TIMEOUT_US 30000000
+#define BENCH_DDC_OPERATIONS 20
+#define BENCH_SYNC_MINIMUM_MS 1000		// Background sync intervals and idle period (simulated)
+#define BENCH_SYNC_MAXIMUM_MS 16000
+#define BENCH_SYNC_IDLE_MS 40000
+
+typedef struct
+{
+	int counts[BENCH_MAX_COUNTS];
+	int countCount;
+	double timeScale;
+	int capsLatency;
+	int readLatency;
+	int writeLatency;
+	int jitter;
+	int minimumGap;
+	int failure;
+	int verify;
+	int perBus;
+	int events;
+	int rate;
+	int fade;
+	unsigned int seed;
+	const char *csvFile;
+	const char *jsonFile;
+	const char *traceFile;
+} bench_options_t;
+
+typedef struct
+{
+	const char *benchmark;
+	int monitors;
+	const char *metric;
+	double value;
+	const char *unit;
+} bench_result_t;
+
+static bench_result_t results[BENCH_MAX_RESULTS];
+static int resultCount = 0;
+
+// Popup refresh completion
+static platform_mutex_t refreshedLock = PLATFORM_MUTEX_INIT;
+static platform_cond_t refreshedChanged;
+static int refreshedCount = 0;
+
+static void BenchResult(const char *benchmark, int monitors, const char *metric, double value, const char *unit)
+{
+	printf("%-10s %3d %-24s %12.3f %s\n", benchmark, monitors, metric, value, unit);
+	if (resultCount >= BENCH_MAX_RESULTS) return;
+	bench_result_t *result = &results[resultCount++];
+	result->benchmark = benchmark;
+	result->monitors = monitors;
+	result->metric = metric;
+	result->value = value;
+	result->unit = unit;
+}
+
+static double BenchElapsedMs(backend_t *sim, int64_t start)
+{
+	return (double)(SimBackendTime(sim) - start) / 1000.0;
+}
+
+static void BrightnessRefreshed(monitor_t *monitor, void *context)
+{
+	PlatformMutexLock(&refreshedLock);
+	refreshedCount++;
+	PlatformCondBroadcast(&refreshedChanged);
+	PlatformMutexUnlock(&refreshedLock);
+}
+
+// Enumeration: probe every monitor from scratch, then again with the capabilities cache populated
+static monitor_t *BenchEnumerate(backend_t *sim, int count)
+{
+	MccsCacheClear();
+	VcpTimingClear();
+	int64_t start = SimBackendTime(sim);
+	monitor_t *monitorList = MonitorListEnumerate();
+	BenchResult("enumerate", count, "enumerate_ms", BenchElapsedMs(sim, start), "ms");
+	MonitorListDestroy(monitorList);
+
+	start = SimBackendTime(sim);
+	monitorList = MonitorListEnumerate();
+	BenchResult("enumerate", count, "enumerate_cached_ms", BenchElapsedMs(sim, start), "ms");
+	return monitorList;
+}
+
+// Wait for an asynchronous refresh of every monitor
+static void BenchRefresh(backend_t *sim, monitor_t *monitorList, int count, const char *firstMetric, const char *allMetric)
+{
+	int64_t start = SimBackendTime(sim);
+	PlatformMutexLock(&refreshedLock);
+	refreshedCount = 0;
+	PlatformMutexUnlock(&refreshedLock);
+	MonitorListRefreshBrightnessAsync(monitorList, BrightnessRefreshed, NULL);
+
+	bool first = true;
+	PlatformMutexLock(&refreshedLock);
+	while (refreshedCount < count)
+	{
+		int seen = refreshedCount;
+		if (!PlatformCondWait(&refreshedChanged, &refreshedLock, BENCH_TIMEOUT_US)) { fprintf(stderr, "ERROR: Timed out waiting for refresh.\n"); break; }
+		if (first && refreshedCount > seen)
+		{
+			first = false;
+			if (firstMetric != NULL) BenchResult("popup", count, firstMetric, BenchElapsedMs(sim, start), "ms");
+		}
+	}
+	PlatformMutexUnlock(&refreshedLock);
+	BenchResult("popup", count, allMetric, BenchElapsedMs(sim, start), "ms");
+}
+
+// Popup open: show the cached values, then wait for every refreshed value (also with additional VCP features read in the same pass)
+static void BenchPopup(backend_t *sim, monitor_t *monitorList, int count)
+{
+	int64_t start = SimBackendTime(sim);
+
+	int total = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		total += MonitorGetBrightness(monitor);
+	}
+	BenchResult("popup", count, "cached_ms", BenchElapsedMs(sim, start), "ms");
+	(void)total;
+
+	BenchRefresh(sim, monitorList, count, "first_refreshed_ms", "all_refreshed_ms");
+
+	start = SimBackendTime(sim);
+	MonitorListRefreshBrightness(monitorList);
+	BenchResult("popup", count, "blocking_refresh_ms", BenchElapsedMs(sim, start), "ms");
+
+	const uint8_t features[] = { VCP_CONTRAST, VCP_VOLUME, VCP_POWER_MODE };
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		MonitorSetRefreshFeatures(monitor, features, sizeof(features) / sizeof(features[0]));
+	}
+	BenchRefresh(sim, monitorList, count, NULL, "all_features_ms");
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		MonitorSetRefreshFeatures(monitor, NULL, 0);
+	}
+}
+
+// Slider drag: a stream of trackbar events posted to every monitor, then time until the final value is applied
+static void BenchDrag(backend_t *sim, const bench_options_t *options, monitor_t *monitorList, int count)
+{
+	sim_stats_t stats;
+	int writesBefore = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (SimBackendStats(sim, i, &stats)) writesBefore += stats.writes;
+	}
+
+	// Events are paced on the simulated clock
+	uint64_t interval = (uint64_t)(1000000.0 / options->rate * options->timeScale);
+	uint64_t realStart = PlatformTimeMicroseconds();
+	int requested = 0;
+	int target = 0;
+	for (int event = 0; event < options->events; event++)
+	{
+		uint64_t due = realStart + (uint64_t)event * interval;
+		uint64_t now = PlatformTimeMicroseconds();
+		if (due > now) PlatformSleepMicroseconds(due - now);
+
+		// Sweep from 0% to 100%
+		target = (options->events > 1) ? event * 100 / (options->events - 1) : 100;
+		for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+		{
+			MonitorPostBrightness(monitor, target);
+			requested++;
+		}
+	}
+	int64_t finalPosted = SimBackendTime(sim);
+	BenchResult("drag", count, "stream_ms", (double)(PlatformTimeMicroseconds() - realStart) / 1000.0 / options->timeScale, "ms");
+
+	// Wait until every monitor has the final value
+	int64_t lastApplied = finalPosted;
+	uint64_t waitStart = PlatformTimeMicroseconds();
+	for (int i = 0; i < count; )
+	{
+		if (!SimBackendStats(sim, i, &stats)) break;
+		if (stats.value == target && stats.lastWriteTime >= finalPosted)
+		{
+			if (stats.lastWriteTime > lastApplied) lastApplied = stats.lastWriteTime;
+			i++;
+			continue;
+		}
+		if (PlatformTimeMicroseconds() - waitStart > BENCH_TIMEOUT_US) { fprintf(stderr, "ERROR: Timed out waiting for monitor %d to apply the final value.\n", i); break; }
+		PlatformSleepMicroseconds(500);
+	}
+	BenchResult("drag", count, "final_apply_ms", (double)(lastApplied - finalPosted) / 1000.0, "ms");
+
+	int issued = -writesBefore;
+	for (int i = 0; i < count; i++)
+	{
+		if (SimBackendStats(sim, i, &stats)) issued += stats.writes;
+	}
+	BenchResult("drag", count, "writes_requested", requested, "writes");
+	BenchResult("drag", count, "writes_issued", issued, "writes");
+	BenchResult("drag", count, "write_ratio", requested > 0 ? (double)issued / requested : 0, "ratio");
+
+	// Command spacing learned by each monitor (as a mean on the simulated clock), and the commands dropped while learning it
+	int gapFailures = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (SimBackendStats(sim, i, &stats)) gapFailures += stats.gapFailures;
+	}
+	double intervalTotal = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		if (monitor->control >= 0) intervalTotal += VcpInterval(monitor->devices[monitor->control]);
+	}
+	BenchResult("drag", count, "interval_ms", count > 0 ? intervalTotal / count / 1000.0 / options->timeScale : 0, "ms");
+	BenchResult("drag", count, "gap_failures", gapFailures, "commands");
+
+	// Time until every monitor has confirmed the value it applied (read back, for the verified proportion of bursts), or those that did not
+	int unconfirmed = 0, index = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next, index++)
+	{
+		while (SimBackendStats(sim, index, &stats) && stats.value != monitor->confirmed && PlatformTimeMicroseconds() - waitStart < BENCH_TIMEOUT_US) PlatformSleepMicroseconds(500);
+		if (stats.value != monitor->confirmed) unconfirmed++;
+	}
+	BenchResult("drag", count, "final_confirmed_ms", (double)(SimBackendTime(sim) - finalPosted) / 1000.0, "ms");
+	BenchResult("drag", count, "unconfirmed", unconfirmed, "monitors");
+}
+
+// Fade: every monitor transitions from the drag's final value to 0 over the fade duration, stepped as fast as each monitor accepts writes
+static void BenchFade(backend_t *sim, const bench_options_t *options, monitor_t *monitorList, int count)
+{
+	sim_stats_t stats;
+	int writesBefore = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (SimBackendStats(sim, i, &stats)) writesBefore += stats.writes;
+	}
+
+	int64_t start = SimBackendTime(sim);
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		MonitorFadeBrightness(monitor, 0, (int)(options->fade * options->timeScale));
+	}
+
+	// Wait until every monitor has reached the target
+	int64_t lastApplied = start;
+	uint64_t waitStart = PlatformTimeMicroseconds();
+	for (int i = 0; i < count; )
+	{
+		if (!SimBackendStats(sim, i, &stats)) break;
+		if (stats.value == 0 && stats.lastWriteTime >= start)
+		{
+			if (stats.lastWriteTime > lastApplied) lastApplied = stats.lastWriteTime;
+			i++;
+			continue;
+		}
+		if (PlatformTimeMicroseconds() - waitStart > BENCH_TIMEOUT_US) { fprintf(stderr, "ERROR: Timed out waiting for monitor %d to complete the fade.\n", i); break; }
+		PlatformSleepMicroseconds(500);
+	}
+	BenchResult("fade", count, "complete_ms", (double)(lastApplied - start) / 1000.0, "ms");
+
+	int steps = -writesBefore;
+	for (int i = 0; i < count; i++)
+	{
+		if (SimBackendStats(sim, i, &stats)) steps += stats.writes;
+	}
+	BenchResult("fade", count, "steps_per_monitor", count > 0 ? (double)steps / count : 0, "writes");
+}
+
+// Set all: every monitor to one master level at once (the first through a curve), then time until the first and the last has applied its value
+static void BenchSetAll(backend_t *sim, monitor_t *monitorList, int count)
+{
+	// Until the fade's final values have been read back
+	sim_stats_t stats;
+	int index = 0;
+	uint64_t settleStart = PlatformTimeMicroseconds();
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next, index++)
+	{
+		while (SimBackendStats(sim, index, &stats) && stats.value != monitor->confirmed && PlatformTimeMicroseconds() - settleStart < BENCH_TIMEOUT_US) PlatformSleepMicroseconds(500);
+	}
+
+	monitor_curve_t curve = { 2, { 0, 100 }, { 10, 90 }, -5 };
+	MonitorSetCurve(MonitorGetIdentity(monitorList), &curve);
+
+	int64_t start = SimBackendTime(sim);
+	MonitorListSetBrightnessAll(monitorList, 75);
+
+	int64_t firstApplied = 0, lastApplied = start;
+	uint64_t waitStart = PlatformTimeMicroseconds();
+	monitor_t *monitor = monitorList;
+	for (int i = 0; i < count && monitor != NULL; )
+	{
+		if (!SimBackendStats(sim, i, &stats)) break;
+		if (stats.value == MonitorCurveBrightness(monitor, 75) && stats.lastWriteTime >= start)
+		{
+			if (firstApplied == 0 || stats.lastWriteTime < firstApplied) firstApplied = stats.lastWriteTime;
+			if (stats.lastWriteTime > lastApplied) lastApplied = stats.lastWriteTime;
+			i++;
+			monitor = monitor->next;
+			continue;
+		}
+		if (PlatformTimeMicroseconds() - waitStart > BENCH_TIMEOUT_US) { fprintf(stderr, "ERROR: Timed out waiting for monitor %d to apply the master level.\n", i); break; }
+		PlatformSleepMicroseconds(500);
+	}
+	BenchResult("setall", count, "all_applied_ms", (double)(lastApplied - start) / 1000.0, "ms");
+	BenchResult("setall", count, "spread_ms", (double)(lastApplied - (firstApplied ? firstApplied : lastApplied)) / 1000.0, "ms");
+
+	MonitorSetCurve(MonitorGetIdentity(monitorList), NULL);
+}
+
+// Wait for a change made on the first monitor itself to be reported by the background sync
+static void BenchSyncDetect(backend_t *sim, int count, int value, bool activity, const char *metric)
+{
+	PlatformMutexLock(&refreshedLock);
+	refreshedCount = 0;
+	PlatformMutexUnlock(&refreshedLock);
+	int64_t start = SimBackendTime(sim);
+	SimBackendSetValue(sim, 0, value);
+	if (activity) MonitorSyncActivity();
+
+	PlatformMutexLock(&refreshedLock);
+	while (refreshedCount == 0)
+	{
+		if (!PlatformCondWait(&refreshedChanged, &refreshedLock, BENCH_TIMEOUT_US)) { fprintf(stderr, "ERROR: Timed out waiting for the sync to find a change.\n"); break; }
+	}
+	PlatformMutexUnlock(&refreshedLock);
+	BenchResult("sync", count, metric, BenchElapsedMs(sim, start), "ms");
+}
+
+// Background sync: reads made while nothing changes (as the interval backs off), and the time to find a change made on a monitor, when idle and after activity
+static void BenchSync(backend_t *sim, const bench_options_t *options, monitor_t *monitorList, int count)
+{
+	sim_stats_t stats;
+	int readsBefore = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (SimBackendStats(sim, i, &stats)) readsBefore += stats.reads;
+	}
+
+	monitor_sync_t sync;
+	sync.minimum = (int)(BENCH_SYNC_MINIMUM_MS * options->timeScale);
+	sync.maximum = (int)(BENCH_SYNC_MAXIMUM_MS * options->timeScale);
+	MonitorSetCorrectedCallback(BrightnessRefreshed, NULL);
+	MonitorSyncStart(monitorList, &sync);
+	PlatformSleepMicroseconds((uint64_t)(BENCH_SYNC_IDLE_MS * 1000.0 * options->timeScale));
+
+	int reads = -readsBefore;
+	for (int i = 0; i < count; i++)
+	{
+		if (SimBackendStats(sim, i, &stats)) reads += stats.reads;
+	}
+	BenchResult("sync", count, "idle_reads_per_monitor", count > 0 ? (double)reads / count : 0, "reads");
+
+	BenchSyncDetect(sim, count, 50, false, "idle_detect_ms");
+	BenchSyncDetect(sim, count, 25, true, "activity_detect_ms");
+
+	MonitorSyncStop();
+	MonitorSetCorrectedCallback(NULL, NULL);
+}
+
+// DDC/CI protocol over a fake monitor's I2C transport: capabilities, get and set exchanges, also with NAKs and corrupt replies injected
+static void BenchDdcRun(const bench_options_t *options, const char *benchmark, int nakPercent, int checksumErrorPercent)
+{
+	ddc_fake_config_t config = {0};
+	config.bus = "fake-0";
+	config.manufacturer = "FAK";
+	config.product = 0x0001;
+	config.serial = options->seed;
+	config.name = "Bench";
+	config.brightness = 50;
+	config.maximum = 100;
+	config.responseDelay = DDC_REPLY_DELAY / 2;
+	config.transferLatency = 1000;
+	config.nakPercent = nakPercent;
+	config.checksumErrorPercent = checksumErrorPercent;
+	config.seed = options->seed;
+	ddc_fake_t *fake = DdcFakeCreate(&config, options->timeScale);
+	ddc_transport_t *transport = DdcFakeOpen(fake);
+	int failures = 0;
+
+	char capabilities[MCCS_CAPABILITIES_LENGTH];
+	uint64_t start = PlatformTimeMicroseconds();
+	if (!DdcCapabilities(transport, capabilities, sizeof(capabilities))) failures++;
+	BenchResult(benchmark, 1, "capabilities_ms", (double)(PlatformTimeMicroseconds() - start) / 1000.0 / options->timeScale, "ms");
+
+	start = PlatformTimeMicroseconds();
+	for (int i = 0; i < BENCH_DDC_OPERATIONS; i++)
+	{
+		int current, maximum;
+		if (!DdcGetVcp(transport, VCP_BRIGHTNESS, &current, &maximum)) failures++;
+	}
+	BenchResult(benchmark, 1, "get_vcp_ms", (double)(PlatformTimeMicroseconds() - start) / 1000.0 / options->timeScale / BENCH_DDC_OPERATIONS, "ms");
+
+	start = PlatformTimeMicroseconds();
+	for (int i = 0; i < BENCH_DDC_OPERATIONS; i++)
+	{
+		if (!DdcSetVcp(transport, VCP_BRIGHTNESS, i * 100 / (BENCH_DDC_OPERATIONS - 1))) failures++;
+	}
+	BenchResult(benchmark, 1, "set_vcp_ms", (double)(PlatformTimeMicroseconds() - start) / 1000.0 / options->timeScale / BENCH_DDC_OPERATIONS, "ms");
+
+	ddc_fake_stats_t stats;
+	DdcFakeStats(fake, &stats);
+	BenchResult(benchmark, 1, "failures", failures, "operations");
+	BenchResult(benchmark, 1, "naks", stats.naks, "transfers");
+	BenchResult(benchmark, 1, "checksum_errors", stats.checksumErrors, "replies");
+
+	transport->close(transport);
+	DdcFakeDestroy(fake);
+}
+
+static bool BenchWriteCsv(const char *filename)
+{
+	FILE *fp = fopen(filename, "w");
+	if (fp == NULL) { fprintf(stderr, "ERROR: Cannot write: %s\n", filename); return false; }
+	fprintf(fp, "benchmark,monitors,metric,value,unit\n");
+	for (int i = 0; i < resultCount; i++)
+	{
+		fprintf(fp, "%s,%d,%s,%.3f,%s\n", results[i].benchmark, results[i].monitors, results[i].metric, results[i].value, results[i].unit);
+	}
+	fclose(fp);
+	return true;
+}
+
+static bool BenchWriteJson(const char *filename, const bench_options_t *options)
+{
+	FILE *fp = fopen(filename, "w");
+	if (fp == NULL) { fprintf(stderr, "ERROR: Cannot write: %s\n", filename); return false; }
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"config\": { \"timeScale\": %g, \"capsLatencyUs\": %d, \"readLatencyUs\": %d, \"writeLatencyUs\": %d, \"jitterUs\": %d, \"minGapUs\": %d, \"failurePercent\": %d, \"verifyPercent\": %d, \"perBus\": %d, \"events\": %d, \"rate\": %d, \"fadeMs\": %d, \"seed\": %u },\n",
+		options->timeScale, options->capsLatency, options->readLatency, options->writeLatency, options->jitter, options->minimumGap, options->failure, options->verify, options->perBus, options->events, options->rate, options->fade, options->seed);
+	fprintf(fp, "  \"results\": [\n");
+	for (int i = 0; i < resultCount; i++)
+	{
+		fprintf(fp, "    { \"benchmark\": \"%s\", \"monitors\": %d, \"metric\": \"%s\", \"value\": %.3f, \"unit\": \"%s\" }%s\n", results[i].benchmark, results[i].monitors, results[i].metric, results[i].value, results[i].unit, (i + 1 < resultCount) ? "," : "");
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+	fclose(fp);
+	return true;
+}
+
+static int BenchParseCounts(bench_options_t *options, const char *list)
+{
+	options->countCount = 0;
+	for (const char *p = list; *p != '\0' && options->countCount < BENCH_MAX_COUNTS; )
+	{
+		int count = atoi(p);
+		if (count < 1 || count > SIM_MAX_MONITORS) return -1;
+		options->counts[options->countCount++] = count;
+		p = strchr(p, ',');
+		if (p == NULL) break;
+		p++;
+	}
+	return options->countCount;
+}
+
+int main(int argc, char *argv[])
+{
+	bench_options_t options = {0};
+	BenchParseCounts(&options, "1,4,16,64");
+	options.timeScale = 0.1;
+	options.capsLatency = 50000;
+	options.readLatency = 40000;
+	options.writeLatency = 50000;
+	options.jitter = 5000;
+	options.minimumGap = 80000;
+	options.failure = 0;
+	options.verify = 100;
+	options.perBus = 2;
+	options.events = 500;
+	options.rate = 1000;
+	options.fade = 1000;
+	options.seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (value == NULL) { fprintf(stderr, "ERROR: Missing value for: %s\n", argv[i]); return 1; }
+		if (strcmp(argv[i], "--monitors") == 0) { if (BenchParseCounts(&options, value) <= 0) { fprintf(stderr, "ERROR: Invalid monitor counts: %s\n", value); return 1; } }
+		else if (strcmp(argv[i], "--time-scale") == 0) options.timeScale = atof(value);
+		else if (strcmp(argv[i], "--caps-latency") == 0) options.capsLatency = atoi(value);
+		else if (strcmp(argv[i], "--read-latency") == 0) options.readLatency = atoi(value);
+		else if (strcmp(argv[i], "--write-latency") == 0) options.writeLatency = atoi(value);
+		else if (strcmp(argv[i], "--jitter") == 0) options.jitter = atoi(value);
+		else if (strcmp(argv[i], "--min-gap") == 0) options.minimumGap = atoi(value);
+		else if (strcmp(argv[i], "--failure") == 0) options.failure = atoi(value);
+		else if (strcmp(argv[i], "--verify") == 0) options.verify = atoi(value);
+		else if (strcmp(argv[i], "--per-bus") == 0) options.perBus = atoi(value);
+		else if (strcmp(argv[i], "--events") == 0) options.events = atoi(value);
+		else if (strcmp(argv[i], "--rate") == 0) options.rate = atoi(value);
+		else if (strcmp(argv[i], "--fade") == 0) options.fade = atoi(value);
+		else if (strcmp(argv[i], "--seed") == 0) options.seed = (unsigned int)strtoul(value, NULL, 10);
+		else if (strcmp(argv[i], "--csv") == 0) options.csvFile = value;
+		else if (strcmp(argv[i], "--json") == 0) options.jsonFile = value;
+		else if (strcmp(argv[i], "--trace") == 0) options.traceFile = value;
+		else { fprintf(stderr, "ERROR: Unknown option: %s\n", argv[i]); return 1; }
+		i++;
+	}
+	if (options.timeScale <= 0 || options.rate <= 0 || options.events <= 0) { fprintf(stderr, "ERROR: Time scale, rate and events must be positive.\n"); return 1; }
+
+	int maxCount = 0;
+	for (int i = 0; i < options.countCount; i++)
+	{
+		if (options.counts[i] > maxCount) maxCount = options.counts[i];
+	}
+
+	// Every monitor is added up-front (disconnected), and each run connects the number it needs
+	backend_t *sim = SimBackendCreate(options.timeScale, options.seed);
+	for (int i = 0; i < maxCount; i++)
+	{
+		char bus[32];
+		snprintf(bus, sizeof(bus), "bus%d", (options.perBus > 0) ? i / options.perBus : i);
+		sim_monitor_t monitor = {0};
+		monitor.bus = (options.perBus > 0) ? bus : NULL;
+		monitor.hasBrightness = true;
+		monitor.minimum = 0;
+		monitor.maximum = 100;
+		monitor.initial = 50;
+		monitor.capsLatency = options.capsLatency;
+		monitor.readLatency = options.readLatency;
+		monitor.writeLatency = options.writeLatency;
+		monitor.jitter = options.jitter;
+		monitor.minimumGap = (i % 2 == 1) ? options.minimumGap : 0;		// Every other monitor is slow to accept commands
+		monitor.failurePercent = options.failure;
+		SimBackendAdd(sim, &monitor);
+		SimBackendSetConnected(sim, i, false);
+	}
+	MonitorRegisterBackend(sim);
+	monitor_policy_t policy;
+	MonitorGetPolicy(&policy);
+	policy.verifyPercent = options.verify;
+	MonitorSetPolicy(&policy);
+	PlatformCondInit(&refreshedChanged);
+	if (options.traceFile != NULL && !TraceStart(options.traceFile)) { fprintf(stderr, "ERROR: Cannot start trace.\n"); return 1; }
+	TraceThreadName("bench");
+
+	printf("%-10s %3s %-24s %12s %s\n", "BENCHMARK", "N", "METRIC", "VALUE", "UNIT");
+	for (int c = 0; c < options.countCount; c++)
+	{
+		int count = options.counts[c];
+		for (int i = 0; i < maxCount; i++) SimBackendSetConnected(sim, i, i < count);
+
+		monitor_t *monitorList = BenchEnumerate(sim, count);
+		BenchPopup(sim, monitorList, count);
+		BenchDrag(sim, &options, monitorList, count);
+		BenchFade(sim, &options, monitorList, count);
+		BenchSetAll(sim, monitorList, count);
+		BenchSync(sim, &options, monitorList, count);
+		MonitorListDestroy(monitorList);
+	}
+
+	BenchDdcRun(&options, "ddc", 0, 0);
+	BenchDdcRun(&options, "ddc_faulty", 10, 10);
+
+	MonitorCleanup();
+	SimBackendDestroy(sim);
+	PlatformCondDestroy(&refreshedChanged);
+
+	bool success = true;
+	if (options.traceFile != NULL) success &= TraceStop();
+	if (options.csvFile != NULL) success &= BenchWriteCsv(options.csvFile);
+	if (options.jsonFile != NULL) success &= BenchWriteJson(options.jsonFile, &options);
+	return success ? 0 : 2;
+}
@@ -15,8 +15,11 @@
 
 #include <rpc.h>
 #include <dbt.h>
+#include <wtsapi32.h>
 
 #include "monitor.h"
+#include "trace.h"
+#include "headless.h"
 
 // commctrl v6 for LoadIconMetric()
 #include <commctrl.h>
@@ -36,12 +39,19 @@
 #pragma comment(lib, "gdi32.lib")		// CreateFontIndirect()
 #pragma comment(lib, "User32.lib")		// Windows
 #pragma comment(lib, "ole32.lib")		// CoInitialize(), etc.
+#pragma comment(lib, "wtsapi32.lib")	// WTSRegisterSessionNotification()
 #endif
 
 // Defines
 #define TITLE TEXT("Brightly")
 #define TITLE_L L"Brightly"
 #define WMAPP_NOTIFYCALLBACK (WM_APP + 1)
+#define WMAPP_BRIGHTNESS_CHANGED (WM_APP + 2)	// wParam = monitor id (the list may have been replaced before the message is handled)
+#define WMAPP_MONITORS_ENUMERATED (WM_APP + 3)	// Background enumeration complete
+#define TIMER_DEVICES_CHANGED 1
+#define DEVICES_CHANGED_DEBOUNCE_MS 500	// Bursts of display/device change events (e.g. docking) are handled once they settle
+#define SYNC_MINIMUM_MS 2000			// Background sync (/SYNC): interval after the popup opens or a change is found...
+#define SYNC_MAXIMUM_MS 120000			// ...doubled while nothing changes, up to this
 #define IDM_OPEN		101
 #define IDM_REFRESH		102
 #define IDM_DEBUG		103
@@ -69,6 +79,47 @@ int gVersion[4] = { 0, 0, 0, 0 };
 NOTIFYICONDATA nid = {0};
 
 monitor_t *monitorList = NULL;
+char gszSnapshotFile[MAX_PATH] = "";	// Last known monitor state, to be usable before enumeration completes
+char gszTraceFile[MAX_PATH] = "";		// Spans written as Chrome trace-event JSON on exit (/TRACE:<file>)
+platform_thread_t gEnumerateThread;
+bool gbEnumerating = false;				// Background enumeration in progress (monitorList is restored from the snapshot, or stands in for the list being updated)
+bool gbDevicesChangedPending = false;	// Devices changed during the background enumeration
+monitor_t *gUpdatingList = NULL;		// List the background enumeration updates (NULL to enumerate afresh)
+bool gbRescan = false;					// The background enumeration replaces the list rather than updating it
+monitor_t *gEnumeratedList = NULL;		// Result of the background enumeration
+bool gbSync = false;					// Monitors are read in the background (/SYNC), so changes made on the monitor itself are followed
+bool gbSessionLocked = false;			// The sync is paused while the session is locked or the displays are off
+bool gbDisplayOff = false;
+HPOWERNOTIFY ghDisplayNotify = NULL;
+
+// GUID_CONSOLE_DISPLAY_STATE (defined here, as it is not in every SDK's libraries)
+static const GUID guidConsoleDisplayState = { 0x6fe69556, 0x704a, 0x47a0, { 0x8f, 0x24, 0xc2, 0x8d, 0x93, 0x6f, 0xda, 0x47 } };
+
+// Headless mode (/GET, /SET:<monitor>=<percent>): no window, the result is printed to stdout as JSON
+bool gbHeadless = false;
+headless_t gHeadless = {0};
+
+// Path of a data file kept between runs: in the local application data folder (or beside the executable, if portable)
+static bool DataFilePath(char *buffer, size_t size, const char *name)
+{
+	char folder[MAX_PATH] = "";
+	if (gbPortable)
+	{
+		GetModuleFileNameA(NULL, folder, sizeof(folder));
+		char *lastSeparator = strrchr(folder, '\\');
+		if (lastSeparator == NULL) return false;
+		*lastSeparator = '\0';
+	}
+	else
+	{
+		DWORD length = GetEnvironmentVariableA("LOCALAPPDATA", folder, sizeof(folder));
+		if (length == 0 || length + sizeof("\\Brightly") > sizeof(folder)) return false;
+		strcat(folder, "\\Brightly");
+		CreateDirectoryA(folder, NULL);
+	}
+	int length = snprintf(buffer, size, "%s\\%s", folder, name);
+	return length > 0 && (size_t)length < size;
+}
 
 // Redirect standard I/O to a console
 static BOOL RedirectIOToConsole(BOOL tryAttach, BOOL createIfRequired)
@@ -254,18 +305,53 @@ void DumpMonitors(FILE *file, bool details)
 		}
 #endif
 	}
+
+	// Machine-readable I/O counts, latency histograms and enumeration phases
+	if (details)
+	{
+		_ftprintf(file, TEXT("*** METRICS (JSON):\n"));
+		MonitorListDumpMetrics(file, monitorList);
+	}
 }
 
-void SearchMonitors(void)
+// Follow the current list in the background (a list from MonitorListUpdate() or MonitorListReplace() is followed already)
+void StartSync(void)
 {
-	if (monitorList != NULL)
+	if (!gbSync || monitorList == NULL) return;
+	monitor_sync_t sync = { SYNC_MINIMUM_MS, SYNC_MAXIMUM_MS };
+	MonitorSyncStart(monitorList, &sync);
+}
+
+// Nobody can see or change the monitors while the session is locked or the displays are off
+void UpdateSyncPause(void)
+{
+	if (!gbSync) return;
+	TraceInstant("app", (gbSessionLocked || gbDisplayOff) ? "SyncPause" : "SyncResume", NULL);
+	MonitorSyncPause(gbSessionLocked || gbDisplayOff);
+}
+
+void SearchMonitors(bool rescan)
+{
+	uint64_t trace = TraceBegin();
+	if (monitorList != NULL && !rescan)
 	{
-		MonitorListDestroy(monitorList);
-		monitorList = NULL;
+		// Only probe monitors that have been added
+		monitorList = MonitorListUpdate(monitorList);
+	}
+	else
+	{
+		if (monitorList != NULL)
+		{
+			MonitorListDestroy(monitorList);
+			monitorList = NULL;
+		}
+		monitorList = MonitorListEnumerate();
+		StartSync();
 	}
-	monitorList = MonitorListEnumerate();
 
 	DumpMonitors(stdout, false);
+	if (gszSnapshotFile[0] != '\0') MonitorListSave(monitorList, gszSnapshotFile);
+	TraceEnd(trace, "app", "SearchMonitors", NULL, rescan ? 1 : 0);
 }
 
 BOOL HasExistingInstance(void)
@@ -301,11 +387,14 @@ BOOL HasExistingInstance(void)
 
 HFONT hDlgFont = NULL;
 int numMonitors = 0;		// Number of controls when window was created
+bool hasMaster = false;		// A master control (setting every monitor at once) is shown above the monitors' controls
 bool windowOpen = false;
 #define ID_LABEL_BASE 3000
 #define ID_LABEL_END (ID_LABEL_BASE + 999)
 #define ID_TRACKBAR_BASE 4000
 #define ID_TRACKBAR_END (ID_TRACKBAR_BASE + 999)
+#define ID_MASTER_LABEL 5000
+#define ID_MASTER_TRACKBAR 5001
 
 void RemoveControls(void)
 {
@@ -316,6 +405,28 @@ void RemoveControls(void)
 		DestroyWindow(GetDlgItem(ghWndMain, ID_TRACKBAR_BASE + i));
 	}
 	numMonitors = 0;
+	if (hasMaster)
+	{
+		DestroyWindow(GetDlgItem(ghWndMain, ID_MASTER_LABEL));
+		DestroyWindow(GetDlgItem(ghWndMain, ID_MASTER_TRACKBAR));
+		hasMaster = false;
+	}
+}
+
+// A trackbar (0-100%) with its label above
+void CreateTrackbar(const wchar_t *description, int labelId, int trackbarId, int y, int width, int position)
+{
+	HWND hWnd = ghWndMain;
+	HINSTANCE hInstance = (HINSTANCE)GetWindowLongPtr(hWnd, GWLP_HINSTANCE); // ghInstance;
+
+	HWND hWndLabel = CreateWindowExW(0, L"STATIC", description, WS_VISIBLE | WS_CHILD | SS_ENDELLIPSIS, 10, y, width, 20, hWnd, (HMENU)(intptr_t)labelId, hInstance, NULL);
+	SendMessage(hWndLabel, WM_SETFONT, (WPARAM)hDlgFont, MAKELPARAM(FALSE, 0));
+
+	HWND hWndTrack = CreateWindowEx(0, TRACKBAR_CLASS, TEXT("Trackbar Control"), WS_CHILD | WS_VISIBLE | TBS_HORZ | WS_TABSTOP | TBS_AUTOTICKS | TBS_DOWNISLEFT, 10, y + 20, width, 30, hWnd, (HMENU)(intptr_t)trackbarId, hInstance, NULL); 
+	SendMessage(hWndTrack, TBM_SETRANGE, (WPARAM)TRUE, (LPARAM)MAKELONG(0, 100));
+	SendMessage(hWndTrack, TBM_SETTICFREQ , (WPARAM)10, (LPARAM)0);
+	SendMessage(hWndTrack, TBM_SETPAGESIZE, 0, (LPARAM)10);
+	SendMessage(hWndTrack, TBM_SETPOS, (WPARAM)TRUE, (LPARAM)position);
 }
 
 void CreateControls(void)
@@ -328,37 +439,46 @@ void CreateControls(void)
 	RemoveControls();
 
 	HWND hWnd = ghWndMain;
-	HINSTANCE hInstance = (HINSTANCE)GetWindowLongPtr(hWnd, GWLP_HINSTANCE); // ghInstance;
+
+	// With more than one adjustable monitor, a master control sets them all together (starting from their mean)
+	int adjustable = 0;
+	int total = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		if (!MonitorHasBrightness(monitor)) continue;
+		total += MonitorGetBrightness(monitor);
+		adjustable++;
+	}
+	int rows = 0;
+	if (adjustable > 1)
+	{
+		CreateTrackbar(L"All displays", ID_MASTER_LABEL, ID_MASTER_TRACKBAR, yMargin, width, total / adjustable);
+		hasMaster = true;
+		rows++;
+	}
 
 	// Populate  // GetDlgItem(hWnd, id)
 	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
 	{
-		int y = yMargin + numMonitors * yStep;
+		int y = yMargin + rows * yStep;
 
 		// Create components
-		const wchar_t *description = MonitorGetDescription(monitor);
-		HWND hWndLabel = CreateWindowExW(0, L"STATIC", description, WS_VISIBLE | WS_CHILD | SS_ENDELLIPSIS, 10, y, width, 20, hWnd, (HMENU)(intptr_t)(ID_LABEL_BASE + numMonitors), hInstance, NULL);
-		SendMessage(hWndLabel, WM_SETFONT, (WPARAM)hDlgFont, MAKELPARAM(FALSE, 0));
-
-		HWND hWndTrack = CreateWindowEx(0, TRACKBAR_CLASS, TEXT("Trackbar Control"), WS_CHILD | WS_VISIBLE | TBS_HORZ | WS_TABSTOP | TBS_AUTOTICKS | TBS_DOWNISLEFT, 10, y + 20, width, 30, hWnd, (HMENU)(intptr_t)(ID_TRACKBAR_BASE + numMonitors), hInstance, NULL); 
-		SendMessage(hWndTrack, TBM_SETRANGE, (WPARAM)TRUE, (LPARAM)MAKELONG(0, 100));
-		SendMessage(hWndTrack, TBM_SETTICFREQ , (WPARAM)10, (LPARAM)0);
-		SendMessage(hWndTrack, TBM_SETPAGESIZE, 0, (LPARAM)10);
-		SendMessage(hWndTrack, TBM_SETPOS, (WPARAM)TRUE, (LPARAM)MonitorGetBrightness(monitor));
+		CreateTrackbar(MonitorGetDescription(monitor), ID_LABEL_BASE + numMonitors, ID_TRACKBAR_BASE + numMonitors, y, width, MonitorGetBrightness(monitor));
 
 		if (!MonitorHasBrightness(monitor))
 		{
-			EnableWindow(hWndLabel, FALSE);
-			EnableWindow(hWndTrack, FALSE);
+			EnableWindow(GetDlgItem(hWnd, ID_LABEL_BASE + numMonitors), FALSE);
+			EnableWindow(GetDlgItem(hWnd, ID_TRACKBAR_BASE + numMonitors), FALSE);
 		}
 
 		numMonitors++;
+		rows++;
 	}
 
 	// Size
 	SIZE windowSize;
 	windowSize.cx = width + 2 * xMargin;
-	windowSize.cy = numMonitors * yStep + 2 * yMargin;
+	windowSize.cy = rows * yStep + 2 * yMargin;
 	SetWindowPos(hWnd, NULL, 0, 0, windowSize.cx, windowSize.cy, SWP_NOACTIVATE | SWP_NOMOVE | SWP_NOZORDER);
 }
 
@@ -398,26 +518,84 @@ void PositionWindow(int x, int y)
 	SetWindowPos(ghWndMain, 0, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, SWP_NOZORDER | SWP_NOACTIVATE);
 }
 
+// Called from a background thread when a monitor's brightness has been read (or corrected after a failed write, or changed elsewhere)
+void BrightnessRefreshed(monitor_t *monitor, void *context)
+{
+	PostMessage((HWND)context, WMAPP_BRIGHTNESS_CHANGED, (WPARAM)monitor->id, 0);
+}
+
+void UpdateControl(int id)
+{
+	monitor_t *monitor = MonitorListFind(monitorList, id);
+	if (monitor == NULL) return;
+	HWND hWndTrack = GetDlgItem(ghWndMain, ID_TRACKBAR_BASE + monitor->index);
+	if (hWndTrack == NULL) return;
+	if (GetCapture() == hWndTrack) return;	// Don't move a slider being dragged
+	SendMessage(hWndTrack, TBM_SETPOS, (WPARAM)TRUE, (LPARAM)MonitorGetBrightness(monitor));
+}
+
 void OpenWindow(int x, int y)
 {
-	MonitorListRefreshBrightness(monitorList);
+	// Show the last known values immediately, the sliders are updated as fresh values are read
+	uint64_t trace = TraceBegin();
 	CreateControls();
 	PositionWindow(x, y);
 	ShowWindow(ghWndMain, SW_SHOW);
 	SetForegroundWindow(ghWndMain);
 	windowOpen = true;
+	if (gbSync) MonitorSyncActivity();	// Values are already current, only changes are reported
+	else MonitorListRefreshBrightnessAsync(monitorList, BrightnessRefreshed, ghWndMain);
+	TraceEnd(trace, "app", "OpenWindow", NULL, numMonitors);
 }
 
 void HideWindow(void)
 {
+	uint64_t trace = TraceBegin();
 	ShowWindow(ghWndMain, SW_HIDE);
 	RemoveControls();
 	windowOpen = false;
+	TraceEnd(trace, "app", "HideWindow", NULL, 0);
 }
 
-void DevicesChanged(void)
+void EnumerateThread(void *context)
 {
-	SearchMonitors();
+	TraceThreadName("enumerate");
+	uint64_t trace = TraceBegin();
+	if (gUpdatingList != NULL && gbRescan)
+	{
+		MonitorListDestroy(gUpdatingList);
+		gUpdatingList = NULL;
+	}
+	if (gUpdatingList != NULL) gEnumeratedList = MonitorListUpdate(gUpdatingList);	// Only probe monitors that have been added
+	else gEnumeratedList = MonitorListEnumerate();
+	gUpdatingList = NULL;
+	TraceEnd(trace, "app", "MonitorListEnumerate", NULL, 0);
+	PostMessage(ghWndMain, WMAPP_MONITORS_ENUMERATED, 0, 0);
+}
+
+// Update the monitors in the background, so the UI thread is not blocked by probing or by flushing writes.
+// Meanwhile, the popup uses stand-ins of the current monitors (with the same ids), whose changes are applied when the result is swapped in.
+void DevicesChanged(bool rescan)
+{
+	KillTimer(ghWndMain, TIMER_DEVICES_CHANGED);
+	if (gbEnumerating)
+	{
+		gbDevicesChangedPending = true;
+		return;
+	}
+	if (!gbImmediatelyExit)
+	{
+		gUpdatingList = monitorList;
+		gbRescan = rescan;
+		monitorList = MonitorListStandIn(gUpdatingList);
+		gbEnumerating = true;
+		if (PlatformThreadCreate(&gEnumerateThread, EnumerateThread, NULL)) return;
+		gbEnumerating = false;
+		MonitorListDestroy(monitorList);
+		monitorList = gUpdatingList;
+		gUpdatingList = NULL;
+	}
+	SearchMonitors(rescan);
 	if (windowOpen)
 	{
 		RemoveControls();
@@ -425,6 +603,51 @@ void DevicesChanged(void)
 	}
 }
 
+// Start with the monitors from the snapshot (so the popup is usable immediately), enumerating the real ones in the background
+void StartEnumeration(void)
+{
+	uint64_t trace = TraceBegin();
+	if (gszSnapshotFile[0] != '\0') monitorList = MonitorListRestore(gszSnapshotFile);
+	TraceEnd(trace, "app", "MonitorListRestore", NULL, monitorList != NULL ? 1 : 0);
+	gbEnumerating = true;
+	if (!PlatformThreadCreate(&gEnumerateThread, EnumerateThread, NULL))
+	{
+		gbEnumerating = false;
+		DevicesChanged(true);
+	}
+}
+
+void MonitorsEnumerated(void)
+{
+	if (!gbEnumerating) return;
+	uint64_t trace = TraceBegin();
+	PlatformThreadJoin(&gEnumerateThread);
+	gbEnumerating = false;
+	monitorList = MonitorListReplace(monitorList, gEnumeratedList);
+	TraceEnd(trace, "app", "MonitorListReplace", NULL, 0);
+	gEnumeratedList = NULL;
+	StartSync();
+	DumpMonitors(stdout, false);
+	if (gszSnapshotFile[0] != '\0') MonitorListSave(monitorList, gszSnapshotFile);
+	if (windowOpen && !gbExiting)
+	{
+		RemoveControls();
+		CreateControls();
+		if (!gbSync) MonitorListRefreshBrightnessAsync(monitorList, BrightnessRefreshed, ghWndMain);
+	}
+	if (gbDevicesChangedPending)
+	{
+		gbDevicesChangedPending = false;
+		DevicesChanged(false);
+	}
+}
+
+// Restart the debounce timer, the monitors are updated when no further changes arrive within the window
+void DevicesChangedDebounced(void)
+{
+	SetTimer(ghWndMain, TIMER_DEVICES_CHANGED, DEVICES_CHANGED_DEBOUNCE_MS, NULL);
+}
+
 void StartExit(void)
 {
 	gbExiting = TRUE;
@@ -439,6 +662,7 @@ void StartExit(void)
 void Startup(HWND hWnd)
 {
 	_tprintf(TEXT("Startup...\n"));
+	uint64_t trace = TraceBegin();
 
 	ghWndMain = hWnd;
 
@@ -471,19 +695,37 @@ void Startup(HWND hWnd)
 
 	if (response != IDCANCEL)
 	{
-		DevicesChanged();
+		// The icon is shown first, the monitors (including any WMI query, which can be slow while the service starts at login) are found in the background
 		if (!gbImmediatelyExit)
 		{
+			uint64_t traceIcon = TraceBegin();
 			AddNotificationIcon(ghWndMain);
+			TraceEnd(traceIcon, "app", "AddNotificationIcon", NULL, 0);
+		}
+		if (gbImmediatelyExit) DevicesChanged(true);
+		else StartEnumeration();
+
+		if (gbSync && !gbImmediatelyExit)
+		{
+			if (!WTSRegisterSessionNotification(ghWndMain, NOTIFY_FOR_THIS_SESSION)) _ftprintf(stderr, TEXT("WARNING: Failed WTSRegisterSessionNotification().\n"));
+			ghDisplayNotify = RegisterPowerSettingNotification(ghWndMain, &guidConsoleDisplayState, DEVICE_NOTIFY_WINDOW_HANDLE);
+			if (ghDisplayNotify == NULL) _ftprintf(stderr, TEXT("WARNING: Failed RegisterPowerSettingNotification().\n"));
 		}
 	}
 
 	if (gbImmediatelyExit) StartExit();
+	TraceEnd(trace, "app", "Startup", NULL, 0);
 }
 
 void Shutdown(void)
 {
 	_tprintf(TEXT("Shutdown()...\n"));
+	if (gbSync)
+	{
+		WTSUnRegisterSessionNotification(ghWndMain);
+		if (ghDisplayNotify != NULL) UnregisterPowerSettingNotification(ghDisplayNotify);
+		ghDisplayNotify = NULL;
+	}
 	DeleteNotificationIcon();
 	_tprintf(TEXT("...END: Shutdown()\n"));
 }
@@ -509,8 +751,8 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 	case WM_DISPLAYCHANGE:
 		{
 			_tprintf(TEXT("WM_DISPLAYCHANGE\n"));
-			DevicesChanged();
-			_tprintf(TEXT("/WM_DISPLAYCHANGE\n"));
+			TraceInstant("app", "WM_DISPLAYCHANGE", NULL);
+			DevicesChangedDebounced();
 		}
 		break;
 
@@ -527,12 +769,21 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 					wParam == DBT_DEVNODES_CHANGED ? TEXT("wParam == DBT_DEVNODES_CHANGED") :
 					TEXT("?")
 				);
-				DevicesChanged();
-				_tprintf(TEXT("/WM_DEVICECHANGE\n"));
+				TraceInstant("app", "WM_DEVICECHANGE", NULL);
+				DevicesChangedDebounced();
 			}
 		}
 		break;
 
+	case WM_TIMER:
+		if (wParam == TIMER_DEVICES_CHANGED)
+		{
+			_tprintf(TEXT("DEVICES_CHANGED\n"));
+			DevicesChanged(false);
+			_tprintf(TEXT("/DEVICES_CHANGED\n"));
+		}
+		break;
+
 	case WM_ACTIVATE:
 		{
 			if (wParam == WA_INACTIVE)
@@ -573,7 +824,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 				break;
 			case IDM_REFRESH:
 				{
-					DevicesChanged();
+					DevicesChanged(true);
 				}
 				break;
 			case IDM_DEBUG:
@@ -699,6 +950,38 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 		}
 		break;
 
+	case WMAPP_BRIGHTNESS_CHANGED:
+		if (windowOpen)
+		{
+			UpdateControl((int)wParam);
+		}
+		break;
+
+	case WMAPP_MONITORS_ENUMERATED:
+		MonitorsEnumerated();
+		break;
+
+	case WM_WTSSESSION_CHANGE:
+		if (wParam == WTS_SESSION_LOCK || wParam == WTS_SESSION_UNLOCK)
+		{
+			gbSessionLocked = (wParam == WTS_SESSION_LOCK);
+			UpdateSyncPause();
+		}
+		break;
+
+	case WM_POWERBROADCAST:
+		if (wParam == PBT_POWERSETTINGCHANGE)
+		{
+			const POWERBROADCAST_SETTING *setting = (const POWERBROADCAST_SETTING *)lParam;
+			if (IsEqualGUID(&setting->PowerSetting, &guidConsoleDisplayState) && setting->DataLength >= sizeof(DWORD))
+			{
+				gbDisplayOff = (*(const DWORD *)setting->Data == 0);	// 0 = off, 1 = on, 2 = dimmed
+				UpdateSyncPause();
+			}
+			return TRUE;
+		}
+		return DefWindowProc(hwnd, message, wParam, lParam);
+
 	case WM_ENDSESSION:
 		StartExit();
 		break;
@@ -725,22 +1008,32 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 			int id = GetWindowLong(hWndControl, GWL_ID);
 			if (id >= ID_TRACKBAR_BASE && id <= ID_TRACKBAR_END)
 			{
+				uint64_t trace = TraceBegin();
 				int index = id - ID_TRACKBAR_BASE;
 				int value;
 				// if (LOWORD(wParam) == TB_THUMBPOSITION || LOWORD(wParam) == TB_THUMBTRACK) value = HIWORD(wParam);
 				value = (int)SendMessage(hWndControl, TBM_GETPOS, 0, 0);
 				//_tprintf(TEXT("#%d @%d\n"), index, value);
-				int i = 0;
-				for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+				monitor_t *monitor = MonitorListGet(monitorList, index);
+				if (monitor != NULL)
 				{
-					if (i == index)
-					{
-						MonitorSetBrightness(monitor, value);
-						break;
-					}
-					i++;
+					MonitorPostBrightness(monitor, value);
+					TraceEnd(trace, "app", "WM_HSCROLL", MonitorGetIdentity(monitor), value);
 				}
-
+			}
+			else if (id == ID_MASTER_TRACKBAR)
+			{
+				// Every monitor at once (each through its own curve), with each monitor's slider following
+				uint64_t trace = TraceBegin();
+				int value = (int)SendMessage(hWndControl, TBM_GETPOS, 0, 0);
+				MonitorListSetBrightnessAll(monitorList, value);
+				for (int index = 0; index < numMonitors; index++)
+				{
+					monitor_t *monitor = MonitorListGet(monitorList, index);
+					if (monitor == NULL || !MonitorHasBrightness(monitor)) continue;
+					SendDlgItemMessage(hwnd, ID_TRACKBAR_BASE + index, TBM_SETPOS, (WPARAM)TRUE, (LPARAM)MonitorGetBrightness(monitor));
+				}
+				TraceEnd(trace, "app", "WM_HSCROLL", "master", value);
 			}
 		}	
 
@@ -768,6 +1061,8 @@ void done(EXCEPTION_POINTERS *exceptionInfo)
 
 void finish(void)
 {
+	TraceStop();
+	if (gbHeadless) return;	// stdout only carries the result
 	_tprintf(TEXT("END: Application ended.\n"));
 	done(NULL);
 }
@@ -794,6 +1089,84 @@ BOOL WINAPI consoleHandler(DWORD signal)
 	return FALSE;
 }
 
+// Resolve index selectors against the snapshot once, so the monitors written are those the backends were chosen for.
+// Returns whether the WMI backend (and so COM) may be needed: a targeted monitor used it when last seen, or is not in the snapshot.
+static bool HeadlessResolve(void)
+{
+	if (gszSnapshotFile[0] == '\0') return true;
+	snapshot_entry_t *entries = (snapshot_entry_t *)malloc(SNAPSHOT_MAX_MONITORS * sizeof(snapshot_entry_t));
+	if (entries == NULL) return true;
+	int count = SnapshotLoad(gszSnapshotFile, entries, SNAPSHOT_MAX_MONITORS);
+	bool needsWmi = (count <= 0);
+	for (int i = 0; i < count; i++)
+	{
+		bool targeted = gHeadless.get;
+		for (int j = 0; j < gHeadless.count; j++)
+		{
+			headless_set_t *set = &gHeadless.sets[j];
+			if (!HeadlessMatches(set->selector, i, entries[i].identity)) continue;
+			if (HeadlessIsIndex(set->selector)) strcpy(set->identity, entries[i].identity);
+			set->matched = true;
+			targeted = true;
+		}
+		if (targeted && strcmp(entries[i].backend, wmiBackend.name) == 0) needsWmi = true;
+	}
+	for (int j = 0; j < gHeadless.count; j++)
+	{
+		if (!gHeadless.sets[j].matched) needsWmi = true;
+		gHeadless.sets[j].matched = false;
+	}
+	free(entries);
+	return needsWmi;
+}
+
+// Apply any /SET: values and print the monitors as JSON, without creating a window.
+// Only the backends the targeted monitors used when last seen are initialized, and only the targeted monitors are probed.
+// Returns the process exit code.
+static int Headless(void)
+{
+	uint64_t start = PlatformTimeMicroseconds();
+
+	// stdout might not be connected when started as a Windows application without a console parameter
+	if (!gbHasConsole && GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) == FILE_TYPE_UNKNOWN)
+	{
+		gbHasConsole = RedirectIOToConsole(TRUE, FALSE);
+	}
+
+	bool comInitialized = false;
+	MonitorRegisterBackend(&ddcciBackend);
+	uint64_t trace = TraceBegin();
+	bool needsWmi = HeadlessResolve();
+	TraceEnd(trace, "app", "HeadlessResolve", NULL, needsWmi ? 1 : 0);
+	if (needsWmi)
+	{
+		HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+		if (SUCCEEDED(hr))
+		{
+			comInitialized = true;
+			hr = CoInitializeSecurity(NULL, -1, NULL, NULL, RPC_C_AUTHN_LEVEL_DEFAULT, RPC_C_IMP_LEVEL_IMPERSONATE, NULL, EOAC_NONE, NULL);
+		}
+		if (SUCCEEDED(hr)) MonitorRegisterBackend(&wmiBackend);
+		else fprintf(stderr, "WARNING: Failed to initialize COM, WMI brightness not available.\n");
+	}
+	MonitorSetProbeFilter(HeadlessTargeted, &gHeadless);
+	trace = TraceBegin();
+	monitorList = MonitorListEnumerate();
+	TraceEnd(trace, "app", "MonitorListEnumerate", NULL, 0);
+
+	// With /GET, every monitor is listed, otherwise only those set
+	bool success = HeadlessRun(&gHeadless, monitorList, stdout, start);
+
+	// Monitors that were not probed have no brightness to remember
+	if (gszSnapshotFile[0] != '\0' && !gHeadless.skipped) MonitorListSave(monitorList, gszSnapshotFile);
+	MonitorListDestroy(monitorList);
+	monitorList = NULL;
+	MonitorCleanup();
+	if (comInitialized) CoUninitialize();
+	TraceStop();
+	return success ? 0 : 3;
+}
+
 int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 {
 	_ftprintf(stderr, TEXT("run()\n"));
@@ -864,6 +1237,26 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 		else if (_tcsicmp(argv[i], TEXT("/NOPORTABLE")) == 0) { gbPortable = FALSE; }	// Allow override
 		else if (_tcsicmp(argv[i], TEXT("/ALLOWDUPLICATE")) == 0) { gbAllowDuplicate = TRUE; }
 		else if (_tcsicmp(argv[i], TEXT("/EXIT")) == 0) { gbImmediatelyExit = TRUE; }
+		else if (_tcsnicmp(argv[i], TEXT("/TRACE:"), 7) == 0 && argv[i][7] != TEXT('\0'))
+		{
+			if (WideCharToMultiByte(CP_ACP, 0, argv[i] + 7, -1, gszTraceFile, sizeof(gszTraceFile), NULL, NULL) == 0)
+			{
+				_ftprintf(stderr, TEXT("ERROR: Invalid trace file: %s\n"), argv[i] + 7);
+				errors++;
+			}
+		}
+		else if (_tcsicmp(argv[i], TEXT("/SYNC")) == 0) { gbSync = true; }
+		else if (_tcsicmp(argv[i], TEXT("/GET")) == 0) { gbHeadless = true; gHeadless.get = true; }
+		else if (_tcsnicmp(argv[i], TEXT("/SET:"), 5) == 0)
+		{
+			char set[HEADLESS_SELECTOR_LENGTH + 8];
+			gbHeadless = true;
+			if (WideCharToMultiByte(CP_UTF8, 0, argv[i] + 5, -1, set, sizeof(set), NULL, NULL) == 0 || !HeadlessParseSet(&gHeadless, set))
+			{
+				_ftprintf(stderr, TEXT("ERROR: Invalid parameter (expected /SET:<index|identity|ALL>=<0-100>): %s\n"), argv[i]);
+				errors++;
+			}
+		}
 		
 		else if (argv[i][0] == '/') 
 		{
@@ -889,7 +1282,7 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 
 	if (gbPortable)
 	{
-		_ftprintf(stdout, TEXT("NOTE: Running as a portable app.\n"));
+		_ftprintf(stderr, TEXT("NOTE: Running as a portable app.\n"));
 	}
 
 	if (errors)
@@ -901,7 +1294,7 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 	if (bShowHelp) 
 	{
 		TCHAR msg[512] = TEXT("");
-		_sntprintf(msg, sizeof(msg) / sizeof(msg[0]), TEXT("%s V%d.%d.%d  Daniel Jackson, 2020-2021.\n\nUsage: [/NOMIN|/MIN]\n\n"), TITLE, gVersion[0], gVersion[1], gVersion[2]);
+		_sntprintf(msg, sizeof(msg) / sizeof(msg[0]), TEXT("%s V%d.%d.%d  Daniel Jackson, 2020-2021.\n\nUsage: [/NOMIN|/MIN] [/SYNC] [/TRACE:<file.json>]\n       /GET | /SET:<index|identity|ALL>=<percent>...   (print the monitors as JSON, without a window)\n\n"), TITLE, gVersion[0], gVersion[1], gVersion[2]);
 		// [/CONSOLE:<ATTACH|CREATE|ATTACH-CREATE>]*  (* only as first parameter)
 		if (gbHasConsole)
 		{
@@ -914,14 +1307,45 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 		return -1;
 	}
 
+	if (gszTraceFile[0] != '\0' && TraceStart(gszTraceFile)) TraceThreadName("main");
+	uint64_t trace = TraceBegin();
+
+	// Monitor capabilities and state are kept between runs
+	char szCacheFile[MAX_PATH];
+	if (DataFilePath(szCacheFile, sizeof(szCacheFile), "capabilities.txt")) MonitorSetCapabilitiesCache(szCacheFile);
+	if (DataFilePath(szCacheFile, sizeof(szCacheFile), "timing.txt")) MonitorSetTimingCache(szCacheFile);
+	if (DataFilePath(szCacheFile, sizeof(szCacheFile), "attach.txt")) MonitorSetAttachCache(szCacheFile);
+	if (DataFilePath(szCacheFile, sizeof(szCacheFile), "curves.txt")) MonitorSetCurveFile(szCacheFile);	// Optional, how the master control maps to each monitor
+	if (!DataFilePath(gszSnapshotFile, sizeof(gszSnapshotFile), "monitors.bin")) gszSnapshotFile[0] = '\0';
+	TraceEnd(trace, "app", "LoadCaches", NULL, 0);
+
+	if (gbHeadless)
+	{
+		return Headless();
+	}
+
+	// Failed writes are retried, and the final value of some slider drags is read back: a monitor that did not apply it has its slider corrected
+	monitor_policy_t policy;
+	MonitorGetPolicy(&policy);
+	policy.verifyPercent = 25;
+	MonitorSetPolicy(&policy);
+
 	// Initialize COM
 	HRESULT hr;
+	trace = TraceBegin();
 	hr = CoInitializeEx(0, COINIT_MULTITHREADED);
 	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed CoInitializeEx().\n"); return 1; }
 	hr = CoInitializeSecurity(NULL, -1, NULL, NULL, RPC_C_AUTHN_LEVEL_DEFAULT, RPC_C_IMP_LEVEL_IMPERSONATE, NULL, EOAC_NONE, NULL);
 	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed CoInitializeSecurity().\n"); return 2; }
+	TraceEnd(trace, "app", "CoInitialize", NULL, (int)hr);
+
+	// Brightness backends, in order of preference: DDC/CI monitors, with WMI control attached (generally for internal panels)
+	MonitorRegisterBackend(&ddcciBackend);
+	MonitorRegisterBackend(&wmiBackend);
+	MonitorSetWatching(true);	// e.g. laptop brightness keys: an open window follows them, and reads do not query WMI
 
 	// Initialize common controls
+	trace = TraceBegin();
 	INITCOMMONCONTROLSEX icce = {0};
 	icce.dwSize = sizeof(icce);
 	icce.dwICC = ICC_STANDARD_CLASSES | ICC_BAR_CLASSES;
@@ -929,6 +1353,7 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 	{
 		fprintf(stderr, "WARNING: Failed InitCommonControlsEx().\n");
 	}
+	TraceEnd(trace, "app", "InitCommonControlsEx", NULL, 0);
 
 	const TCHAR szWindowClass[] = TITLE;
 	WNDCLASSEX wcex = {sizeof(wcex)};
@@ -946,6 +1371,7 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 	DWORD dwStyle = 0; // WS_CLIPSIBLINGS | WS_CLIPCHILDREN | WS_POPUP | WS_VISIBLE | WS_THICKFRAME
 	DWORD dwStyleEx = WS_EX_CONTROLPARENT | WS_EX_TOOLWINDOW | WS_EX_TOPMOST; // (WS_EX_TOOLWINDOW) & ~(WS_EX_APPWINDOW);
 
+	trace = TraceBegin();
 	HWND hWnd = CreateWindowEx(dwStyleEx, szWindowClass, szTitle, dwStyle, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, NULL, NULL, ghInstance, NULL);
 
 	// Remove caption
@@ -957,9 +1383,11 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 	SystemParametersInfo(SPI_GETNONCLIENTMETRICS, ncm.cbSize, &ncm, 0);
 	hDlgFont = CreateFontIndirect(&(ncm.lfMessageFont));
 	SendMessage(hWnd, WM_SETFONT, (WPARAM)hDlgFont, MAKELPARAM(FALSE, 0));
+	TraceEnd(trace, "app", "CreateWindow", NULL, hWnd != NULL ? 1 : 0);
 
 	ghWndMain = hWnd;
 	if (!hWnd) { return -1; }
+	MonitorSetCorrectedCallback(BrightnessRefreshed, ghWndMain);
 
 	HideWindow();  // nCmdShow
 
@@ -1012,7 +1440,16 @@ int run(int argc, TCHAR *argv[], HINSTANCE hInstance, BOOL hasConsole)
 		}
 	}
 
+	// Wait for any background enumeration, and keep the last brightness for the next start
+	trace = TraceBegin();
+	MonitorsEnumerated();
+	if (gszSnapshotFile[0] != '\0') MonitorListSave(monitorList, gszSnapshotFile);
+	MonitorListDestroy(monitorList);
+	monitorList = NULL;
+	MonitorCleanup();
 	CoUninitialize();
+	TraceEnd(trace, "app", "Cleanup", NULL, 0);
+	TraceStop();
 
 	return 0;
 }
@@ -44,14 +44,14 @@ CALL "%VCVARSALL%" %ARCH%
 :BUILD
 SET NOLOGO=/nologo
 ECHO Compiling...
-cl %NOLOGO% -c /EHsc /DUNICODE /D_UNICODE /Tc"brightly.c" /Tc"monitor.c"
+cl %NOLOGO% -c /EHsc /DUNICODE /D_UNICODE /Tc"brightly.c" /Tc"monitor.c" /Tc"backend_ddcci.c" /Tc"backend_wmi.c" /Tc"backend_sim.c" /Tc"platform.c" /Tc"vcp.c" /Tc"edid.c" /Tc"mccs.c" /Tc"snapshot.c" /Tc"ddc.c" /Tc"ddc_fake.c" /Tc"trace.c" /Tc"histogram.c" /Tc"lookup.c" /Tc"json.c" /Tc"headless.c"
 IF ERRORLEVEL 1 GOTO ERROR
 ECHO Resources...
 rc %NOLOGO% brightly.rc
 IF ERRORLEVEL 1 GOTO ERROR
 ECHO Linking...
 rem /manifest:embed  -- now external .manifest is included in .rc file
-link %NOLOGO% /out:brightly.exe brightly brightly.res monitor /subsystem:windows
+link %NOLOGO% /out:brightly.exe brightly brightly.res monitor backend_ddcci backend_wmi backend_sim platform vcp edid mccs snapshot ddc ddc_fake trace histogram lookup json headless /subsystem:windows
 IF ERRORLEVEL 1 GOTO ERROR
 ECHO Done: V%VER%
 IF DEFINED INTERACTIVE_BUILD COLOR 2F & PAUSE & COLOR
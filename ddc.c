@@ -0,0 +1,270 @@
+// Monitor Brightness - DDC/CI Protocol
+// Dan Jackson, 2020.
+
+// DDC/CI (VESA DDC/CI 1.1) over a raw I2C transport, for platforms without a monitor configuration API (e.g. Linux /dev/i2c-N).
+// Requests are written to address 0x37: source 0x51, 0x80 | length, payload, checksum (XOR including the destination 0x6E).
+// Replies are read from the same address: source 0x6E, 0x80 | length, payload, checksum (XOR including the virtual host address 0x50).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "edid.h"
+#include "vcp.h"
+#include "ddc.h"
+
+#define DDC_CAPABILITIES_ATTEMPTS 3		// Each capabilities fragment is retried after a NAK or corrupt reply (once the bus has been idle for DDC_RETRY_DELAY)
+#define DDC_MAX_TRANSPORTS 32
+#define DDC_MAX_CAPABILITIES 4096
+
+#define DDC_GET_VCP 0x01
+#define DDC_GET_VCP_REPLY 0x02
+#define DDC_SET_VCP 0x03
+#define DDC_CAPABILITIES_REQUEST 0xF3
+#define DDC_CAPABILITIES_REPLY 0xE3
+
+typedef struct
+{
+	backend_t backend;
+	ddc_list_t list;
+	void *context;
+} ddc_state_t;
+
+typedef struct
+{
+	backend_device_t base;
+	ddc_transport_t *transport;
+} ddc_device_t;
+
+static void DdcDelay(ddc_transport_t *transport, int microseconds)
+{
+	if (transport->timeScale > 0) PlatformSleepMicroseconds((uint64_t)(microseconds * transport->timeScale));
+}
+
+static bool DdcRequest(ddc_transport_t *transport, const uint8_t *payload, size_t length)
+{
+	uint8_t message[DDC_MAX_MESSAGE];
+	if (length + 3 > sizeof(message)) return false;
+	message[0] = 0x51;
+	message[1] = (uint8_t)(0x80 | length);
+	memcpy(message + 2, payload, length);
+	uint8_t checksum = DDC_ADDRESS_DDCCI << 1;
+	for (size_t i = 0; i < length + 2; i++) checksum ^= message[i];
+	message[length + 2] = checksum;
+	return transport->write(transport, DDC_ADDRESS_DDCCI, message, length + 3);
+}
+
+// Read a reply, returns the payload length (0 for a null message), or -1 for a NAK or an invalid reply
+static int DdcReply(ddc_transport_t *transport, uint8_t *payload, size_t size)
+{
+	uint8_t message[DDC_MAX_MESSAGE];
+	if (!transport->read(transport, DDC_ADDRESS_DDCCI, message, sizeof(message))) return -1;
+	if (message[0] != (DDC_ADDRESS_DDCCI << 1) || (message[1] & 0x80) == 0) return -1;
+	size_t length = message[1] & 0x7f;
+	if (length + 3 > sizeof(message) || length > size) return -1;
+	uint8_t checksum = 0x50;
+	for (size_t i = 0; i < length + 2; i++) checksum ^= message[i];
+	if (checksum != message[length + 2]) return -1;
+	memcpy(payload, message + 2, length);
+	return (int)length;
+}
+
+// Request and read the reply, making up to 'attempts' exchanges while the reply is NAKed or invalid
+static int DdcExchange(ddc_transport_t *transport, const uint8_t *request, size_t requestLength, int delay, uint8_t *reply, size_t replySize, int attempts)
+{
+	int length = -1;
+	for (int attempt = 0; attempt < attempts && length < 0; attempt++)
+	{
+		if (attempt > 0) DdcDelay(transport, DDC_RETRY_DELAY);
+		if (!DdcRequest(transport, request, requestLength)) continue;
+		DdcDelay(transport, delay);
+		length = DdcReply(transport, reply, replySize);
+	}
+	return length;
+}
+
+bool DdcReadEdid(ddc_transport_t *transport, uint8_t *data, size_t length)
+{
+	uint8_t offset = 0;
+	if (length < EDID_BLOCK_LENGTH) return false;
+	if (!transport->write(transport, DDC_ADDRESS_EDID, &offset, 1)) return false;
+	return transport->read(transport, DDC_ADDRESS_EDID, data, EDID_BLOCK_LENGTH);
+}
+
+// VCP commands are a single exchange: a failure is retried (if at all) by the caller's policy (see monitor_policy_t), so retries are not multiplied across layers
+bool DdcGetVcp(ddc_transport_t *transport, uint8_t code, int *current, int *maximum)
+{
+	uint8_t request[2] = { DDC_GET_VCP, code };
+	uint8_t reply[DDC_MAX_MESSAGE];
+	transport->unsupported = false;
+	int length = DdcExchange(transport, request, sizeof(request), DDC_REPLY_DELAY, reply, sizeof(reply), 1);
+	if (length != 8 || reply[0] != DDC_GET_VCP_REPLY || reply[2] != code) return false;
+	if (reply[1] != 0) { transport->unsupported = true; return false; }	// Unsupported VCP code
+	*maximum = (reply[4] << 8) | reply[5];
+	*current = (reply[6] << 8) | reply[7];
+	return true;
+}
+
+bool DdcSetVcp(ddc_transport_t *transport, uint8_t code, int value)
+{
+	uint8_t request[4] = { DDC_SET_VCP, code, (uint8_t)(value >> 8), (uint8_t)value };
+	return DdcRequest(transport, request, sizeof(request));
+}
+
+// The capabilities string is read once when a monitor is first probed (outside the read/write policy), so a failed fragment is retried here rather than restarting the whole string
+bool DdcCapabilities(ddc_transport_t *transport, char *buffer, size_t size)
+{
+	size_t offset = 0;
+	for (;;)
+	{
+		uint8_t request[3] = { DDC_CAPABILITIES_REQUEST, (uint8_t)(offset >> 8), (uint8_t)offset };
+		uint8_t reply[DDC_MAX_MESSAGE];
+		int length = DdcExchange(transport, request, sizeof(request), DDC_CAPABILITIES_DELAY, reply, sizeof(reply), DDC_CAPABILITIES_ATTEMPTS);
+		if (length < 3 || reply[0] != DDC_CAPABILITIES_REPLY || ((reply[1] << 8) | reply[2]) != (int)offset) return false;
+
+		// An empty fragment ends the string
+		size_t count = (size_t)length - 3;
+		if (count == 0) break;
+		if (offset + count >= size || offset + count > DDC_MAX_CAPABILITIES) return false;
+		memcpy(buffer + offset, reply + 3, count);
+		offset += count;
+	}
+	buffer[offset] = '\0';
+	return offset > 0;
+}
+
+static backend_device_t *DdcEnumerate(backend_t *backend, backend_device_t **existing, int existingCount)
+{
+	ddc_state_t *state = (ddc_state_t *)backend->context;
+	backend_device_t *list = NULL, *last = NULL;
+
+	ddc_transport_t *transports[DDC_MAX_TRANSPORTS];
+	int count = state->list(state->context, transports, DDC_MAX_TRANSPORTS);
+	for (int t = 0; t < count; t++)
+	{
+		ddc_transport_t *transport = transports[t];
+
+		// Keep an existing device...
+		ddc_device_t *device = NULL;
+		for (int i = 0; i < existingCount; i++)
+		{
+			if (existing[i] != NULL && strcmp(((ddc_device_t *)existing[i])->transport->name, transport->name) == 0)
+			{
+				device = (ddc_device_t *)existing[i];
+				existing[i] = NULL;
+				break;
+			}
+		}
+
+		if (device != NULL)
+		{
+			transport->close(transport);
+		}
+		else
+		{
+			// ...or add a new one, if a display responds with an EDID on the bus
+			uint8_t data[EDID_BLOCK_LENGTH];
+			edid_info_t info;
+			if (!DdcReadEdid(transport, data, sizeof(data)) || !EdidParse(data, sizeof(data), &info))
+			{
+				transport->close(transport);
+				continue;
+			}
+			device = (ddc_device_t *)calloc(1, sizeof(ddc_device_t));
+			device->base.backend = backend;
+			device->transport = transport;
+			snprintf(device->base.key, sizeof(device->base.key), "%s", transport->name);
+			snprintf(device->base.bus, sizeof(device->base.bus), "%s", transport->name);
+			EdidIdentity(&info, device->base.identity, sizeof(device->base.identity));
+			EdidDescription(&info, device->base.description, BACKEND_DESCRIPTION_LENGTH);
+		}
+
+		device->base.next = NULL;
+		if (last == NULL) list = &device->base; else last->next = &device->base;
+		last = &device->base;
+	}
+
+	return list;
+}
+
+static bool DdcBackendVcpGet(backend_device_t *device, uint8_t code, int *current, int *maximum)
+{
+	ddc_transport_t *transport = ((ddc_device_t *)device)->transport;
+	bool success = DdcGetVcp(transport, code, current, maximum);
+	device->unsupported = transport->unsupported;
+	return success;
+}
+
+static bool DdcBackendVcpSet(backend_device_t *device, uint8_t code, int value)
+{
+	return DdcSetVcp(((ddc_device_t *)device)->transport, code, value);
+}
+
+static bool DdcBackendCapabilities(backend_device_t *device, backend_caps_t *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+	if (!DdcBackendVcpGet(device, VCP_BRIGHTNESS, &caps->current, &caps->maximum)) return false;
+	caps->hasBrightness = true;
+	return true;
+}
+
+static bool DdcBackendGet(backend_device_t *device, int *value)
+{
+	int maximum;
+	return DdcBackendVcpGet(device, VCP_BRIGHTNESS, value, &maximum);
+}
+
+static bool DdcBackendSet(backend_device_t *device, int value)
+{
+	return DdcBackendVcpSet(device, VCP_BRIGHTNESS, value);
+}
+
+static bool DdcBackendCapabilitiesString(backend_device_t *device, char *buffer, size_t size)
+{
+	return DdcCapabilities(((ddc_device_t *)device)->transport, buffer, size);
+}
+
+static void DdcBackendClose(backend_device_t *device)
+{
+	ddc_device_t *ddcDevice = (ddc_device_t *)device;
+	ddcDevice->transport->close(ddcDevice->transport);
+	free(ddcDevice);
+}
+
+static void DdcBackendDump(backend_device_t *device, FILE *file)
+{
+	ddc_device_t *ddcDevice = (ddc_device_t *)device;
+	fprintf(file, "DDC: transport=%s\n", ddcDevice->transport->name);	// /dev/i2c-5
+	fprintf(file, "DDC: identity=%s\n", device->identity);				// ACM-1234-0001E240
+}
+
+backend_t *DdcBackendCreate(const char *name, ddc_list_t list, void *context)
+{
+	ddc_state_t *state = (ddc_state_t *)calloc(1, sizeof(ddc_state_t));
+	if (state == NULL) return NULL;
+	state->list = list;
+	state->context = context;
+
+	state->backend.name = name;
+	state->backend.flags = 0;
+	state->backend.readDeadline = 250;
+	state->backend.commandInterval = 50000;		// DDC/CI: 50 ms between commands
+	state->backend.context = state;
+	state->backend.enumerate = DdcEnumerate;
+	state->backend.capabilities = DdcBackendCapabilities;
+	state->backend.get = DdcBackendGet;
+	state->backend.set = DdcBackendSet;
+	state->backend.close = DdcBackendClose;
+	state->backend.dump = DdcBackendDump;
+	state->backend.shutdown = NULL;
+	state->backend.vcpGet = DdcBackendVcpGet;
+	state->backend.vcpSet = DdcBackendVcpSet;
+	state->backend.capabilitiesString = DdcBackendCapabilitiesString;
+	return &state->backend;
+}
+
+void DdcBackendDestroy(backend_t *backend)
+{
+	free(backend->context);
+}
@@ -0,0 +1,56 @@
+// Monitor Brightness - DDC/CI Protocol
+// Dan Jackson, 2020.
+
+#ifndef _DDC_H
+#define _DDC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "backend.h"
+
+#define DDC_ADDRESS_EDID 0x50			// 7-bit I2C address of the EDID
+#define DDC_ADDRESS_DDCCI 0x37			// 7-bit I2C address of DDC/CI (0x6E/0x6F as 8-bit)
+
+#define DDC_REPLY_DELAY 40000			// Microseconds between a request and reading its reply
+#define DDC_CAPABILITIES_DELAY 50000	// Microseconds between a capabilities request and reading its reply
+#define DDC_RETRY_DELAY 50000			// Microseconds after a NAK or invalid reply before the request is sent again (the DDC/CI command interval)
+#define DDC_MAX_MESSAGE 40				// Source, length, up to 35 bytes of payload (capabilities fragment), checksum
+#define DDC_NAME_LENGTH 64
+
+// Raw I2C access to a display's bus (e.g. /dev/i2c-N, or an in-process fake monitor)
+typedef struct _ddc_transport_t
+{
+	char name[DDC_NAME_LENGTH];			// Bus, e.g. /dev/i2c-5
+	double timeScale;					// Applied to the protocol delays: 1.0 for real devices, less for a fake one
+	bool unsupported;					// Set by DdcGetVcp(): the monitor replied that the feature is not supported (rather than NAKing or replying invalidly)
+	void *context;
+	bool (*write)(struct _ddc_transport_t *transport, uint8_t address, const uint8_t *data, size_t length);
+	bool (*read)(struct _ddc_transport_t *transport, uint8_t address, uint8_t *data, size_t length);
+	void (*close)(struct _ddc_transport_t *transport);
+} ddc_transport_t;
+
+// Protocol
+bool DdcReadEdid(ddc_transport_t *transport, uint8_t *data, size_t length);	// Base block (at least 128 bytes)
+bool DdcGetVcp(ddc_transport_t *transport, uint8_t code, int *current, int *maximum);
+bool DdcSetVcp(ddc_transport_t *transport, uint8_t code, int value);
+bool DdcCapabilities(ddc_transport_t *transport, char *buffer, size_t size);	// Capabilities string, read in fragments
+
+// Backend over the transports found by 'list' on each enumeration (transports for already-known buses are closed again)
+typedef int (*ddc_list_t)(void *context, ddc_transport_t **transports, int maxCount);
+backend_t *DdcBackendCreate(const char *name, ddc_list_t list, void *context);
+void DdcBackendDestroy(backend_t *backend);
+
+#if defined(__linux__)
+// ddc_i2c.c: only the i2c-N buses linked from a DRM connector are listed (not e.g. SMBus or sensor adapters, which must not be probed)
+typedef struct
+{
+	const char *drmRoot;				// NULL for /sys/class/drm
+	const char *deviceRoot;				// NULL for /dev
+} ddc_i2c_roots_t;
+int DdcI2cList(void *context, ddc_transport_t **transports, int maxCount);	// context is a ddc_i2c_roots_t (NULL for the defaults)
+ddc_transport_t *DdcI2cOpen(const char *path);
+#endif
+
+#endif
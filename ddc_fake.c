@@ -0,0 +1,279 @@
+// Monitor Brightness - Fake DDC/CI Monitor
+// Dan Jackson, 2020.
+
+// An in-process I2C transport that behaves as a DDC/CI monitor: it validates the framing and checksums of each request and answers from
+// its own VCP table, EDID and capabilities string, with configurable reply delays, NAKs and corrupt replies.
+// Used to exercise and measure the whole DDC/CI protocol stack without a display attached.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "edid.h"
+#include "vcp.h"
+#include "ddc_fake.h"
+
+#define DDC_FAKE_CAPABILITIES_LENGTH 512
+#define DDC_FAKE_FRAGMENT 32			// Maximum capabilities bytes per reply
+
+struct _ddc_fake_t
+{
+	ddc_fake_config_t config;
+	char bus[DDC_NAME_LENGTH];
+	char capabilities[DDC_FAKE_CAPABILITIES_LENGTH];
+	double timeScale;
+	platform_mutex_t lock;
+	bool connected;
+	uint32_t random;
+	uint8_t edid[EDID_BLOCK_LENGTH];
+	int edidOffset;
+	int features[256];
+	int featureMaximum[256];
+	uint8_t reply[DDC_MAX_MESSAGE];		// Pending reply payload
+	int replyLength;					// -1 if none (a null message is read)
+	uint64_t replyReady;				// Time the reply may be read
+	ddc_fake_stats_t stats;
+};
+
+// xorshift32
+static uint32_t DdcFakeRandom(ddc_fake_t *fake)
+{
+	uint32_t x = fake->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	fake->random = x;
+	return x;
+}
+
+// (must hold the lock)
+static bool DdcFakeNak(ddc_fake_t *fake)
+{
+	if (!fake->connected || (fake->config.nakPercent > 0 && (int)(DdcFakeRandom(fake) % 100) < fake->config.nakPercent))
+	{
+		fake->stats.naks++;
+		return true;
+	}
+	return false;
+}
+
+static void DdcFakeTransfer(ddc_fake_t *fake)
+{
+	if (fake->config.transferLatency > 0 && fake->timeScale > 0) PlatformSleepMicroseconds((uint64_t)(fake->config.transferLatency * fake->timeScale));
+}
+
+// Handle a request (must hold the lock)
+static void DdcFakeRequest(ddc_fake_t *fake, const uint8_t *data, size_t length)
+{
+	// Framing and checksum (including the destination address)
+	size_t payloadLength = (length >= 2) ? (data[1] & 0x7f) : 0;
+	uint8_t checksum = DDC_ADDRESS_DDCCI << 1;
+	for (size_t i = 0; i < length - 1 && length >= 2; i++) checksum ^= data[i];
+	if (length < 3 || data[0] != 0x51 || (data[1] & 0x80) == 0 || payloadLength + 3 != length || checksum != data[length - 1] || payloadLength == 0)
+	{
+		fake->stats.badRequests++;
+		fake->replyLength = -1;
+		return;
+	}
+	fake->stats.requests++;
+
+	const uint8_t *payload = data + 2;
+	fake->replyLength = -1;
+	fake->replyReady = PlatformTimeMicroseconds() + (uint64_t)(fake->config.responseDelay * fake->timeScale);
+	if (payload[0] == 0x01 && payloadLength == 2)
+	{
+		// Get VCP feature
+		uint8_t code = payload[1];
+		bool supported = fake->featureMaximum[code] > 0;
+		int maximum = fake->featureMaximum[code], current = fake->features[code];
+		uint8_t reply[8] = { 0x02, supported ? 0x00 : 0x01, code, 0x00, (uint8_t)(maximum >> 8), (uint8_t)maximum, (uint8_t)(current >> 8), (uint8_t)current };
+		memcpy(fake->reply, reply, sizeof(reply));
+		fake->replyLength = sizeof(reply);
+	}
+	else if (payload[0] == 0x03 && payloadLength == 4)
+	{
+		// Set VCP feature (no reply)
+		uint8_t code = payload[1];
+		int value = (payload[2] << 8) | payload[3];
+		if (fake->featureMaximum[code] > 0)
+		{
+			fake->features[code] = (value > fake->featureMaximum[code]) ? fake->featureMaximum[code] : value;
+			fake->stats.sets++;
+		}
+	}
+	else if (payload[0] == 0xF3 && payloadLength == 3)
+	{
+		// Capabilities request: fragment from the offset
+		int offset = (payload[1] << 8) | payload[2];
+		int total = (int)strlen(fake->capabilities);
+		int count = (offset < total) ? total - offset : 0;
+		if (count > DDC_FAKE_FRAGMENT) count = DDC_FAKE_FRAGMENT;
+		fake->reply[0] = 0xE3;
+		fake->reply[1] = payload[1];
+		fake->reply[2] = payload[2];
+		memcpy(fake->reply + 3, fake->capabilities + offset, (size_t)count);
+		fake->replyLength = 3 + count;
+	}
+}
+
+static bool DdcFakeWrite(ddc_transport_t *transport, uint8_t address, const uint8_t *data, size_t length)
+{
+	ddc_fake_t *fake = (ddc_fake_t *)transport->context;
+	DdcFakeTransfer(fake);
+	PlatformMutexLock(&fake->lock);
+	bool success = !DdcFakeNak(fake);
+	if (success && address == DDC_ADDRESS_EDID && length >= 1) fake->edidOffset = data[0];
+	else if (success && address == DDC_ADDRESS_DDCCI) DdcFakeRequest(fake, data, length);
+	else success = false;
+	PlatformMutexUnlock(&fake->lock);
+	return success;
+}
+
+static bool DdcFakeRead(ddc_transport_t *transport, uint8_t address, uint8_t *data, size_t length)
+{
+	ddc_fake_t *fake = (ddc_fake_t *)transport->context;
+	DdcFakeTransfer(fake);
+	PlatformMutexLock(&fake->lock);
+	bool success = !DdcFakeNak(fake);
+	if (success && address == DDC_ADDRESS_EDID)
+	{
+		for (size_t i = 0; i < length; i++) data[i] = fake->edid[(fake->edidOffset + i) % EDID_BLOCK_LENGTH];
+	}
+	else if (success && address == DDC_ADDRESS_DDCCI)
+	{
+		if (fake->replyLength >= 0 && PlatformTimeMicroseconds() < fake->replyReady)
+		{
+			fake->stats.earlyReads++;
+			success = false;
+		}
+		else
+		{
+			// The pending reply, or a null message
+			uint8_t message[DDC_MAX_MESSAGE] = {0};
+			int payloadLength = (fake->replyLength > 0) ? fake->replyLength : 0;
+			message[0] = DDC_ADDRESS_DDCCI << 1;
+			message[1] = (uint8_t)(0x80 | payloadLength);
+			memcpy(message + 2, fake->reply, (size_t)payloadLength);
+			uint8_t checksum = 0x50;
+			for (int i = 0; i < payloadLength + 2; i++) checksum ^= message[i];
+			if (fake->config.checksumErrorPercent > 0 && (int)(DdcFakeRandom(fake) % 100) < fake->config.checksumErrorPercent)
+			{
+				checksum ^= 0xff;
+				fake->stats.checksumErrors++;
+			}
+			message[payloadLength + 2] = checksum;
+			memset(data, 0, length);
+			memcpy(data, message, (length < sizeof(message)) ? length : sizeof(message));
+			fake->replyLength = -1;
+		}
+	}
+	else
+	{
+		success = false;
+	}
+	PlatformMutexUnlock(&fake->lock);
+	return success;
+}
+
+static void DdcFakeClose(ddc_transport_t *transport)
+{
+	free(transport);
+}
+
+ddc_fake_t *DdcFakeCreate(const ddc_fake_config_t *config, double timeScale)
+{
+	ddc_fake_t *fake = (ddc_fake_t *)calloc(1, sizeof(ddc_fake_t));
+	if (fake == NULL) return NULL;
+	fake->config = *config;
+	fake->timeScale = timeScale;
+	PlatformMutexInit(&fake->lock);
+	fake->connected = true;
+	fake->random = config->seed | 1;
+	fake->replyLength = -1;
+	snprintf(fake->bus, sizeof(fake->bus), "%s", (config->bus != NULL) ? config->bus : "fake");
+	fake->config.bus = fake->bus;
+
+	edid_info_t info = {0};
+	snprintf(info.manufacturer, sizeof(info.manufacturer), "%s", (config->manufacturer != NULL) ? config->manufacturer : "FAK");
+	info.product = config->product;
+	info.serial = config->serial;
+	if (config->name != NULL) snprintf(info.name, sizeof(info.name), "%s", config->name);
+	EdidBuild(&info, fake->edid);
+
+	fake->featureMaximum[VCP_BRIGHTNESS] = (config->maximum > 0) ? config->maximum : 100;
+	fake->features[VCP_BRIGHTNESS] = config->brightness;
+	fake->featureMaximum[VCP_CONTRAST] = 100;
+	fake->features[VCP_CONTRAST] = 50;
+	fake->featureMaximum[VCP_VOLUME] = 100;
+	fake->features[VCP_VOLUME] = 30;
+	fake->featureMaximum[VCP_POWER_MODE] = 5;
+	fake->features[VCP_POWER_MODE] = 1;
+
+	if (config->capabilities != NULL) snprintf(fake->capabilities, sizeof(fake->capabilities), "%s", config->capabilities);
+	else snprintf(fake->capabilities, sizeof(fake->capabilities), "(prot(monitor)type(lcd)model(%s)cmds(01 02 03 07 0C F3)vcp(10 12 62 D6(01 04 05))mccs_ver(2.2))", (config->name != NULL) ? config->name : "FAKE");
+	fake->config.capabilities = fake->capabilities;
+	return fake;
+}
+
+void DdcFakeDestroy(ddc_fake_t *fake)
+{
+	PlatformMutexDestroy(&fake->lock);
+	free(fake);
+}
+
+ddc_transport_t *DdcFakeOpen(ddc_fake_t *fake)
+{
+	ddc_transport_t *transport = (ddc_transport_t *)calloc(1, sizeof(ddc_transport_t));
+	if (transport == NULL) return NULL;
+	snprintf(transport->name, sizeof(transport->name), "%s", fake->bus);
+	transport->timeScale = fake->timeScale;
+	transport->context = fake;
+	transport->write = DdcFakeWrite;
+	transport->read = DdcFakeRead;
+	transport->close = DdcFakeClose;
+	return transport;
+}
+
+int DdcFakeList(void *context, ddc_transport_t **transports, int maxCount)
+{
+	ddc_fake_t **fakes = (ddc_fake_t **)context;
+	int count = 0;
+	for (int i = 0; fakes[i] != NULL && count < maxCount; i++)
+	{
+		ddc_transport_t *transport = DdcFakeOpen(fakes[i]);
+		if (transport != NULL) transports[count++] = transport;
+	}
+	return count;
+}
+
+void DdcFakeSetConnected(ddc_fake_t *fake, bool connected)
+{
+	PlatformMutexLock(&fake->lock);
+	fake->connected = connected;
+	PlatformMutexUnlock(&fake->lock);
+}
+
+void DdcFakeSetFeature(ddc_fake_t *fake, uint8_t code, int value, int maximum)
+{
+	PlatformMutexLock(&fake->lock);
+	fake->features[code] = value;
+	fake->featureMaximum[code] = maximum;
+	PlatformMutexUnlock(&fake->lock);
+}
+
+bool DdcFakeGetFeature(ddc_fake_t *fake, uint8_t code, int *value)
+{
+	PlatformMutexLock(&fake->lock);
+	bool supported = fake->featureMaximum[code] > 0;
+	*value = fake->features[code];
+	PlatformMutexUnlock(&fake->lock);
+	return supported;
+}
+
+void DdcFakeStats(ddc_fake_t *fake, ddc_fake_stats_t *stats)
+{
+	PlatformMutexLock(&fake->lock);
+	*stats = fake->stats;
+	PlatformMutexUnlock(&fake->lock);
+}
@@ -0,0 +1,51 @@
+// Monitor Brightness - Fake DDC/CI Monitor
+// Dan Jackson, 2020.
+
+#ifndef _DDC_FAKE_H
+#define _DDC_FAKE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ddc.h"
+
+typedef struct _ddc_fake_t ddc_fake_t;
+
+// Emulated monitor (times are in microseconds, scaled by the time scale given at creation)
+typedef struct
+{
+	const char *bus;					// Transport name, e.g. "fake-0"
+	const char *manufacturer;			// EDID identification, e.g. "ACM"
+	uint16_t product;
+	uint32_t serial;
+	const char *name;					// EDID display name, NULL for none
+	const char *capabilities;			// MCCS capabilities string, NULL for one generated from the supported features
+	int brightness;
+	int maximum;
+	int responseDelay;					// Time before a reply is ready (reading earlier is NAKed)
+	int transferLatency;				// Time taken by each I2C read or write
+	int nakPercent;						// Chance of each read or write being NAKed
+	int checksumErrorPercent;			// Chance of each reply having a bad checksum
+	unsigned int seed;
+} ddc_fake_config_t;
+
+typedef struct
+{
+	int requests;						// Valid requests received
+	int badRequests;					// Requests with a bad checksum or framing (ignored, as by a monitor)
+	int sets;
+	int naks;
+	int earlyReads;						// Reads before the reply was ready (NAKed)
+	int checksumErrors;					// Replies sent with a corrupt checksum
+} ddc_fake_stats_t;
+
+ddc_fake_t *DdcFakeCreate(const ddc_fake_config_t *config, double timeScale);
+void DdcFakeDestroy(ddc_fake_t *fake);
+ddc_transport_t *DdcFakeOpen(ddc_fake_t *fake);	// New transport to the monitor (closing it does not destroy the monitor)
+int DdcFakeList(void *context, ddc_transport_t **transports, int maxCount);	// ddc_list_t for DdcBackendCreate(), context is a NULL-terminated array of ddc_fake_t *
+void DdcFakeSetConnected(ddc_fake_t *fake, bool connected);	// A disconnected monitor NAKs everything
+void DdcFakeSetFeature(ddc_fake_t *fake, uint8_t code, int value, int maximum);	// A maximum of 0 is unsupported
+bool DdcFakeGetFeature(ddc_fake_t *fake, uint8_t code, int *value);
+void DdcFakeStats(ddc_fake_t *fake, ddc_fake_stats_t *stats);
+
+#endif
@@ -0,0 +1,132 @@
+// Monitor Brightness - DDC/CI Linux I2C Transport
+// Dan Jackson, 2020.
+
+// Displays' DDC buses are exposed by the graphics drivers as /dev/i2c-N (requires the i2c-dev module, and read/write access, e.g. the i2c group).
+// Other adapters (SMBus, sensors, EEPROMs) also appear there, and writing to them can upset the device, so only the buses a DRM connector links to
+// (its ddc link, or an i2c-N entry for a DisplayPort AUX channel) are listed.
+
+#if defined(__linux__)
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "ddc.h"
+
+#define DDC_I2C_ROOT "/dev"
+#define DDC_I2C_DRM_ROOT "/sys/class/drm"
+#define DDC_I2C_PATH_LENGTH 512
+
+typedef struct
+{
+	ddc_transport_t transport;
+	int fd;
+	int address;						// Current I2C_SLAVE address, -1 if not set
+} ddc_i2c_t;
+
+static bool DdcI2cAddress(ddc_i2c_t *i2c, uint8_t address)
+{
+	if (i2c->address == address) return true;
+	if (ioctl(i2c->fd, I2C_SLAVE, (unsigned long)address) < 0) return false;
+	i2c->address = address;
+	return true;
+}
+
+static bool DdcI2cWrite(ddc_transport_t *transport, uint8_t address, const uint8_t *data, size_t length)
+{
+	ddc_i2c_t *i2c = (ddc_i2c_t *)transport->context;
+	if (!DdcI2cAddress(i2c, address)) return false;
+	return write(i2c->fd, data, length) == (ssize_t)length;
+}
+
+static bool DdcI2cRead(ddc_transport_t *transport, uint8_t address, uint8_t *data, size_t length)
+{
+	ddc_i2c_t *i2c = (ddc_i2c_t *)transport->context;
+	if (!DdcI2cAddress(i2c, address)) return false;
+	return read(i2c->fd, data, length) == (ssize_t)length;
+}
+
+static void DdcI2cClose(ddc_transport_t *transport)
+{
+	ddc_i2c_t *i2c = (ddc_i2c_t *)transport->context;
+	close(i2c->fd);
+	free(i2c);
+}
+
+ddc_transport_t *DdcI2cOpen(const char *path)
+{
+	int fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) return NULL;
+	ddc_i2c_t *i2c = (ddc_i2c_t *)calloc(1, sizeof(ddc_i2c_t));
+	if (i2c == NULL) { close(fd); return NULL; }
+	i2c->fd = fd;
+	i2c->address = -1;
+	snprintf(i2c->transport.name, sizeof(i2c->transport.name), "%s", path);
+	i2c->transport.timeScale = 1.0;
+	i2c->transport.context = i2c;
+	i2c->transport.write = DdcI2cWrite;
+	i2c->transport.read = DdcI2cRead;
+	i2c->transport.close = DdcI2cClose;
+	return &i2c->transport;
+}
+
+// Whether a DRM connector (card<N>-<connector>) links to the bus: as its ddc adapter, or with the adapter in its directory
+static bool DdcI2cLinked(const char *drmRoot, const char *bus)
+{
+	bool linked = false;
+	DIR *dir = opendir(drmRoot);
+	if (dir == NULL) return false;
+	struct dirent *entry;
+	while (!linked && (entry = readdir(dir)) != NULL)
+	{
+		if (strncmp(entry->d_name, "card", 4) != 0 || strchr(entry->d_name, '-') == NULL) continue;
+		char path[DDC_I2C_PATH_LENGTH];
+		char target[DDC_I2C_PATH_LENGTH];
+		if (snprintf(path, sizeof(path), "%s/%s/ddc", drmRoot, entry->d_name) >= (int)sizeof(path)) continue;
+		ssize_t length = readlink(path, target, sizeof(target) - 1);
+		if (length > 0)
+		{
+			target[length] = '\0';
+			const char *name = strrchr(target, '/');
+			if (strcmp((name != NULL) ? name + 1 : target, bus) == 0) linked = true;
+		}
+		if (snprintf(path, sizeof(path), "%s/%s/%s", drmRoot, entry->d_name, bus) >= (int)sizeof(path)) continue;
+		if (access(path, F_OK) == 0) linked = true;
+	}
+	closedir(dir);
+	return linked;
+}
+
+int DdcI2cList(void *context, ddc_transport_t **transports, int maxCount)
+{
+	const ddc_i2c_roots_t *roots = (const ddc_i2c_roots_t *)context;
+	const char *root = (roots != NULL && roots->deviceRoot != NULL) ? roots->deviceRoot : DDC_I2C_ROOT;
+	const char *drmRoot = (roots != NULL && roots->drmRoot != NULL) ? roots->drmRoot : DDC_I2C_DRM_ROOT;
+	DIR *dir = opendir(root);
+	if (dir == NULL) return 0;
+	int count = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL && count < maxCount)
+	{
+		if (strncmp(entry->d_name, "i2c-", 4) != 0 || !DdcI2cLinked(drmRoot, entry->d_name)) continue;
+		char path[DDC_NAME_LENGTH];
+		size_t rootLength = strlen(root), nameLength = strlen(entry->d_name);
+		if (rootLength + nameLength + 2 > sizeof(path)) continue;
+		memcpy(path, root, rootLength);
+		path[rootLength] = '/';
+		memcpy(path + rootLength + 1, entry->d_name, nameLength + 1);
+		ddc_transport_t *transport = DdcI2cOpen(path);
+		if (transport != NULL) transports[count++] = transport;
+	}
+	closedir(dir);
+	return count;
+}
+
+#endif
@@ -0,0 +1,131 @@
+// Monitor Brightness - EDID
+// Dan Jackson, 2020.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "edid.h"
+
+// Text from a display descriptor (terminated by a line feed, padded with spaces)
+static void EdidDescriptorText(const uint8_t *descriptor, char *text)
+{
+	int length = 0;
+	for (int i = 5; i < 18; i++)
+	{
+		char c = (char)descriptor[i];
+		if (c == '\n' || c == '\0') break;
+		text[length++] = (c >= 0x20 && c < 0x7f) ? c : '?';
+	}
+	while (length > 0 && text[length - 1] == ' ') length--;
+	text[length] = '\0';
+}
+
+bool EdidParse(const uint8_t *data, size_t length, edid_info_t *info)
+{
+	static const uint8_t header[8] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+
+	memset(info, 0, sizeof(*info));
+	if (data == NULL || length < EDID_BLOCK_LENGTH) return false;
+	if (memcmp(data, header, sizeof(header)) != 0) return false;
+
+	uint8_t checksum = 0;
+	for (int i = 0; i < EDID_BLOCK_LENGTH; i++) checksum += data[i];
+	if (checksum != 0) return false;
+
+	// Manufacturer PNP ID: three 5-bit letters, big-endian
+	uint16_t id = (uint16_t)((data[8] << 8) | data[9]);
+	info->manufacturer[0] = (char)('A' - 1 + ((id >> 10) & 0x1f));
+	info->manufacturer[1] = (char)('A' - 1 + ((id >> 5) & 0x1f));
+	info->manufacturer[2] = (char)('A' - 1 + (id & 0x1f));
+	info->manufacturer[3] = '\0';
+
+	info->product = (uint16_t)(data[10] | (data[11] << 8));
+	info->serial = (uint32_t)data[12] | ((uint32_t)data[13] << 8) | ((uint32_t)data[14] << 16) | ((uint32_t)data[15] << 24);
+
+	// Display descriptors
+	for (int offset = 54; offset <= 108; offset += 18)
+	{
+		const uint8_t *descriptor = data + offset;
+		if (descriptor[0] != 0 || descriptor[1] != 0 || descriptor[2] != 0) continue;	// Detailed timing
+		if (descriptor[3] == 0xfc) EdidDescriptorText(descriptor, info->name);
+		if (descriptor[3] == 0xff) EdidDescriptorText(descriptor, info->serialText);
+	}
+
+	return true;
+}
+
+// Text display descriptor (tag 0xfc name, 0xff serial)
+static void EdidBuildDescriptor(uint8_t *descriptor, uint8_t tag, const char *text)
+{
+	memset(descriptor, 0, 18);
+	descriptor[3] = tag;
+	int length = 0;
+	for (; text[length] != '\0' && length < 13; length++) descriptor[5 + length] = (uint8_t)text[length];
+	if (length < 13) descriptor[5 + length++] = '\n';
+	for (; length < 13; length++) descriptor[5 + length] = ' ';
+}
+
+void EdidBuild(const edid_info_t *info, uint8_t *data)
+{
+	static const uint8_t header[8] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+
+	memset(data, 0, EDID_BLOCK_LENGTH);
+	memcpy(data, header, sizeof(header));
+	uint16_t id = 0;
+	for (int i = 0; i < 3; i++) id = (uint16_t)((id << 5) | ((info->manufacturer[i] - 'A' + 1) & 0x1f));
+	data[8] = (uint8_t)(id >> 8);
+	data[9] = (uint8_t)id;
+	data[10] = (uint8_t)info->product;
+	data[11] = (uint8_t)(info->product >> 8);
+	for (int i = 0; i < 4; i++) data[12 + i] = (uint8_t)(info->serial >> (8 * i));
+	data[16] = 1;		// Week
+	data[17] = 30;		// Year (1990 + 30)
+	data[18] = 1;		// Version 1.4
+	data[19] = 4;
+
+	// Display descriptors (unused ones are dummy descriptors, tag 0x10)
+	int offset = 54;
+	if (info->name[0] != '\0') { EdidBuildDescriptor(data + offset, 0xfc, info->name); offset += 18; }
+	if (info->serialText[0] != '\0') { EdidBuildDescriptor(data + offset, 0xff, info->serialText); offset += 18; }
+	for (; offset <= 108; offset += 18) data[offset + 3] = 0x10;
+
+	uint8_t checksum = 0;
+	for (int i = 0; i < EDID_BLOCK_LENGTH - 1; i++) checksum += data[i];
+	data[EDID_BLOCK_LENGTH - 1] = (uint8_t)(0x100 - checksum);
+}
+
+void EdidIdentity(const edid_info_t *info, char *buffer, size_t size)
+{
+	if (info->serialText[0] != '\0')
+	{
+		// Serial descriptors may contain spaces
+		char serial[EDID_TEXT_LENGTH];
+		int length = 0;
+		for (const char *p = info->serialText; *p != '\0'; p++)
+		{
+			serial[length++] = (*p == ' ') ? '_' : *p;
+		}
+		serial[length] = '\0';
+		snprintf(buffer, size, "%s-%04X-%s", info->manufacturer, info->product, serial);
+	}
+	else
+	{
+		snprintf(buffer, size, "%s-%04X-%08X", info->manufacturer, info->product, (unsigned int)info->serial);
+	}
+}
+
+void EdidDescription(const edid_info_t *info, wchar_t *buffer, size_t count)
+{
+	if (count == 0) return;
+	char text[EDID_TEXT_LENGTH + 8];
+	if (info->name[0] != '\0') snprintf(text, sizeof(text), "%s", info->name);
+	else snprintf(text, sizeof(text), "%s %04X", info->manufacturer, info->product);
+
+	// The text is ASCII, so each character widens directly (a "%s" wide format is not portable: it is a wide string on MSVC)
+	size_t length = 0;
+	for (const char *p = text; *p != '\0' && length + 1 < count; p++)
+	{
+		buffer[length++] = (wchar_t)(unsigned char)*p;
+	}
+	buffer[length] = L'\0';
+}
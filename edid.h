@@ -0,0 +1,37 @@
+// Monitor Brightness - EDID
+// Dan Jackson, 2020.
+
+#ifndef _EDID_H
+#define _EDID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define EDID_IDENTITY_LENGTH 64
+#define EDID_TEXT_LENGTH 14
+#define EDID_BLOCK_LENGTH 128
+
+typedef struct
+{
+	char manufacturer[4];				// PNP ID, e.g. "ACM"
+	uint16_t product;
+	uint32_t serial;					// Numeric serial, often 0 (see serialText)
+	char name[EDID_TEXT_LENGTH];		// Display product name descriptor, e.g. "ACME 1234"
+	char serialText[EDID_TEXT_LENGTH];	// Display product serial number descriptor
+} edid_info_t;
+
+// Parse the base block (at least 128 bytes), returns false if the header or checksum is invalid
+bool EdidParse(const uint8_t *data, size_t length, edid_info_t *info);
+
+// Build a minimal valid base block (EDID 1.4) with the identification and any name/serial descriptors, e.g. for a simulated monitor
+void EdidBuild(const edid_info_t *info, uint8_t *data);
+
+// Stable identity string: manufacturer, product and serial (e.g. "ACM-1234-0001E240" or "ACM-1234-SN12345")
+void EdidIdentity(const edid_info_t *info, char *buffer, size_t size);
+
+// Description: the product name, otherwise the manufacturer and product (e.g. "ACME 1234" or "ACM 1234"), as a wide string of 'count' characters
+void EdidDescription(const edid_info_t *info, wchar_t *buffer, size_t count);
+
+#endif
@@ -0,0 +1,169 @@
+// Monitor Brightness - Headless Mode
+// Dan Jackson, 2020.
+
+// The monitors are listed, and any brightness set, without a user interface: the result is written as JSON, e.g.
+//   {"monitors":[{"index":0,"identity":"ACM-1234-0001E240","description":"ACME 1234","backend":"ddcci","hasBrightness":true,"brightness":50,"requested":50,"ok":true}],"ok":true,"elapsedMs":120}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "headless.h"
+#include "platform.h"
+#include "trace.h"
+#include "json.h"
+
+typedef struct
+{
+	monitor_t *monitor;
+	int brightness;
+	bool ok;
+	bool threaded;
+	platform_thread_t thread;
+} headless_job_t;
+
+// Case-insensitive comparison of ASCII text
+static bool HeadlessEqual(const char *a, const char *b)
+{
+	for (; tolower((unsigned char)*a) == tolower((unsigned char)*b); a++, b++)
+	{
+		if (*a == '\0') return true;
+	}
+	return false;
+}
+
+bool HeadlessParseSet(headless_t *headless, const char *arg)
+{
+	if (headless->count >= HEADLESS_MAX_SETS) return false;
+	const char *separator = strchr(arg, '=');
+	if (separator == NULL || separator == arg || separator - arg >= HEADLESS_SELECTOR_LENGTH) return false;
+	char *end = NULL;
+	long brightness = strtol(separator + 1, &end, 10);
+	if (end == separator + 1 || *end != '\0' || brightness < 0 || brightness > 100) return false;
+
+	headless_set_t *set = &headless->sets[headless->count];
+	int length = (int)(separator - arg);
+	for (int i = 0; i < length; i++)
+	{
+		if (arg[i] < 0x20 || arg[i] > 0x7e) return false;	// Selectors are indexes or identities (ASCII)
+		set->selector[i] = arg[i];
+	}
+	set->selector[length] = '\0';
+	set->identity[0] = '\0';
+	set->brightness = (int)brightness;
+	set->matched = false;
+	headless->count++;
+	return true;
+}
+
+bool HeadlessIsIndex(const char *selector)
+{
+	char *end = NULL;
+	strtol(selector, &end, 10);
+	return end != selector && *end == '\0';
+}
+
+bool HeadlessMatches(const char *selector, int index, const char *identity)
+{
+	if (HeadlessEqual(selector, "all")) return true;
+	if (HeadlessIsIndex(selector)) return strtol(selector, NULL, 10) == index;
+	return identity != NULL && HeadlessEqual(selector, identity);
+}
+
+bool HeadlessSetMatches(const headless_set_t *set, int index, const char *identity)
+{
+	if (set->identity[0] != '\0') return identity != NULL && HeadlessEqual(set->identity, identity);
+	return HeadlessMatches(set->selector, index, identity);
+}
+
+bool HeadlessTargeted(int index, const char *identity, void *context)
+{
+	headless_t *headless = (headless_t *)context;
+	if (headless->get) return true;
+	for (int j = 0; j < headless->count; j++)
+	{
+		if (HeadlessSetMatches(&headless->sets[j], index, identity)) return true;
+	}
+	headless->skipped = true;
+	return false;
+}
+
+static void HeadlessSetThread(void *context)
+{
+	headless_job_t *job = (headless_job_t *)context;
+	job->ok = MonitorSetBrightness(job->monitor, job->brightness);
+}
+
+bool HeadlessRun(headless_t *headless, monitor_t *monitorList, FILE *file, uint64_t start)
+{
+	// Each monitor gets the value of the last set that matches it, and all are written concurrently
+	int monitorCount = MonitorListCount(monitorList);
+	headless_job_t *jobs = (headless_job_t *)calloc(monitorCount > 0 ? monitorCount : 1, sizeof(headless_job_t));
+	if (jobs == NULL)
+	{
+		fprintf(stderr, "ERROR: Out of memory\n");
+		return false;
+	}
+	uint64_t trace = TraceBegin();
+	int i = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next, i++)
+	{
+		jobs[i].monitor = monitor;
+		jobs[i].brightness = -1;
+		for (int j = 0; j < headless->count; j++)
+		{
+			if (HeadlessSetMatches(&headless->sets[j], monitor->index, MonitorGetIdentity(monitor)))
+			{
+				headless->sets[j].matched = true;
+				jobs[i].brightness = headless->sets[j].brightness;
+			}
+		}
+		if (jobs[i].brightness < 0) continue;
+		jobs[i].threaded = PlatformThreadCreate(&jobs[i].thread, HeadlessSetThread, &jobs[i]);
+		if (!jobs[i].threaded) HeadlessSetThread(&jobs[i]);
+	}
+	for (i = 0; i < monitorCount; i++)
+	{
+		if (jobs[i].threaded) PlatformThreadJoin(&jobs[i].thread);
+	}
+	TraceEnd(trace, "app", "HeadlessSet", NULL, headless->count);
+
+	bool success = true;
+	for (int j = 0; j < headless->count; j++)
+	{
+		if (!headless->sets[j].matched)
+		{
+			fprintf(stderr, "ERROR: No monitor matches: %s\n", headless->sets[j].selector);
+			success = false;
+		}
+	}
+
+	fprintf(file, "{\"monitors\":[");
+	bool first = true;
+	for (i = 0; i < monitorCount; i++)
+	{
+		monitor_t *monitor = jobs[i].monitor;
+		if (!headless->get && jobs[i].brightness < 0) continue;
+		bool hasBrightness = MonitorHasBrightness(monitor);
+		fprintf(file, "%s{\"index\":%d,\"identity\":", first ? "" : ",", monitor->index);
+		JsonWriteString(file, MonitorGetIdentity(monitor));
+		fprintf(file, ",\"description\":");
+		JsonWriteWideString(file, MonitorGetDescription(monitor));
+		fprintf(file, ",\"backend\":");
+		JsonWriteString(file, monitor->control >= 0 ? monitor->devices[monitor->control]->backend->name : "");
+		fprintf(file, ",\"hasBrightness\":%s,\"brightness\":", hasBrightness ? "true" : "false");
+		if (hasBrightness) fprintf(file, "%d", MonitorGetBrightness(monitor)); else fprintf(file, "null");
+		if (jobs[i].brightness >= 0)
+		{
+			fprintf(file, ",\"requested\":%d,\"ok\":%s", jobs[i].brightness, jobs[i].ok ? "true" : "false");
+			if (!jobs[i].ok) success = false;
+		}
+		fprintf(file, "}");
+		first = false;
+	}
+	fprintf(file, "],\"ok\":%s,\"elapsedMs\":%d}\n", success ? "true" : "false", (int)((PlatformTimeMicroseconds() - start) / 1000));
+	fflush(file);
+	free(jobs);
+	return success;
+}
@@ -0,0 +1,42 @@
+// Monitor Brightness - Headless Mode
+// Dan Jackson, 2020.
+
+#ifndef _HEADLESS_H
+#define _HEADLESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "backend.h"
+#include "monitor.h"
+
+#define HEADLESS_MAX_SETS 16
+#define HEADLESS_SELECTOR_LENGTH 64
+
+// A requested brightness, "<monitor>=<percent>"
+typedef struct
+{
+	char selector[HEADLESS_SELECTOR_LENGTH];	// "all", a monitor index, or a monitor identity (case-insensitive)
+	char identity[BACKEND_KEY_LENGTH];			// An index selector resolved against another list (e.g. a snapshot), matched instead (empty if not resolved)
+	int brightness;
+	bool matched;
+} headless_set_t;
+
+// The monitors to list and set, shared by the command lines of each platform
+typedef struct
+{
+	headless_set_t sets[HEADLESS_MAX_SETS];
+	int count;
+	bool get;									// Every monitor is listed, otherwise only those set
+	bool skipped;								// A monitor was not probed (HeadlessTargeted())
+} headless_t;
+
+bool HeadlessParseSet(headless_t *headless, const char *arg);	// "<index|identity|all>=<0-100>", false if invalid (or too many)
+bool HeadlessIsIndex(const char *selector);
+bool HeadlessMatches(const char *selector, int index, const char *identity);	// Whether a selector refers to the monitor at this index with this identity
+bool HeadlessSetMatches(const headless_set_t *set, int index, const char *identity);	// ...by the identity its index was resolved to, if any
+bool HeadlessTargeted(int index, const char *identity, void *context);	// A monitor_filter_t (for MonitorSetProbeFilter()) of the monitors listed or set, the context is the headless_t
+bool HeadlessRun(headless_t *headless, monitor_t *monitorList, FILE *file, uint64_t start);	// Set each monitor to the last value that matches it (all concurrently), then write the result as JSON (elapsed since start), returns whether every set matched and was written
+
+#endif
@@ -0,0 +1,66 @@
+// Monitor Brightness - Latency Histograms
+// Dan Jackson, 2020.
+
+#include "histogram.h"
+
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+static int HistogramIndex(uint64_t value)
+{
+	if (value < HISTOGRAM_SUB_BUCKETS) return (int)value;
+	int magnitude = 0;
+	for (uint64_t v = value; v > 1; v >>= 1) magnitude++;
+	int shift = magnitude - HISTOGRAM_SUB_BITS;
+	if (shift >= HISTOGRAM_MAGNITUDES) return HISTOGRAM_BUCKETS - 1;
+	return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int)(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+// Highest value in a bucket
+static uint64_t HistogramHighest(int index)
+{
+	if (index < HISTOGRAM_SUB_BUCKETS) return (uint64_t)index;
+	int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+	uint64_t sub = (uint64_t)(index & (HISTOGRAM_SUB_BUCKETS - 1)) + HISTOGRAM_SUB_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+void HistogramRecord(histogram_t *histogram, uint64_t value)
+{
+	if (histogram->count == 0 || value < histogram->minimum) histogram->minimum = value;
+	if (value > histogram->maximum) histogram->maximum = value;
+	histogram->count++;
+	histogram->sum += value;
+	histogram->buckets[HistogramIndex(value)]++;
+}
+
+uint64_t HistogramPercentile(const histogram_t *histogram, double percentile)
+{
+	if (histogram->count == 0) return 0;
+	uint64_t target = (uint64_t)(percentile / 100.0 * (double)histogram->count + 0.5);
+	if (target < 1) target = 1;
+	if (target > histogram->count) target = histogram->count;
+	uint64_t total = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		total += histogram->buckets[i];
+		if (total >= target)
+		{
+			uint64_t value = HistogramHighest(i);
+			return (value > histogram->maximum) ? histogram->maximum : value;
+		}
+	}
+	return histogram->maximum;
+}
+
+void HistogramDumpJson(FILE *file, const histogram_t *histogram)
+{
+	fprintf(file, "{\"count\":%llu", (unsigned long long)histogram->count);
+	if (histogram->count > 0)
+	{
+		fprintf(file, ",\"min\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu",
+			(unsigned long long)histogram->minimum, (unsigned long long)(histogram->sum / histogram->count),
+			(unsigned long long)HistogramPercentile(histogram, 50), (unsigned long long)HistogramPercentile(histogram, 90),
+			(unsigned long long)HistogramPercentile(histogram, 99), (unsigned long long)histogram->maximum);
+	}
+	fprintf(file, "}");
+}
@@ -0,0 +1,28 @@
+// Monitor Brightness - Latency Histograms
+// Dan Jackson, 2020.
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Log-linear buckets (as HDR histograms): exact below 16, then 16 per power of two (within 1/16 of the value) up to over a day in microseconds
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_MAGNITUDES 33
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAGNITUDES + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t minimum;
+	uint64_t maximum;
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+void HistogramRecord(histogram_t *histogram, uint64_t value);
+uint64_t HistogramPercentile(const histogram_t *histogram, double percentile);	// Highest value equivalent to that at the percentile (0-100), 0 if empty
+void HistogramDumpJson(FILE *file, const histogram_t *histogram);		// Summary object: count, min, mean, percentiles, max
+
+#endif
@@ -0,0 +1,42 @@
+// Monitor Brightness - JSON Output
+// Dan Jackson, 2020.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "json.h"
+
+// A byte of UTF-8 text within a string value
+static void JsonPutByte(FILE *file, unsigned char c)
+{
+	if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+	else if (c < 0x20) fprintf(file, "\\u%04x", c);
+	else fputc(c, file);
+}
+
+void JsonWriteString(FILE *file, const char *text)
+{
+	fputc('"', file);
+	for (const unsigned char *p = (const unsigned char *)(text != NULL ? text : ""); *p != '\0'; p++) JsonPutByte(file, *p);
+	fputc('"', file);
+}
+
+void JsonWriteWideString(FILE *file, const wchar_t *text)
+{
+	fputc('"', file);
+	for (const wchar_t *p = (text != NULL ? text : L""); *p != L'\0'; p++)
+	{
+		uint32_t c = (uint32_t)*p;
+		if (c >= 0xd800 && c <= 0xdbff && p[1] >= 0xdc00 && p[1] <= 0xdfff)	// UTF-16 surrogate pair (where wchar_t is 16-bit)
+		{
+			c = 0x10000 + ((c - 0xd800) << 10) + ((uint32_t)p[1] - 0xdc00);
+			p++;
+		}
+		if (c >= 0x110000 || (c >= 0xd800 && c <= 0xdfff)) c = 0xfffd;
+		if (c < 0x80) JsonPutByte(file, (unsigned char)c);
+		else if (c < 0x800) { JsonPutByte(file, (unsigned char)(0xc0 | (c >> 6))); JsonPutByte(file, (unsigned char)(0x80 | (c & 0x3f))); }
+		else if (c < 0x10000) { JsonPutByte(file, (unsigned char)(0xe0 | (c >> 12))); JsonPutByte(file, (unsigned char)(0x80 | ((c >> 6) & 0x3f))); JsonPutByte(file, (unsigned char)(0x80 | (c & 0x3f))); }
+		else { JsonPutByte(file, (unsigned char)(0xf0 | (c >> 18))); JsonPutByte(file, (unsigned char)(0x80 | ((c >> 12) & 0x3f))); JsonPutByte(file, (unsigned char)(0x80 | ((c >> 6) & 0x3f))); JsonPutByte(file, (unsigned char)(0x80 | (c & 0x3f))); }
+	}
+	fputc('"', file);
+}
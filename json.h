@@ -0,0 +1,13 @@
+// Monitor Brightness - JSON Output
+// Dan Jackson, 2020.
+
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stdio.h>
+#include <wchar.h>
+
+void JsonWriteString(FILE *file, const char *text);		// A quoted and escaped JSON string value from UTF-8 text (NULL is written as "")
+void JsonWriteWideString(FILE *file, const wchar_t *text);	// ...from wide text (UTF-16 or UTF-32, as wchar_t is on the platform), written as UTF-8
+
+#endif
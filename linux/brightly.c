@@ -0,0 +1,85 @@
+// Brightly for Linux - Command Line
+// Dan Jackson, 2020.
+
+// The Linux counterpart of the Windows application's headless mode: the monitors are listed, and any brightness set, as JSON on stdout.
+// External monitors are controlled over DDC/CI on their DRM connector's I2C bus, and internal panels through the sysfs backlight devices.
+//
+//   brightly [--get] [--set <index|identity|all>=<0-100>]... [--drm /sys/class/drm] [--dev /dev] [--backlight /sys/class/backlight] [--trace trace.json]
+//
+// With --get every monitor is listed, otherwise only those set.  The exit code is 0 on success, 1 for invalid options, and 3 if a monitor was not matched or a value not written.
+
+#if defined(__linux__)
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "monitor.h"
+#include "platform.h"
+#include "backend_drm.h"
+#include "backend_sysfs.h"
+#include "trace.h"
+#include "headless.h"
+
+int main(int argc, char *argv[])
+{
+	uint64_t start = PlatformTimeMicroseconds();
+	headless_t headless = {0};
+	const char *drmRoot = NULL;
+	const char *deviceRoot = NULL;
+	const char *backlightRoot = NULL;
+	const char *traceFile = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--get") == 0) { headless.get = true; continue; }
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (value == NULL) { fprintf(stderr, "ERROR: Missing value for: %s\n", argv[i]); return 1; }
+		if (strcmp(argv[i], "--set") == 0)
+		{
+			if (!HeadlessParseSet(&headless, value)) { fprintf(stderr, "ERROR: Invalid value (expected --set <index|identity|all>=<0-100>): %s\n", value); return 1; }
+		}
+		else if (strcmp(argv[i], "--drm") == 0) drmRoot = value;
+		else if (strcmp(argv[i], "--dev") == 0) deviceRoot = value;
+		else if (strcmp(argv[i], "--backlight") == 0) backlightRoot = value;
+		else if (strcmp(argv[i], "--trace") == 0) traceFile = value;
+		else { fprintf(stderr, "ERROR: Unknown option: %s\n", argv[i]); return 1; }
+		i++;
+	}
+	if (headless.count == 0) headless.get = true;
+	if (traceFile != NULL) TraceStart(traceFile);
+
+	// In order of preference
+	backend_t *drmBackend = DrmBackendCreate(drmRoot, deviceRoot);
+	if (drmBackend != NULL) MonitorRegisterBackend(drmBackend);
+	backend_t *sysfsBackend = SysfsBackendCreate(backlightRoot);
+	if (sysfsBackend != NULL) MonitorRegisterBackend(sysfsBackend);
+
+	// Only the monitors listed or set are probed
+	MonitorSetProbeFilter(HeadlessTargeted, &headless);
+	uint64_t trace = TraceBegin();
+	monitor_t *monitorList = MonitorListEnumerate();
+	TraceEnd(trace, "app", "MonitorListEnumerate", NULL, 0);
+	bool success = HeadlessRun(&headless, monitorList, stdout, start);
+
+	MonitorListDestroy(monitorList);
+	MonitorCleanup();
+	if (sysfsBackend != NULL) SysfsBackendDestroy(sysfsBackend);
+	if (drmBackend != NULL) DrmBackendDestroy(drmBackend);
+	TraceStop();
+	return success ? 0 : 3;
+}
+
+#else
+
+#include <stdio.h>
+
+int main(void)
+{
+	fprintf(stderr, "ERROR: Linux only (use brightly.exe /GET or /SET:<monitor>=<percent> on Windows)\n");
+	return 1;
+}
+
+#endif
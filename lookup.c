@@ -0,0 +1,75 @@
+// Monitor Brightness - Hash Lookups
+// Dan Jackson, 2020.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lookup.h"
+
+uint32_t LookupHash(const void *data, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t LookupHashString(const char *text)
+{
+	return LookupHash(text, strlen(text));
+}
+
+bool LookupInit(lookup_t *lookup, int count)
+{
+	// At most half full, so probe sequences stay short
+	int capacity = 4;
+	while (capacity < count * 2) capacity <<= 1;
+	lookup->count = 0;
+	lookup->entries = (lookup_entry_t *)calloc(capacity, sizeof(lookup_entry_t));
+	if (lookup->entries == NULL)
+	{
+		fprintf(stderr, "ERROR: Cannot allocate lookup of %d entries.\n", count);
+		lookup->capacity = 0;
+		return false;
+	}
+	lookup->capacity = capacity;
+	return true;
+}
+
+void LookupFree(lookup_t *lookup)
+{
+	free(lookup->entries);
+	lookup->entries = NULL;
+	lookup->capacity = 0;
+	lookup->count = 0;
+}
+
+bool LookupAdd(lookup_t *lookup, uint32_t hash, void *value)
+{
+	if (lookup->count >= lookup->capacity - 1) return false;	// Always leave an empty slot to end probing
+	int mask = lookup->capacity - 1;
+	int i = (int)(hash & (uint32_t)mask);
+	while (lookup->entries[i].value != NULL) i = (i + 1) & mask;
+	lookup->entries[i].hash = hash;
+	lookup->entries[i].value = value;
+	lookup->count++;
+	return true;
+}
+
+void *LookupNext(const lookup_t *lookup, uint32_t hash, int *cursor)
+{
+	if (lookup->capacity == 0) return NULL;
+	int mask = lookup->capacity - 1;
+	for (;;)
+	{
+		const lookup_entry_t *entry = &lookup->entries[(hash + (uint32_t)*cursor) & (uint32_t)mask];
+		if (entry->value == NULL) return NULL;
+		(*cursor)++;
+		if (entry->hash == hash) return entry->value;
+	}
+}
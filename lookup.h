@@ -0,0 +1,34 @@
+// Monitor Brightness - Hash Lookups
+// Dan Jackson, 2020.
+
+#ifndef _LOOKUP_H
+#define _LOOKUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Open-addressed table from a hash to values (e.g. devices by key), sized once for the number of entries.
+// Only the hash is stored: callers compare their full key for each candidate returned by LookupNext().
+typedef struct
+{
+	uint32_t hash;
+	void *value;						// NULL if the slot is empty
+} lookup_entry_t;
+
+typedef struct
+{
+	int capacity;						// Power of two, 0 if not allocated (nothing is found)
+	int count;
+	lookup_entry_t *entries;
+} lookup_t;
+
+uint32_t LookupHash(const void *data, size_t length);	// FNV-1a
+uint32_t LookupHashString(const char *text);
+
+bool LookupInit(lookup_t *lookup, int count);			// Room for 'count' entries
+void LookupFree(lookup_t *lookup);
+bool LookupAdd(lookup_t *lookup, uint32_t hash, void *value);	// value must not be NULL, false if full
+void *LookupNext(const lookup_t *lookup, uint32_t hash, int *cursor);	// Each value added with the hash in turn (start with *cursor = 0), NULL after the last
+
+#endif
@@ -0,0 +1,298 @@
+// Monitor Brightness - MCCS capabilities
+// Dan Jackson, 2020.
+
+// Fetching the capabilities string over DDC/CI takes several hundred milliseconds on many monitors, so the parsed result is cached by monitor identity.
+// The cache file has one line per monitor: the identity, a tab, then the canonical capabilities string.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "mccs.h"
+
+#define MCCS_IDENTITY_LENGTH 64
+
+typedef struct _mccs_cache_entry_t
+{
+	char identity[MCCS_IDENTITY_LENGTH];
+	mccs_caps_t caps;
+	struct _mccs_cache_entry_t *next;
+} mccs_cache_entry_t;
+
+static platform_mutex_t cacheLock = PLATFORM_MUTEX_INIT;
+static mccs_cache_entry_t *cacheEntries = NULL;
+static char *cacheFile = NULL;
+static bool cacheChanged = false;
+
+static int MccsHexDigit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// Find the closing parenthesis matching the open one before 'p', NULL if unbalanced
+static const char *MccsGroupEnd(const char *p)
+{
+	int depth = 1;
+	for (; *p != '\0'; p++)
+	{
+		if (*p == '(') depth++;
+		else if (*p == ')' && --depth == 0) return p;
+	}
+	return NULL;
+}
+
+static void MccsText(char *dst, const char *start, const char *end)
+{
+	size_t length = (size_t)(end - start);
+	if (length >= MCCS_TEXT_LENGTH) length = MCCS_TEXT_LENGTH - 1;
+	memcpy(dst, start, length);
+	dst[length] = '\0';
+}
+
+// Hex bytes, with or without separating spaces, e.g. "10 12 14" or "101214"; a byte followed by a group lists its values
+static bool MccsParseVcp(const char *p, const char *end, mccs_caps_t *caps)
+{
+	mccs_vcp_t *last = NULL;
+	while (p < end)
+	{
+		if (isspace((unsigned char)*p)) { p++; continue; }
+		if (*p == '(')
+		{
+			const char *groupEnd = MccsGroupEnd(p + 1);
+			if (groupEnd == NULL || groupEnd > end || last == NULL) return false;
+			for (const char *q = p + 1; q < groupEnd; )
+			{
+				if (isspace((unsigned char)*q)) { q++; continue; }
+				int high = MccsHexDigit(q[0]);
+				int low = (q + 1 < groupEnd) ? MccsHexDigit(q[1]) : -1;
+				if (high < 0 || low < 0) return false;
+				if (last->valueCount < MCCS_MAX_VALUES) last->values[last->valueCount++] = (uint8_t)(high * 16 + low);
+				q += 2;
+			}
+			p = groupEnd + 1;
+			continue;
+		}
+		int high = MccsHexDigit(p[0]);
+		int low = (p + 1 < end) ? MccsHexDigit(p[1]) : -1;
+		if (high < 0 || low < 0) return false;
+		uint8_t code = (uint8_t)(high * 16 + low);
+		last = NULL;
+		for (int i = 0; i < caps->vcpCount; i++)
+		{
+			if (caps->vcp[i].code == code) last = &caps->vcp[i];
+		}
+		if (last == NULL && caps->vcpCount < MCCS_MAX_VCP)
+		{
+			last = &caps->vcp[caps->vcpCount++];
+			last->code = code;
+			last->valueCount = 0;
+		}
+		p += 2;
+	}
+	return true;
+}
+
+bool MccsParse(const char *capabilities, mccs_caps_t *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+	if (capabilities == NULL) return false;
+
+	// The outer parentheses are sometimes missing
+	const char *p = capabilities;
+	while (isspace((unsigned char)*p)) p++;
+	const char *end = p + strlen(p);
+	if (*p == '(')
+	{
+		end = MccsGroupEnd(p + 1);
+		if (end == NULL) return false;
+		p++;
+	}
+
+	bool hasVcp = false;
+	while (p < end)
+	{
+		// Keyword
+		const char *keyword = p;
+		while (p < end && *p != '(') p++;
+		if (p >= end) break;
+		const char *keywordEnd = p;
+		while (keyword < keywordEnd && isspace((unsigned char)*keyword)) keyword++;
+		size_t keywordLength = (size_t)(keywordEnd - keyword);
+
+		// Group
+		const char *group = p + 1;
+		const char *groupEnd = MccsGroupEnd(group);
+		if (groupEnd == NULL || groupEnd > end) return false;
+
+		if (keywordLength == 4 && strncmp(keyword, "prot", 4) == 0) MccsText(caps->protocol, group, groupEnd);
+		else if (keywordLength == 4 && strncmp(keyword, "type", 4) == 0) MccsText(caps->type, group, groupEnd);
+		else if (keywordLength == 5 && strncmp(keyword, "model", 5) == 0) MccsText(caps->model, group, groupEnd);
+		else if (keywordLength == 8 && strncmp(keyword, "mccs_ver", 8) == 0) MccsText(caps->version, group, groupEnd);
+		else if (keywordLength == 3 && strncmp(keyword, "vcp", 3) == 0)
+		{
+			if (!MccsParseVcp(group, groupEnd, caps)) return false;
+			hasVcp = true;
+		}
+		p = groupEnd + 1;
+	}
+
+	return hasVcp;
+}
+
+size_t MccsFormat(const mccs_caps_t *caps, char *buffer, size_t size)
+{
+	size_t length = 0;
+	#define MCCS_APPEND(...) do { int n = snprintf(buffer + length, (length < size) ? size - length : 0, __VA_ARGS__); if (n > 0) length += (size_t)n; } while (0)
+	MCCS_APPEND("(");
+	if (caps->protocol[0] != '\0') MCCS_APPEND("prot(%s)", caps->protocol);
+	if (caps->type[0] != '\0') MCCS_APPEND("type(%s)", caps->type);
+	if (caps->model[0] != '\0') MCCS_APPEND("model(%s)", caps->model);
+	MCCS_APPEND("vcp(");
+	for (int i = 0; i < caps->vcpCount; i++)
+	{
+		MCCS_APPEND("%s%02X", (i > 0) ? " " : "", caps->vcp[i].code);
+		if (caps->vcp[i].valueCount > 0)
+		{
+			MCCS_APPEND("(");
+			for (int j = 0; j < caps->vcp[i].valueCount; j++) MCCS_APPEND("%s%02X", (j > 0) ? " " : "", caps->vcp[i].values[j]);
+			MCCS_APPEND(")");
+		}
+	}
+	MCCS_APPEND(")");
+	if (caps->version[0] != '\0') MCCS_APPEND("mccs_ver(%s)", caps->version);
+	MCCS_APPEND(")");
+	#undef MCCS_APPEND
+	return length;
+}
+
+const mccs_vcp_t *MccsFindVcp(const mccs_caps_t *caps, uint8_t code)
+{
+	for (int i = 0; i < caps->vcpCount; i++)
+	{
+		if (caps->vcp[i].code == code) return &caps->vcp[i];
+	}
+	return NULL;
+}
+
+// (must hold the lock)
+static mccs_cache_entry_t *MccsCacheFind(const char *identity)
+{
+	for (mccs_cache_entry_t *entry = cacheEntries; entry != NULL; entry = entry->next)
+	{
+		if (strcmp(entry->identity, identity) == 0) return entry;
+	}
+	return NULL;
+}
+
+// (must hold the lock)
+static void MccsCacheAdd(const char *identity, const mccs_caps_t *caps)
+{
+	mccs_cache_entry_t *entry = MccsCacheFind(identity);
+	if (entry == NULL)
+	{
+		entry = (mccs_cache_entry_t *)calloc(1, sizeof(mccs_cache_entry_t));
+		if (entry == NULL) return;
+		snprintf(entry->identity, sizeof(entry->identity), "%s", identity);
+		entry->next = cacheEntries;
+		cacheEntries = entry;
+	}
+	entry->caps = *caps;
+}
+
+bool MccsCacheLoad(const char *filename)
+{
+	PlatformMutexLock(&cacheLock);
+	free(cacheFile);
+	cacheFile = NULL;
+	if (filename != NULL && (cacheFile = (char *)malloc(strlen(filename) + 1)) != NULL) strcpy(cacheFile, filename);
+	FILE *fp = (filename != NULL) ? fopen(filename, "r") : NULL;
+	if (fp == NULL)
+	{
+		PlatformMutexUnlock(&cacheLock);
+		return false;
+	}
+
+	char *line = (char *)malloc(MCCS_IDENTITY_LENGTH + MCCS_CAPABILITIES_LENGTH + 2);
+	mccs_caps_t *caps = (mccs_caps_t *)malloc(sizeof(mccs_caps_t));
+	while (line != NULL && caps != NULL && fgets(line, MCCS_IDENTITY_LENGTH + MCCS_CAPABILITIES_LENGTH + 2, fp) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		char *tab = strchr(line, '\t');
+		if (tab == NULL || tab == line || tab - line >= MCCS_IDENTITY_LENGTH) continue;
+		*tab = '\0';
+		if (!MccsParse(tab + 1, caps)) { fprintf(stderr, "WARNING: Invalid capabilities cache entry: %s\n", line); continue; }
+		MccsCacheAdd(line, caps);
+	}
+	free(caps);
+	free(line);
+	fclose(fp);
+	cacheChanged = false;
+	PlatformMutexUnlock(&cacheLock);
+	return true;
+}
+
+bool MccsCacheSave(void)
+{
+	bool success = true;
+	PlatformMutexLock(&cacheLock);
+	if (cacheFile != NULL && cacheChanged)
+	{
+		FILE *fp = fopen(cacheFile, "w");
+		char *buffer = (char *)malloc(MCCS_CAPABILITIES_LENGTH);
+		if (fp == NULL || buffer == NULL)
+		{
+			fprintf(stderr, "ERROR: Cannot write capabilities cache: %s\n", cacheFile);
+			success = false;
+		}
+		else
+		{
+			for (mccs_cache_entry_t *entry = cacheEntries; entry != NULL; entry = entry->next)
+			{
+				if (MccsFormat(&entry->caps, buffer, MCCS_CAPABILITIES_LENGTH) >= MCCS_CAPABILITIES_LENGTH) continue;
+				fprintf(fp, "%s\t%s\n", entry->identity, buffer);
+			}
+			cacheChanged = false;
+		}
+		free(buffer);
+		if (fp != NULL) fclose(fp);
+	}
+	PlatformMutexUnlock(&cacheLock);
+	return success;
+}
+
+bool MccsCacheLookup(const char *identity, mccs_caps_t *caps)
+{
+	if (identity == NULL || identity[0] == '\0') return false;
+	PlatformMutexLock(&cacheLock);
+	mccs_cache_entry_t *entry = MccsCacheFind(identity);
+	if (entry != NULL) *caps = entry->caps;
+	PlatformMutexUnlock(&cacheLock);
+	return entry != NULL;
+}
+
+void MccsCacheStore(const char *identity, const mccs_caps_t *caps)
+{
+	if (identity == NULL || identity[0] == '\0') return;
+	PlatformMutexLock(&cacheLock);
+	MccsCacheAdd(identity, caps);
+	cacheChanged = true;
+	PlatformMutexUnlock(&cacheLock);
+}
+
+void MccsCacheClear(void)
+{
+	PlatformMutexLock(&cacheLock);
+	while (cacheEntries != NULL)
+	{
+		mccs_cache_entry_t *next = cacheEntries->next;
+		free(cacheEntries);
+		cacheEntries = next;
+	}
+	cacheChanged = false;
+	PlatformMutexUnlock(&cacheLock);
+}
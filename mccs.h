@@ -0,0 +1,45 @@
+// Monitor Brightness - MCCS capabilities
+// Dan Jackson, 2020.
+
+#ifndef _MCCS_H
+#define _MCCS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MCCS_TEXT_LENGTH 64
+#define MCCS_MAX_VCP 256
+#define MCCS_MAX_VALUES 32
+#define MCCS_CAPABILITIES_LENGTH 4096		// Maximum capabilities string
+
+typedef struct
+{
+	uint8_t code;
+	int valueCount;						// Allowed values (for non-continuous features), 0 if not listed
+	uint8_t values[MCCS_MAX_VALUES];
+} mccs_vcp_t;
+
+// Parsed capabilities string, e.g. (prot(monitor)type(lcd)model(ACME1234)cmds(01 02 03 07 0C E3 F3)vcp(02 04 10 12 14(05 08 0B) 60(0F 11 12) D6(01 04))mccs_ver(2.1))
+typedef struct
+{
+	char protocol[MCCS_TEXT_LENGTH];	// "monitor"
+	char type[MCCS_TEXT_LENGTH];		// "lcd"
+	char model[MCCS_TEXT_LENGTH];
+	char version[MCCS_TEXT_LENGTH];		// MCCS version, e.g. "2.1"
+	int vcpCount;
+	mccs_vcp_t vcp[MCCS_MAX_VCP];
+} mccs_caps_t;
+
+bool MccsParse(const char *capabilities, mccs_caps_t *caps);
+size_t MccsFormat(const mccs_caps_t *caps, char *buffer, size_t size);		// Canonical capabilities string (parses to the same result)
+const mccs_vcp_t *MccsFindVcp(const mccs_caps_t *caps, uint8_t code);
+
+// Cache of parsed capabilities by stable monitor identity (e.g. from the EDID), optionally persisted to a file
+bool MccsCacheLoad(const char *filename);	// Sets the file used by MccsCacheSave(), a missing file is an empty cache
+bool MccsCacheSave(void);					// Only writes if changed
+bool MccsCacheLookup(const char *identity, mccs_caps_t *caps);
+void MccsCacheStore(const char *identity, const mccs_caps_t *caps);
+void MccsCacheClear(void);
+
+#endif
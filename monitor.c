@@ -1,641 +1,2166 @@
 // Monitor Brightness
 // Dan Jackson, 2020.
 
-// NOTE: This is "just enough" to work and needs improvement: better abstractions, correct error handling, general tidying up.
+// Monitors are assembled from the devices of each registered backend (see backend.h): a primary backend's device (e.g. DDC/CI) creates
+// the monitor, and devices from attaching backends (e.g. WMI) with the same key add their brightness control to it.
+// Only platform.h is used for threads and timing, so this builds natively for any platform with a backend.
 
-// Generally external monitors (DCC/CI): https://docs.microsoft.com/en-us/windows/win32/api/highlevelmonitorconfigurationapi/nf-highlevelmonitorconfigurationapi-setmonitorbrightness
-// Generally internal monitors (WMI): https://docs.microsoft.com/en-us/windows/win32/wmicoreprov/wmisetbrightness-method-in-class-wmimonitorbrightnessmethods?redirectedfrom=MSDN  /  https://stackoverflow.com/questions/47333195/change-brightness-using-wmi  /  https://devblogs.microsoft.com/scripting/use-powershell-to-report-and-set-monitor-brightness/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define _WIN32_WINNT 0x0600	// 0x0400
-#define _WIN32_DCOM
+#include "monitor.h"
+#include "mccs.h"
+#include "trace.h"
+#include "lookup.h"
+#include "json.h"
 
-#include <windows.h>
-#include <tchar.h>
+// Bus access is limited, as the DDC/CI buses of a single GPU may be serialized
+#define MONITOR_ADAPTER_CONCURRENCY 2
+#define MONITOR_MAX_ADAPTERS 16
 
-#include <stdio.h>
+typedef struct
+{
+	char id[BACKEND_KEY_LENGTH];		// Device bus, e.g. the adapter DeviceID PCI\VEN_8086&DEV_1234&SUBSYS_...
+	platform_semaphore_t semaphore;
+} adapter_t;
 
-#ifdef GetObject	// Otherwise defined as GetObjectW
-#undef GetObject
-#endif
+static platform_mutex_t adapterLock = PLATFORM_MUTEX_INIT;
+static adapter_t adapters[MONITOR_MAX_ADAPTERS];
+static int adapterCount = 0;
 
-#include <wbemidl.h>
-#include <wbemcli.h>
+#define MONITOR_MAX_BACKENDS 8
 
-#include <highlevelmonitorconfigurationapi.h>
-#include <physicalmonitorenumerationapi.h>
+// Shortest interval between fade steps (devices without a command interval, e.g. a sysfs backlight, could otherwise be written continuously)
+#define MONITOR_FADE_MIN_STEP_US 10000
 
-// MSC-Specific Pragmas
-#ifdef _MSC_VER
-#pragma comment(lib, "ole32.lib")
-#pragma comment(lib, "oleaut32.lib")
-#pragma comment(lib, "wbemuuid.lib")
-#pragma comment(lib, "Dxva2.lib")
-#endif
+static backend_t *backends[MONITOR_MAX_BACKENDS];
+static int backendCount = 0;
+static bool watching = false;							// Backends are asked to report changes made elsewhere (MonitorSetWatching())
+static bool backendWatched[MONITOR_MAX_BACKENDS];
+static monitor_filter_t probeFilter = NULL;				// Monitors not accepted are not probed (MonitorSetProbeFilter())
+static void *probeFilterContext = NULL;
 
-#include "monitor.h"
+// Phases of the last enumeration (MonitorListUpdate()), for the metrics
+#define MONITOR_MAX_PHASES (MONITOR_MAX_BACKENDS * 2)
 
 typedef struct
 {
-	monitor_t *monitorList;
-	monitor_t *lastMonitor;
-} enum_state_t;
-
-static wchar_t *variantU16ArrayToString(VARIANT vtProp)
-{
-	if (vtProp.vt == VT_NULL) return NULL;
-	if (vtProp.vt == VT_EMPTY) return NULL;
-	if (!(vtProp.vt & VT_ARRAY)) return NULL;
-	SAFEARRAY *pSafeArray = vtProp.parray;
-	long lLower;
-	SafeArrayGetLBound(pSafeArray, 1, &lLower);
-	long lUpper;
-	SafeArrayGetUBound(pSafeArray, 1, &lUpper);
-	size_t length = (size_t)(lUpper - lLower);
-	wchar_t *str = (wchar_t *)malloc((length + 1) * sizeof(wchar_t));
-	memset(str, 0, (length + 1) * sizeof(wchar_t));
-	for (long i = lLower; i <= lUpper; i++)
-	{
-		UINT32 c = 0;
-		SafeArrayGetElement(pSafeArray, &i, &c);
-		str[i - lLower] = (wchar_t)c;
-	}
-	return str;
-}
-
-static bool WmiSetBrightness(monitor_t *monitor, int brightness)
-{
-	HRESULT hr = 0;
-
-	// Create locator
-	IWbemLocator *locator = NULL;
-	hr = CoCreateInstance(&CLSID_WbemLocator, 0, CLSCTX_INPROC_SERVER, &IID_IWbemLocator, (LPVOID *)&locator);
-	if (FAILED(hr) || !locator) { fprintf(stderr, "ERROR: Failed CoCreateInstance(CLSID_WbemLocator).\n"); return false; }
-
-	// Connect to WMI
-	IWbemServices *services = NULL;
-	BSTR bstrResource = SysAllocString(L"ROOT\\WMI"); // "\\\\.\\ROOT\\wmi"
-	hr = locator->lpVtbl->ConnectServer(locator, bstrResource, NULL, NULL, NULL, 0, NULL, NULL, &services);
-	if (FAILED(hr) || !services) { fprintf(stderr, "ERROR: Failed ConnectServer().\n"); return false; }
-	SysFreeString(bstrResource);
-
-	// Proxy security levels
-	hr = CoSetProxyBlanket((IUnknown *)services, RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE, NULL, RPC_C_AUTHN_LEVEL_CALL, RPC_C_IMP_LEVEL_IMPERSONATE, NULL, EOAC_NONE);
-	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed CoSetProxyBlanket().\n"); return false; }
-
-	// Query
-	IEnumWbemClassObject *results = NULL;
-	// NOTE WMI PATH=WmiMonitorBrightnessMethods.InstanceName="DISPLAY\ACME1234\9&abcdef9&0&UID12345_0"
-	BSTR bstrQuery = SysAllocString(L"SELECT * FROM WmiMonitorBrightnessMethods");
-	BSTR bstrQueryLanguage = SysAllocString(L"WQL");
-	hr = services->lpVtbl->ExecQuery(services, bstrQueryLanguage, bstrQuery, WBEM_FLAG_BIDIRECTIONAL, NULL, &results); // WBEM_FLAG_BIDIRECTIONAL or WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY
-	SysFreeString(bstrQueryLanguage);
-	SysFreeString(bstrQuery);
-
-	if (results != NULL)
-	{
-		IWbemClassObject *result = NULL;
-		ULONG returnedCount = 0;
-		while ((hr = results->lpVtbl->Next(results, WBEM_INFINITE, 1, &result, &returnedCount)) == S_OK)
-		{
-			VARIANT vtInstanceName;
-			hr = result->lpVtbl->Get(result, L"InstanceName", 0, &vtInstanceName, 0, 0);
-			//_tprintf(TEXT("WMI: instance=%ls\n"), vtInstanceName.bstrVal);
-
-			// If this is the correct monitor...
-			if (_tcscmp(monitor->wmiInstance, vtInstanceName.bstrVal) == 0)		// NOTE: This comparison requires a UNICODE build
-			{
-				BSTR bstrClassName = SysAllocString(L"WmiMonitorBrightnessMethods");
-				BSTR bstrMethodName = SysAllocString(L"WmiSetBrightness");
-
-				IWbemClassObject *pClass = NULL;
-				hr = services->lpVtbl->GetObject(services, bstrClassName, 0, NULL, &pClass, NULL);
-				if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed GetObject().\n"); return false; }
-
-				IWbemClassObject* pInParamsDefinition = NULL;
-				hr = pClass->lpVtbl->GetMethod(pClass, bstrMethodName, 0, &pInParamsDefinition, NULL);
-				if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed GetMethod().\n"); return false; }
-
-				IWbemClassObject* pClassInstance = NULL;
-				hr = pInParamsDefinition->lpVtbl->SpawnInstance(pInParamsDefinition, 0, &pClassInstance);
-				if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed SpawnInstance().\n"); return false; }
-
-				VARIANT vtParam1;
-				VariantInit(&vtParam1);
-				vtParam1.vt = VT_I4;	// uint32
-				vtParam1.intVal = 1;	// seconds
-				hr = pClassInstance->lpVtbl->Put(pClassInstance, L"Timeout", 0, &vtParam1, CIM_UINT32);
-				if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed Put(vtParam1).\n"); return false; }
-
-				VARIANT vtParam2;
-				VariantInit(&vtParam2);
-				vtParam2.vt = VT_UI1;	// uint8
-				vtParam2.intVal = brightness;
-				hr = pClassInstance->lpVtbl->Put(pClassInstance, L"Brightness", 0, &vtParam2, CIM_UINT8);
-				if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed Put(vtParam2).\n"); return false; }
-
-				// Set "this" pointer to object instance to call method on it
-				CIMTYPE type;
-				LONG flavor;
-				VARIANT vtThis;
-				result->lpVtbl->Get(result, L"__RELPATH", 0, &vtThis, &type, &flavor);	// "__RELPATH" / "__PATH"
-				// PATH=    WmiMonitorBrightnessMethods.InstanceName="DISPLAY\\XXX1234\\0&abcdef0&0&UID0123456_0"
-
-				// Execute Method
-				IWbemClassObject* pOutParams = NULL;
-				hr = services->lpVtbl->ExecMethod(services, vtThis.bstrVal, bstrMethodName, 0, NULL, pClassInstance, &pOutParams, NULL);
-				if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed ExecMethod() = 0x%08x / 0x%08x\n", (unsigned int)hr, (unsigned int)GetLastError()); return false; } // WBEM_E_INVALID_METHOD_PARAMETERS = 0x8004102F
-
-				VariantClear(&vtThis);
-				VariantClear(&vtParam2);
-				VariantClear(&vtParam1);
-
-				SysFreeString(bstrMethodName);
-				SysFreeString(bstrClassName);
-				pClass->lpVtbl->Release(pClass);
-				pInParamsDefinition->lpVtbl->Release(pInParamsDefinition);
-			}
-
-			result->lpVtbl->Release(result);
-		}
-	}
-	results->lpVtbl->Release(results);
+	const char *phase;					// "enumerate", "probe" (devices not already known) or "skip" (an attaching backend not needed)
+	const char *backend;
+	uint64_t duration;					// Microseconds
+	int count;							// Devices
+} enumeration_phase_t;
+
+static platform_mutex_t enumerationLock = PLATFORM_MUTEX_INIT;
+static enumeration_phase_t enumerationPhases[MONITOR_MAX_PHASES];
+static int enumerationPhaseCount = 0;
+static uint64_t enumerationDuration = 0;
+static int enumerationCount = 0;
+
+// Index of a list (shared by its monitors): by position, stable id and primary device key
+typedef struct _monitor_registry_t
+{
+	int count;
+	monitor_t **monitors;				// In list order
+	lookup_t byId;
+	lookup_t byKey;
+} monitor_registry_t;
 
-	services->lpVtbl->Release(services);
-	locator->lpVtbl->Release(locator);
+// Ids are unique for the process (a list may be restored while another is enumerated)
+static platform_mutex_t monitorIdLock = PLATFORM_MUTEX_INIT;
+static int monitorNextId = 1;
 
-	return true;
-}
+// Monitors (by key) that an attaching backend had no device for when last enumerated, kept between runs so it is not queried again (e.g. WMI on a desktop)
+#define MONITOR_MAX_ABSENT 32
 
-static bool WmiUpdateBrightness(monitor_t *monitorList)
+typedef struct
 {
-	HRESULT hr = 0;
-	// Create locator
-	IWbemLocator *locator = NULL;
-	hr = CoCreateInstance(&CLSID_WbemLocator, 0, CLSCTX_INPROC_SERVER, &IID_IWbemLocator, (LPVOID *)&locator);
-	if (FAILED(hr) || !locator) { fprintf(stderr, "ERROR: Failed CoCreateInstance(CLSID_WbemLocator).\n"); return false; }
+	char backend[16];
+	char key[BACKEND_KEY_LENGTH];
+} absent_t;
 
-	// Connect to WMI
-	IWbemServices *services = NULL;
-	BSTR bstrResource = SysAllocString(L"ROOT\\WMI"); // "\\\\.\\ROOT\\wmi"
-	hr = locator->lpVtbl->ConnectServer(locator, bstrResource, NULL, NULL, NULL, 0, NULL, NULL, &services);
-	if (FAILED(hr) || !services) { fprintf(stderr, "ERROR: Failed ConnectServer().\n"); return false; }
-	SysFreeString(bstrResource);
+static absent_t absent[MONITOR_MAX_ABSENT];		// Only used by enumeration (which is not concurrent)
+static int absentCount = 0;
+static char *absentFile = NULL;
+static bool absentChanged = false;
 
-	// Proxy security levels
-	hr = CoSetProxyBlanket((IUnknown *)services, RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE, NULL, RPC_C_AUTHN_LEVEL_CALL, RPC_C_IMP_LEVEL_IMPERSONATE, NULL, EOAC_NONE);
-	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed CoSetProxyBlanket().\n"); return false; }
-
-	// Query
-	IEnumWbemClassObject *results = NULL;
-	BSTR bstrQuery = SysAllocString(L"SELECT * FROM WmiMonitorBrightness");
-	BSTR bstrQueryLanguage = SysAllocString(L"WQL");
-	hr = services->lpVtbl->ExecQuery(services, bstrQueryLanguage, bstrQuery, WBEM_FLAG_BIDIRECTIONAL, NULL, &results); // WBEM_FLAG_BIDIRECTIONAL or WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY
-	SysFreeString(bstrQueryLanguage);
-	SysFreeString(bstrQuery);
-
-	if (results != NULL)
+// Find (or create) the bus semaphore shared by all devices on the same bus (NULL if not limited)
+static platform_semaphore_t *AdapterSemaphore(const char *id)
+{
+	platform_semaphore_t *semaphore = NULL;
+	if (id[0] == '\0') return NULL;
+	PlatformMutexLock(&adapterLock);
+	for (int i = 0; i < adapterCount; i++)
+	{
+		if (strcmp(adapters[i].id, id) == 0)
+		{
+			semaphore = &adapters[i].semaphore;
+			break;
+		}
+	}
+	if (semaphore == NULL && adapterCount < MONITOR_MAX_ADAPTERS)
 	{
-		IWbemClassObject *result = NULL;
-		ULONG returnedCount = 0;
-		while ((hr = results->lpVtbl->Next(results, WBEM_INFINITE, 1, &result, &returnedCount)) == S_OK)
+		if (PlatformSemaphoreInit(&adapters[adapterCount].semaphore, MONITOR_ADAPTER_CONCURRENCY))
 		{
-			VARIANT vtInstanceName;
-			hr = result->lpVtbl->Get(result, L"InstanceName", 0, &vtInstanceName, 0, 0);
+			snprintf(adapters[adapterCount].id, sizeof(adapters[adapterCount].id), "%s", id);
+			semaphore = &adapters[adapterCount].semaphore;
+			adapterCount++;
+		}
+	}
+	PlatformMutexUnlock(&adapterLock);
+	return semaphore;
+}
+
+static void BusAcquire(platform_semaphore_t *busSemaphore)
+{
+	if (busSemaphore != NULL) PlatformSemaphoreAcquire(busSemaphore);
+}
 
-			VARIANT vtCurrentBrightness;
-			hr = result->lpVtbl->Get(result, L"CurrentBrightness", 0, &vtCurrentBrightness, 0, 0);
+static void BusRelease(platform_semaphore_t *busSemaphore)
+{
+	if (busSemaphore != NULL) PlatformSemaphoreRelease(busSemaphore);
+}
 
-			VARIANT vtLevels;
-			hr = result->lpVtbl->Get(result, L"Levels", 0, &vtLevels, 0, 0);	// count of levels
+// Record one read or write attempt through the brightness control (times from PlatformTimeMicroseconds)
+static void MonitorMetricsAttempt(monitor_t *monitor, bool write, uint64_t requested, uint64_t acquired, uint64_t completed, bool success)
+{
+	monitor_metrics_t *metrics = monitor->metrics;
+	PlatformMutexLock(&monitor->metricsLock);
+	HistogramRecord(&metrics->busWait, acquired - requested);
+	if (write)
+	{
+		metrics->writes++;
+		if (!success) metrics->writeErrors++;
+		HistogramRecord(&metrics->writeLatency, completed - acquired);
+	}
+	else
+	{
+		metrics->reads++;
+		if (!success) metrics->readErrors++;
+		HistogramRecord(&metrics->readLatency, completed - acquired);
+	}
+	PlatformMutexUnlock(&monitor->metricsLock);
+}
 
-			VARIANT vtLevel;
-			hr = result->lpVtbl->Get(result, L"Level", 0, &vtLevel, 0, 0);		// array of possible levels
+// Record the outcome of a read or write made under the policy, after its final attempt (numbered from 0)
+static void MonitorMetricsOutcome(monitor_t *monitor, bool write, int attempt, bool success)
+{
+	monitor_metrics_t *metrics = monitor->metrics;
+	PlatformMutexLock(&monitor->metricsLock);
+	if (write)
+	{
+		metrics->writeRetries += attempt;
+		if (!success) metrics->writeFailures++;
+	}
+	else
+	{
+		metrics->readRetries += attempt;
+		if (!success) metrics->readFailures++;
+	}
+	PlatformMutexUnlock(&monitor->metricsLock);
+}
 
-			// Locate the instance in the enumerated monitors
-			monitor_t *thisMonitor = NULL;
-			for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
-			{
-				if (_tcscmp(monitor->wmiInstance, vtInstanceName.bstrVal) == 0)		// NOTE: This comparison requires a UNICODE build
-				{
-					thisMonitor = monitor;
-				}
-			}
-			if (thisMonitor)
-			{
-				thisMonitor->hasWmiBrightness = true;
-				thisMonitor->wmiBrightness = vtCurrentBrightness.intVal;
-				// At this point, assume minimum of 0 and singly incrementing levels up to maximum
-				thisMonitor->wmiMinBrightness = 0;
-				thisMonitor->wmiMaxBrightness = thisMonitor->wmiMinBrightness + vtLevels.intVal - 1;
-			}
+bool MonitorRegisterBackend(backend_t *backend)
+{
+	if (backendCount >= MONITOR_MAX_BACKENDS) { fprintf(stderr, "ERROR: Too many backends.\n"); return false; }
+	backends[backendCount++] = backend;
+	return true;
+}
 
-			if (vtLevel.vt != VT_NULL && vtLevel.vt != VT_EMPTY && (vtLevel.vt & VT_ARRAY))
-			{
-				SAFEARRAY *pSafeArray = vtLevel.parray;
+// Master level mappings by monitor identity
+#define MONITOR_MAX_CURVES 32
 
-				long lLower;
-				SafeArrayGetLBound(pSafeArray, 1, &lLower);
-				UINT32 first = 0;
-				SafeArrayGetElement(pSafeArray, &lLower, &first);
+typedef struct
+{
+	char identity[BACKEND_KEY_LENGTH];
+	monitor_curve_t curve;
+} curve_entry_t;
 
-				long lUpper;
-				SafeArrayGetUBound(pSafeArray, 1, &lUpper);
-				UINT32 last = 0;
-				SafeArrayGetElement(pSafeArray, &lUpper, &last);
+static platform_mutex_t curveLock = PLATFORM_MUTEX_INIT;
+static curve_entry_t curves[MONITOR_MAX_CURVES];
+static int curveCount = 0;
 
-				if (last > first && thisMonitor)
-				{
-					// Take actual minimum and maximum, still assuming there are only single increments
-					thisMonitor->wmiMinBrightness = first;
-					thisMonitor->wmiMaxBrightness = last;
-				}
-			}
+// Retries are made outside of the bus, so other monitors can use it during the backoff
+static platform_mutex_t policyLock = PLATFORM_MUTEX_INIT;
+static monitor_policy_t policy = { 2, 50, 1000, 0 };
+static monitor_callback_t correctedCallback = NULL;
+static void *correctedContext = NULL;
 
-			//_tprintf(TEXT("WMI: instance=%ls, currentBrightness=%d, levels=%d (%d - %d)\n"), vtInstanceName.bstrVal, vtCurrentBrightness.intVal, vtLevels.intVal, thisMonitor->wmiMinBrightness, thisMonitor->wmiMaxBrightness);
-			VariantClear(&vtInstanceName);
-			VariantClear(&vtCurrentBrightness);
-			VariantClear(&vtLevels);
-			VariantClear(&vtLevel);
+void MonitorSetPolicy(const monitor_policy_t *newPolicy)
+{
+	PlatformMutexLock(&policyLock);
+	policy = *newPolicy;
+	PlatformMutexUnlock(&policyLock);
+}
 
-			result->lpVtbl->Release(result);
-		}
-		results->lpVtbl->Release(results);
-	}
+void MonitorGetPolicy(monitor_policy_t *currentPolicy)
+{
+	PlatformMutexLock(&policyLock);
+	*currentPolicy = policy;
+	PlatformMutexUnlock(&policyLock);
+}
 
-	services->lpVtbl->Release(services);
-	locator->lpVtbl->Release(locator);
+void MonitorSetCorrectedCallback(monitor_callback_t callback, void *context)
+{
+	PlatformMutexLock(&policyLock);
+	correctedCallback = callback;
+	correctedContext = context;
+	PlatformMutexUnlock(&policyLock);
+}
 
+// After a failed attempt (numbered from 0) of an operation started at 'start', wait for the backoff and return true if another attempt should be made
+static bool MonitorRetry(uint64_t start, int attempt)
+{
+	monitor_policy_t current;
+	MonitorGetPolicy(&current);
+	if (attempt >= current.retries) return false;
+	uint64_t delay = (uint64_t)current.backoff * 1000 << (attempt < 16 ? attempt : 16);
+	if (current.timeout > 0 && PlatformTimeMicroseconds() + delay - start >= (uint64_t)current.timeout * 1000) return false;
+	if (delay > 0) PlatformSleepMicroseconds(delay);
 	return true;
 }
 
-static bool EnumWmiMonitors(monitor_t *monitorList)
+// A read should not replace the stored brightness while a newer value is still being written (must hold the worker lock, so the check and the store are not separated by a post)
+static bool MonitorWriterBusy(monitor_t *monitor)
 {
-	HRESULT hr = 0;
+	return monitor->writerPending >= 0 || monitor->writerActive || monitor->fadeActive;
+}
 
-	// Create locator
-	IWbemLocator *locator = NULL;
-	hr = CoCreateInstance(&CLSID_WbemLocator, 0, CLSCTX_INPROC_SERVER, &IID_IWbemLocator, (LPVOID *)&locator);
-	if (FAILED(hr) || !locator) { fprintf(stderr, "ERROR: Failed CoCreateInstance(CLSID_WbemLocator).\n"); return false; }
+// Index of a monitor recorded as having no device from the backend, -1 if not recorded
+static int AbsentFind(const backend_t *backend, const char *key)
+{
+	for (int i = 0; i < absentCount; i++)
+	{
+		if (strcmp(absent[i].backend, backend->name) == 0 && strcmp(absent[i].key, key) == 0) return i;
+	}
+	return -1;
+}
 
-	// Connect to WMI
-	IWbemServices *services = NULL;
-	BSTR bstrResource = SysAllocString(L"ROOT\\WMI"); // "\\\\.\\ROOT\\wmi"
-	hr = locator->lpVtbl->ConnectServer(locator, bstrResource, NULL, NULL, NULL, 0, NULL, NULL, &services);
-	if (FAILED(hr) || !services) { fprintf(stderr, "ERROR: Failed ConnectServer().\n"); return false; }
-	SysFreeString(bstrResource);
+// Record whether the backend had a device for the monitor when last enumerated
+static void AbsentSet(const backend_t *backend, const char *key, bool isAbsent)
+{
+	int index = AbsentFind(backend, key);
+	if (isAbsent && index < 0 && absentCount < MONITOR_MAX_ABSENT && strlen(backend->name) < sizeof(absent[0].backend))
+	{
+		strcpy(absent[absentCount].backend, backend->name);
+		strcpy(absent[absentCount].key, key);
+		absentCount++;
+		absentChanged = true;
+	}
+	else if (!isAbsent && index >= 0)
+	{
+		absent[index] = absent[--absentCount];
+		absentChanged = true;
+	}
+}
 
-	// Proxy security levels
-	hr = CoSetProxyBlanket((IUnknown *)services, RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE, NULL, RPC_C_AUTHN_LEVEL_CALL, RPC_C_IMP_LEVEL_IMPERSONATE, NULL, EOAC_NONE);
-	if (FAILED(hr)) { fprintf(stderr, "ERROR: Failed CoSetProxyBlanket().\n"); return false; }
+static bool AbsentSave(void)
+{
+	if (absentFile == NULL || !absentChanged) return true;
+	FILE *fp = fopen(absentFile, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "ERROR: Cannot write attach cache: %s\n", absentFile);
+		return false;
+	}
+	for (int i = 0; i < absentCount; i++)
+	{
+		fprintf(fp, "%s\t%s\n", absent[i].backend, absent[i].key);
+	}
+	fclose(fp);
+	absentChanged = false;
+	return true;
+}
 
-	// Query
-	IEnumWbemClassObject *results = NULL;
-	BSTR bstrQuery = SysAllocString(L"SELECT * FROM WMIMonitorID");
-	BSTR bstrQueryLanguage = SysAllocString(L"WQL");
-	hr = services->lpVtbl->ExecQuery(services, bstrQueryLanguage, bstrQuery, WBEM_FLAG_BIDIRECTIONAL, NULL, &results); // WBEM_FLAG_BIDIRECTIONAL or WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY
-	SysFreeString(bstrQueryLanguage);
-	SysFreeString(bstrQuery);
+// Whether an attaching backend is worth enumerating: a monitor not known to be external is present that it was not found absent for when last queried, or it already has devices attached
+static bool AttachWanted(backend_t *backend, monitor_t *list, monitor_t **previous, int previousCount)
+{
+	for (monitor_t *monitor = list; monitor != NULL; monitor = monitor->next)
+	{
+		if (monitor->devices[0]->output != BACKEND_OUTPUT_EXTERNAL && AbsentFind(backend, monitor->devices[0]->key) < 0) return true;
+		for (int i = 1; i < monitor->deviceCount; i++) if (monitor->devices[i]->backend == backend) return true;
+	}
+	for (int i = 0; i < previousCount; i++)
+	{
+		if (previous[i] == NULL) continue;
+		for (int j = 1; j < previous[i]->deviceCount; j++) if (previous[i]->devices[j]->backend == backend) return true;
+	}
+	return false;
+}
 
-	if (results != NULL)
+void MonitorCleanup(void)
+{
+	MonitorSyncStop();
+	for (int i = 0; i < backendCount; i++)
 	{
-		IWbemClassObject *result = NULL;
-		ULONG returnedCount = 0;
-		while ((hr = results->lpVtbl->Next(results, WBEM_INFINITE, 1, &result, &returnedCount)) == S_OK)
-		{
-			VARIANT vtInstanceName;
-			hr = result->lpVtbl->Get(result, L"InstanceName", 0, &vtInstanceName, 0, 0);
+		if (backendWatched[i]) backends[i]->watch(backends[i], NULL, NULL);
+		backendWatched[i] = false;
+		if (backends[i]->shutdown != NULL) backends[i]->shutdown(backends[i]);
+	}
 
-			VARIANT vtManufacturerName;
-			hr = result->lpVtbl->Get(result, L"ManufacturerName", 0, &vtManufacturerName, 0, 0);
-			wchar_t *manufacturerName = variantU16ArrayToString(vtManufacturerName);
-			VariantClear(&vtManufacturerName);
+	PlatformMutexLock(&adapterLock);
+	for (int i = 0; i < adapterCount; i++)
+	{
+		PlatformSemaphoreDestroy(&adapters[i].semaphore);
+	}
+	adapterCount = 0;
+	PlatformMutexUnlock(&adapterLock);
+
+	MccsCacheClear();
+	VcpTimingSave();
+	VcpTimingClear();
+	AbsentSave();
+	free(absentFile);
+	absentFile = NULL;
+	absentCount = 0;
+
+	PlatformMutexLock(&curveLock);
+	curveCount = 0;
+	PlatformMutexUnlock(&curveLock);
+}
 
-			VARIANT vtUserFriendlyName;
-			hr = result->lpVtbl->Get(result, L"UserFriendlyName", 0, &vtUserFriendlyName, 0, 0);
-			wchar_t *userFriendlyName = variantU16ArrayToString(vtUserFriendlyName);
-			VariantClear(&vtUserFriendlyName);
+bool MonitorSetCapabilitiesCache(const char *filename)
+{
+	return MccsCacheLoad(filename);
+}
 
-			// VARIANT vtProductCodeID;
-			// hr = result->lpVtbl->Get(result, L"ProductCodeID", 0, &vtProductCodeID, 0, 0);
-			// wchar_t *productCodeID = variantU16ArrayToString(vtProductCodeID);
-			// VariantClear(&vtProductCodeID);
+bool MonitorSetTimingCache(const char *filename)
+{
+	return VcpTimingLoad(filename);
+}
 
-			// VARIANT vtSerialNumberID;
-			// hr = result->lpVtbl->Get(result, L"SerialNumberID", 0, &vtSerialNumberID, 0, 0);
-			// wchar_t *serialNumberID = variantU16ArrayToString(vtSerialNumberID);
-			// VariantClear(&vtSerialNumberID);
+bool MonitorSetAttachCache(const char *filename)
+{
+	free(absentFile);
+	absentFile = NULL;
+	absentCount = 0;
+	absentChanged = false;
+	if (filename != NULL && (absentFile = (char *)malloc(strlen(filename) + 1)) != NULL) strcpy(absentFile, filename);
+	FILE *fp = (filename != NULL) ? fopen(filename, "r") : NULL;
+	if (fp == NULL) return false;
+
+	char line[sizeof(absent_t) + 8];
+	while (fgets(line, sizeof(line), fp) != NULL && absentCount < MONITOR_MAX_ABSENT)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		char *tab = strchr(line, '\t');
+		if (tab == NULL || tab == line || tab - line >= (int)sizeof(absent[0].backend) || strlen(tab + 1) >= BACKEND_KEY_LENGTH || tab[1] == '\0') continue;
+		*tab = '\0';
+		strcpy(absent[absentCount].backend, line);
+		strcpy(absent[absentCount].key, tab + 1);
+		absentCount++;
+	}
+	fclose(fp);
+	return true;
+}
 
-			//VARIANT vtYearOfManufacture;
-			//hr = result->lpVtbl->Get(result, L"YearOfManufacture", 0, &vtYearOfManufacture, 0, 0);
 
-			//_tprintf(TEXT("WMI: instance=%s; manufacturer=%s; userFriendly=%s; productCodeID=%s; serialNumberID=%s;\n"), vtInstanceName.bstrVal, manufacturerName, userFriendlyName, productCodeID, serialNumberID);
+// The MCCS capabilities of a device with raw VCP access: cached by identity, otherwise fetched and parsed (must hold the bus).
+// *absent is set if the device has no capabilities string at all (no raw VCP access, or the backend reports none), rather than one that failed to fetch or parse.
+static bool MonitorDeviceMccs(backend_device_t *device, mccs_caps_t *mccs, bool *absent)
+{
+	*absent = true;
+	if (device->backend->capabilitiesString == NULL || device->backend->vcpGet == NULL) return false;
+	*absent = false;
+	if (MccsCacheLookup(device->identity, mccs)) return true;
+
+	char *capabilities = (char *)malloc(MCCS_CAPABILITIES_LENGTH);
+	device->unsupported = false;
+	bool success = capabilities != NULL && device->backend->capabilitiesString(device, capabilities, MCCS_CAPABILITIES_LENGTH);
+	device->lastCommand = PlatformTimeMicroseconds();	// Also spaced from the next command
+	if (!success && device->unsupported) *absent = true;
+	success = success && MccsParse(capabilities, mccs);
+	free(capabilities);
+	if (success) MccsCacheStore(device->identity, mccs);
+	return success;
+}
 
-			// Locate the instance in the enumerated monitors
-			monitor_t *thisMonitor = NULL;
-			for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
-			{
-				// ...where we have a non-empty prefix and have not yet located the full instance path...
-				if (monitor->wmiInstancePrefix[0] != 0 && monitor->wmiInstance[0] == 0)
-				{
-					// NOTE: The build has to be UNICODE for direct comparisons with BSTR
-					// ...and the prefix matches...
-					if (_tcsnccmp(monitor->wmiInstancePrefix, vtInstanceName.bstrVal, _tcslen(monitor->wmiInstancePrefix)) == 0)
-					{
-						// ...this is the instance
-						thisMonitor = monitor;
-					}
-				}
-			}
-			if (thisMonitor)
-			{
-				_tcscpy_s(thisMonitor->wmiInstance, _countof(thisMonitor->wmiInstance), vtInstanceName.bstrVal);
-			}
+// Brightness capabilities from a read of the brightness feature (must hold the bus)
+static bool MonitorVcpCaps(backend_device_t *device, backend_caps_t *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+	vcp_value_t value = { VCP_BRIGHTNESS };
+	if (VcpRead(device, &value, 1) != 1) return false;
+	caps->hasBrightness = true;
+	caps->minimum = 0;
+	caps->current = value.current;
+	caps->maximum = value.maximum;
+	return true;
+}
 
-			VariantClear(&vtInstanceName);
-			free(manufacturerName);
-			free(userFriendlyName);
-			//VariantClear(&vtYearOfManufacture);	
+// Brightness capabilities from the MCCS capabilities and a read of the brightness feature (must hold the bus)
+static bool MonitorMccsCaps(backend_device_t *device, const mccs_caps_t *mccs, backend_caps_t *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+	if (MccsFindVcp(mccs, VCP_BRIGHTNESS) == NULL) return true;
+	return MonitorVcpCaps(device, caps);
+}
 
-			result->lpVtbl->Release(result);
-		}
-		results->lpVtbl->Release(results);
-	}
-	services->lpVtbl->Release(services);
-	locator->lpVtbl->Release(locator);
-	return true;
+// Probe a device's capabilities, using the capabilities cache where possible (the capabilities string can take several hundred milliseconds to fetch)
+static void MonitorProbeDevice(monitor_t *monitor, int slot)
+{
+	backend_device_t *device = monitor->devices[slot];
+	platform_semaphore_t *busSemaphore = AdapterSemaphore(device->bus);
+	uint64_t trace = TraceBegin();
+	BusAcquire(busSemaphore);
+	mccs_caps_t *mccs = (mccs_caps_t *)malloc(sizeof(mccs_caps_t));
+	bool absent = true;
+	bool success = mccs != NULL && MonitorDeviceMccs(device, mccs, &absent) && MonitorMccsCaps(device, mccs, &monitor->caps[slot]);
+	free(mccs);
+	// A capabilities string that failed is not fetched again (as the backend's own capabilities() may, e.g. the Windows high-level API): the brightness feature is read directly
+	if (!success && !absent) success = MonitorVcpCaps(device, &monitor->caps[slot]);
+	else if (!success) success = device->backend->capabilities(device, &monitor->caps[slot]);
+	BusRelease(busSemaphore);
+	if (!success) memset(&monitor->caps[slot], 0, sizeof(monitor->caps[slot]));
+	TraceEnd(trace, "monitor", "probe", device->key, success ? 1 : 0);
 }
 
-static void MonitorUpdateBrightness(monitor_t *monitor)
+// Use the first device with brightness, -1 if none
+static int MonitorSelectControl(const monitor_t *monitor)
 {
-	if (monitor->hasBrightness)
+	for (int i = 0; i < monitor->deviceCount; i++)
 	{
-		// Get current brightness
-		DWORD dwMinimumBrightness = 0, dwCurrentBrightness = 0, dwMaximumBrightness = 0;
-		BOOL bResult = GetMonitorBrightness(monitor->physicalMonitor.hPhysicalMonitor, &dwMinimumBrightness, &dwCurrentBrightness, &dwMaximumBrightness);
-		//if (!bResult) { _ftprintf(stderr, TEXT("WARNING: GetMonitorBrightness() failed (perhaps the monitor does not support DDC/CI?): 0x%08x\n"), GetLastError()); }
-		if (bResult)
-		{
-			monitor->minBrightness = dwMinimumBrightness;
-			monitor->brightness = dwCurrentBrightness;
-			monitor->maxBrightness = dwMaximumBrightness;
-		}
+		if (monitor->caps[i].hasBrightness && monitor->caps[i].maximum > monitor->caps[i].minimum) return i;
 	}
+	return -1;
 }
 
-static void MonitorCreate(monitor_t *monitor, MONITORINFOEX monitorInfo, DISPLAY_DEVICE displayDevice, DISPLAY_DEVICE displayDeviceInterface, PHYSICAL_MONITOR physicalMonitor)
+// Device for raw VCP feature access, NULL if none
+static backend_device_t *MonitorVcpDevice(monitor_t *monitor)
 {
-	memset(monitor, 0, sizeof(monitor_t));
-	
-	monitor->monitorInfo = monitorInfo;
-	monitor->displayDevice = displayDevice;
-	monitor->displayDeviceInterface = displayDeviceInterface;
-	monitor->physicalMonitor = physicalMonitor;
+	if (monitor->deviceCount > 0 && monitor->devices[0]->backend->vcpGet != NULL) return monitor->devices[0];
+	return NULL;
+}
 
-	DWORD dwMonitorCapabilities = 0, dwSupportedColorTemperatures = 0;
-	BOOL bResult = GetMonitorCapabilities(monitor->physicalMonitor.hPhysicalMonitor, &dwMonitorCapabilities, &dwSupportedColorTemperatures);
-	// This will fail if DDC/CI not supported (e.g. for internal panels) -- but the WMI interface may still be supported
-	//if (!bResult) { _ftprintf(stderr, TEXT("WARNING: GetMonitorCapabilities() failed: 0x%08x\n"), GetLastError()); } // 0x1f = ERROR_GEN_FAILURE
-	if (bResult)
+// Store the results of a refresh pass for the requested features
+static void MonitorStoreFeatures(monitor_t *monitor, const vcp_value_t *values, int count)
+{
+	for (int i = 0; i < count && i < monitor->featureCount; i++)
 	{
-		monitor->hasBrightness = (dwMonitorCapabilities & MC_CAPS_BRIGHTNESS) != 0;
-		MonitorUpdateBrightness(monitor);
+		if (values[i].ok) monitor->features[i] = values[i];
 	}
+}
+
+static void MonitorUpdateBrightness(monitor_t *monitor)
+{
+	backend_device_t *vcpDevice = MonitorVcpDevice(monitor);
+	vcp_value_t values[VCP_MAX_FEATURES + 1];
 
-	// monitor->displayDeviceInterface.DeviceID: \\?\DISPLAY#ACME1234#9&abcdef9&0&UID12345#{abcdef01-abcd-abcd-abcd-abcdef012345}
-	// WMI instance is: DISPLAY\ACME1234\9&abcdef9&0&UID12345_0
-	// WMI PATH: WmiMonitorBrightnessMethods.InstanceName="DISPLAY\ACME1234\9&abcdef9&0&UID12345_0"
-	// Determine WMI instance prefix from device interface name
-	if (monitor->displayDeviceInterface.DeviceID[0] != '\0')
+	monitor->readChanged = false;
+	if (monitor->control >= 0)
 	{
-		TCHAR *src = monitor->displayDeviceInterface.DeviceID;
-		// Remove a prefix of "\\?\"
-		if (src[0] == TEXT('\\') && src[1] == TEXT('\\') && src[2] == TEXT('?') && src[3] == TEXT('\\')) src += 4;
-		TCHAR *dst = monitor->wmiInstancePrefix;
-		for (;;)
+		backend_device_t *device = monitor->devices[monitor->control];
+		int value = 0;
+		bool success = false;
+		uint64_t start = PlatformTimeMicroseconds();
+		int attempt;
+		for (attempt = 0; !success; attempt++)
 		{
-			TCHAR c = *src++;
-			// Hash (#) turns in to backslash (\), unless followed by open curly brace ({) which ends the string
-			if (c == TEXT('#'))
+			uint64_t requested = PlatformTimeMicroseconds();
+			BusAcquire(monitor->busSemaphore);
+			uint64_t acquired = PlatformTimeMicroseconds();
+			if (device == vcpDevice)
+			{
+				// Brightness and any additional features in a single pass
+				values[0].code = VCP_BRIGHTNESS;
+				for (int i = 0; i < monitor->featureCount; i++) values[i + 1].code = monitor->features[i].code;
+				VcpRead(device, values, monitor->featureCount + 1);
+				success = values[0].ok;
+				value = values[0].current;
+				MonitorStoreFeatures(monitor, values + 1, monitor->featureCount);
+			}
+			else
 			{
-				if (*src == TEXT('{')) c = 0;
-				else c = TEXT('\\');
+				success = device->backend->get(device, &value);
 			}
-			*dst++ = c;
-			if (c == 0) break;
+			uint64_t completed = PlatformTimeMicroseconds();
+			BusRelease(monitor->busSemaphore);
+			MonitorMetricsAttempt(monitor, false, requested, acquired, completed, success);
+			if (!success && !MonitorRetry(start, attempt)) break;
 		}
+		MonitorMetricsOutcome(monitor, false, success ? attempt - 1 : attempt, success);	// On failure, the stored value is kept, but is not confirmed
+		PlatformMutexLock(&monitor->workerLock);
+		if (success && !MonitorWriterBusy(monitor))
+		{
+			if (value != monitor->caps[monitor->control].current) monitor->readChanged = true;
+			monitor->caps[monitor->control].current = value;
+			monitor->confirmed = value;
+		}
+		PlatformMutexUnlock(&monitor->workerLock);
+		if (monitor->readChanged)
+		{
+			PlatformMutexLock(&monitor->metricsLock);
+			monitor->metrics->changes++;
+			PlatformMutexUnlock(&monitor->metricsLock);
+		}
+		if (device == vcpDevice) return;
 	}
 
+	// Features from another device than the brightness control
+	if (vcpDevice != NULL && monitor->featureCount > 0)
+	{
+		platform_semaphore_t *busSemaphore = AdapterSemaphore(vcpDevice->bus);
+		for (int i = 0; i < monitor->featureCount; i++) values[i].code = monitor->features[i].code;
+		BusAcquire(busSemaphore);
+		VcpRead(vcpDevice, values, monitor->featureCount);
+		BusRelease(busSemaphore);
+		MonitorStoreFeatures(monitor, values, monitor->featureCount);
+	}
 }
 
-void MonitorDump(FILE *file, monitor_t *monitor)
+void MonitorSetRefreshFeatures(monitor_t *monitor, const uint8_t *codes, int count)
 {
-	_ftprintf(file, TEXT("PHYSICAL_MONITOR: description=%ls\n"), monitor->physicalMonitor.szPhysicalMonitorDescription); // Acme 1234
-	_ftprintf(file, TEXT("INFO: hasBrightness=%s\n"), monitor->hasBrightness ? TEXT("true") : TEXT("false"));
-	_ftprintf(file, TEXT("INFO: brightness=%d\n"), monitor->brightness);
-	_ftprintf(file, TEXT("INFO: minBrightness=%d\n"), monitor->minBrightness);
-	_ftprintf(file, TEXT("INFO: maxBrightness=%d\n"), monitor->maxBrightness);
+	if (count > VCP_MAX_FEATURES) count = VCP_MAX_FEATURES;
+	PlatformMutexLock(&monitor->workerLock);
+	for (int i = 0; i < count; i++)
+	{
+		memset(&monitor->features[i], 0, sizeof(monitor->features[i]));
+		monitor->features[i].code = codes[i];
+	}
+	monitor->featureCount = count;
+	PlatformMutexUnlock(&monitor->workerLock);
+}
 
-	_ftprintf(file, TEXT("MONITOR: monitorInfo.dwFlags=0x%08x\n"), monitor->monitorInfo.dwFlags);	// MONITORINFOF_PRIMARY=0x00000001
-	_ftprintf(file, TEXT("MONITOR: monitorInfo.szDevice=%s\n"), monitor->monitorInfo.szDevice);		// \\.\DISPLAY1
+const vcp_value_t *MonitorGetFeature(monitor_t *monitor, uint8_t code)
+{
+	for (int i = 0; i < monitor->featureCount; i++)
+	{
+		if (monitor->features[i].code == code) return monitor->features[i].ok ? &monitor->features[i] : NULL;
+	}
+	return NULL;
+}
 
-	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceName=%s\n"), monitor->displayDevice.DeviceName);		// \\.\DISPLAY1\Monitor0
-	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceString=%s\n"), monitor->displayDevice.DeviceString);	// Acme 1234
-	_ftprintf(file, TEXT("DISPLAY: displayDevice.StateFlags=0x%08x\n"), monitor->displayDevice.StateFlags);	// DISPLAY_DEVICE_ACTIVE=0x00000001, DISPLAY_DEVICE_ATTACHED=0x00000002
-	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceID=%s\n"), monitor->displayDevice.DeviceID);			// MONITOR\ACME1234\{01234567-0123-0123-0123-0123456789ab}\0001
-	_ftprintf(file, TEXT("DISPLAY: displayDevice.DeviceKey=%s\n"), monitor->displayDevice.DeviceKey);		// \Registry\Machine\System\CurrentControlSet\Control\Class\{01234567-0123-0123-0123-0123456789ab}\0001
+int MonitorReadFeatures(monitor_t *monitor, vcp_value_t *values, int count)
+{
+	backend_device_t *vcpDevice = MonitorVcpDevice(monitor);
+	if (vcpDevice == NULL) return 0;
+	platform_semaphore_t *busSemaphore = AdapterSemaphore(vcpDevice->bus);
+	BusAcquire(busSemaphore);
+	int result = VcpRead(vcpDevice, values, count);
+	BusRelease(busSemaphore);
+	return result;
+}
 
-	_ftprintf(file, TEXT("DISPLAY: displayDeviceInterface.DeviceID=%s\n"), monitor->displayDeviceInterface.DeviceID);	// \\?\DISPLAY#ACME1234#9&abcdef9&0&UID12345#{abcdef01-abcd-abcd-abcd-abcdef012345}
+int MonitorWriteFeatures(monitor_t *monitor, vcp_value_t *values, int count)
+{
+	backend_device_t *vcpDevice = MonitorVcpDevice(monitor);
+	if (vcpDevice == NULL) return 0;
+	platform_semaphore_t *busSemaphore = AdapterSemaphore(vcpDevice->bus);
+	BusAcquire(busSemaphore);
+	int result = VcpWrite(vcpDevice, values, count);
+	BusRelease(busSemaphore);
+	return result;
+}
 
-	_ftprintf(file, TEXT("WMI: wmiInstancePrefix=%s\n"), monitor->wmiInstancePrefix);	// prefix (i.e. without trailing "_0" etc): DISPLAY\ACME1234\9&abcdef9&0&UID12345
-	_ftprintf(file, TEXT("WMI: wmiInstance=%s\n"), monitor->wmiInstance);				// DISPLAY\ACME1234\9&abcdef9&0&UID12345_0
-	_ftprintf(file, TEXT("WMI: wmiHasBrightness=%s\n"), monitor->hasWmiBrightness ? TEXT("true") : TEXT("false"));
-	_ftprintf(file, TEXT("WMI: wmiBrightness=%d\n"), monitor->wmiBrightness);
-	_ftprintf(file, TEXT("WMI: wmiMinBrightness=%d\n"), monitor->wmiMinBrightness);
-	_ftprintf(file, TEXT("WMI: wmiMaxBrightness=%d\n"), monitor->wmiMaxBrightness);
+static uint32_t MonitorIdHash(int id)
+{
+	return LookupHash(&id, sizeof(id));
 }
 
-static void MonitorDestroy(monitor_t *monitor)
+static uint32_t MonitorPointerHash(const void *pointer)
 {
-	DestroyPhysicalMonitors(1, &monitor->physicalMonitor);
+	return LookupHash(&pointer, sizeof(pointer));
 }
 
-bool MonitorHasBrightness(monitor_t *monitor)
+static monitor_t *MonitorAlloc(void)
 {
-	return monitor->hasBrightness || monitor->hasWmiBrightness;
+	monitor_t *monitor = (monitor_t *)calloc(1, sizeof(monitor_t));
+	monitor->caps = (backend_caps_t *)calloc(MONITOR_MAX_DEVICES, sizeof(backend_caps_t));
+	monitor->metrics = (monitor_metrics_t *)calloc(1, sizeof(monitor_metrics_t));
+	PlatformMutexLock(&monitorIdLock);
+	monitor->id = monitorNextId++;
+	PlatformMutexUnlock(&monitorIdLock);
+	PlatformMutexInit(&monitor->workerLock);
+	PlatformCondInit(&monitor->workerChanged);
+	PlatformMutexInit(&monitor->metricsLock);
+	monitor->writerPending = -1;
+	monitor->control = -1;
+	monitor->confirmed = -1;
+	return monitor;
 }
 
-int MonitorGetBrightness(monitor_t *monitor)
+// Whether a monitor at a list position is to be probed
+static bool MonitorProbeWanted(monitor_t *monitor, int index)
 {
-	if (monitor->hasBrightness)
-	{
-		int range = monitor->maxBrightness - monitor->minBrightness;
-		if (range <= 0) return 0;
-		return (monitor->brightness - monitor->minBrightness) * 100 / range;
-	}
-	else if (monitor->hasWmiBrightness)
+	return probeFilter == NULL || probeFilter(index, MonitorGetIdentity(monitor), probeFilterContext);
+}
+
+static monitor_t *MonitorCreate(backend_device_t *device, int index)
+{
+	monitor_t *monitor = MonitorAlloc();
+	monitor->devices[0] = device;
+	monitor->deviceCount = 1;
+	device->owner = monitor;
+	if (MonitorProbeWanted(monitor, index)) MonitorProbeDevice(monitor, 0);
+	monitor->control = MonitorSelectControl(monitor);
+	if (monitor->control >= 0)
 	{
-		// TODO: WMI mode should use the enumeration of accepted brightness values (not just assume they're continuous)
-		int range = monitor->wmiMaxBrightness - monitor->wmiMinBrightness;
-		if (range <= 0) return 0;
-		return (monitor->wmiBrightness - monitor->wmiMinBrightness) * 100 / range;
+		monitor->busSemaphore = AdapterSemaphore(device->bus);
+		monitor->confirmed = monitor->caps[monitor->control].current;
 	}
-	else
+	return monitor;
+}
+
+void MonitorGetMetrics(monitor_t *monitor, monitor_metrics_t *metrics)
+{
+	PlatformMutexLock(&monitor->metricsLock);
+	*metrics = *monitor->metrics;
+	PlatformMutexUnlock(&monitor->metricsLock);
+}
+
+static void MonitorDumpHistogram(FILE *file, const char *name, const histogram_t *histogram)
+{
+	fprintf(file, "METRICS: %s count=%llu", name, (unsigned long long)histogram->count);
+	if (histogram->count > 0)
 	{
-		return 0;
+		fprintf(file, " min=%llu p50=%llu p90=%llu p99=%llu max=%llu (us)", (unsigned long long)histogram->minimum,
+			(unsigned long long)HistogramPercentile(histogram, 50), (unsigned long long)HistogramPercentile(histogram, 90),
+			(unsigned long long)HistogramPercentile(histogram, 99), (unsigned long long)histogram->maximum);
 	}
+	fprintf(file, "\n");
 }
 
-void MonitorSetBrightness(monitor_t *monitor, int brightness)
+void MonitorDump(FILE *file, monitor_t *monitor)
 {
-	if (monitor->hasBrightness)
+	fprintf(file, "INFO: description=%ls\n", MonitorGetDescription(monitor));
+	fprintf(file, "INFO: hasBrightness=%s\n", MonitorHasBrightness(monitor) ? "true" : "false");
+	fprintf(file, "INFO: id=%d\n", monitor->id);
+	fprintf(file, "INFO: control=%d\n", monitor->control);
+	fprintf(file, "INFO: identity=%s\n", MonitorGetIdentity(monitor));
+	fprintf(file, "INFO: confirmed=%d\n", monitor->confirmed);
+	monitor_metrics_t *metrics = (monitor_metrics_t *)malloc(sizeof(monitor_metrics_t));
+	if (metrics != NULL)
 	{
-		int range = monitor->maxBrightness - monitor->minBrightness;
-		if (range <= 0) return;
-		int value = brightness * range / 100 + monitor->minBrightness;
-		SetMonitorBrightness(monitor->physicalMonitor.hPhysicalMonitor, value);
-		monitor->brightness = value;
+		MonitorGetMetrics(monitor, metrics);
+		fprintf(file, "METRICS: reads=%d errors=%d retries=%d failures=%d\n", metrics->reads, metrics->readErrors, metrics->readRetries, metrics->readFailures);
+		fprintf(file, "METRICS: writes=%d errors=%d retries=%d failures=%d coalesced=%d mismatches=%d\n", metrics->writes, metrics->writeErrors, metrics->writeRetries, metrics->writeFailures, metrics->coalesced, metrics->mismatches);
+		fprintf(file, "METRICS: changes=%d\n", metrics->changes);
+		MonitorDumpHistogram(file, "readLatency", &metrics->readLatency);
+		MonitorDumpHistogram(file, "writeLatency", &metrics->writeLatency);
+		MonitorDumpHistogram(file, "busWait", &metrics->busWait);
+		free(metrics);
 	}
-	else if (monitor->hasWmiBrightness)
+	if (monitor->restored != NULL) fprintf(file, "INFO: restored backend=%s\n", monitor->restored->backend);
+	for (int i = 0; i < monitor->deviceCount; i++)
 	{
-		// TODO: WMI mode should use the enumeration of accepted brightness values (not just assume they're continuous)
-		int range = monitor->wmiMaxBrightness - monitor->wmiMinBrightness;
-		if (range <= 0) return;
-		int value = brightness * range / 100 + monitor->wmiMinBrightness;
-		WmiSetBrightness(monitor, value);
-		monitor->wmiBrightness = value;
+		backend_device_t *device = monitor->devices[i];
+		backend_caps_t *caps = &monitor->caps[i];
+		fprintf(file, "DEVICE: #%d backend=%s\n", i, device->backend->name);
+		fprintf(file, "DEVICE: key=%s\n", device->key);
+		fprintf(file, "DEVICE: bus=%s\n", device->bus);
+		fprintf(file, "DEVICE: hasBrightness=%s\n", caps->hasBrightness ? "true" : "false");
+		fprintf(file, "DEVICE: brightness=%d\n", caps->current);
+		fprintf(file, "DEVICE: minBrightness=%d\n", caps->minimum);
+		fprintf(file, "DEVICE: maxBrightness=%d\n", caps->maximum);
+		fprintf(file, "DEVICE: levels=%d\n", caps->levelCount);
+		fprintf(file, "DEVICE: commandInterval=%d\n", VcpInterval(device));
+		if (device->backend->dump != NULL) device->backend->dump(device, file);
 	}
 }
 
-static BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hDC, LPRECT lpRect, LPARAM lParam)
+// Capabilities of the brightness control (or as restored from the snapshot), NULL if none
+static backend_caps_t *MonitorControlCaps(monitor_t *monitor)
 {
-	//_tprintf(TEXT("===\n"));
-	enum_state_t *enumState = (enum_state_t *)lParam;
-
-	DWORD dwNumberOfPhysicalMonitors = 0;
-	BOOL bResult = GetNumberOfPhysicalMonitorsFromHMONITOR(hMonitor, &dwNumberOfPhysicalMonitors);
-	if (!bResult) { fprintf(stderr, "ERROR: Failed GetNumberOfPhysicalMonitorsFromHMONITOR().\n"); return TRUE; }	// continue anyway
-	//	_tprintf(TEXT("MONITOR: Physical monitors=%d\n"), dwNumberOfPhysicalMonitors);
-
-	PHYSICAL_MONITOR *physicalMonitors = (PHYSICAL_MONITOR *)malloc(dwNumberOfPhysicalMonitors * sizeof(PHYSICAL_MONITOR));
-	bResult = GetPhysicalMonitorsFromHMONITOR(hMonitor, dwNumberOfPhysicalMonitors, physicalMonitors);
-	if (!bResult) { fprintf(stderr, "ERROR: Failed GetPhysicalMonitorsFromHMONITOR().\n"); return TRUE; }	// continue anyway
-	for (DWORD i = 0; i < dwNumberOfPhysicalMonitors; i++)
-	{
-		//_tprintf(TEXT("---\n"));
-		monitor_t *newMonitor = (monitor_t *)malloc(sizeof(monitor_t));
-
-		//_tprintf(TEXT("PHYSICAL_MONITOR: description=%ls\n"), physicalMonitors[i].szPhysicalMonitorDescription); // Acme 1234
-
-		// Find which display device(s) are given to this monitor (this could be outside the loop as the same for all physical monitors on this logical monitor)
-		MONITORINFOEX monitorInfo;
-		memset(&monitorInfo, 0, sizeof(monitorInfo));
-		monitorInfo.cbSize = sizeof(monitorInfo);
-		bResult = GetMonitorInfo(hMonitor, (LPMONITORINFO)&monitorInfo);
-		//_tprintf(TEXT("MONITOR: monitorInfo.dwFlags=0x%08x\n"), monitorInfo.dwFlags);	// MONITORINFOF_PRIMARY=0x00000001
-		//_tprintf(TEXT("MONITOR: monitorInfo.szDevice=%s\n"), monitorInfo.szDevice);		// \\.\DISPLAY1
+	if (monitor->control >= 0) return &monitor->caps[monitor->control];
+	if (monitor->restored != NULL && monitor->restored->caps.hasBrightness && monitor->restored->caps.maximum > monitor->restored->caps.minimum) return &monitor->restored->caps;
+	return NULL;
+}
 
-		// ...this might to be the same index as for EnumDisplayDevices?  Perhaps not if multiple video cards?
-		// ...we're only using the additional information to link the WMI interface to a monitor.
-		DISPLAY_DEVICE displayDevice;
-		memset(&displayDevice, 0, sizeof(displayDevice));
-		displayDevice.cb = sizeof(displayDevice);
-		EnumDisplayDevices(monitorInfo.szDevice, i, &displayDevice, 0);
+bool MonitorHasBrightness(monitor_t *monitor)
+{
+	return MonitorControlCaps(monitor) != NULL;
+}
 
-		DISPLAY_DEVICE displayDeviceInterface;
-		memset(&displayDeviceInterface, 0, sizeof(displayDeviceInterface));
-		displayDeviceInterface.cb = sizeof(displayDeviceInterface);
-		EnumDisplayDevices(monitorInfo.szDevice, i, &displayDeviceInterface, EDD_GET_DEVICE_INTERFACE_NAME);
+int MonitorGetBrightness(monitor_t *monitor)
+{
+	backend_caps_t *caps = MonitorControlCaps(monitor);
+	if (caps == NULL) return 0;
+	int range = caps->maximum - caps->minimum;
+	if (range <= 0) return 0;
+	return (caps->current - caps->minimum) * 100 / range;
+}
 
-		// (displayDevice.StateFlags & DISPLAY_DEVICE_ATTACHED_TO_DESKTOP)
-		// _tprintf(TEXT("DISPLAY: displayDevice.DeviceName=%s\n"), displayDevice.DeviceName);		// \\.\DISPLAY1\Monitor0
-		// _tprintf(TEXT("DISPLAY: displayDevice.DeviceString=%s\n"), displayDevice.DeviceString);	// Acme 1234
-		// _tprintf(TEXT("DISPLAY: displayDevice.StateFlags=0x%08x\n"), displayDevice.StateFlags);	// DISPLAY_DEVICE_ACTIVE=0x00000001, DISPLAY_DEVICE_ATTACHED=0x00000002
-		// _tprintf(TEXT("DISPLAY: displayDevice.DeviceID=%s\n"), displayDevice.DeviceID);			// MONITOR\ACME1234\{01234567-0123-0123-0123-0123456789ab}\0001
-		// _tprintf(TEXT("DISPLAY: displayDevice.DeviceKey=%s\n"), displayDevice.DeviceKey);		// \Registry\Machine\System\CurrentControlSet\Control\Class\{01234567-0123-0123-0123-0123456789ab}\0001
+// The nearest accepted raw value (if the control has discrete levels)
+static int MonitorNearestLevel(const backend_caps_t *caps, int value)
+{
+	if (caps->levelCount <= 0) return value;
+	int nearest = caps->levels[0];
+	for (int i = 1; i < caps->levelCount; i++)
+	{
+		if (abs(caps->levels[i] - value) < abs(nearest - value)) nearest = caps->levels[i];
+	}
+	return nearest;
+}
 
-		// Enum with flag to get interface name
-		// _tprintf(TEXT("DISPLAY: displayDeviceInterface.DeviceID=%s\n"), displayDeviceInterface.DeviceID);	// \\?\DISPLAY#ACME1234#9&abcdef9&0&UID12345#{abcdef01-abcd-abcd-abcd-abcdef012345}
-		// NOTE: WMI instance is: DISPLAY\ACME1234\9&abcdef9&0&UID12345_0
-		// NOTE WMI PATH=WmiMonitorBrightnessMethods.InstanceName="DISPLAY\ACME1234\9&abcdef9&0&UID12345_0"
+// Convert a percentage to the raw value for the monitor's brightness control (the nearest accepted level, if discrete), -1 if none
+static int MonitorBrightnessValue(monitor_t *monitor, int brightness)
+{
+	backend_caps_t *caps = MonitorControlCaps(monitor);
+	if (caps == NULL) return -1;
+	int range = caps->maximum - caps->minimum;
+	if (range <= 0) return -1;
+	return MonitorNearestLevel(caps, brightness * range / 100 + caps->minimum);
+}
 
-		// Create monitor object
-		MonitorCreate(newMonitor, monitorInfo, displayDevice, displayDeviceInterface, physicalMonitors[i]);
+// Blocking write of a raw value
+static bool MonitorWriteBrightness(monitor_t *monitor, int value)
+{
+	if (monitor->control < 0) return false;
+	backend_device_t *device = monitor->devices[monitor->control];
+	bool success;
+	uint64_t requested = PlatformTimeMicroseconds();
+	BusAcquire(monitor->busSemaphore);
+	uint64_t acquired = PlatformTimeMicroseconds();
+	if (device->backend->vcpSet != NULL)
+	{
+		vcp_value_t brightness = { VCP_BRIGHTNESS, false, value, 0 };
+		success = VcpWrite(device, &brightness, 1) == 1;
+	}
+	else
+	{
+		success = device->backend->set(device, value);
+	}
+	uint64_t completed = PlatformTimeMicroseconds();
+	BusRelease(monitor->busSemaphore);
+	MonitorMetricsAttempt(monitor, true, requested, acquired, completed, success);
+	return success;
+}
 
-		// Add to end of linked list
-		if (enumState->monitorList == NULL)
+// Write a raw value under the policy's retries
+static bool MonitorWriteChecked(monitor_t *monitor, int value)
+{
+	const char *key = (monitor->deviceCount > 0) ? monitor->devices[0]->key : NULL;
+	uint64_t trace = TraceBegin();
+	uint64_t start = PlatformTimeMicroseconds();
+	for (int attempt = 0; ; attempt++)
+	{
+		if (MonitorWriteBrightness(monitor, value))
+		{
+			MonitorMetricsOutcome(monitor, true, attempt, true);
+			TraceEnd(trace, "monitor", "write", key, attempt);
+			return true;
+		}
+		if (!MonitorRetry(start, attempt))
 		{
-			enumState->monitorList = newMonitor;
+			MonitorMetricsOutcome(monitor, true, attempt, false);
+			break;
 		}
+	}
+	TraceEnd(trace, "monitor", "write", key, -1);
+	return false;
+}
 
-		if (enumState->lastMonitor == NULL)
+// Read the raw value of the brightness control under the policy's retries
+static bool MonitorReadChecked(monitor_t *monitor, int *value)
+{
+	if (monitor->control < 0) return false;
+	backend_device_t *device = monitor->devices[monitor->control];
+	uint64_t trace = TraceBegin();
+	uint64_t start = PlatformTimeMicroseconds();
+	for (int attempt = 0; ; attempt++)
+	{
+		bool success;
+		uint64_t requested = PlatformTimeMicroseconds();
+		BusAcquire(monitor->busSemaphore);
+		uint64_t acquired = PlatformTimeMicroseconds();
+		if (device->backend->vcpGet != NULL)
 		{
-			newMonitor->index = 0;
+			vcp_value_t brightness = { VCP_BRIGHTNESS };
+			success = VcpRead(device, &brightness, 1) == 1;
+			*value = brightness.current;
 		}
 		else
 		{
-			newMonitor->index = enumState->lastMonitor->index + 1;
-			enumState->lastMonitor->next = newMonitor;
+			success = device->backend->get(device, value);
+		}
+		uint64_t completed = PlatformTimeMicroseconds();
+		BusRelease(monitor->busSemaphore);
+		MonitorMetricsAttempt(monitor, false, requested, acquired, completed, success);
+		if (success)
+		{
+			MonitorMetricsOutcome(monitor, false, attempt, true);
+			TraceEnd(trace, "monitor", "read", device->key, attempt);
+			return true;
+		}
+		if (!MonitorRetry(start, attempt))
+		{
+			MonitorMetricsOutcome(monitor, false, attempt, false);
+			break;
 		}
-		enumState->lastMonitor = newMonitor;
 	}
-	free(physicalMonitors);
+	TraceEnd(trace, "monitor", "read", device->key, -1);
+	return false;
+}
 
-	//_tprintf(TEXT("===\n"));
+// Whether to verify this burst's final value (an even sample of the policy's proportion of bursts)
+static bool MonitorVerifySample(monitor_t *monitor)
+{
+	monitor_policy_t current;
+	MonitorGetPolicy(&current);
+	monitor->verifyCredit += current.verifyPercent;
+	if (monitor->verifyCredit < 100) return false;
+	monitor->verifyCredit -= 100;
+	return true;
+}
 
-	return TRUE;
+// Confirm the final written value of a burst, returns the confirmed value (reading it back, for a sample of bursts), or -1 if unknown.
+// A value that reads back differently is written once more.
+static int MonitorConfirmWrite(monitor_t *monitor, int value, bool success)
+{
+	if (!success) return monitor->confirmed;
+	if (!MonitorVerifySample(monitor)) return value;
+	int actual;
+	if (!MonitorReadChecked(monitor, &actual)) return value;	// Acknowledged, but could not be read
+	if (actual == value) return value;
+	PlatformMutexLock(&monitor->metricsLock);
+	monitor->metrics->mismatches++;
+	PlatformMutexUnlock(&monitor->metricsLock);
+	if (MonitorWriteChecked(monitor, value) && MonitorReadChecked(monitor, &actual) && actual == value) return value;
+	return actual;
 }
 
-const wchar_t *MonitorGetDescription(monitor_t *monitor)
+static void MonitorStoreBrightness(monitor_t *monitor, int value)
 {
-	return monitor->physicalMonitor.szPhysicalMonitorDescription;
+	backend_caps_t *caps = MonitorControlCaps(monitor);
+	if (caps != NULL) caps->current = value;
+	if (monitor->restored != NULL) monitor->restoredChanged = true;
 }
 
-monitor_t *MonitorListEnumerate(void)
+bool MonitorSetBrightness(monitor_t *monitor, int brightness)
 {
-	// Enumerate physical monitors, check for DDC/CI control (typically for external displays).
-	enum_state_t state = {0};
-	EnumDisplayMonitors(NULL, NULL, MonitorEnumProc, (LPARAM)&state);
+	int value = MonitorBrightnessValue(monitor, brightness);
+	if (value < 0) return false;
+	MonitorCancelFade(monitor);
+	if (monitor->restored != NULL)
+	{
+		MonitorStoreBrightness(monitor, value);		// Applied once enumerated
+		return true;
+	}
+	bool success = MonitorWriteChecked(monitor, value);
+	int confirmed = MonitorConfirmWrite(monitor, value, success);
+	PlatformMutexLock(&monitor->workerLock);
+	monitor->confirmed = confirmed;
+	if (confirmed >= 0) MonitorStoreBrightness(monitor, confirmed);	// Replacing any value a read stored while writing
+	PlatformMutexUnlock(&monitor->workerLock);
+	return success && confirmed == value;
+}
 
-	// Enumerate WMI brightness controls (typically for internal panels?) and associate with physical display.
-_tprintf(TEXT("EnumWmiMonitors...\n"));
-	EnumWmiMonitors(state.monitorList);
+// Refresh deadline: a read is waited for at most this long once its bus is expected to be free (unless the backend gives its own)
+#define MONITOR_READ_DEADLINE_MS 250
 
-	// Initial fetch of WMI brightness values
-_tprintf(TEXT("WmiUpdateBrightness...\n"));
-	WmiUpdateBrightness(state.monitorList);
+typedef struct _refresh_batch_t refresh_batch_t;
 
-_tprintf(TEXT("...done\n"));
-	return state.monitorList;
-}
+typedef struct _refresh_item_t
+{
+	refresh_batch_t *batch;
+	monitor_t *monitor;
+	uint64_t deadline;		// Microseconds (PlatformTimeMicroseconds)
+	bool done;
+} refresh_item_t;
 
-void MonitorListRefreshBrightness(monitor_t *monitorList)
+struct _refresh_batch_t
 {
-	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	monitor_t *monitorList;
+	int references;			// Waiting caller (if any) and each outstanding read
+	int count;
+	refresh_item_t *items;
+	monitor_callback_t callback;	// Optional, called for each monitor as its value is read
+	void *context;
+};
+
+// Background reads outstanding (the list must not be destroyed while any are in progress)
+static platform_mutex_t refreshLock = PLATFORM_MUTEX_INIT;
+static platform_cond_t refreshChanged;
+static bool refreshInitialized = false;
+static int refreshOutstanding = 0;
+
+static void RefreshInit(void)
+{
+	// A list may be enumerated on another thread than the one refreshing a restored list
+	PlatformMutexLock(&refreshLock);
+	if (!refreshInitialized)
 	{
-		MonitorUpdateBrightness(monitor);
+		PlatformCondInit(&refreshChanged);
+		refreshInitialized = true;
 	}
+	PlatformMutexUnlock(&refreshLock);
+}
 
-	// Don't do any WMI update if there are no supported monitors
-	int wmiCount = 0;
-	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
-	{
-		if (monitor->hasWmiBrightness) wmiCount++;
-	}
-	if (wmiCount == 0)
-	{
-		return;
-	}
-	WmiUpdateBrightness(monitorList);
+// Drop a reference to a batch (must hold the lock), returns true if it should be freed
+static bool RefreshBatchRelease(refresh_batch_t *batch)
+{
+	return --batch->references == 0;
 }
 
-void MonitorListDestroy(monitor_t *monitorList)
+static void RefreshBatchFree(refresh_batch_t *batch)
 {
-	for (monitor_t *monitor = monitorList; monitor != NULL; )
+	free(batch->items);
+	free(batch);
+}
+
+static void RefreshRead(refresh_item_t *item)
+{
+	refresh_batch_t *batch = item->batch;
+
+	MonitorUpdateBrightness(item->monitor);
+	if (batch->callback) batch->callback(item->monitor, batch->context);
+
+	PlatformMutexLock(&refreshLock);
+	item->done = true;
+	item->monitor->readPending = false;
+	refreshOutstanding--;
+	bool release = RefreshBatchRelease(batch);
+	PlatformCondBroadcast(&refreshChanged);
+	PlatformMutexUnlock(&refreshLock);
+	if (release) RefreshBatchFree(batch);
+}
+
+// Record the confirmed value after the final write of a burst, correcting the stored value (and notifying) if the requested one was not applied.
+// A value posted in the meantime is left to its own write.
+static void MonitorNotifyCorrected(monitor_t *monitor)
+{
+	PlatformMutexLock(&policyLock);
+	monitor_callback_t callback = correctedCallback;
+	void *context = correctedContext;
+	PlatformMutexUnlock(&policyLock);
+	if (callback != NULL) callback(monitor, context);
+}
+
+static void MonitorCorrect(monitor_t *monitor, int value, int confirmed)
+{
+	PlatformMutexLock(&monitor->workerLock);
+	monitor->confirmed = confirmed;
+	bool correct = confirmed != value && confirmed >= 0 && monitor->writerPending < 0 && !monitor->fadeActive;
+	if (correct) MonitorStoreBrightness(monitor, confirmed);
+	PlatformMutexUnlock(&monitor->workerLock);
+	if (correct) MonitorNotifyCorrected(monitor);
+}
+
+// Brightness changed elsewhere (e.g. hotkeys or adaptive brightness on a laptop panel), reported by a watching backend from its own thread.
+// Ignored while a value of our own is being written (the device reports that change too).
+static void MonitorDeviceChanged(backend_device_t *device, int value, void *context)
+{
+	monitor_t *monitor = (monitor_t *)device->owner;
+	if (monitor == NULL) return;
+	PlatformMutexLock(&monitor->workerLock);
+	bool changed = monitor->control >= 0 && monitor->devices[monitor->control] == device && monitor->writerPending < 0 && !monitor->writerActive && !monitor->fadeActive && monitor->caps[monitor->control].current != value;
+	if (changed)
 	{
-		monitor_t *nextMonitor = monitor->next;
-		MonitorDestroy(monitor);
-		free(monitor);
-		monitor = nextMonitor;
+		MonitorStoreBrightness(monitor, value);
+		monitor->confirmed = value;
 	}
+	PlatformMutexUnlock(&monitor->workerLock);
+	if (changed) MonitorNotifyCorrected(monitor);
+}
+
+void MonitorSetProbeFilter(monitor_filter_t filter, void *context)
+{
+	probeFilter = filter;
+	probeFilterContext = context;
+}
+
+void MonitorSetWatching(bool enable)
+{
+	watching = enable;
 }
 
+// Start a backend reporting changes made elsewhere, once it has a device
+static void MonitorWatchBackend(int b)
+{
+	backend_t *backend = backends[b];
+	if (!watching || backendWatched[b] || backend->watch == NULL) return;
+	backendWatched[b] = backend->watch(backend, MonitorDeviceChanged, NULL);
+}
+
+// The fade's value at the given time, ending the fade at its duration (must hold the worker lock).
+// Values come from the clock rather than a fixed step size, so a slow device takes fewer, larger steps and still finishes on time.
+static int MonitorFadeStep(monitor_t *monitor, uint64_t now)
+{
+	uint64_t elapsed = now - monitor->fadeStart;
+	if (elapsed >= monitor->fadeDuration)
+	{
+		monitor->fadeActive = false;
+		return monitor->fadeTarget;
+	}
+	int value = monitor->fadeFrom + (int)((int64_t)(monitor->fadeTarget - monitor->fadeFrom) * (int64_t)elapsed / (int64_t)monitor->fadeDuration);
+	return MonitorNearestLevel(&monitor->caps[monitor->control], value);
+}
+
+// Per-monitor I/O worker: applies only the most recently posted value (values posted while a write is in progress replace each other), and performs refresh reads.
+// The final value is therefore applied at most one write duration after it is posted, and a pending write is issued before any read.
+// A fade is stepped between other requests: a posted value ends it, and a read is made between steps.
+static void MonitorWorker(void *context)
+{
+	monitor_t *monitor = (monitor_t *)context;
+	TraceThreadName("monitor worker");
+	PlatformMutexLock(&monitor->workerLock);
+	for (;;)
+	{
+		if (monitor->writerPending >= 0)
+		{
+			int value = monitor->writerPending;
+			monitor->writerPending = -1;
+			monitor->writerActive = true;
+			PlatformMutexUnlock(&monitor->workerLock);
+			bool success = MonitorWriteChecked(monitor, value);
+			PlatformMutexLock(&monitor->workerLock);
+			if (monitor->writerPending < 0 && !monitor->fadeActive)
+			{
+				// The final value of a burst
+				PlatformMutexUnlock(&monitor->workerLock);
+				MonitorCorrect(monitor, value, MonitorConfirmWrite(monitor, value, success));
+				PlatformMutexLock(&monitor->workerLock);
+			}
+			monitor->writerActive = false;
+		}
+		else if (monitor->readItem != NULL)
+		{
+			refresh_item_t *item = monitor->readItem;
+			monitor->readItem = NULL;
+			PlatformMutexUnlock(&monitor->workerLock);
+			RefreshRead(item);
+			PlatformMutexLock(&monitor->workerLock);
+		}
+		else if (monitor->workerExit && monitor->fadeActive)
+		{
+			// Finish immediately
+			monitor->fadeActive = false;
+			monitor->writerPending = monitor->fadeTarget;
+		}
+		else if (monitor->workerExit)
+		{
+			break;
+		}
+		else if (monitor->fadeActive)
+		{
+			uint64_t now = PlatformTimeMicroseconds();
+			if (now < monitor->fadeNext)
+			{
+				PlatformCondWait(&monitor->workerChanged, &monitor->workerLock, (int64_t)(monitor->fadeNext - now));
+				continue;
+			}
+			int value = MonitorFadeStep(monitor, now);
+			if (value == monitor->fadeValue && monitor->fadeActive)
+			{
+				monitor->fadeNext = now + MONITOR_FADE_MIN_STEP_US;
+				continue;
+			}
+			monitor->fadeValue = value;
+			monitor->writerActive = true;
+			PlatformMutexUnlock(&monitor->workerLock);
+			bool success = MonitorWriteBrightness(monitor, value);	// An intermediate step is not retried, as the next one soon follows
+			PlatformMutexLock(&monitor->workerLock);
+			if (!monitor->fadeActive && monitor->writerPending < 0)
+			{
+				// The fade's final value
+				PlatformMutexUnlock(&monitor->workerLock);
+				if (!success) success = MonitorWriteChecked(monitor, value);
+				MonitorCorrect(monitor, value, MonitorConfirmWrite(monitor, value, success));
+				PlatformMutexLock(&monitor->workerLock);
+			}
+			monitor->writerActive = false;
+
+			// The next step once the device can accept another command: each step waits for the write to complete (however long the device takes) and the interval required after a set
+			uint64_t completed = PlatformTimeMicroseconds();
+			int interval = VcpNextInterval(monitor->devices[monitor->control]);
+			monitor->fadeNext = completed + (uint64_t)interval;
+			if (monitor->fadeNext < now + MONITOR_FADE_MIN_STEP_US) monitor->fadeNext = now + MONITOR_FADE_MIN_STEP_US;
+		}
+		else
+		{
+			PlatformCondWait(&monitor->workerChanged, &monitor->workerLock, -1);
+		}
+	}
+	PlatformMutexUnlock(&monitor->workerLock);
+}
+
+// Start the worker on first use
+static bool MonitorWorkerStart(monitor_t *monitor)
+{
+	if (monitor->workerStarted) return true;
+	monitor->workerExit = false;
+	if (!PlatformThreadCreate(&monitor->worker, MonitorWorker, monitor))
+	{
+		fprintf(stderr, "ERROR: Failed to start monitor worker thread.\n");
+		return false;
+	}
+	monitor->workerStarted = true;
+	return true;
+}
+
+static void MonitorWorkerStop(monitor_t *monitor)
+{
+	if (!monitor->workerStarted) return;
+	PlatformMutexLock(&monitor->workerLock);
+	monitor->workerExit = true;
+	PlatformCondSignal(&monitor->workerChanged);
+	PlatformMutexUnlock(&monitor->workerLock);
+	PlatformThreadJoin(&monitor->worker);	// Any pending value is written first
+	monitor->workerStarted = false;
+}
+
+void MonitorPostBrightness(monitor_t *monitor, int brightness)
+{
+	int value = MonitorBrightnessValue(monitor, brightness);
+	if (value < 0) return;
+	if (monitor->restored != NULL || !MonitorWorkerStart(monitor))
+	{
+		MonitorStoreBrightness(monitor, value);
+		if (monitor->restored == NULL) MonitorWriteBrightness(monitor, value);	// Otherwise applied once enumerated
+		return;
+	}
+
+	// Stored with the pending value, so a read in between cannot replace it
+	PlatformMutexLock(&monitor->workerLock);
+	MonitorStoreBrightness(monitor, value);
+	bool coalesced = monitor->writerPending >= 0;
+	monitor->fadeActive = false;
+	monitor->writerPending = value;
+	PlatformCondSignal(&monitor->workerChanged);
+	PlatformMutexUnlock(&monitor->workerLock);
+
+	if (coalesced)
+	{
+		PlatformMutexLock(&monitor->metricsLock);
+		monitor->metrics->coalesced++;
+		PlatformMutexUnlock(&monitor->metricsLock);
+	}
+}
+
+void MonitorFadeBrightness(monitor_t *monitor, int brightness, int duration)
+{
+	int value = MonitorBrightnessValue(monitor, brightness);
+	if (value < 0) return;
+	if (duration <= 0 || monitor->restored != NULL || monitor->control < 0 || !MonitorWorkerStart(monitor))
+	{
+		MonitorPostBrightness(monitor, brightness);
+		return;
+	}
+
+	PlatformMutexLock(&monitor->workerLock);
+	if (!monitor->fadeActive)
+	{
+		// A value still to be written is where the fade starts from
+		monitor->fadeValue = (monitor->writerPending >= 0) ? monitor->writerPending : monitor->caps[monitor->control].current;
+	}
+	monitor->fadeFrom = monitor->fadeValue;		// Retargeted from the value last written
+	monitor->fadeTarget = value;
+	monitor->fadeStart = PlatformTimeMicroseconds();
+	monitor->fadeDuration = (uint64_t)duration * 1000;
+	monitor->fadeActive = true;
+	monitor->writerPending = -1;
+	MonitorStoreBrightness(monitor, value);
+	PlatformCondSignal(&monitor->workerChanged);
+	PlatformMutexUnlock(&monitor->workerLock);
+}
+
+void MonitorCancelFade(monitor_t *monitor)
+{
+	PlatformMutexLock(&monitor->workerLock);
+	if (monitor->fadeActive)
+	{
+		monitor->fadeActive = false;
+		MonitorStoreBrightness(monitor, monitor->fadeValue);
+		PlatformCondSignal(&monitor->workerChanged);
+	}
+	PlatformMutexUnlock(&monitor->workerLock);
+}
+
+bool MonitorIsFading(monitor_t *monitor)
+{
+	PlatformMutexLock(&monitor->workerLock);
+	bool fading = monitor->fadeActive;
+	PlatformMutexUnlock(&monitor->workerLock);
+	return fading;
+}
+
+// Index of a monitor's curve (must hold the lock), -1 if none
+static int CurveFind(const char *identity)
+{
+	for (int i = 0; i < curveCount; i++)
+	{
+		if (strcmp(curves[i].identity, identity) == 0) return i;
+	}
+	return -1;
+}
+
+bool MonitorSetCurve(const char *identity, const monitor_curve_t *curve)
+{
+	if (strlen(identity) >= BACKEND_KEY_LENGTH) return false;
+	if (curve != NULL)
+	{
+		bool valid = curve->count >= 0 && curve->count <= MONITOR_CURVE_POINTS && curve->offset >= -100 && curve->offset <= 100;
+		for (int i = 0; valid && i < curve->count; i++)
+		{
+			if (curve->master[i] < 0 || curve->master[i] > 100 || curve->brightness[i] < 0 || curve->brightness[i] > 100) valid = false;
+			if (i > 0 && curve->master[i] <= curve->master[i - 1]) valid = false;
+		}
+		if (!valid)
+		{
+			fprintf(stderr, "ERROR: Invalid brightness curve for: %s\n", identity);
+			return false;
+		}
+	}
+
+	PlatformMutexLock(&curveLock);
+	int index = CurveFind(identity);
+	bool success = true;
+	if (curve == NULL)
+	{
+		if (index >= 0) curves[index] = curves[--curveCount];
+	}
+	else if (index >= 0)
+	{
+		curves[index].curve = *curve;
+	}
+	else if (curveCount < MONITOR_MAX_CURVES)
+	{
+		strcpy(curves[curveCount].identity, identity);
+		curves[curveCount].curve = *curve;
+		curveCount++;
+	}
+	else
+	{
+		fprintf(stderr, "ERROR: Too many brightness curves, ignoring: %s\n", identity);
+		success = false;
+	}
+	PlatformMutexUnlock(&curveLock);
+	return success;
+}
+
+bool MonitorSetCurveFile(const char *filename)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == NULL) return false;
+
+	bool success = true;
+	char line[BACKEND_KEY_LENGTH + 16 * MONITOR_CURVE_POINTS + 16];
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#') continue;
+		char *identity = strtok(line, "\t");
+		char *field = strtok(NULL, "\t");
+		if (identity == NULL || field == NULL)
+		{
+			fprintf(stderr, "ERROR: Invalid brightness curve line in: %s\n", filename);
+			success = false;
+			continue;
+		}
+		monitor_curve_t curve = {0};
+		curve.offset = atoi(field);
+		bool valid = true;
+		while ((field = strtok(NULL, "\t")) != NULL)
+		{
+			if (curve.count >= MONITOR_CURVE_POINTS || sscanf(field, "%d:%d", &curve.master[curve.count], &curve.brightness[curve.count]) != 2) valid = false;
+			else curve.count++;
+		}
+		if (!valid)
+		{
+			fprintf(stderr, "ERROR: Invalid brightness curve points for: %s\n", identity);
+			success = false;
+			continue;
+		}
+		if (!MonitorSetCurve(identity, &curve)) success = false;
+	}
+	fclose(fp);
+	return success;
+}
+
+int MonitorCurveBrightness(monitor_t *monitor, int master)
+{
+	monitor_curve_t curve;
+	PlatformMutexLock(&curveLock);
+	int index = CurveFind(MonitorGetIdentity(monitor));
+	if (index >= 0) curve = curves[index].curve;
+	PlatformMutexUnlock(&curveLock);
+	if (index < 0) return master;
+
+	int brightness = master;
+	if (curve.count > 0)
+	{
+		int i = 0;
+		while (i < curve.count - 1 && master > curve.master[i + 1]) i++;
+		if (master <= curve.master[0]) brightness = curve.brightness[0];
+		else if (i >= curve.count - 1) brightness = curve.brightness[curve.count - 1];
+		else brightness = curve.brightness[i] + (curve.brightness[i + 1] - curve.brightness[i]) * (master - curve.master[i]) / (curve.master[i + 1] - curve.master[i]);
+	}
+	brightness += curve.offset;
+	if (brightness < 0) brightness = 0;
+	if (brightness > 100) brightness = 100;
+	return brightness;
+}
+
+static void MonitorDestroy(monitor_t *monitor)
+{
+	MonitorWorkerStop(monitor);
+	for (int i = 0; i < monitor->deviceCount; i++)
+	{
+		monitor->devices[i]->backend->close(monitor->devices[i]);
+		monitor->devices[i] = NULL;
+	}
+	monitor->deviceCount = 0;
+	free(monitor->restored);
+	monitor->restored = NULL;
+	PlatformCondDestroy(&monitor->workerChanged);
+	PlatformMutexDestroy(&monitor->workerLock);
+	PlatformMutexDestroy(&monitor->metricsLock);
+	free(monitor->metrics);
+	monitor->metrics = NULL;
+	free(monitor->caps);
+	monitor->caps = NULL;
+}
+
+const wchar_t *MonitorGetDescription(monitor_t *monitor)
+{
+	if (monitor->restored != NULL) return monitor->restored->description;
+	return monitor->devices[0]->description;
+}
+
+const char *MonitorGetIdentity(monitor_t *monitor)
+{
+	if (monitor->restored != NULL) return monitor->restored->identity;
+	for (int i = 0; i < monitor->deviceCount; i++)
+	{
+		if (monitor->devices[i]->identity[0] != '\0') return monitor->devices[i]->identity;
+	}
+	return monitor->devices[0]->key;
+}
+
+monitor_t *MonitorListEnumerate(void)
+{
+	return MonitorListUpdate(NULL);
+}
+
+// Read every monitor concurrently on its worker.
+// Each read has its own deadline (later for monitors queued behind others on the same adapter).
+// Returns the batch (holding a reference for the caller to wait on) if 'wait' is set, otherwise NULL.
+static refresh_batch_t *RefreshSubmit(monitor_t *monitorList, bool wait, monitor_callback_t callback, void *context)
+{
+	int count = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		if (monitor->control >= 0) count++;
+	}
+	if (count == 0) return NULL;
+
+	refresh_batch_t *batch = (refresh_batch_t *)malloc(sizeof(refresh_batch_t));
+	batch->monitorList = monitorList;
+	batch->references = wait ? 1 : 0;
+	batch->count = 0;
+	batch->items = (refresh_item_t *)calloc(count, sizeof(refresh_item_t));
+	batch->callback = callback;
+	batch->context = context;
+
+	RefreshInit();
+	uint64_t now = PlatformTimeMicroseconds();
+	PlatformMutexLock(&refreshLock);
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		if (monitor->control < 0) continue;
+		if (monitor->readPending) continue;		// Still waiting on a previous read
+		int queued = 0;
+		for (monitor_t *other = monitorList; other != monitor; other = other->next)
+		{
+			if (other->control >= 0 && monitor->busSemaphore != NULL && other->busSemaphore == monitor->busSemaphore) queued++;
+		}
+		int readDeadline = monitor->devices[monitor->control]->backend->readDeadline;
+		if (readDeadline <= 0) readDeadline = MONITOR_READ_DEADLINE_MS;
+		refresh_item_t *item = &batch->items[batch->count++];
+		item->batch = batch;
+		item->monitor = monitor;
+		item->deadline = now + (uint64_t)(queued / MONITOR_ADAPTER_CONCURRENCY + 1) * readDeadline * 1000;
+		monitor->readPending = true;
+	}
+	batch->references += batch->count;
+	refreshOutstanding += batch->count;
+	PlatformMutexUnlock(&refreshLock);
+
+	// Without a waiting caller, the batch may be freed as soon as the last item is complete
+	int submitCount = batch->count;
+	refresh_item_t *items = batch->items;
+	if (submitCount == 0)
+	{
+		if (!wait) RefreshBatchFree(batch);
+		return wait ? batch : NULL;
+	}
+	for (int i = 0; i < submitCount; i++)
+	{
+		monitor_t *monitor = items[i].monitor;
+		if (!MonitorWorkerStart(monitor))
+		{
+			RefreshRead(&items[i]);
+			continue;
+		}
+		PlatformMutexLock(&monitor->workerLock);
+		monitor->readItem = &items[i];
+		PlatformCondSignal(&monitor->workerChanged);
+		PlatformMutexUnlock(&monitor->workerLock);
+	}
+
+	return wait ? batch : NULL;
+}
+
+// Each value is handed to its monitor's worker without waiting, so the writes overlap (limited only by monitors sharing a bus)
+void MonitorListSetBrightnessAll(monitor_t *monitorList, int master)
+{
+	uint64_t trace = TraceBegin();
+	int count = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		if (!MonitorHasBrightness(monitor)) continue;
+		MonitorPostBrightness(monitor, MonitorCurveBrightness(monitor, master));
+		count++;
+	}
+	TraceEnd(trace, "monitor", "setAll", NULL, count);
+}
+
+void MonitorListRefreshBrightness(monitor_t *monitorList)
+{
+	// Slower reads are left to complete in the background and keep the previous value until then.
+	refresh_batch_t *batch = RefreshSubmit(monitorList, true, NULL, NULL);
+	if (batch == NULL) return;
+
+	// Wait until every read has completed or passed its deadline
+	uint64_t now;
+	int late = 0;
+	PlatformMutexLock(&refreshLock);
+	for (;;)
+	{
+		now = PlatformTimeMicroseconds();
+		uint64_t wake = 0;
+		late = 0;
+		for (int i = 0; i < batch->count; i++)
+		{
+			if (batch->items[i].done) continue;
+			if (batch->items[i].deadline <= now) { late++; continue; }
+			if (wake == 0 || batch->items[i].deadline < wake) wake = batch->items[i].deadline;
+		}
+		if (wake == 0) break;
+		PlatformCondWait(&refreshChanged, &refreshLock, (int64_t)(wake - now));
+	}
+	bool release = RefreshBatchRelease(batch);
+	PlatformMutexUnlock(&refreshLock);
+	if (release) RefreshBatchFree(batch);
+
+	if (late > 0) fprintf(stderr, "WARNING: %d brightness read(s) exceeded the deadline.\n", late);
+}
+
+void MonitorListRefreshBrightnessAsync(monitor_t *monitorList, monitor_callback_t callback, void *context)
+{
+	RefreshSubmit(monitorList, false, callback, context);
+}
+
+// Wait for any background reads to complete
+static void RefreshWaitIdle(void)
+{
+	RefreshInit();
+	PlatformMutexLock(&refreshLock);
+	while (refreshOutstanding > 0)
+	{
+		PlatformCondWait(&refreshChanged, &refreshLock, -1);
+	}
+	PlatformMutexUnlock(&refreshLock);
+}
+
+// Background sync: a scheduler thread submits a read of the followed list to the monitors' workers, at an interval doubled after each
+// pass that finds nothing changed (so an idle sync costs a few reads an hour), and reset by a change or activity.
+// The thread only waits, the reads are made on the workers (and a watched backend answers from its cache, without any I/O).
+// Lock order: syncListLock, then the refresh and worker locks. syncLock is never held while taking another.
+static platform_mutex_t syncLock = PLATFORM_MUTEX_INIT;
+static platform_cond_t syncChanged;
+static bool syncInitialized = false;
+static platform_thread_t syncThread;
+static bool syncStarted = false;
+static bool syncStop = false;
+static bool syncPaused = false;
+static bool syncReadNow = false;						// Read on the next wake, rather than at the end of the interval
+static bool syncTighten = false;						// Return to the minimum interval
+static monitor_sync_t syncPolicy = { 2000, 120000 };
+static platform_mutex_t syncListLock = PLATFORM_MUTEX_INIT;	// Held while submitting, so a list is not read once it is detached
+static monitor_t *syncList = NULL;
+
+// Refresh callback for the sync's reads
+static void MonitorSyncRead(monitor_t *monitor, void *context)
+{
+	if (!monitor->readChanged) return;
+	PlatformMutexLock(&syncLock);
+	syncTighten = true;
+	PlatformCondSignal(&syncChanged);
+	PlatformMutexUnlock(&syncLock);
+	MonitorNotifyCorrected(monitor);
+}
+
+static void MonitorSyncThread(void *context)
+{
+	TraceThreadName("monitor sync");
+	int interval = 0;
+	uint64_t next = 0;
+	PlatformMutexLock(&syncLock);
+	while (!syncStop)
+	{
+		uint64_t now = PlatformTimeMicroseconds();
+		if (syncTighten || syncReadNow || interval == 0)
+		{
+			interval = syncPolicy.minimum;
+			if (syncReadNow) next = now;
+			else if (next == 0 || next > now + (uint64_t)interval * 1000) next = now + (uint64_t)interval * 1000;
+			syncTighten = false;
+			syncReadNow = false;
+		}
+		if (syncPaused)
+		{
+			PlatformCondWait(&syncChanged, &syncLock, -1);
+			continue;
+		}
+		if (now < next)
+		{
+			PlatformCondWait(&syncChanged, &syncLock, (int64_t)(next - now));
+			continue;
+		}
+		PlatformMutexUnlock(&syncLock);
+
+		// Monitors still being read from the previous pass are skipped
+		uint64_t trace = TraceBegin();
+		PlatformMutexLock(&syncListLock);
+		RefreshSubmit(syncList, false, MonitorSyncRead, NULL);
+		PlatformMutexUnlock(&syncListLock);
+		TraceEnd(trace, "monitor", "sync", NULL, interval);
+
+		PlatformMutexLock(&syncLock);
+		next = PlatformTimeMicroseconds() + (uint64_t)interval * 1000;
+		interval = (interval > syncPolicy.maximum / 2) ? syncPolicy.maximum : interval * 2;
+	}
+	PlatformMutexUnlock(&syncLock);
+}
+
+// Stop following a list that is about to change (call before waiting for outstanding reads), true if it was followed
+static bool MonitorSyncDetach(monitor_t *monitorList)
+{
+	PlatformMutexLock(&syncListLock);
+	bool detached = monitorList != NULL && syncList == monitorList;
+	if (detached) syncList = NULL;
+	PlatformMutexUnlock(&syncListLock);
+	return detached;
+}
+
+static void MonitorSyncAttach(monitor_t *monitorList)
+{
+	PlatformMutexLock(&syncListLock);
+	syncList = monitorList;
+	PlatformMutexUnlock(&syncListLock);
+	PlatformMutexLock(&syncLock);
+	syncReadNow = true;
+	PlatformCondSignal(&syncChanged);
+	PlatformMutexUnlock(&syncLock);
+}
+
+bool MonitorSyncStart(monitor_t *monitorList, const monitor_sync_t *sync)
+{
+	PlatformMutexLock(&syncLock);
+	if (!syncInitialized)
+	{
+		PlatformCondInit(&syncChanged);
+		syncInitialized = true;
+	}
+	syncPolicy = *sync;
+	if (syncPolicy.minimum < 1) syncPolicy.minimum = 1;
+	if (syncPolicy.maximum < syncPolicy.minimum) syncPolicy.maximum = syncPolicy.minimum;
+	syncTighten = true;
+	bool started = syncStarted;
+	PlatformMutexUnlock(&syncLock);
+
+	MonitorSyncAttach(monitorList);
+	if (started) return true;
+
+	PlatformMutexLock(&syncLock);
+	syncStop = false;
+	syncStarted = PlatformThreadCreate(&syncThread, MonitorSyncThread, NULL);
+	started = syncStarted;
+	PlatformMutexUnlock(&syncLock);
+	if (!started)
+	{
+		fprintf(stderr, "ERROR: Cannot start the brightness sync thread.\n");
+		MonitorSyncAttach(NULL);
+	}
+	return started;
+}
+
+void MonitorSyncStop(void)
+{
+	PlatformMutexLock(&syncLock);
+	bool started = syncStarted;
+	syncStop = true;
+	if (started) PlatformCondSignal(&syncChanged);
+	PlatformMutexUnlock(&syncLock);
+	if (!started) return;
+
+	PlatformThreadJoin(&syncThread);
+	PlatformMutexLock(&syncListLock);
+	syncList = NULL;
+	PlatformMutexUnlock(&syncListLock);
+	PlatformMutexLock(&syncLock);
+	syncStarted = false;
+	PlatformMutexUnlock(&syncLock);
+}
+
+void MonitorSyncActivity(void)
+{
+	PlatformMutexLock(&syncLock);
+	syncReadNow = true;
+	if (syncStarted) PlatformCondSignal(&syncChanged);
+	PlatformMutexUnlock(&syncLock);
+}
+
+void MonitorSyncPause(bool paused)
+{
+	PlatformMutexLock(&syncLock);
+	if (syncPaused && !paused) syncReadNow = true;
+	syncPaused = paused;
+	if (syncStarted) PlatformCondSignal(&syncChanged);
+	PlatformMutexUnlock(&syncLock);
+}
+
+static void RegistryFree(monitor_registry_t *registry)
+{
+	if (registry == NULL) return;
+	LookupFree(&registry->byKey);
+	LookupFree(&registry->byId);
+	free(registry->monitors);
+	free(registry);
+}
+
+// Number the monitors of a list in order, and index them in a new registry (any previous one is left for the caller to free, as other lists' monitors may share it)
+static void MonitorListIndex(monitor_t *list)
+{
+	int count = 0;
+	for (monitor_t *monitor = list; monitor != NULL; monitor = monitor->next) monitor->index = count++;
+
+	monitor_registry_t *registry = (monitor_registry_t *)calloc(1, sizeof(monitor_registry_t));
+	if (registry != NULL) registry->monitors = (monitor_t **)malloc((count + 1) * sizeof(monitor_t *));
+	if (registry == NULL || registry->monitors == NULL || !LookupInit(&registry->byId, count) || !LookupInit(&registry->byKey, count))
+	{
+		fprintf(stderr, "ERROR: Cannot allocate the index of %d monitors.\n", count);
+		RegistryFree(registry);
+		registry = NULL;
+	}
+
+	for (monitor_t *monitor = list; monitor != NULL; monitor = monitor->next)
+	{
+		monitor->registry = registry;
+		if (registry == NULL) continue;
+		registry->monitors[registry->count++] = monitor;
+		LookupAdd(&registry->byId, MonitorIdHash(monitor->id), monitor);
+		if (monitor->deviceCount > 0 && monitor->devices[0]->key[0] != '\0') LookupAdd(&registry->byKey, LookupHashString(monitor->devices[0]->key), monitor);
+	}
+}
+
+int MonitorListCount(monitor_t *monitorList)
+{
+	if (monitorList == NULL || monitorList->registry == NULL) return 0;
+	return monitorList->registry->count;
+}
+
+monitor_t *MonitorListGet(monitor_t *monitorList, int index)
+{
+	if (monitorList == NULL || monitorList->registry == NULL || index < 0 || index >= monitorList->registry->count) return NULL;
+	return monitorList->registry->monitors[index];
+}
+
+monitor_t *MonitorListFind(monitor_t *monitorList, int id)
+{
+	if (monitorList == NULL || monitorList->registry == NULL) return NULL;
+	uint32_t hash = MonitorIdHash(id);
+	monitor_t *monitor;
+	for (int cursor = 0; (monitor = (monitor_t *)LookupNext(&monitorList->registry->byId, hash, &cursor)) != NULL; )
+	{
+		if (monitor->id == id) return monitor;
+	}
+	return NULL;
+}
+
+monitor_t *MonitorListFindKey(monitor_t *monitorList, const char *key)
+{
+	if (monitorList == NULL || monitorList->registry == NULL) return NULL;
+	uint32_t hash = LookupHashString(key);
+	monitor_t *monitor;
+	for (int cursor = 0; (monitor = (monitor_t *)LookupNext(&monitorList->registry->byKey, hash, &cursor)) != NULL; )
+	{
+		if (strcmp(monitor->devices[0]->key, key) == 0) return monitor;
+	}
+	return NULL;
+}
+
+void MonitorListDestroy(monitor_t *monitorList)
+{
+	MonitorSyncDetach(monitorList);
+	RefreshWaitIdle();
+
+	if (monitorList != NULL) RegistryFree(monitorList->registry);
+
+	for (monitor_t *monitor = monitorList; monitor != NULL; )
+	{
+		monitor_t *nextMonitor = monitor->next;
+		MonitorDestroy(monitor);
+		free(monitor);
+		monitor = nextMonitor;
+	}
+}
+
+void MonitorListDumpMetrics(FILE *file, monitor_t *monitorList)
+{
+	PlatformMutexLock(&enumerationLock);
+	fprintf(file, "{\"enumeration\":{\"count\":%d,\"duration\":%llu,\"phases\":[", enumerationCount, (unsigned long long)enumerationDuration);
+	for (int i = 0; i < enumerationPhaseCount; i++)
+	{
+		const enumeration_phase_t *phase = &enumerationPhases[i];
+		fprintf(file, "%s{\"phase\":\"%s\",\"backend\":", (i > 0) ? "," : "", phase->phase);
+		JsonWriteString(file, phase->backend);
+		fprintf(file, ",\"duration\":%llu,\"count\":%d}", (unsigned long long)phase->duration, phase->count);
+	}
+	PlatformMutexUnlock(&enumerationLock);
+
+	fprintf(file, "]},\"monitors\":[");
+	monitor_metrics_t *metrics = (monitor_metrics_t *)malloc(sizeof(monitor_metrics_t));
+	for (monitor_t *monitor = monitorList; monitor != NULL && metrics != NULL; monitor = monitor->next)
+	{
+		MonitorGetMetrics(monitor, metrics);
+		fprintf(file, "%s{\"index\":%d,\"id\":%d,\"identity\":", (monitor != monitorList) ? "," : "", monitor->index, monitor->id);
+		JsonWriteString(file, MonitorGetIdentity(monitor));
+		fprintf(file, ",\"backend\":");
+		JsonWriteString(file, (monitor->control >= 0) ? monitor->devices[monitor->control]->backend->name : "");
+		fprintf(file, ",\"reads\":%d,\"readErrors\":%d,\"readRetries\":%d,\"readFailures\":%d", metrics->reads, metrics->readErrors, metrics->readRetries, metrics->readFailures);
+		fprintf(file, ",\"writes\":%d,\"writeErrors\":%d,\"writeRetries\":%d,\"writeFailures\":%d", metrics->writes, metrics->writeErrors, metrics->writeRetries, metrics->writeFailures);
+		fprintf(file, ",\"coalesced\":%d,\"mismatches\":%d,\"changes\":%d,\"readLatency\":", metrics->coalesced, metrics->mismatches, metrics->changes);
+		HistogramDumpJson(file, &metrics->readLatency);
+		fprintf(file, ",\"writeLatency\":");
+		HistogramDumpJson(file, &metrics->writeLatency);
+		fprintf(file, ",\"busWait\":");
+		HistogramDumpJson(file, &metrics->busWait);
+		fprintf(file, "}");
+	}
+	free(metrics);
+	fprintf(file, "]}\n");
+}
+
+// Apply brightness set on a restored monitor to the same enumerated monitor
+static void MonitorHandover(monitor_t *monitor, monitor_t *monitorList)
+{
+	if (monitor->restored == NULL || !monitor->restoredChanged) return;
+	for (monitor_t *other = monitorList; other != NULL; other = other->next)
+	{
+		if (other->restored == NULL && strcmp(MonitorGetIdentity(other), monitor->restored->identity) == 0)
+		{
+			MonitorPostBrightness(other, MonitorGetBrightness(monitor));
+			break;
+		}
+	}
+}
+
+monitor_t *MonitorListRestore(const char *filename)
+{
+	snapshot_entry_t *entries = (snapshot_entry_t *)malloc(SNAPSHOT_MAX_MONITORS * sizeof(snapshot_entry_t));
+	if (entries == NULL) return NULL;
+	int count = SnapshotLoad(filename, entries, SNAPSHOT_MAX_MONITORS);
+
+	monitor_t *list = NULL, *last = NULL;
+	for (int i = 0; i < count; i++)
+	{
+		monitor_t *monitor = MonitorAlloc();
+		monitor->restored = (snapshot_entry_t *)malloc(sizeof(snapshot_entry_t));
+		*monitor->restored = entries[i];
+		if (last == NULL) list = monitor; else last->next = monitor;
+		last = monitor;
+	}
+	free(entries);
+	MonitorListIndex(list);
+
+	if (count > 0) fprintf(stderr, "MONITORS: %d restored\n", count);
+	return list;
+}
+
+// The snapshot entry of a monitor (a zeroed entry is filled in)
+static void MonitorSnapshotEntry(monitor_t *monitor, snapshot_entry_t *entry)
+{
+	if (monitor->restored != NULL)
+	{
+		*entry = *monitor->restored;
+		return;
+	}
+	snprintf(entry->identity, sizeof(entry->identity), "%s", MonitorGetIdentity(monitor));
+	wcsncpy(entry->description, MonitorGetDescription(monitor), BACKEND_DESCRIPTION_LENGTH - 1);
+	if (monitor->control >= 0)
+	{
+		snprintf(entry->backend, sizeof(entry->backend), "%s", monitor->devices[monitor->control]->backend->name);
+		entry->caps = monitor->caps[monitor->control];
+	}
+}
+
+monitor_t *MonitorListStandIn(monitor_t *monitorList)
+{
+	monitor_t *list = NULL, *last = NULL;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		monitor_t *standIn = MonitorAlloc();
+		standIn->id = monitor->id;
+		standIn->restored = (snapshot_entry_t *)calloc(1, sizeof(snapshot_entry_t));
+		MonitorSnapshotEntry(monitor, standIn->restored);
+		if (last == NULL) list = standIn; else last->next = standIn;
+		last = standIn;
+	}
+	MonitorListIndex(list);
+	return list;
+}
+
+bool MonitorListSave(monitor_t *monitorList, const char *filename)
+{
+	snapshot_entry_t *entries = (snapshot_entry_t *)calloc(SNAPSHOT_MAX_MONITORS, sizeof(snapshot_entry_t));
+	if (entries == NULL) return false;
+	int count = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL && count < SNAPSHOT_MAX_MONITORS; monitor = monitor->next)
+	{
+		MonitorSnapshotEntry(monitor, &entries[count++]);
+	}
+	bool success = SnapshotSave(filename, entries, count);
+	free(entries);
+	return success;
+}
+
+monitor_t *MonitorListReplace(monitor_t *monitorList, monitor_t *newList)
+{
+	bool synced = MonitorSyncDetach(monitorList);
+	RefreshWaitIdle();
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next)
+	{
+		MonitorHandover(monitor, newList);
+	}
+
+	// Enumerated monitors take over the ids of the restored monitors they replace (each only once, as identities may repeat)
+	bool *inherited = (bool *)calloc(MonitorListCount(newList) + 1, sizeof(bool));
+	for (monitor_t *monitor = monitorList; monitor != NULL && inherited != NULL; monitor = monitor->next)
+	{
+		if (monitor->restored == NULL) continue;
+		for (monitor_t *other = newList; other != NULL; other = other->next)
+		{
+			if (!inherited[other->index] && other->restored == NULL && strcmp(MonitorGetIdentity(other), monitor->restored->identity) == 0)
+			{
+				other->id = monitor->id;
+				inherited[other->index] = true;
+				break;
+			}
+		}
+	}
+	free(inherited);
+	monitor_registry_t *stale = (newList != NULL) ? newList->registry : NULL;
+	MonitorListIndex(newList);
+	RegistryFree(stale);
+
+	MonitorListDestroy(monitorList);
+	if (synced) MonitorSyncAttach(newList);
+	return newList;
+}
+
+// Remove a backend's attached devices from a monitor (without closing them), keeping their capabilities
+static void MonitorDetach(monitor_t *monitor, backend_t *backend, backend_device_t **devices, monitor_t **owners, backend_caps_t *caps, int *count)
+{
+	for (int i = 1; i < monitor->deviceCount; )
+	{
+		if (monitor->devices[i]->backend != backend) { i++; continue; }
+
+		// Flush any write through the control device before it (or those after it) are moved
+		if (monitor->control >= i) MonitorWorkerStop(monitor);
+
+		devices[*count] = monitor->devices[i];
+		owners[*count] = monitor;
+		caps[*count] = monitor->caps[i];
+		(*count)++;
+
+		PlatformMutexLock(&monitor->workerLock);
+		for (int j = i + 1; j < monitor->deviceCount; j++)
+		{
+			monitor->devices[j - 1] = monitor->devices[j];
+			monitor->caps[j - 1] = monitor->caps[j];
+		}
+		monitor->deviceCount--;
+		monitor->devices[monitor->deviceCount] = NULL;
+		if (monitor->control > i) monitor->control--;
+		else if (monitor->control == i)
+		{
+			monitor->control = -1;					// Until re-attached (MonitorUpdateControl())
+			monitor->busSemaphore = NULL;
+		}
+		PlatformMutexUnlock(&monitor->workerLock);
+	}
+}
+
+// Devices of a monitor before the attaching backends are enumerated, to only reselect the control of those that changed
+typedef struct
+{
+	monitor_t *monitor;
+	int deviceCount;
+	backend_device_t *devices[MONITOR_MAX_DEVICES];
+	backend_device_t *control;				// NULL if none
+} monitor_devices_t;
+
+static void MonitorDevicesSave(monitor_devices_t *saved, monitor_t *monitor)
+{
+	saved->monitor = monitor;
+	saved->deviceCount = monitor->deviceCount;
+	memcpy(saved->devices, monitor->devices, sizeof(saved->devices));
+	saved->control = (monitor->control >= 0) ? monitor->devices[monitor->control] : NULL;
+}
+
+// Reselect the control of a monitor whose devices changed (the last confirmed value is kept while the control device is the same)
+static void MonitorUpdateControl(const monitor_devices_t *saved)
+{
+	monitor_t *monitor = saved->monitor;
+	if (monitor->deviceCount == saved->deviceCount && memcmp(monitor->devices, saved->devices, sizeof(saved->devices)) == 0 && (saved->control == NULL || monitor->control >= 0)) return;
+
+	int control = MonitorSelectControl(monitor);
+	backend_device_t *device = (control >= 0) ? monitor->devices[control] : NULL;
+	platform_semaphore_t *busSemaphore = (device != NULL) ? AdapterSemaphore(device->bus) : NULL;
+	int confirmed = (device != NULL) ? monitor->caps[control].current : -1;
+
+	// The worker is idle while a different device takes control (any pending write goes through the previous one)
+	if (device != saved->control) MonitorWorkerStop(monitor);
+
+	PlatformMutexLock(&monitor->workerLock);
+	monitor->control = control;
+	monitor->busSemaphore = busSemaphore;
+	if (device != saved->control) monitor->confirmed = confirmed;
+	PlatformMutexUnlock(&monitor->workerLock);
+}
+
+monitor_t *MonitorListUpdate(monitor_t *monitorList)
+{
+	// Background reads may still be walking the existing list
+	bool synced = MonitorSyncDetach(monitorList);
+	RefreshWaitIdle();
+
+	// Existing monitors (and their devices) are reused rather than being recreated
+	int previousCount = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next) previousCount++;
+	monitor_t **previous = (monitor_t **)calloc(previousCount + 1, sizeof(monitor_t *));
+	previousCount = 0;
+	for (monitor_t *monitor = monitorList; monitor != NULL; monitor = monitor->next) previous[previousCount++] = monitor;
+	monitor_registry_t *stale = (monitorList != NULL) ? monitorList->registry : NULL;
+
+	// Previous monitors by their primary device, as an unchanged device is returned as-is
+	lookup_t previousDevices;
+	LookupInit(&previousDevices, previousCount);
+	for (int i = 0; i < previousCount; i++)
+	{
+		if (previous[i]->deviceCount > 0) LookupAdd(&previousDevices, MonitorPointerHash(previous[i]->devices[0]), &previous[i]);
+	}
+
+	int capacity = previousCount * MONITOR_MAX_DEVICES + 1;
+	backend_device_t **existing = (backend_device_t **)calloc(capacity, sizeof(backend_device_t *));
+	backend_device_t **detached = (backend_device_t **)calloc(capacity, sizeof(backend_device_t *));
+	monitor_t **owners = (monitor_t **)calloc(capacity, sizeof(monitor_t *));
+	backend_caps_t *detachedCaps = (backend_caps_t *)calloc(capacity, sizeof(backend_caps_t));
+
+	monitor_t *list = NULL, *last = NULL;
+	int added = 0, position = 0;
+	enumeration_phase_t phases[MONITOR_MAX_PHASES];
+	int phaseCount = 0;
+	uint64_t enumerationStart = PlatformTimeMicroseconds();
+
+	// Each device of a primary backend is a monitor, only probing those not already known...
+	for (int b = 0; b < backendCount; b++)
+	{
+		backend_t *backend = backends[b];
+		if (backend->flags & BACKEND_FLAG_ATTACH) continue;
+
+		int existingCount = 0;
+		for (int i = 0; i < previousCount; i++)
+		{
+			if (previous[i] != NULL && previous[i]->deviceCount > 0 && previous[i]->devices[0]->backend == backend) existing[existingCount++] = previous[i]->devices[0];
+		}
+
+		uint64_t trace = TraceBegin();
+		uint64_t phaseStart = PlatformTimeMicroseconds();
+		backend_device_t *device = backend->enumerate(backend, existing, existingCount);
+		TraceEnd(trace, "monitor", "enumerate", backend->name, backend->incomplete ? -1 : 0);
+		enumeration_phase_t *enumerated = &phases[phaseCount++];
+		enumerated->phase = "enumerate";
+		enumerated->backend = backend->name;
+		enumerated->duration = PlatformTimeMicroseconds() - phaseStart;
+		enumerated->count = 0;
+		enumeration_phase_t *probed = &phases[phaseCount++];
+		probed->phase = "probe";
+		probed->backend = backend->name;
+		probed->duration = 0;
+		probed->count = 0;
+		while (device != NULL)
+		{
+			backend_device_t *nextDevice = device->next;
+			monitor_t *monitor = NULL;
+			monitor_t **entry;
+			uint32_t hash = MonitorPointerHash(device);
+			for (int cursor = 0; (entry = (monitor_t **)LookupNext(&previousDevices, hash, &cursor)) != NULL; )
+			{
+				if (*entry != NULL && (*entry)->devices[0] == device)
+				{
+					monitor = *entry;
+					*entry = NULL;
+					break;
+				}
+			}
+			if (monitor == NULL)
+			{
+				uint64_t probeStart = PlatformTimeMicroseconds();
+				monitor = MonitorCreate(device, position);
+				probed->duration += PlatformTimeMicroseconds() - probeStart;
+				probed->count++;
+				added++;
+			}
+			enumerated->count++;
+
+			// Add to end of linked list
+			monitor->next = NULL;
+			if (last == NULL) list = monitor; else last->next = monitor;
+			last = monitor;
+			position++;
+			device = nextDevice;
+		}
+		if (enumerated->count > 0) MonitorWatchBackend(b);
+	}
+	LookupFree(&previousDevices);
+	MonitorListIndex(list);
+
+	int monitorCount = 0;
+	for (monitor_t *monitor = list; monitor != NULL; monitor = monitor->next) monitorCount++;
+	monitor_devices_t *saved = (monitor_devices_t *)calloc(monitorCount + 1, sizeof(monitor_devices_t));
+	monitorCount = 0;
+	for (monitor_t *monitor = list; monitor != NULL; monitor = monitor->next) MonitorDevicesSave(&saved[monitorCount++], monitor);
+
+	// ...then devices of attaching backends are added to the monitor with the same key
+	for (int b = 0; b < backendCount; b++)
+	{
+		backend_t *backend = backends[b];
+		if (!(backend->flags & BACKEND_FLAG_ATTACH)) continue;
+		if (!AttachWanted(backend, list, previous, previousCount))
+		{
+			enumeration_phase_t *skipped = &phases[phaseCount++];
+			skipped->phase = "skip";
+			skipped->backend = backend->name;
+			skipped->duration = 0;
+			skipped->count = 0;
+			continue;
+		}
+
+		int detachedCount = 0;
+		for (monitor_t *monitor = list; monitor != NULL; monitor = monitor->next) MonitorDetach(monitor, backend, detached, owners, detachedCaps, &detachedCount);
+		for (int i = 0; i < previousCount; i++)
+		{
+			if (previous[i] != NULL) MonitorDetach(previous[i], backend, detached, owners, detachedCaps, &detachedCount);
+		}
+		memcpy(existing, detached, detachedCount * sizeof(backend_device_t *));
+		lookup_t detachedDevices;
+		LookupInit(&detachedDevices, detachedCount);
+		for (int i = 0; i < detachedCount; i++) LookupAdd(&detachedDevices, MonitorPointerHash(detached[i]), &detached[i]);
+
+		uint64_t trace = TraceBegin();
+		uint64_t phaseStart = PlatformTimeMicroseconds();
+		backend_device_t *device = backend->enumerate(backend, existing, detachedCount);
+		TraceEnd(trace, "monitor", "enumerate", backend->name, backend->incomplete ? -1 : 0);
+		enumeration_phase_t *enumerated = &phases[phaseCount++];
+		enumerated->phase = "enumerate";
+		enumerated->backend = backend->name;
+		enumerated->duration = PlatformTimeMicroseconds() - phaseStart;
+		enumerated->count = 0;
+		enumeration_phase_t *probed = &phases[phaseCount++];
+		probed->phase = "probe";
+		probed->backend = backend->name;
+		probed->duration = 0;
+		probed->count = 0;
+		while (device != NULL)
+		{
+			backend_device_t *nextDevice = device->next;
+
+			monitor_t *target = (device->key[0] != '\0') ? MonitorListFindKey(list, device->key) : NULL;
+
+			if (target != NULL && target->deviceCount < MONITOR_MAX_DEVICES)
+			{
+				int slot = target->deviceCount++;
+				target->devices[slot] = device;
+				device->owner = target;
+				int found = -1;
+				backend_device_t **entry;
+				uint32_t hash = MonitorPointerHash(device);
+				for (int cursor = 0; (entry = (backend_device_t **)LookupNext(&detachedDevices, hash, &cursor)) != NULL; )
+				{
+					if (*entry == device) { found = (int)(entry - detached); break; }
+				}
+				if (found >= 0 && owners[found] == target) target->caps[slot] = detachedCaps[found];	// Unchanged
+				else if (!MonitorProbeWanted(target, target->index)) memset(&target->caps[slot], 0, sizeof(target->caps[slot]));
+				else
+				{
+					uint64_t probeStart = PlatformTimeMicroseconds();
+					MonitorProbeDevice(target, slot);
+					probed->duration += PlatformTimeMicroseconds() - probeStart;
+					probed->count++;
+				}
+				enumerated->count++;
+			}
+			else
+			{
+				backend->close(device);
+			}
+			device = nextDevice;
+		}
+		LookupFree(&detachedDevices);
+		if (enumerated->count > 0) MonitorWatchBackend(b);
+
+		// Devices no longer present
+		for (int i = 0; i < detachedCount; i++)
+		{
+			if (existing[i] != NULL) backend->close(existing[i]);
+		}
+
+		// Remember the monitors (not known to be external) the backend has no device for
+		for (monitor_t *monitor = list; monitor != NULL && !backend->incomplete; monitor = monitor->next)
+		{
+			if (monitor->devices[0]->output == BACKEND_OUTPUT_EXTERNAL) continue;
+			bool attached = false;
+			for (int i = 1; i < monitor->deviceCount; i++) if (monitor->devices[i]->backend == backend) attached = true;
+			AbsentSet(backend, monitor->devices[0]->key, !attached);
+		}
+	}
+
+	// Anything remaining in the previous list has been removed
+	int removed = 0;
+	for (int i = 0; i < previousCount; i++)
+	{
+		if (previous[i] == NULL) continue;
+		MonitorHandover(previous[i], list);
+		MonitorDestroy(previous[i]);
+		free(previous[i]);
+		removed++;
+	}
+	fprintf(stderr, "MONITORS: %d added, %d removed\n", added, removed);
+	MccsCacheSave();
+	VcpTimingSave();
+	AbsentSave();
+
+	for (int i = 0; i < monitorCount; i++) MonitorUpdateControl(&saved[i]);
+	free(saved);
+	RegistryFree(stale);
+
+	PlatformMutexLock(&enumerationLock);
+	memcpy(enumerationPhases, phases, phaseCount * sizeof(enumeration_phase_t));
+	enumerationPhaseCount = phaseCount;
+	enumerationDuration = PlatformTimeMicroseconds() - enumerationStart;
+	enumerationCount++;
+	PlatformMutexUnlock(&enumerationLock);
+
+	free(detachedCaps);
+	free(owners);
+	free(detached);
+	free(existing);
+	free(previous);
+
+	if (synced) MonitorSyncAttach(list);
+	return list;
+}
@@ -4,47 +4,161 @@
 #ifndef _MONITOR_H
 #define _MONITOR_H
 
-#include <windows.h>
-#include <highlevelmonitorconfigurationapi.h>
-#include <tchar.h>
-
+#include <stdio.h>
 #include <stdbool.h>
 
-#define MONITOR_WMI_INSTANCE_PREFIX_LENGTH 128
+#include "platform.h"
+#include "backend.h"
+#include "vcp.h"
+#include "snapshot.h"
+#include "histogram.h"
+
+#define MONITOR_MAX_DEVICES 4
+
+// Brightness I/O of a monitor since it was enumerated, through its brightness control (e.g. DDC/CI or WMI)
+typedef struct
+{
+	int reads;														// Attempts
+	int writes;
+	int readErrors;													// Attempts that failed
+	int writeErrors;
+	int readRetries;												// Further attempts made by the policy after a failure
+	int writeRetries;
+	int readFailures;												// Reads and writes that failed after every retry
+	int writeFailures;
+	int coalesced;													// Posted values replaced by a later one before being written
+	int mismatches;													// Verified writes that read back a different value
+	int changes;													// Reads that found the brightness changed elsewhere (e.g. the monitor's own buttons)
+	histogram_t readLatency;										// Each attempt (microseconds)
+	histogram_t writeLatency;
+	histogram_t busWait;											// Waiting for the bus before each attempt (microseconds)
+} monitor_metrics_t;
 
 typedef struct _monitor_t
 {
-	int index;
-
-	MONITORINFOEX monitorInfo;										// Logical HMONITOR
-	DISPLAY_DEVICE displayDevice;									// Standard display device information
-	DISPLAY_DEVICE displayDeviceInterface;							// DeviceID is set using EDD_GET_DEVICE_INTERFACE_NAME
-	PHYSICAL_MONITOR physicalMonitor;								// Physical monitor
-
-	TCHAR wmiInstancePrefix[MONITOR_WMI_INSTANCE_PREFIX_LENGTH];	// Assumed prefix of the WMI instance path
-	TCHAR wmiInstance[MONITOR_WMI_INSTANCE_PREFIX_LENGTH];			// Found WMI instance path
-	bool hasWmiBrightness;											// 
-	int wmiBrightness;
-	int wmiMinBrightness;
-	int wmiMaxBrightness;
-
-	bool queriedOk;
-	bool hasBrightness;
-	int minBrightness;
-	int maxBrightness;
-	int brightness;
+	int index;														// Position in its list
+	int id;															// Unique and stable while the monitor is present (kept by MonitorListUpdate(), and taken over from the restored monitor it replaces)
+	struct _monitor_registry_t *registry;							// Index of the list the monitor is in (shared, owned by the list)
+
+	int deviceCount;
+	backend_device_t *devices[MONITOR_MAX_DEVICES];					// devices[0] is from a primary backend (e.g. DDC/CI), any others are attached by key (e.g. WMI)
+	backend_caps_t *caps;											// [MONITOR_MAX_DEVICES] probed when each device is added ('current' is the last known raw value), allocated separately, as each holds the discrete levels
+	int control;													// Device used for brightness (the first that has it), -1 if none
+	platform_semaphore_t *busSemaphore;								// Limits concurrent calls per bus of the control device (shared, not owned)
+	bool readPending;												// Background read in progress (MonitorListRefreshBrightness)
+	bool readChanged;												// The last read found a different value than the stored one
+	int featureCount;												// Additional VCP features read with the brightness by each refresh
+	vcp_value_t features[VCP_MAX_FEATURES];
+
+	// Background I/O worker (started on first MonitorPostBrightness() or refresh)
+	platform_thread_t worker;
+	bool workerStarted;
+	platform_mutex_t workerLock;
+	platform_cond_t workerChanged;
+	int writerPending;												// Raw value still to be written, -1 if none
+	bool writerActive;												// Write in progress
+	struct _refresh_item_t *readItem;								// Read requested by a refresh, NULL if none
+	bool workerExit;
+
+	// Transition to a target value, stepped by the worker only as fast as the device accepts writes (MonitorFadeBrightness())
+	bool fadeActive;
+	int fadeFrom;													// Raw value at the start of the fade
+	int fadeTarget;													// Raw target value
+	int fadeValue;													// Raw value most recently written by the fade
+	uint64_t fadeStart;												// Microseconds (PlatformTimeMicroseconds)
+	uint64_t fadeDuration;
+	uint64_t fadeNext;												// Time of the next step: after the last write completed and the device's command interval
+
+	// Brightness confirmed by the device (see monitor_policy_t)
+	int confirmed;													// Raw value last read, or written (and read back, if verified), -1 if unknown
+	int verifyCredit;												// Accumulated verification percentage (a burst is verified on reaching 100)
+
+	platform_mutex_t metricsLock;
+	monitor_metrics_t *metrics;										// Allocated separately, as the histograms are large and rarely read
+
+	snapshot_entry_t *restored;										// Monitor restored from a snapshot (without devices) until replaced by an enumerated one, NULL otherwise
+	bool restoredChanged;											// Brightness was set on the restored monitor, to be applied to the enumerated one
 
 	struct _monitor_t *next;
 } monitor_t;
 
+typedef void (*monitor_callback_t)(monitor_t *monitor, void *context);
+typedef bool (*monitor_filter_t)(int index, const char *identity, void *context);	// By list position and identity (see MonitorGetIdentity())
+
+// Handling of failed brightness reads and writes (shared by all monitors)
+typedef struct
+{
+	int retries;			// Further attempts after a failed read or write (the only retry layer: each attempt is a single VCP command)
+	int backoff;			// Milliseconds before the first retry, doubled for each further one
+	int timeout;			// Milliseconds after which no further attempt is started, 0 for no limit
+	int verifyPercent;		// Proportion of bursts of writes (e.g. a slider drag) whose final value is read back, 0-100
+} monitor_policy_t;
+
+// Mapping of a shared (master) level to a monitor's brightness, so monitors that differ can be set together (MonitorListSetBrightnessAll())
+#define MONITOR_CURVE_POINTS 8
+typedef struct
+{
+	int count;								// Points of a piecewise-linear curve in increasing master order, 0 for none (the master level as-is)
+	int master[MONITOR_CURVE_POINTS];		// 0-100
+	int brightness[MONITOR_CURVE_POINTS];	// 0-100
+	int offset;								// Percentage points added after the curve
+} monitor_curve_t;
+
+// Background reads of every monitor, to follow changes made elsewhere (e.g. the monitor's own buttons) without a read when the popup opens
+typedef struct
+{
+	int minimum;			// Milliseconds between reads after activity or a change
+	int maximum;			// Milliseconds between reads reached by doubling the interval while nothing changes
+} monitor_sync_t;
+
+bool MonitorRegisterBackend(backend_t *backend);	// Before the first enumeration, in order of preference
+bool MonitorSetCapabilitiesCache(const char *filename);	// Load (and later save) parsed MCCS capabilities by monitor identity, so monitors are not probed again
+bool MonitorSetTimingCache(const char *filename);	// Load (and later save) the DDC/CI command spacing learned for each monitor model
+bool MonitorSetAttachCache(const char *filename);	// Load (and later save) the monitors not known to be external that an attaching backend (e.g. WMI) has no device for, so it is only queried when one might
+void MonitorSetPolicy(const monitor_policy_t *policy);
+void MonitorGetPolicy(monitor_policy_t *policy);
+void MonitorSetCorrectedCallback(monitor_callback_t callback, void *context);	// Called from a background thread when a monitor's brightness is corrected to its confirmed value (a write failed, or read back differently), or was changed elsewhere (see MonitorSetWatching())
+void MonitorSetProbeFilter(monitor_filter_t filter, void *context);	// Before enumerating: only monitors the filter accepts are probed (e.g. a command line setting one monitor), the others are listed without brightness, NULL to probe all
+void MonitorSetWatching(bool watching);	// Before enumerating: backends that can (e.g. WMI) report brightness changed elsewhere (e.g. hotkeys) as it happens, once they have a device, so no polling is needed
+
 void MonitorDump(FILE *file, monitor_t *monitor);
+void MonitorGetMetrics(monitor_t *monitor, monitor_metrics_t *metrics);
 bool MonitorHasBrightness(monitor_t *monitor);
 int MonitorGetBrightness(monitor_t *monitor);	// at time of last call to MonitorListRefreshBrightness()
-void MonitorSetBrightness(monitor_t *monitor, int brightness);
+bool MonitorSetBrightness(monitor_t *monitor, int brightness);	// blocking, returns false (keeping the confirmed value) if the write failed
+void MonitorPostBrightness(monitor_t *monitor, int brightness);	// non-blocking, only the latest value is written
+void MonitorFadeBrightness(monitor_t *monitor, int brightness, int duration);	// non-blocking transition over the duration (milliseconds), retargeting any fade in progress from its current value
+void MonitorCancelFade(monitor_t *monitor);	// Stop any fade in progress at the value last written
+bool MonitorIsFading(monitor_t *monitor);
+bool MonitorSetCurve(const char *identity, const monitor_curve_t *curve);	// Master level mapping for the monitor with the identity (see MonitorGetIdentity()), NULL to remove
+bool MonitorSetCurveFile(const char *filename);	// Load master level mappings, a line per monitor: <identity><TAB><offset>[<TAB><master>:<brightness>]...
+int MonitorCurveBrightness(monitor_t *monitor, int master);	// The brightness (0-100) the monitor is set to for a master level
 const wchar_t *MonitorGetDescription(monitor_t *monitor);
+const char *MonitorGetIdentity(monitor_t *monitor);	// Stable across connections (e.g. from the EDID), otherwise the device key
+void MonitorSetRefreshFeatures(monitor_t *monitor, const uint8_t *codes, int count);	// e.g. VCP_CONTRAST, VCP_VOLUME, VCP_POWER_MODE: read in the same pass as the brightness by each refresh
+const vcp_value_t *MonitorGetFeature(monitor_t *monitor, uint8_t code);	// at time of the last refresh, NULL if not read
+int MonitorReadFeatures(monitor_t *monitor, vcp_value_t *values, int count);	// blocking, one spaced pass, returns the number read
+int MonitorWriteFeatures(monitor_t *monitor, vcp_value_t *values, int count);	// blocking, one spaced pass, returns the number written
 
 monitor_t *MonitorListEnumerate(void);
-void MonitorListRefreshBrightness(monitor_t *monitorList);
+monitor_t *MonitorListUpdate(monitor_t *monitorList);	// Re-enumerate, keeping unchanged monitors and only probing added ones (returns the new list, the old one must not be used)
+void MonitorListSetBrightnessAll(monitor_t *monitorList, int master);	// non-blocking, each monitor's mapped value is posted to its own worker, so they are written concurrently
+void MonitorListRefreshBrightness(monitor_t *monitorList);	// blocking (until each read completes or its deadline passes)
+void MonitorListRefreshBrightnessAsync(monitor_t *monitorList, monitor_callback_t callback, void *context);	// callback is made from a background thread as each monitor's value is read
 void MonitorListDestroy(monitor_t *monitorList);
+int MonitorListCount(monitor_t *monitorList);
+monitor_t *MonitorListGet(monitor_t *monitorList, int index);	// NULL if out of range
+monitor_t *MonitorListFind(monitor_t *monitorList, int id);	// By stable id, NULL if not in the list
+monitor_t *MonitorListFindKey(monitor_t *monitorList, const char *key);	// By the key of its primary device (e.g. DISPLAY\ACME1234\9&abcdef9&0&UID12345), NULL if none
+void MonitorListDumpMetrics(FILE *file, monitor_t *monitorList);	// JSON: the phases of the last enumeration, and each monitor's I/O metrics
+monitor_t *MonitorListRestore(const char *filename);	// Monitors from a snapshot, usable (including setting the brightness) while the real ones are enumerated, NULL if none
+monitor_t *MonitorListStandIn(monitor_t *monitorList);	// Restored copies of the list's monitors (with the same ids), usable while the list itself is updated on another thread, and given to MonitorListReplace() with the result
+bool MonitorListSave(monitor_t *monitorList, const char *filename);	// Snapshot the capabilities and last brightness of each monitor
+monitor_t *MonitorListReplace(monitor_t *monitorList, monitor_t *newList);	// Swap in a newly enumerated list, applying any brightness set on the old (restored) monitors to the same new ones (the old list is destroyed)
+bool MonitorSyncStart(monitor_t *monitorList, const monitor_sync_t *sync);	// Keep the list's stored values current (followed through MonitorListUpdate()/MonitorListReplace(), or call again for another list), changes are reported to the corrected callback
+void MonitorSyncStop(void);
+void MonitorSyncActivity(void);	// Read now, and again at the minimum interval (e.g. the popup opened)
+void MonitorSyncPause(bool paused);	// e.g. while the session is locked or the displays are off (a read is made on resuming)
+void MonitorCleanup(void);	// Release shared resources (e.g. the WMI connection), call before CoUninitialize()
 
 #endif
@@ -0,0 +1,270 @@
+// Platform abstractions (threads, locking and timing)
+// Dan Jackson, 2020.
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0600
+#include <windows.h>
+#else
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <errno.h>
+#endif
+
+#include <stdlib.h>
+
+#include "platform.h"
+
+#ifdef _WIN32
+
+void PlatformMutexInit(platform_mutex_t *mutex)
+{
+	InitializeSRWLock(mutex);
+}
+
+void PlatformMutexDestroy(platform_mutex_t *mutex)
+{
+	;	// Nothing to release for an SRW lock
+}
+
+void PlatformMutexLock(platform_mutex_t *mutex)
+{
+	AcquireSRWLockExclusive(mutex);
+}
+
+void PlatformMutexUnlock(platform_mutex_t *mutex)
+{
+	ReleaseSRWLockExclusive(mutex);
+}
+
+void PlatformCondInit(platform_cond_t *cond)
+{
+	InitializeConditionVariable(cond);
+}
+
+void PlatformCondDestroy(platform_cond_t *cond)
+{
+	;	// Nothing to release for a condition variable
+}
+
+void PlatformCondSignal(platform_cond_t *cond)
+{
+	WakeConditionVariable(cond);
+}
+
+void PlatformCondBroadcast(platform_cond_t *cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+bool PlatformCondWait(platform_cond_t *cond, platform_mutex_t *mutex, int64_t timeoutMicroseconds)
+{
+	DWORD timeout = (timeoutMicroseconds < 0) ? INFINITE : (DWORD)((timeoutMicroseconds + 999) / 1000);
+	return SleepConditionVariableSRW(cond, mutex, timeout, 0) ? true : false;
+}
+
+typedef struct
+{
+	platform_thread_func_t func;
+	void *context;
+} platform_thread_start_t;
+
+static DWORD WINAPI PlatformThreadStart(LPVOID lpParameter)
+{
+	platform_thread_start_t start = *(platform_thread_start_t *)lpParameter;
+	free(lpParameter);
+	HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);		// e.g. WMI calls
+	start.func(start.context);
+	if (SUCCEEDED(hr)) CoUninitialize();
+	return 0;
+}
+
+bool PlatformThreadCreate(platform_thread_t *thread, platform_thread_func_t func, void *context)
+{
+	platform_thread_start_t *start = (platform_thread_start_t *)malloc(sizeof(platform_thread_start_t));
+	if (start == NULL) return false;
+	start->func = func;
+	start->context = context;
+	*thread = CreateThread(NULL, 0, PlatformThreadStart, start, 0, NULL);
+	if (*thread == NULL) { free(start); return false; }
+	return true;
+}
+
+void PlatformThreadJoin(platform_thread_t *thread)
+{
+	WaitForSingleObject(*thread, INFINITE);
+	CloseHandle(*thread);
+	*thread = NULL;
+}
+
+bool PlatformSemaphoreInit(platform_semaphore_t *semaphore, int count)
+{
+	*semaphore = CreateSemaphore(NULL, count, count, NULL);
+	return *semaphore != NULL;
+}
+
+void PlatformSemaphoreDestroy(platform_semaphore_t *semaphore)
+{
+	CloseHandle(*semaphore);
+	*semaphore = NULL;
+}
+
+void PlatformSemaphoreAcquire(platform_semaphore_t *semaphore)
+{
+	WaitForSingleObject(*semaphore, INFINITE);
+}
+
+void PlatformSemaphoreRelease(platform_semaphore_t *semaphore)
+{
+	ReleaseSemaphore(*semaphore, 1, NULL);
+}
+
+uint64_t PlatformTimeMicroseconds(void)
+{
+	static LARGE_INTEGER frequency = {0};
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+void PlatformSleepMicroseconds(uint64_t microseconds)
+{
+	Sleep((DWORD)((microseconds + 999) / 1000));
+}
+
+#else
+
+void PlatformMutexInit(platform_mutex_t *mutex)
+{
+	pthread_mutex_init(mutex, NULL);
+}
+
+void PlatformMutexDestroy(platform_mutex_t *mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void PlatformMutexLock(platform_mutex_t *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void PlatformMutexUnlock(platform_mutex_t *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void PlatformCondInit(platform_cond_t *cond)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+void PlatformCondDestroy(platform_cond_t *cond)
+{
+	pthread_cond_destroy(cond);
+}
+
+void PlatformCondSignal(platform_cond_t *cond)
+{
+	pthread_cond_signal(cond);
+}
+
+void PlatformCondBroadcast(platform_cond_t *cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+bool PlatformCondWait(platform_cond_t *cond, platform_mutex_t *mutex, int64_t timeoutMicroseconds)
+{
+	if (timeoutMicroseconds < 0)
+	{
+		pthread_cond_wait(cond, mutex);
+		return true;
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += (time_t)(timeoutMicroseconds / 1000000);
+	ts.tv_nsec += (long)(timeoutMicroseconds % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+	return pthread_cond_timedwait(cond, mutex, &ts) != ETIMEDOUT;
+}
+
+typedef struct
+{
+	platform_thread_func_t func;
+	void *context;
+} platform_thread_start_t;
+
+static void *PlatformThreadStart(void *arg)
+{
+	platform_thread_start_t start = *(platform_thread_start_t *)arg;
+	free(arg);
+	start.func(start.context);
+	return NULL;
+}
+
+bool PlatformThreadCreate(platform_thread_t *thread, platform_thread_func_t func, void *context)
+{
+	platform_thread_start_t *start = (platform_thread_start_t *)malloc(sizeof(platform_thread_start_t));
+	if (start == NULL) return false;
+	start->func = func;
+	start->context = context;
+	if (pthread_create(thread, NULL, PlatformThreadStart, start) != 0) { free(start); return false; }
+	return true;
+}
+
+void PlatformThreadJoin(platform_thread_t *thread)
+{
+	pthread_join(*thread, NULL);
+}
+
+bool PlatformSemaphoreInit(platform_semaphore_t *semaphore, int count)
+{
+	pthread_mutex_init(&semaphore->mutex, NULL);
+	pthread_cond_init(&semaphore->cond, NULL);
+	semaphore->count = count;
+	return true;
+}
+
+void PlatformSemaphoreDestroy(platform_semaphore_t *semaphore)
+{
+	pthread_cond_destroy(&semaphore->cond);
+	pthread_mutex_destroy(&semaphore->mutex);
+}
+
+void PlatformSemaphoreAcquire(platform_semaphore_t *semaphore)
+{
+	pthread_mutex_lock(&semaphore->mutex);
+	while (semaphore->count <= 0) pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+	semaphore->count--;
+	pthread_mutex_unlock(&semaphore->mutex);
+}
+
+void PlatformSemaphoreRelease(platform_semaphore_t *semaphore)
+{
+	pthread_mutex_lock(&semaphore->mutex);
+	semaphore->count++;
+	pthread_mutex_unlock(&semaphore->mutex);
+	pthread_cond_signal(&semaphore->cond);
+}
+
+uint64_t PlatformTimeMicroseconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void PlatformSleepMicroseconds(uint64_t microseconds)
+{
+	struct timespec ts;
+	ts.tv_sec = (time_t)(microseconds / 1000000);
+	ts.tv_nsec = (long)(microseconds % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR) { ; }
+}
+
+#endif
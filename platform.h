@@ -0,0 +1,56 @@
+// Platform abstractions (threads, locking and timing)
+// Dan Jackson, 2020.
+
+#ifndef _PLATFORM_H
+#define _PLATFORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK platform_mutex_t;
+#define PLATFORM_MUTEX_INIT SRWLOCK_INIT
+typedef CONDITION_VARIABLE platform_cond_t;
+#define PLATFORM_COND_INIT CONDITION_VARIABLE_INIT
+typedef HANDLE platform_thread_t;
+typedef HANDLE platform_semaphore_t;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t platform_mutex_t;
+#define PLATFORM_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+typedef pthread_cond_t platform_cond_t;		// Must be initialized with PlatformCondInit() (uses the monotonic clock)
+typedef pthread_t platform_thread_t;
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int count;
+} platform_semaphore_t;
+#endif
+
+typedef void (*platform_thread_func_t)(void *context);
+
+void PlatformMutexInit(platform_mutex_t *mutex);
+void PlatformMutexDestroy(platform_mutex_t *mutex);
+void PlatformMutexLock(platform_mutex_t *mutex);
+void PlatformMutexUnlock(platform_mutex_t *mutex);
+
+void PlatformCondInit(platform_cond_t *cond);
+void PlatformCondDestroy(platform_cond_t *cond);
+void PlatformCondSignal(platform_cond_t *cond);
+void PlatformCondBroadcast(platform_cond_t *cond);
+bool PlatformCondWait(platform_cond_t *cond, platform_mutex_t *mutex, int64_t timeoutMicroseconds);	// Negative timeout waits indefinitely, returns false if timed out
+
+bool PlatformThreadCreate(platform_thread_t *thread, platform_thread_func_t func, void *context);		// On Windows, the thread is initialized for COM (multi-threaded apartment)
+void PlatformThreadJoin(platform_thread_t *thread);
+
+bool PlatformSemaphoreInit(platform_semaphore_t *semaphore, int count);
+void PlatformSemaphoreDestroy(platform_semaphore_t *semaphore);
+void PlatformSemaphoreAcquire(platform_semaphore_t *semaphore);
+void PlatformSemaphoreRelease(platform_semaphore_t *semaphore);
+
+uint64_t PlatformTimeMicroseconds(void);		// Monotonic
+void PlatformSleepMicroseconds(uint64_t microseconds);
+
+#endif
@@ -0,0 +1,194 @@
+// Monitor Brightness - State Snapshot
+// Dan Jackson, 2020.
+
+// Compact little-endian binary file, read at startup before any monitor is probed:
+//   "BRSS" version:u8 count:u8
+//   per entry: identity:str backend:str description:wstr hasBrightness:u8 minimum:i32 maximum:i32 current:i32 levelCount:u8 levels:i32[levelCount]
+// Strings are a u8 length followed by the UTF-8 bytes (or UTF-16 code units for wstr).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "BRSS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_SIZE 0x10000
+
+typedef struct
+{
+	uint8_t *data;
+	size_t length;
+	size_t offset;
+	bool overflow;
+} snapshot_buffer_t;
+
+static void SnapshotPutBytes(snapshot_buffer_t *buffer, const void *data, size_t length)
+{
+	if (buffer->offset + length > buffer->length) { buffer->overflow = true; return; }
+	memcpy(buffer->data + buffer->offset, data, length);
+	buffer->offset += length;
+}
+
+static void SnapshotPutU8(snapshot_buffer_t *buffer, unsigned int value)
+{
+	uint8_t byte = (uint8_t)value;
+	SnapshotPutBytes(buffer, &byte, 1);
+}
+
+static void SnapshotPutI32(snapshot_buffer_t *buffer, int value)
+{
+	uint32_t v = (uint32_t)value;
+	uint8_t bytes[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+	SnapshotPutBytes(buffer, bytes, sizeof(bytes));
+}
+
+static void SnapshotPutString(snapshot_buffer_t *buffer, const char *value, size_t maxLength)
+{
+	size_t length = strlen(value);
+	if (length > maxLength - 1) length = maxLength - 1;
+	if (length > 255) length = 255;
+	SnapshotPutU8(buffer, (unsigned int)length);
+	SnapshotPutBytes(buffer, value, length);
+}
+
+static void SnapshotPutWideString(snapshot_buffer_t *buffer, const wchar_t *value, size_t maxLength)
+{
+	size_t length = wcslen(value);
+	if (length > maxLength - 1) length = maxLength - 1;
+	if (length > 255) length = 255;
+	SnapshotPutU8(buffer, (unsigned int)length);
+	for (size_t i = 0; i < length; i++)
+	{
+		uint16_t c = (uint16_t)value[i];
+		uint8_t bytes[2] = { (uint8_t)c, (uint8_t)(c >> 8) };
+		SnapshotPutBytes(buffer, bytes, sizeof(bytes));
+	}
+}
+
+static bool SnapshotGetBytes(snapshot_buffer_t *buffer, void *data, size_t length)
+{
+	if (buffer->offset + length > buffer->length) { buffer->overflow = true; return false; }
+	memcpy(data, buffer->data + buffer->offset, length);
+	buffer->offset += length;
+	return true;
+}
+
+static unsigned int SnapshotGetU8(snapshot_buffer_t *buffer)
+{
+	uint8_t byte = 0;
+	SnapshotGetBytes(buffer, &byte, 1);
+	return byte;
+}
+
+static int SnapshotGetI32(snapshot_buffer_t *buffer)
+{
+	uint8_t bytes[4] = {0};
+	SnapshotGetBytes(buffer, bytes, sizeof(bytes));
+	return (int)((uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24));
+}
+
+static void SnapshotGetString(snapshot_buffer_t *buffer, char *value, size_t maxLength)
+{
+	size_t length = SnapshotGetU8(buffer);
+	if (length >= maxLength) { buffer->overflow = true; value[0] = '\0'; return; }
+	if (!SnapshotGetBytes(buffer, value, length)) length = 0;
+	value[length] = '\0';
+}
+
+static void SnapshotGetWideString(snapshot_buffer_t *buffer, wchar_t *value, size_t maxLength)
+{
+	size_t length = SnapshotGetU8(buffer);
+	if (length >= maxLength) { buffer->overflow = true; value[0] = L'\0'; return; }
+	for (size_t i = 0; i < length; i++)
+	{
+		uint8_t bytes[2] = {0};
+		SnapshotGetBytes(buffer, bytes, sizeof(bytes));
+		value[i] = (wchar_t)(bytes[0] | (bytes[1] << 8));
+	}
+	value[length] = L'\0';
+}
+
+int SnapshotLoad(const char *filename, snapshot_entry_t *entries, int maxCount)
+{
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) return 0;
+	snapshot_buffer_t buffer = {0};
+	buffer.data = (uint8_t *)malloc(SNAPSHOT_MAX_SIZE);
+	if (buffer.data != NULL) buffer.length = fread(buffer.data, 1, SNAPSHOT_MAX_SIZE, fp);
+	fclose(fp);
+
+	int count = 0;
+	char magic[4] = {0};
+	if (SnapshotGetBytes(&buffer, magic, sizeof(magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0 && SnapshotGetU8(&buffer) == SNAPSHOT_VERSION)
+	{
+		int total = (int)SnapshotGetU8(&buffer);
+		for (int i = 0; i < total && count < maxCount && !buffer.overflow; i++)
+		{
+			snapshot_entry_t *entry = &entries[count];
+			memset(entry, 0, sizeof(*entry));
+			SnapshotGetString(&buffer, entry->identity, sizeof(entry->identity));
+			SnapshotGetString(&buffer, entry->backend, sizeof(entry->backend));
+			SnapshotGetWideString(&buffer, entry->description, BACKEND_DESCRIPTION_LENGTH);
+			entry->caps.hasBrightness = SnapshotGetU8(&buffer) != 0;
+			entry->caps.minimum = SnapshotGetI32(&buffer);
+			entry->caps.maximum = SnapshotGetI32(&buffer);
+			entry->caps.current = SnapshotGetI32(&buffer);
+			entry->caps.levelCount = (int)SnapshotGetU8(&buffer);
+			if (entry->caps.levelCount > BACKEND_MAX_LEVELS) buffer.overflow = true;
+			for (int j = 0; j < entry->caps.levelCount && !buffer.overflow; j++) entry->caps.levels[j] = SnapshotGetI32(&buffer);
+			if (!buffer.overflow) count++;
+		}
+		if (buffer.overflow)
+		{
+			fprintf(stderr, "WARNING: Snapshot truncated, ignored: %s\n", filename);
+			count = 0;	// Partly written (or corrupt), so none of it is trusted
+		}
+	}
+	else
+	{
+		fprintf(stderr, "WARNING: Not a valid snapshot: %s\n", filename);
+	}
+
+	free(buffer.data);
+	return count;
+}
+
+bool SnapshotSave(const char *filename, const snapshot_entry_t *entries, int count)
+{
+	if (count > 255) count = 255;
+	snapshot_buffer_t buffer = {0};
+	buffer.data = (uint8_t *)malloc(SNAPSHOT_MAX_SIZE);
+	if (buffer.data == NULL) return false;
+	buffer.length = SNAPSHOT_MAX_SIZE;
+
+	SnapshotPutBytes(&buffer, SNAPSHOT_MAGIC, 4);
+	SnapshotPutU8(&buffer, SNAPSHOT_VERSION);
+	SnapshotPutU8(&buffer, (unsigned int)count);
+	for (int i = 0; i < count; i++)
+	{
+		const snapshot_entry_t *entry = &entries[i];
+		SnapshotPutString(&buffer, entry->identity, sizeof(entry->identity));
+		SnapshotPutString(&buffer, entry->backend, sizeof(entry->backend));
+		SnapshotPutWideString(&buffer, entry->description, BACKEND_DESCRIPTION_LENGTH);
+		SnapshotPutU8(&buffer, entry->caps.hasBrightness ? 1 : 0);
+		SnapshotPutI32(&buffer, entry->caps.minimum);
+		SnapshotPutI32(&buffer, entry->caps.maximum);
+		SnapshotPutI32(&buffer, entry->caps.current);
+		int levelCount = (entry->caps.levelCount > 0 && entry->caps.levelCount <= BACKEND_MAX_LEVELS) ? entry->caps.levelCount : 0;
+		SnapshotPutU8(&buffer, (unsigned int)levelCount);
+		for (int j = 0; j < levelCount; j++) SnapshotPutI32(&buffer, entry->caps.levels[j]);
+	}
+
+	bool success = false;
+	FILE *fp = buffer.overflow ? NULL : fopen(filename, "wb");
+	if (fp != NULL)
+	{
+		success = fwrite(buffer.data, 1, buffer.offset, fp) == buffer.offset;
+		if (fclose(fp) != 0) success = false;
+	}
+	if (!success) fprintf(stderr, "ERROR: Cannot write snapshot: %s\n", filename);
+	free(buffer.data);
+	return success;
+}
@@ -0,0 +1,28 @@
+// Monitor Brightness - State Snapshot
+// Dan Jackson, 2020.
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdbool.h>
+#include <wchar.h>
+
+#include "backend.h"
+
+#define SNAPSHOT_MAX_MONITORS 32
+#define SNAPSHOT_BACKEND_LENGTH 16
+
+// Last known state of a monitor, so it can be shown (and controlled) before it has been enumerated
+typedef struct _snapshot_entry_t
+{
+	char identity[BACKEND_KEY_LENGTH];					// Stable monitor identity, or device key (see MonitorGetIdentity())
+	char backend[SNAPSHOT_BACKEND_LENGTH];				// Backend of the brightness control (e.g. "ddcci" or "wmi"), empty if none
+	wchar_t description[BACKEND_DESCRIPTION_LENGTH];
+	backend_caps_t caps;								// Of the brightness control, 'current' is the last brightness
+} snapshot_entry_t;
+
+// Returns the number of entries read (0 if the file is missing, truncated or not a valid snapshot of this version)
+int SnapshotLoad(const char *filename, snapshot_entry_t *entries, int maxCount);
+bool SnapshotSave(const char *filename, const snapshot_entry_t *entries, int count);
+
+#endif
@@ -0,0 +1,23 @@
+// Unit Test Checks
+// Dan Jackson, 2020.
+
+#ifndef _TEST_H
+#define _TEST_H
+
+#include <stdio.h>
+
+// Each failed check is reported and counted, the test's exit code is non-zero if any failed
+static int testChecks = 0;
+static int testFailures = 0;
+
+#define TEST_CHECK(condition) do { testChecks++; if (!(condition)) { fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, #condition); testFailures++; } } while (0)
+#define TEST_EQUAL_INT(actual, expected) do { long long _a = (long long)(actual), _e = (long long)(expected); testChecks++; if (_a != _e) { fprintf(stderr, "FAIL: %s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); testFailures++; } } while (0)
+#define TEST_EQUAL_STRING(actual, expected) do { const char *_a = (actual), *_e = (expected); testChecks++; if (strcmp(_a, _e) != 0) { fprintf(stderr, "FAIL: %s:%d: %s == \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, _a, _e); testFailures++; } } while (0)
+
+static int TestResult(const char *name)
+{
+	printf("%s: %d checks, %d failed\n", name, testChecks, testFailures);
+	return (testFailures > 0) ? 1 : 0;
+}
+
+#endif
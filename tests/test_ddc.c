@@ -0,0 +1,283 @@
+// DDC/CI Protocol Tests
+// Dan Jackson, 2020.
+
+// The protocol (ddc.c) against a scripted transport (exact framing, checksums and NAKs) and the fake monitor (ddc_fake.c),
+// and, on Linux, that only the I2C buses linked from a DRM connector are listed.
+
+#if defined(__linux__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "vcp.h"
+#include "ddc.h"
+#include "ddc_fake.h"
+#include "test.h"
+#include "test_tree.h"
+
+#define TEST_TIME_SCALE 0.1
+#define TEST_MAX_TRANSFERS 8
+
+// Replies with a fixed message (or fragments of a capabilities string), after NAKing the first reads
+typedef struct
+{
+	ddc_transport_t transport;
+	uint8_t reply[DDC_MAX_MESSAGE];
+	const char *capabilities;			// Answers capabilities requests, if set
+	int naks;							// Reads still to NAK
+	int writes;
+	int reads;
+	uint8_t written[DDC_MAX_MESSAGE];	// Last message written
+	size_t writtenLength;
+	uint64_t writeTimes[TEST_MAX_TRANSFERS];
+	uint64_t readTimes[TEST_MAX_TRANSFERS];
+} test_script_t;
+
+// A reply from the display (source 0x6E, checksum including the virtual host address 0x50)
+static void TestScriptReply(test_script_t *script, const uint8_t *payload, size_t length)
+{
+	script->reply[0] = DDC_ADDRESS_DDCCI << 1;
+	script->reply[1] = (uint8_t)(0x80 | length);
+	memcpy(script->reply + 2, payload, length);
+	uint8_t checksum = 0x50;
+	for (size_t i = 0; i < length + 2; i++) checksum ^= script->reply[i];
+	script->reply[length + 2] = checksum;
+}
+
+static bool TestScriptWrite(ddc_transport_t *transport, uint8_t address, const uint8_t *data, size_t length)
+{
+	test_script_t *script = (test_script_t *)transport->context;
+	if (script->writes < TEST_MAX_TRANSFERS) script->writeTimes[script->writes] = PlatformTimeMicroseconds();
+	script->writes++;
+	if (address != DDC_ADDRESS_DDCCI || length > sizeof(script->written)) return false;
+	memcpy(script->written, data, length);
+	script->writtenLength = length;
+	return true;
+}
+
+static bool TestScriptRead(ddc_transport_t *transport, uint8_t address, uint8_t *data, size_t length)
+{
+	test_script_t *script = (test_script_t *)transport->context;
+	if (script->reads < TEST_MAX_TRANSFERS) script->readTimes[script->reads] = PlatformTimeMicroseconds();
+	script->reads++;
+	if (script->naks > 0) { script->naks--; return false; }
+	if (script->capabilities != NULL && script->writtenLength == 6 && script->written[2] == 0xF3)
+	{
+		// Up to 32 bytes from the requested offset
+		uint8_t fragment[3 + 32] = { 0xE3, script->written[3], script->written[4] };
+		size_t offset = ((size_t)script->written[3] << 8) | script->written[4], total = strlen(script->capabilities);
+		size_t count = (offset < total) ? total - offset : 0;
+		if (count > 32) count = 32;
+		memcpy(fragment + 3, script->capabilities + offset, count);
+		TestScriptReply(script, fragment, 3 + count);
+	}
+	memcpy(data, script->reply, (length < sizeof(script->reply)) ? length : sizeof(script->reply));
+	return true;
+}
+
+static void TestScriptInit(test_script_t *script, const uint8_t *payload, size_t length)
+{
+	memset(script, 0, sizeof(*script));
+	snprintf(script->transport.name, sizeof(script->transport.name), "script");
+	script->transport.timeScale = TEST_TIME_SCALE;
+	script->transport.context = script;
+	script->transport.write = TestScriptWrite;
+	script->transport.read = TestScriptRead;
+	TestScriptReply(script, payload, length);
+}
+
+static const uint8_t testGetReply[] = { 0x02, 0x00, VCP_BRIGHTNESS, 0x00, 0x00, 0x64, 0x00, 0x32 };	// Brightness 50 of 100
+
+// Requests are framed with the source, length and a checksum including the destination address 0x6E
+static void TestRequest(void)
+{
+	test_script_t script;
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	TEST_CHECK(DdcSetVcp(&script.transport, VCP_BRIGHTNESS, 0x1234));
+	TEST_EQUAL_INT(script.writes, 1);
+	TEST_EQUAL_INT(script.writtenLength, 7);
+	const uint8_t expected[] = { 0x51, 0x84, 0x03, VCP_BRIGHTNESS, 0x12, 0x34, 0x6E ^ 0x51 ^ 0x84 ^ 0x03 ^ VCP_BRIGHTNESS ^ 0x12 ^ 0x34 };
+	TEST_CHECK(memcmp(script.written, expected, sizeof(expected)) == 0);
+
+	int current = -1, maximum = -1;
+	TEST_CHECK(DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+	TEST_EQUAL_INT(current, 50);
+	TEST_EQUAL_INT(maximum, 100);
+	TEST_EQUAL_INT(script.written[2], 0x01);
+	TEST_EQUAL_INT(script.written[3], VCP_BRIGHTNESS);
+}
+
+// Replies with a bad checksum or framing are rejected, as are replies for another feature or an unsupported one
+static void TestReplyRejected(void)
+{
+	test_script_t script;
+	int current = -1, maximum = -1;
+
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	script.reply[sizeof(testGetReply) + 2] ^= 0x01;
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+	TEST_EQUAL_INT(script.writes, 1);										// Retried by the caller's policy, not here
+	TEST_EQUAL_INT(script.reads, 1);
+
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	script.reply[0] = 0x6F;									// Source is not the display
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	script.reply[1] &= 0x7f;								// Length without its marker bit
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	script.reply[1] = 0x80 | DDC_MAX_MESSAGE;				// Longer than a message
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_CONTRAST, &current, &maximum));
+
+	const uint8_t unsupported[] = { 0x02, 0x01, VCP_BRIGHTNESS, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	TestScriptInit(&script, unsupported, sizeof(unsupported));
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+	TEST_EQUAL_INT(current, -1);
+	TEST_CHECK(script.transport.unsupported);								// A valid reply (so the spacing is not widened)
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_CONTRAST, &current, &maximum));
+	TEST_CHECK(!script.transport.unsupported);
+}
+
+// A VCP command is a single exchange (retried, if at all, by the caller's policy), but a NAKed capabilities fragment is requested again,
+// once the bus has been idle for the DDC/CI command interval
+static void TestNakRetry(void)
+{
+	test_script_t script;
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	script.naks = 1;
+	int current = -1, maximum = -1;
+	TEST_CHECK(!DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+	TEST_EQUAL_INT(script.writes, 1);
+	TEST_CHECK(script.readTimes[0] - script.writeTimes[0] >= (uint64_t)(DDC_REPLY_DELAY * TEST_TIME_SCALE));
+	TEST_CHECK(DdcGetVcp(&script.transport, VCP_BRIGHTNESS, &current, &maximum));
+	TEST_EQUAL_INT(current, 50);
+
+	TestScriptInit(&script, testGetReply, sizeof(testGetReply));
+	script.capabilities = "(prot(monitor)type(lcd)model(ACME 1234)cmds(01 02 03 F3)vcp(10 12))";
+	script.naks = 1;
+	char buffer[128];
+	TEST_CHECK(DdcCapabilities(&script.transport, buffer, sizeof(buffer)));
+	TEST_EQUAL_STRING(buffer, script.capabilities);
+	TEST_EQUAL_INT(script.writes, 5);										// Three fragments, the empty one, and the retry
+	TEST_CHECK(script.writeTimes[1] - script.readTimes[0] >= (uint64_t)(DDC_RETRY_DELAY * TEST_TIME_SCALE));
+}
+
+// Against the fake monitor: capabilities are read in fragments, corrupt replies are rejected, and a disconnected monitor NAKs
+static void TestFake(void)
+{
+	static const char capabilities[] = "(prot(monitor)type(lcd)model(ACME 1234)cmds(01 02 03 07 0C E3 F3)vcp(02 04 05 08 10 12 14(05 08 0B) 16 18 1A 52 60(01 03 0F 11) AC AE B2 B6 C6 C8 C9 D6(01 04 05) DF)mccs_ver(2.1))";
+	ddc_fake_config_t config = {0};
+	config.bus = "fake-0";
+	config.manufacturer = "ACM";
+	config.product = 0x1234;
+	config.name = "ACME 1234";
+	config.capabilities = capabilities;
+	config.brightness = 40;
+	config.maximum = 100;
+	config.responseDelay = DDC_REPLY_DELAY / 2;
+	ddc_fake_t *fake = DdcFakeCreate(&config, TEST_TIME_SCALE);
+	TEST_CHECK(fake != NULL);
+	if (fake == NULL) return;
+	ddc_transport_t *transport = DdcFakeOpen(fake);
+
+	char buffer[512];
+	TEST_CHECK(DdcCapabilities(transport, buffer, sizeof(buffer)));
+	TEST_EQUAL_STRING(buffer, capabilities);
+	ddc_fake_stats_t stats;
+	DdcFakeStats(fake, &stats);
+	int fragments = (int)((sizeof(capabilities) - 1 + 31) / 32);		// The fake replies with up to 32 bytes
+	TEST_CHECK(fragments > 1);
+	TEST_EQUAL_INT(stats.requests, fragments + 1);						// ...and an empty fragment ends the string
+	TEST_EQUAL_INT(stats.badRequests, 0);
+	TEST_CHECK(!DdcCapabilities(transport, buffer, 64));				// Too long for the buffer
+
+	int current = -1, maximum = -1;
+	TEST_CHECK(DdcSetVcp(transport, VCP_BRIGHTNESS, 75));
+	TEST_CHECK(DdcGetVcp(transport, VCP_BRIGHTNESS, &current, &maximum));
+	TEST_EQUAL_INT(current, 75);
+	TEST_EQUAL_INT(maximum, 100);
+
+	// A request with a bad checksum is ignored by the monitor
+	const uint8_t bad[] = { 0x51, 0x84, 0x03, VCP_BRIGHTNESS, 0x00, 0x10, 0x00 };
+	TEST_CHECK(transport->write(transport, DDC_ADDRESS_DDCCI, bad, sizeof(bad)));
+	DdcFakeStats(fake, &stats);
+	TEST_EQUAL_INT(stats.badRequests, 1);
+	int value = -1;
+	TEST_CHECK(DdcFakeGetFeature(fake, VCP_BRIGHTNESS, &value));
+	TEST_EQUAL_INT(value, 75);
+
+	DdcFakeSetConnected(fake, false);
+	TEST_CHECK(!DdcGetVcp(transport, VCP_BRIGHTNESS, &current, &maximum));
+	DdcFakeSetConnected(fake, true);
+	TEST_CHECK(DdcGetVcp(transport, VCP_BRIGHTNESS, &current, &maximum));
+
+	transport->close(transport);
+	DdcFakeDestroy(fake);
+
+	// Every reply corrupt
+	config.checksumErrorPercent = 100;
+	fake = DdcFakeCreate(&config, TEST_TIME_SCALE);
+	transport = DdcFakeOpen(fake);
+	TEST_CHECK(!DdcGetVcp(transport, VCP_BRIGHTNESS, &current, &maximum));
+	DdcFakeStats(fake, &stats);
+	TEST_CHECK(stats.checksumErrors > 0);
+	TEST_EQUAL_INT(stats.checksumErrors, stats.requests);
+	transport->close(transport);
+	DdcFakeDestroy(fake);
+}
+
+#if defined(__linux__)
+// Only the buses linked from a DRM connector are opened
+static void TestI2cList(void)
+{
+	if (TestTreeCreate() == NULL) { TEST_CHECK(false); return; }
+	TEST_CHECK(TestTreeWriteString("drm/card0-DP-1/status", "connected\n"));
+	TEST_CHECK(TestTreeLink("drm/card0-DP-1/ddc", "../../../0000:00:02.0/i2c-5"));
+	TEST_CHECK(TestTreeDirectory("drm/card0-DP-2/i2c-7"));				// DisplayPort AUX channel
+	TEST_CHECK(TestTreeWriteString("drm/card0/dev", "226:0\n"));
+	TEST_CHECK(TestTreeWriteString("dev/i2c-0", ""));					// e.g. SMBus
+	TEST_CHECK(TestTreeWriteString("dev/i2c-5", ""));
+	TEST_CHECK(TestTreeWriteString("dev/i2c-7", ""));
+	TEST_CHECK(TestTreeWriteString("dev/i2c-12", ""));
+
+	char drmRoot[TEST_TREE_PATH_LENGTH], deviceRoot[TEST_TREE_PATH_LENGTH];
+	TEST_CHECK(TestTreePath("drm", drmRoot, sizeof(drmRoot)));
+	TEST_CHECK(TestTreePath("dev", deviceRoot, sizeof(deviceRoot)));
+	ddc_i2c_roots_t roots = { drmRoot, deviceRoot };
+	ddc_transport_t *transports[8];
+	int count = DdcI2cList(&roots, transports, 8);
+	TEST_EQUAL_INT(count, 2);
+	bool found5 = false, found7 = false;
+	for (int i = 0; i < count; i++)
+	{
+		const char *name = strrchr(transports[i]->name, '/');
+		name = (name != NULL) ? name + 1 : transports[i]->name;
+		if (strcmp(name, "i2c-5") == 0) found5 = true;
+		if (strcmp(name, "i2c-7") == 0) found7 = true;
+		transports[i]->close(transports[i]);
+	}
+	TEST_CHECK(found5 && found7);
+	TestTreeRemove();
+}
+#endif
+
+int main(void)
+{
+	TestRequest();
+	TestReplyRejected();
+	TestNakRetry();
+	TestFake();
+#if defined(__linux__)
+	TestI2cList();
+#endif
+	return TestResult("ddc");
+}
@@ -0,0 +1,158 @@
+// Linux DRM Connector Backend Tests
+// Dan Jackson, 2020.
+
+// Against a temporary /sys/class/drm tree: connected and enabled external connectors are found, identified from their EDID and
+// mapped to their DDC bus, while internal panels (eDP, LVDS, DSI) are left to the sysfs backlight backend.
+
+#if defined(__linux__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+#if defined(__linux__)
+
+#include "backend_drm.h"
+#include "edid.h"
+#include "test_tree.h"
+
+#define TEST_DEVICE_ROOT "/nonexistent/dev"
+
+// A connector directory with its status, enabled and edid attributes
+static void TestConnector(const char *connector, const char *status, const char *enabled, const char *manufacturer, uint16_t product, uint32_t serial, const char *name)
+{
+	char path[TEST_TREE_PATH_LENGTH];
+	snprintf(path, sizeof(path), "drm/%s/status", connector);
+	TEST_CHECK(TestTreeWriteString(path, status));
+	snprintf(path, sizeof(path), "drm/%s/enabled", connector);
+	TEST_CHECK(TestTreeWriteString(path, enabled));
+
+	edid_info_t info = {{0}};
+	snprintf(info.manufacturer, sizeof(info.manufacturer), "%s", manufacturer);
+	info.product = product;
+	info.serial = serial;
+	snprintf(info.name, sizeof(info.name), "%s", name);
+	uint8_t edid[EDID_BLOCK_LENGTH];
+	EdidBuild(&info, edid);
+	snprintf(path, sizeof(path), "drm/%s/edid", connector);
+	TEST_CHECK(TestTreeWrite(path, edid, sizeof(edid)));
+}
+
+static backend_device_t *TestFind(backend_device_t *list, const char *key)
+{
+	for (backend_device_t *device = list; device != NULL; device = device->next)
+	{
+		if (strcmp(device->key, key) == 0) return device;
+	}
+	return NULL;
+}
+
+static int TestCount(backend_device_t *list)
+{
+	int count = 0;
+	for (backend_device_t *device = list; device != NULL; device = device->next) count++;
+	return count;
+}
+
+static void TestClose(backend_t *backend, backend_device_t *list)
+{
+	while (list != NULL)
+	{
+		backend_device_t *next = list->next;
+		backend->close(list);
+		list = next;
+	}
+}
+
+static void TestBackend(void)
+{
+	char root[TEST_TREE_PATH_LENGTH];
+	TEST_CHECK(TestTreePath("drm", root, sizeof(root)));
+
+	// External connectors: the DDC bus from the ddc link, or from an i2c-N entry (e.g. a DisplayPort AUX channel)
+	TestConnector("card0-DP-1", "connected\n", "enabled\n", "ACM", 0x1234, 123456, "ACME 1234");
+	TEST_CHECK(TestTreeLink("drm/card0-DP-1/ddc", "../../../0000:00:02.0/i2c-5"));
+	TestConnector("card0-HDMI-A-1", "connected\n", "enabled\n", "DEL", 0xA0B6, 0x3336304C, "DELL U2415");
+	TEST_CHECK(TestTreeDirectory("drm/card0-HDMI-A-1/i2c-7"));
+
+	// Not usable: disconnected, disabled, no valid EDID, or not a connector
+	TestConnector("card0-DP-2", "disconnected\n", "disabled\n", "ACM", 0x1234, 1, "ACME 1234");
+	TestConnector("card0-DP-3", "connected\n", "disabled\n", "ACM", 0x1234, 2, "ACME 1234");
+	TEST_CHECK(TestTreeWriteString("drm/card0-DP-4/status", "connected\n"));
+	TEST_CHECK(TestTreeWriteString("drm/card0-DP-4/enabled", "enabled\n"));
+	TEST_CHECK(TestTreeWriteString("drm/card0-DP-4/edid", ""));
+	TEST_CHECK(TestTreeWriteString("drm/card0/dev", "226:0\n"));
+	TEST_CHECK(TestTreeWriteString("drm/version", "drm 1.1.0 20060810\n"));
+
+	// Internal panels, even though connected with a valid EDID
+	TestConnector("card0-eDP-1", "connected\n", "enabled\n", "BOE", 0x0747, 0, "");
+	TEST_CHECK(TestTreeLink("drm/card0-eDP-1/ddc", "../../../0000:00:02.0/i2c-3"));
+	TestConnector("card0-LVDS-1", "connected\n", "enabled\n", "LGD", 0x02DC, 0, "");
+	TestConnector("card1-DSI-1", "connected\n", "enabled\n", "SDC", 0x4141, 0, "");
+
+	backend_t *backend = DrmBackendCreate(root, TEST_DEVICE_ROOT);
+	TEST_CHECK(backend != NULL);
+	if (backend == NULL) return;
+	TEST_EQUAL_STRING(backend->name, "drm");
+
+	backend_device_t *list = backend->enumerate(backend, NULL, 0);
+	TEST_EQUAL_INT(TestCount(list), 2);
+	backend_device_t *dp = TestFind(list, "drm/card0-DP-1");
+	backend_device_t *hdmi = TestFind(list, "drm/card0-HDMI-A-1");
+	TEST_CHECK(dp != NULL && hdmi != NULL);
+	if (dp == NULL || hdmi == NULL) { TestClose(backend, list); DrmBackendDestroy(backend); return; }
+	TEST_CHECK(TestFind(list, "drm/card0-eDP-1") == NULL);
+	TEST_CHECK(TestFind(list, "drm/card0-LVDS-1") == NULL);
+	TEST_CHECK(TestFind(list, "drm/card1-DSI-1") == NULL);
+
+	TEST_EQUAL_STRING(dp->bus, TEST_DEVICE_ROOT "/i2c-5");
+	TEST_EQUAL_STRING(dp->identity, "ACM-1234-0001E240");
+	TEST_CHECK(dp->output == BACKEND_OUTPUT_EXTERNAL);
+	TEST_CHECK(wcscmp(dp->description, L"ACME 1234") == 0);
+	TEST_EQUAL_STRING(hdmi->bus, TEST_DEVICE_ROOT "/i2c-7");
+	TEST_EQUAL_STRING(hdmi->identity, "DEL-A0B6-3336304C");
+	TEST_CHECK(wcscmp(hdmi->description, L"DELL U2415") == 0);
+
+	// No bus traffic until a command, which fails (once warned) when the bus cannot be opened
+	int value = -1;
+	TEST_CHECK(!backend->get(dp, &value));
+	TEST_CHECK(!backend->set(dp, 50));
+
+	// Re-enumeration keeps the same display on the same connector, but a different display there is a new device
+	TestConnector("card0-HDMI-A-1", "connected\n", "enabled\n", "DEL", 0xA0B6, 0x33363999, "DELL U2415");
+	backend_device_t *existing[] = { dp, hdmi };
+	backend_device_t *updated = backend->enumerate(backend, existing, 2);
+	TEST_EQUAL_INT(TestCount(updated), 2);
+	TEST_CHECK(TestFind(updated, "drm/card0-DP-1") == dp);
+	backend_device_t *replaced = TestFind(updated, "drm/card0-HDMI-A-1");
+	TEST_CHECK(replaced != NULL && replaced != hdmi);
+	if (replaced != NULL) TEST_EQUAL_STRING(replaced->identity, "DEL-A0B6-33363999");
+	TEST_CHECK(existing[0] == NULL);
+	TEST_CHECK(existing[1] == hdmi);
+	if (existing[1] != NULL) backend->close(existing[1]);
+
+	TestClose(backend, updated);
+	DrmBackendDestroy(backend);
+}
+
+int main(void)
+{
+	if (TestTreeCreate() == NULL) return 1;
+	TestBackend();
+	TestTreeRemove();
+	return TestResult("drm");
+}
+
+#else
+
+int main(void)
+{
+	printf("drm: skipped (not Linux)\n");
+	return 0;
+}
+
+#endif
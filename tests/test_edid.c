@@ -0,0 +1,99 @@
+// EDID Parser Tests
+// Dan Jackson, 2020.
+
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "edid.h"
+#include "test.h"
+
+// Base block as read from a monitor: a detailed timing first, then serial, name and range limit descriptors
+static const uint8_t capturedDell[EDID_BLOCK_LENGTH] =
+{
+	0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x10, 0xac, 0xb6, 0xa0, 0x4c, 0x30, 0x36, 0x33,
+	0x2a, 0x19, 0x01, 0x04, 0xb5, 0x34, 0x20, 0x78, 0x3a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x3a, 0x80, 0x18, 0x71, 0x38, 0x2d, 0x40, 0x58, 0x2c,
+	0x45, 0x00, 0x09, 0x25, 0x21, 0x00, 0x00, 0x1e, 0x00, 0x00, 0x00, 0xff, 0x00, 0x37, 0x4d, 0x54,
+	0x30, 0x31, 0x36, 0x36, 0x53, 0x30, 0x41, 0x42, 0x4c, 0x0a, 0x00, 0x00, 0x00, 0xfc, 0x00, 0x44,
+	0x45, 0x4c, 0x4c, 0x20, 0x55, 0x32, 0x34, 0x31, 0x35, 0x0a, 0x20, 0x20, 0x00, 0x00, 0x00, 0xfd,
+	0x00, 0x38, 0x4c, 0x1e, 0x51, 0x11, 0x00, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x01, 0x78,
+};
+
+static void TestCaptured(void)
+{
+	edid_info_t info;
+	char identity[EDID_IDENTITY_LENGTH];
+	TEST_CHECK(EdidParse(capturedDell, sizeof(capturedDell), &info));
+	TEST_EQUAL_STRING(info.manufacturer, "DEL");
+	TEST_EQUAL_INT(info.product, 0xA0B6);
+	TEST_EQUAL_INT(info.serial, 0x3336304C);
+	TEST_EQUAL_STRING(info.name, "DELL U2415");
+	TEST_EQUAL_STRING(info.serialText, "7MT0166S0ABL");
+	EdidIdentity(&info, identity, sizeof(identity));
+	TEST_EQUAL_STRING(identity, "DEL-A0B6-7MT0166S0ABL");
+}
+
+static void TestInvalid(void)
+{
+	edid_info_t info;
+	uint8_t data[EDID_BLOCK_LENGTH];
+	TEST_CHECK(!EdidParse(NULL, 0, &info));
+	TEST_CHECK(!EdidParse(capturedDell, EDID_BLOCK_LENGTH - 1, &info));	// Short
+
+	memcpy(data, capturedDell, sizeof(data));
+	data[100] ^= 0x01;
+	TEST_CHECK(!EdidParse(data, sizeof(data), &info));		// Checksum
+
+	memcpy(data, capturedDell, sizeof(data));
+	data[0] = 0x01;
+	data[EDID_BLOCK_LENGTH - 1]--;
+	TEST_CHECK(!EdidParse(data, sizeof(data), &info));		// Header (with a valid checksum)
+}
+
+// A built block parses to the same identification
+static void TestBuild(void)
+{
+	edid_info_t info = {0}, parsed;
+	char identity[EDID_IDENTITY_LENGTH];
+	uint8_t data[EDID_BLOCK_LENGTH];
+
+	strcpy(info.manufacturer, "ACM");
+	info.product = 0x1234;
+	info.serial = 123456;
+	strcpy(info.name, "ACME 1234");
+	EdidBuild(&info, data);
+	TEST_CHECK(EdidParse(data, sizeof(data), &parsed));
+	TEST_EQUAL_STRING(parsed.manufacturer, "ACM");
+	TEST_EQUAL_INT(parsed.product, 0x1234);
+	TEST_EQUAL_INT(parsed.serial, 123456);
+	TEST_EQUAL_STRING(parsed.name, "ACME 1234");
+	TEST_EQUAL_STRING(parsed.serialText, "");
+	EdidIdentity(&parsed, identity, sizeof(identity));
+	TEST_EQUAL_STRING(identity, "ACM-1234-0001E240");
+
+	// The description is the name, otherwise the manufacturer and product, and is truncated to fit
+	wchar_t description[16];
+	EdidDescription(&parsed, description, sizeof(description) / sizeof(description[0]));
+	TEST_CHECK(wcscmp(description, L"ACME 1234") == 0);
+	EdidDescription(&parsed, description, 5);
+	TEST_CHECK(wcscmp(description, L"ACME") == 0);
+	parsed.name[0] = '\0';
+	EdidDescription(&parsed, description, sizeof(description) / sizeof(description[0]));
+	TEST_CHECK(wcscmp(description, L"ACM 1234") == 0);
+
+	strcpy(info.serialText, "SN 12 345");		// Spaces are replaced in the identity
+	EdidBuild(&info, data);
+	TEST_CHECK(EdidParse(data, sizeof(data), &parsed));
+	EdidIdentity(&parsed, identity, sizeof(identity));
+	TEST_EQUAL_STRING(identity, "ACM-1234-SN_12_345");
+}
+
+int main(void)
+{
+	TestCaptured();
+	TestInvalid();
+	TestBuild();
+	return TestResult("edid");
+}
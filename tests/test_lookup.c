@@ -0,0 +1,87 @@
+// Hash Lookup Tests
+// Dan Jackson, 2020.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lookup.h"
+#include "test.h"
+
+static void TestFind(void)
+{
+	static const char *keys[] = { "DISPLAY\\ACM1234\\1", "DISPLAY\\ACM1234\\2", "DISPLAY\\DEL40F4\\1", "", "x" };
+	const int count = (int)(sizeof(keys) / sizeof(keys[0]));
+	lookup_t lookup;
+	TEST_CHECK(LookupInit(&lookup, count));
+	for (int i = 0; i < count; i++) TEST_CHECK(LookupAdd(&lookup, LookupHashString(keys[i]), (void *)keys[i]));
+	TEST_EQUAL_INT(lookup.count, count);
+
+	for (int i = 0; i < count; i++)
+	{
+		int cursor = 0, found = 0;
+		const char *value;
+		while ((value = (const char *)LookupNext(&lookup, LookupHashString(keys[i]), &cursor)) != NULL)
+		{
+			if (strcmp(value, keys[i]) == 0) found++;
+		}
+		TEST_EQUAL_INT(found, 1);
+	}
+
+	int cursor = 0;
+	const char *value;
+	while ((value = (const char *)LookupNext(&lookup, LookupHashString("missing"), &cursor)) != NULL) TEST_CHECK(strcmp(value, "missing") != 0);
+	LookupFree(&lookup);
+	TEST_EQUAL_INT(lookup.capacity, 0);
+}
+
+// Every value added with the same hash is returned, in the order added
+static void TestCollisions(void)
+{
+	int values[8];
+	lookup_t lookup;
+	TEST_CHECK(LookupInit(&lookup, 8));
+	for (int i = 0; i < 8; i++) TEST_CHECK(LookupAdd(&lookup, 42, &values[i]));
+	int cursor = 0, count = 0;
+	int *value;
+	while ((value = (int *)LookupNext(&lookup, 42, &cursor)) != NULL)
+	{
+		TEST_CHECK(value == &values[count]);
+		count++;
+	}
+	TEST_EQUAL_INT(count, 8);
+	LookupFree(&lookup);
+}
+
+// Room is always left to end probing
+static void TestFull(void)
+{
+	int value = 0;
+	lookup_t lookup;
+	TEST_CHECK(LookupInit(&lookup, 1));
+	int added = 0;
+	while (added < 100 && LookupAdd(&lookup, (uint32_t)added, &value)) added++;
+	TEST_EQUAL_INT(added, lookup.capacity - 1);
+	int cursor = 0;
+	TEST_CHECK(LookupNext(&lookup, 0x7fffffff, &cursor) == NULL);
+	LookupFree(&lookup);
+
+	lookup_t empty = {0};
+	cursor = 0;
+	TEST_CHECK(LookupNext(&empty, 0, &cursor) == NULL);
+}
+
+static void TestHash(void)
+{
+	TEST_EQUAL_INT(LookupHashString(""), 2166136261u);			// FNV-1a offset basis
+	TEST_EQUAL_INT(LookupHashString("a"), 0xe40c292cu);			// Published FNV-1a test vector
+	TEST_EQUAL_INT(LookupHash("foobar", 6), 0xbf9cf968u);
+}
+
+int main(void)
+{
+	TestFind();
+	TestCollisions();
+	TestFull();
+	TestHash();
+	return TestResult("lookup");
+}
@@ -0,0 +1,96 @@
+// MCCS Capabilities Parser Tests
+// Dan Jackson, 2020.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mccs.h"
+#include "vcp.h"
+#include "test.h"
+
+// Capabilities strings as returned by monitors (including their quirks)
+static const char *capturedDell = "(prot(monitor)type(LCD)model(U2415)cmds(01 02 03 07 0C E3 F3)vcp(02 04 05 08 10 12 14(01 04 05 06 08 09 0B 0C) 16 18 1A 52 60(01 0F 11) AA(01 02) AC AE B2 B6 C6 C8 C9 D6(01 04 05) DC(00 02 03 05) DF E0 E1 E2(00 01 02 04 0E 12 14 19) F0(00 08) F1(01) F2 FD)mswhql(1)asset_eep(40)mccs_ver(2.1))";
+static const char *capturedLg = "(prot(monitor)type(LCD)model(LG Ultra HD)cmds(01 02 03 0C E3 F3)vcp(02 04 05 08 10 12 14(05 08 0B) 16 18 1A 52 60( 11 12 0F 10) AC AE B2 B6 C0 C6 C8 C9 D6(01 04) DF 62 8D F4 F5(00 01 02) F6(00 01 02) 4D 4E 4F 15(01 06 09 10 11 13 14 28 29 32 44 48) F7(00 01 02 03) F8(00 01) F9 E4 E5 E6 E7 E8 E9 EA EB EF FD(00 01) FE(00 01 02) FF)mccs_ver(2.1)mswhql(1))";
+static const char *capturedPacked = "prot(monitor)type(lcd)model(SyncMaster)cmds(01020304070C4EF3)vcp(0210121416181A6062AC)mccs_ver(2.0)";	// No outer parentheses or separating spaces
+
+static void TestDell(void)
+{
+	mccs_caps_t caps;
+	TEST_CHECK(MccsParse(capturedDell, &caps));
+	TEST_EQUAL_STRING(caps.protocol, "monitor");
+	TEST_EQUAL_STRING(caps.type, "LCD");
+	TEST_EQUAL_STRING(caps.model, "U2415");
+	TEST_EQUAL_STRING(caps.version, "2.1");
+	TEST_EQUAL_INT(caps.vcpCount, 30);
+	TEST_CHECK(MccsFindVcp(&caps, VCP_BRIGHTNESS) != NULL);
+	TEST_CHECK(MccsFindVcp(&caps, 0x62) == NULL);
+
+	const mccs_vcp_t *input = MccsFindVcp(&caps, 0x60);
+	TEST_CHECK(input != NULL);
+	if (input != NULL)
+	{
+		TEST_EQUAL_INT(input->valueCount, 3);
+		TEST_EQUAL_INT(input->values[0], 0x01);
+		TEST_EQUAL_INT(input->values[2], 0x11);
+	}
+}
+
+static void TestLg(void)
+{
+	mccs_caps_t caps;
+	TEST_CHECK(MccsParse(capturedLg, &caps));
+	TEST_EQUAL_STRING(caps.model, "LG Ultra HD");
+	const mccs_vcp_t *input = MccsFindVcp(&caps, 0x60);	// Space after the opening parenthesis
+	TEST_CHECK(input != NULL && input->valueCount == 4 && input->values[3] == 0x10);
+	const mccs_vcp_t *colour = MccsFindVcp(&caps, 0x15);
+	TEST_CHECK(colour != NULL && colour->valueCount == 12);
+	TEST_CHECK(MccsFindVcp(&caps, 0xFF) != NULL);
+}
+
+static void TestPacked(void)
+{
+	mccs_caps_t caps;
+	TEST_CHECK(MccsParse(capturedPacked, &caps));
+	TEST_EQUAL_STRING(caps.model, "SyncMaster");
+	TEST_EQUAL_STRING(caps.version, "2.0");
+	TEST_EQUAL_INT(caps.vcpCount, 10);
+	TEST_CHECK(MccsFindVcp(&caps, VCP_BRIGHTNESS) != NULL);
+	TEST_CHECK(MccsFindVcp(&caps, 0xAC) != NULL);
+}
+
+// The canonical form (as cached) parses to the same result
+static void TestFormat(void)
+{
+	const char *captured[] = { capturedDell, capturedLg, capturedPacked };
+	for (int i = 0; i < (int)(sizeof(captured) / sizeof(captured[0])); i++)
+	{
+		mccs_caps_t caps, reparsed;
+		char buffer[MCCS_CAPABILITIES_LENGTH];
+		TEST_CHECK(MccsParse(captured[i], &caps));
+		size_t length = MccsFormat(&caps, buffer, sizeof(buffer));
+		TEST_CHECK(length > 0 && length < sizeof(buffer));
+		TEST_CHECK(MccsParse(buffer, &reparsed));
+		TEST_CHECK(memcmp(&caps, &reparsed, sizeof(caps)) == 0);
+	}
+}
+
+static void TestInvalid(void)
+{
+	mccs_caps_t caps;
+	TEST_CHECK(!MccsParse(NULL, &caps));
+	TEST_CHECK(!MccsParse("", &caps));
+	TEST_CHECK(!MccsParse("(prot(monitor)type(lcd))", &caps));	// No vcp()
+	TEST_CHECK(!MccsParse("(prot(monitor)vcp(10 12 14(05 08)", &caps));	// Unbalanced
+	TEST_CHECK(!MccsParse("(vcp(10 1G))", &caps));	// Not hex
+	TEST_CHECK(!MccsParse("(vcp((01) 10))", &caps));	// Values without a code
+}
+
+int main(void)
+{
+	TestDell();
+	TestLg();
+	TestPacked();
+	TestFormat();
+	TestInvalid();
+	return TestResult("mccs");
+}
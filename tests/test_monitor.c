@@ -0,0 +1,140 @@
+// Monitor Read/Write Policy Tests
+// Dan Jackson, 2020.
+
+// The retry, timeout and verification policy (monitor_policy_t) and the coalescing of posted values, against a simulated monitor:
+// a transient failure is retried, the timeout stops further attempts, a write that reads back differently is written again,
+// and only the final value of a burst is verified (and always applied).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "monitor.h"
+#include "backend_sim.h"
+#include "test.h"
+
+#define TEST_TIME_SCALE 0.1				// Simulated latencies run 10x faster (including the 50 ms DDC/CI command spacing)
+#define TEST_BURST 10
+
+static backend_t *testBackend = NULL;
+
+static void TestRetry(monitor_t *monitor)
+{
+	monitor_policy_t policy = { 2, 1, 0, 0 };
+	MonitorSetPolicy(&policy);
+
+	// One transient failure is retried
+	monitor_metrics_t before, after;
+	MonitorGetMetrics(monitor, &before);
+	SimBackendFailNext(testBackend, 0, 1);
+	TEST_CHECK(MonitorSetBrightness(monitor, 30));
+	MonitorGetMetrics(monitor, &after);
+	TEST_EQUAL_INT(after.writeRetries - before.writeRetries, 1);
+	TEST_EQUAL_INT(after.writeFailures - before.writeFailures, 0);
+	sim_stats_t stats;
+	TEST_CHECK(SimBackendStats(testBackend, 0, &stats));
+	TEST_EQUAL_INT(stats.value, 30);
+
+	// More failures than retries: the confirmed value is kept
+	MonitorGetMetrics(monitor, &before);
+	SimBackendFailNext(testBackend, 0, 3);
+	TEST_CHECK(!MonitorSetBrightness(monitor, 70));
+	MonitorGetMetrics(monitor, &after);
+	TEST_EQUAL_INT(after.writes - before.writes, 3);
+	TEST_EQUAL_INT(after.writeFailures - before.writeFailures, 1);
+	TEST_EQUAL_INT(MonitorGetBrightness(monitor), 30);
+	SimBackendFailNext(testBackend, 0, 0);
+}
+
+static void TestTimeout(monitor_t *monitor)
+{
+	// Retries are plentiful, but the first backoff already passes the timeout
+	monitor_policy_t policy = { 10, 20, 10, 0 };
+	MonitorSetPolicy(&policy);
+	monitor_metrics_t before, after;
+	MonitorGetMetrics(monitor, &before);
+	SimBackendFailNext(testBackend, 0, 100);
+	TEST_CHECK(!MonitorSetBrightness(monitor, 40));
+	MonitorGetMetrics(monitor, &after);
+	TEST_EQUAL_INT(after.writes - before.writes, 1);
+	TEST_EQUAL_INT(after.writeRetries - before.writeRetries, 0);
+	TEST_EQUAL_INT(after.writeFailures - before.writeFailures, 1);
+	SimBackendFailNext(testBackend, 0, 0);
+}
+
+static void TestVerify(monitor_t *monitor)
+{
+	monitor_policy_t policy = { 2, 1, 0, 100 };
+	MonitorSetPolicy(&policy);
+
+	// Acknowledged, but not applied: read back, written again and confirmed
+	monitor_metrics_t before, after;
+	MonitorGetMetrics(monitor, &before);
+	SimBackendIgnoreNext(testBackend, 0, 1);
+	TEST_CHECK(MonitorSetBrightness(monitor, 60));
+	MonitorGetMetrics(monitor, &after);
+	TEST_EQUAL_INT(after.mismatches - before.mismatches, 1);
+	TEST_EQUAL_INT(after.writes - before.writes, 2);
+	sim_stats_t stats;
+	TEST_CHECK(SimBackendStats(testBackend, 0, &stats));
+	TEST_EQUAL_INT(stats.value, 60);
+	TEST_EQUAL_INT(MonitorGetBrightness(monitor), 60);
+
+	// Ignored every time: the value read back is what is confirmed
+	SimBackendIgnoreNext(testBackend, 0, 2);
+	TEST_CHECK(!MonitorSetBrightness(monitor, 80));
+	TEST_EQUAL_INT(MonitorGetBrightness(monitor), 60);
+	SimBackendIgnoreNext(testBackend, 0, 0);
+}
+
+static void TestBurst(monitor_t **list)
+{
+	monitor_policy_t policy = { 2, 1, 0, 100 };
+	MonitorSetPolicy(&policy);
+
+	// Values posted faster than they can be written replace each other, only the last of the burst is read back
+	sim_stats_t before, after;
+	TEST_CHECK(SimBackendStats(testBackend, 0, &before));
+	monitor_metrics_t metrics;
+	for (int i = 1; i <= TEST_BURST; i++) MonitorPostBrightness(*list, 50 + i);
+	TEST_EQUAL_INT(MonitorGetBrightness(*list), 50 + TEST_BURST);
+
+	// Destroying the list waits for the pending value
+	MonitorGetMetrics(*list, &metrics);
+	MonitorListDestroy(*list);
+	*list = NULL;
+	TEST_CHECK(SimBackendStats(testBackend, 0, &after));
+	TEST_CHECK(metrics.coalesced > 0);
+	TEST_CHECK(after.writes - before.writes < TEST_BURST);
+	TEST_EQUAL_INT(after.reads - before.reads, 1);
+	TEST_EQUAL_INT(after.value, 50 + TEST_BURST);
+}
+
+int main(int argc, char *argv[])
+{
+	testBackend = SimBackendCreate(TEST_TIME_SCALE, 1);
+	sim_monitor_t config = {0};
+	config.hasBrightness = true;
+	config.minimum = 0;
+	config.maximum = 100;
+	config.initial = 50;
+	config.readLatency = 10000;
+	config.writeLatency = 200000;
+	TEST_EQUAL_INT(SimBackendAdd(testBackend, &config), 0);
+	TEST_CHECK(MonitorRegisterBackend(testBackend));
+
+	monitor_t *list = MonitorListEnumerate();
+	TEST_EQUAL_INT(MonitorListCount(list), 1);
+	if (list != NULL && MonitorHasBrightness(list))
+	{
+		TEST_EQUAL_INT(MonitorGetBrightness(list), 50);
+		TestRetry(list);
+		TestTimeout(list);
+		TestVerify(list);
+		TestBurst(&list);
+	}
+	MonitorListDestroy(list);
+	MonitorCleanup();
+	SimBackendDestroy(testBackend);
+	return TestResult("monitor");
+}
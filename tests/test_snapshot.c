@@ -0,0 +1,170 @@
+// State Snapshot Tests
+// Dan Jackson, 2020.
+
+// The "BRSS" snapshot read at every start: entries (identity, backend, description, capabilities and brightness) survive a save and load,
+// a truncated file or one of another version is rejected, and a list saved by MonitorListSave() is restored by MonitorListRestore().
+
+#if defined(__linux__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "test.h"
+
+#if defined(__linux__)
+
+#include "snapshot.h"
+#include "monitor.h"
+#include "backend_sim.h"
+#include "test_tree.h"
+
+static void TestEntries(snapshot_entry_t *entries)
+{
+	memset(entries, 0, 2 * sizeof(snapshot_entry_t));
+	snprintf(entries[0].identity, sizeof(entries[0].identity), "ACM-1234-0001E240");
+	snprintf(entries[0].backend, sizeof(entries[0].backend), "ddcci");
+	wcscpy(entries[0].description, L"ACME 1234");
+	entries[0].caps.hasBrightness = true;
+	entries[0].caps.minimum = 0;
+	entries[0].caps.maximum = 100;
+	entries[0].caps.current = 42;
+	snprintf(entries[1].identity, sizeof(entries[1].identity), "DISPLAY\\ACME5678\\1&2&3");
+	snprintf(entries[1].backend, sizeof(entries[1].backend), "wmi");
+	wcscpy(entries[1].description, L"Built-in \u00e9cran");
+	entries[1].caps.hasBrightness = true;
+	entries[1].caps.minimum = 0;
+	entries[1].caps.maximum = 100;
+	entries[1].caps.current = 60;
+	entries[1].caps.levelCount = 3;
+	entries[1].caps.levels[0] = 0;
+	entries[1].caps.levels[1] = 60;
+	entries[1].caps.levels[2] = 100;
+}
+
+static void TestRoundTrip(void)
+{
+	snapshot_entry_t saved[2], loaded[SNAPSHOT_MAX_MONITORS];
+	TestEntries(saved);
+	char path[256];
+	TEST_CHECK(TestTreePath("snapshot.dat", path, sizeof(path)));
+	TEST_CHECK(SnapshotSave(path, saved, 2));
+	TestTreeRecord(path);
+
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, SNAPSHOT_MAX_MONITORS), 2);
+	for (int i = 0; i < 2; i++)
+	{
+		TEST_EQUAL_STRING(loaded[i].identity, saved[i].identity);
+		TEST_EQUAL_STRING(loaded[i].backend, saved[i].backend);
+		TEST_CHECK(wcscmp(loaded[i].description, saved[i].description) == 0);
+		TEST_CHECK(loaded[i].caps.hasBrightness == saved[i].caps.hasBrightness);
+		TEST_EQUAL_INT(loaded[i].caps.minimum, saved[i].caps.minimum);
+		TEST_EQUAL_INT(loaded[i].caps.maximum, saved[i].caps.maximum);
+		TEST_EQUAL_INT(loaded[i].caps.current, saved[i].caps.current);
+		TEST_EQUAL_INT(loaded[i].caps.levelCount, saved[i].caps.levelCount);
+	}
+	TEST_EQUAL_INT(loaded[1].caps.levels[1], 60);
+
+	// Only as many as asked for
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, 1), 1);
+	TEST_EQUAL_STRING(loaded[0].identity, saved[0].identity);
+}
+
+// Damaged copies of the snapshot saved by TestRoundTrip()
+static void TestRejected(void)
+{
+	snapshot_entry_t loaded[SNAPSHOT_MAX_MONITORS];
+	char path[256];
+	static char data[4096];
+	size_t length = 0;
+	TEST_CHECK(TestTreePath("snapshot.dat", path, sizeof(path)));
+	FILE *fp = fopen(path, "rb");
+	if (fp != NULL)
+	{
+		length = fread(data, 1, sizeof(data), fp);
+		fclose(fp);
+	}
+	TEST_CHECK(length > 6);
+	if (length <= 6) return;
+
+	// Truncated part way through the last entry, or after the header
+	TEST_CHECK(TestTreeWrite("truncated.dat", data, length - 3));
+	TEST_CHECK(TestTreePath("truncated.dat", path, sizeof(path)));
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, SNAPSHOT_MAX_MONITORS), 0);
+	TEST_CHECK(TestTreeWrite("truncated.dat", data, 6));
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, SNAPSHOT_MAX_MONITORS), 0);
+
+	// Another version
+	data[4]++;
+	TEST_CHECK(TestTreeWrite("version.dat", data, length));
+	TEST_CHECK(TestTreePath("version.dat", path, sizeof(path)));
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, SNAPSHOT_MAX_MONITORS), 0);
+
+	// Not a snapshot, or missing
+	TEST_CHECK(TestTreeWriteString("other.dat", "not a snapshot"));
+	TEST_CHECK(TestTreePath("other.dat", path, sizeof(path)));
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, SNAPSHOT_MAX_MONITORS), 0);
+	TEST_CHECK(TestTreePath("missing.dat", path, sizeof(path)));
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, SNAPSHOT_MAX_MONITORS), 0);
+}
+
+static void TestMonitorList(void)
+{
+	backend_t *backend = SimBackendCreate(0, 1);
+	sim_monitor_t config = {0};
+	config.hasBrightness = true;
+	config.minimum = 0;
+	config.maximum = 100;
+	config.initial = 35;
+	TEST_EQUAL_INT(SimBackendAdd(backend, &config), 0);
+	TEST_CHECK(MonitorRegisterBackend(backend));
+	monitor_t *list = MonitorListEnumerate();
+	TEST_EQUAL_INT(MonitorListCount(list), 1);
+	char path[256];
+	TEST_CHECK(TestTreePath("monitors.dat", path, sizeof(path)));
+	TEST_CHECK(MonitorListSave(list, path));
+	TestTreeRecord(path);
+
+	// Usable (with the last brightness) before any monitor is enumerated
+	monitor_t *restored = MonitorListRestore(path);
+	TEST_EQUAL_INT(MonitorListCount(restored), 1);
+	if (list != NULL && restored != NULL)
+	{
+		TEST_EQUAL_STRING(MonitorGetIdentity(restored), MonitorGetIdentity(list));
+		TEST_CHECK(wcscmp(MonitorGetDescription(restored), MonitorGetDescription(list)) == 0);
+		TEST_CHECK(MonitorHasBrightness(restored));
+		TEST_EQUAL_INT(MonitorGetBrightness(restored), 35);
+	}
+	snapshot_entry_t loaded[SNAPSHOT_MAX_MONITORS];
+	TEST_EQUAL_INT(SnapshotLoad(path, loaded, SNAPSHOT_MAX_MONITORS), 1);
+	TEST_EQUAL_STRING(loaded[0].backend, "sim");
+	TEST_EQUAL_INT(loaded[0].caps.current, 35);
+
+	MonitorListDestroy(restored);
+	MonitorListDestroy(list);
+	MonitorCleanup();
+	SimBackendDestroy(backend);
+}
+
+int main(int argc, char *argv[])
+{
+	if (TestTreeCreate() == NULL) return 1;
+	TestRoundTrip();
+	TestRejected();
+	TestMonitorList();
+	TestTreeRemove();
+	return TestResult("snapshot");
+}
+
+#else
+
+int main(void)
+{
+	printf("snapshot: skipped (not Linux)\n");
+	return 0;
+}
+
+#endif
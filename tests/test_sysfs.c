@@ -0,0 +1,156 @@
+// Linux sysfs Backlight Backend Tests
+// Dan Jackson, 2020.
+
+// Against a temporary /sys/class/backlight tree: devices are found, read and written (with pwrite()) through their brightness files.
+
+#if defined(__linux__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+#if defined(__linux__)
+
+#include "backend_sysfs.h"
+#include "monitor.h"
+#include "test_tree.h"
+
+static backend_device_t *TestFind(backend_device_t *list, const char *key)
+{
+	for (backend_device_t *device = list; device != NULL; device = device->next)
+	{
+		if (strcmp(device->key, key) == 0) return device;
+	}
+	return NULL;
+}
+
+static int TestCount(backend_device_t *list)
+{
+	int count = 0;
+	for (backend_device_t *device = list; device != NULL; device = device->next) count++;
+	return count;
+}
+
+static void TestBackend(void)
+{
+	char buffer[64];
+	TEST_CHECK(TestTreeWriteString("intel_backlight/max_brightness", "937\n"));
+	TEST_CHECK(TestTreeWriteString("intel_backlight/brightness", "468\n"));
+	TEST_CHECK(TestTreeWriteString("acpi_video0/max_brightness", "15\n"));
+	TEST_CHECK(TestTreeWriteString("acpi_video0/brightness", "15\n"));
+	TEST_CHECK(TestTreeWriteString("no_maximum/brightness", "1\n"));		// Not a usable device
+	TEST_CHECK(TestTreeWriteString("zero_maximum/max_brightness", "0\n"));
+	TEST_CHECK(TestTreeWriteString("zero_maximum/brightness", "0\n"));
+
+	backend_t *backend = SysfsBackendCreate(testTreeRoot);
+	TEST_CHECK(backend != NULL);
+	if (backend == NULL) return;
+	TEST_EQUAL_STRING(backend->name, "sysfs");
+
+	backend_device_t *list = backend->enumerate(backend, NULL, 0);
+	TEST_EQUAL_INT(TestCount(list), 2);
+	backend_device_t *intel = TestFind(list, "backlight/intel_backlight");
+	backend_device_t *acpi = TestFind(list, "backlight/acpi_video0");
+	TEST_CHECK(intel != NULL && acpi != NULL);
+	if (intel == NULL || acpi == NULL) return;
+	TEST_CHECK(intel->backend == backend);
+	TEST_CHECK(intel->output == BACKEND_OUTPUT_INTERNAL);
+
+	backend_caps_t caps;
+	TEST_CHECK(backend->capabilities(intel, &caps));
+	TEST_CHECK(caps.hasBrightness);
+	TEST_EQUAL_INT(caps.minimum, 0);
+	TEST_EQUAL_INT(caps.maximum, 937);
+	TEST_EQUAL_INT(caps.current, 468);
+	TEST_EQUAL_INT(caps.levelCount, 0);
+
+	int value = -1;
+	TEST_CHECK(backend->get(acpi, &value));
+	TEST_EQUAL_INT(value, 15);
+
+	// Written in place at the start of the file, read back from the same open descriptor
+	TEST_CHECK(backend->set(intel, 100));
+	TEST_EQUAL_STRING(TestTreeRead("intel_backlight/brightness", buffer, sizeof(buffer)), "100\n");
+	TEST_CHECK(backend->set(intel, 7));
+	TEST_EQUAL_INT(atoi(TestTreeRead("intel_backlight/brightness", buffer, sizeof(buffer))), 7);
+	value = -1;
+	TEST_CHECK(backend->get(intel, &value));
+	TEST_EQUAL_INT(value, 7);
+
+	// Changed elsewhere (e.g. by a hotkey)
+	TEST_CHECK(TestTreeWriteString("acpi_video0/brightness", "3\n"));
+	TEST_CHECK(backend->get(acpi, &value));
+	TEST_EQUAL_INT(value, 3);
+
+	// Re-enumeration keeps unchanged devices, opens added ones, and leaves removed ones to the caller
+	TEST_CHECK(TestTreeDelete("acpi_video0/max_brightness"));
+	TEST_CHECK(TestTreeDelete("acpi_video0/brightness"));
+	TEST_CHECK(TestTreeDelete("acpi_video0"));
+	TEST_CHECK(TestTreeWriteString("nv_backlight/max_brightness", "100\n"));
+	TEST_CHECK(TestTreeWriteString("nv_backlight/brightness", "50\n"));
+	backend_device_t *existing[] = { intel, acpi };
+	backend_device_t *updated = backend->enumerate(backend, existing, 2);
+	TEST_EQUAL_INT(TestCount(updated), 2);
+	TEST_CHECK(TestFind(updated, "backlight/intel_backlight") == intel);
+	TEST_CHECK(TestFind(updated, "backlight/nv_backlight") != NULL);
+	TEST_CHECK(existing[0] == NULL);
+	TEST_CHECK(existing[1] == acpi);
+	if (existing[1] != NULL) backend->close(existing[1]);
+
+	while (updated != NULL)
+	{
+		backend_device_t *next = updated->next;
+		backend->close(updated);
+		updated = next;
+	}
+	SysfsBackendDestroy(backend);
+}
+
+// Registered with the monitor list, as by an application
+static void TestMonitors(void)
+{
+	char buffer[64];
+	backend_t *backend = SysfsBackendCreate(testTreeRoot);
+	TEST_CHECK(backend != NULL);
+	if (backend == NULL) return;
+	TEST_CHECK(MonitorRegisterBackend(backend));
+
+	monitor_t *monitorList = MonitorListEnumerate();
+	TEST_EQUAL_INT(MonitorListCount(monitorList), 2);
+	monitor_t *monitor = MonitorListFindKey(monitorList, "backlight/intel_backlight");
+	TEST_CHECK(monitor != NULL);
+	if (monitor != NULL)
+	{
+		TEST_CHECK(MonitorHasBrightness(monitor));
+		TEST_CHECK(MonitorSetBrightness(monitor, 100));
+		TEST_EQUAL_INT(atoi(TestTreeRead("intel_backlight/brightness", buffer, sizeof(buffer))), 937);
+		TEST_CHECK(MonitorSetBrightness(monitor, 0));
+		TEST_EQUAL_INT(atoi(TestTreeRead("intel_backlight/brightness", buffer, sizeof(buffer))), 0);
+	}
+	MonitorListDestroy(monitorList);
+	MonitorCleanup();
+	SysfsBackendDestroy(backend);
+}
+
+int main(void)
+{
+	if (TestTreeCreate() == NULL) return 1;
+	TestBackend();
+	TestMonitors();
+	TestTreeRemove();
+	return TestResult("sysfs");
+}
+
+#else
+
+int main(void)
+{
+	printf("sysfs: skipped (not Linux)\n");
+	return 0;
+}
+
+#endif
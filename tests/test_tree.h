@@ -0,0 +1,122 @@
+// Unit Test Temporary Directory Trees
+// Dan Jackson, 2020.
+
+// Fake sysfs/devfs trees for the Linux backends: each file, link or directory made is recorded, so the whole tree can be removed.
+// The including test defines _POSIX_C_SOURCE 200809L before any header.
+
+#ifndef _TEST_TREE_H
+#define _TEST_TREE_H
+
+#if defined(__linux__)
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_TREE_PATH_LENGTH 512
+#define TEST_TREE_MAX_ENTRIES 128
+
+static char testTreeRoot[TEST_TREE_PATH_LENGTH] = "";
+static char testTreeEntries[TEST_TREE_MAX_ENTRIES][TEST_TREE_PATH_LENGTH];
+static int testTreeCount = 0;
+
+// A new empty temporary directory, returns its path (NULL on failure)
+static inline const char *TestTreeCreate(void)
+{
+	const char *tmp = getenv("TMPDIR");
+	snprintf(testTreeRoot, sizeof(testTreeRoot), "%s/brightly-test-XXXXXX", (tmp != NULL && tmp[0] != '\0') ? tmp : "/tmp");
+	testTreeCount = 0;
+	if (mkdtemp(testTreeRoot) == NULL)
+	{
+		fprintf(stderr, "ERROR: Cannot create temporary directory: %s\n", testTreeRoot);
+		testTreeRoot[0] = '\0';
+		return NULL;
+	}
+	return testTreeRoot;
+}
+
+static inline bool TestTreeRecord(const char *path)
+{
+	if (testTreeCount >= TEST_TREE_MAX_ENTRIES) return false;
+	snprintf(testTreeEntries[testTreeCount++], TEST_TREE_PATH_LENGTH, "%s", path);
+	return true;
+}
+
+// The full path of an entry relative to the root, making any missing parent directories
+static inline bool TestTreePath(const char *relative, char *path, size_t size)
+{
+	if ((size_t)snprintf(path, size, "%s/%s", testTreeRoot, relative) >= size) return false;
+	for (char *p = path + strlen(testTreeRoot) + 1; (p = strchr(p, '/')) != NULL; p++)
+	{
+		*p = '\0';
+		struct stat st;
+		bool made = (stat(path, &st) != 0);
+		if (made && (mkdir(path, 0700) != 0 || !TestTreeRecord(path))) { *p = '/'; return false; }
+		*p = '/';
+	}
+	return true;
+}
+
+static inline bool TestTreeDirectory(const char *relative)
+{
+	char path[TEST_TREE_PATH_LENGTH];
+	return TestTreePath(relative, path, sizeof(path)) && mkdir(path, 0700) == 0 && TestTreeRecord(path);
+}
+
+static inline bool TestTreeWrite(const char *relative, const void *data, size_t length)
+{
+	char path[TEST_TREE_PATH_LENGTH];
+	if (!TestTreePath(relative, path, sizeof(path))) return false;
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	bool success = TestTreeRecord(path) && fwrite(data, 1, length, fp) == length;
+	return (fclose(fp) == 0) && success;
+}
+
+static inline bool TestTreeWriteString(const char *relative, const char *text)
+{
+	return TestTreeWrite(relative, text, strlen(text));
+}
+
+// A symbolic link to the target (relative to the link's directory, as in sysfs)
+static inline bool TestTreeLink(const char *relative, const char *target)
+{
+	char path[TEST_TREE_PATH_LENGTH];
+	return TestTreePath(relative, path, sizeof(path)) && symlink(target, path) == 0 && TestTreeRecord(path);
+}
+
+// The contents of a file as a string, empty if it cannot be read
+static inline const char *TestTreeRead(const char *relative, char *buffer, size_t size)
+{
+	char path[TEST_TREE_PATH_LENGTH];
+	buffer[0] = '\0';
+	if (!TestTreePath(relative, path, sizeof(path))) return buffer;
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) return buffer;
+	size_t length = fread(buffer, 1, size - 1, fp);
+	buffer[length] = '\0';
+	fclose(fp);
+	return buffer;
+}
+
+// Remove a file, link or empty directory before the rest of the tree (e.g. a device unplugged)
+static inline bool TestTreeDelete(const char *relative)
+{
+	char path[TEST_TREE_PATH_LENGTH];
+	return TestTreePath(relative, path, sizeof(path)) && remove(path) == 0;
+}
+
+// Remove everything made, most recent first, then the root
+static inline void TestTreeRemove(void)
+{
+	while (testTreeCount > 0) remove(testTreeEntries[--testTreeCount]);
+	if (testTreeRoot[0] != '\0') rmdir(testTreeRoot);
+	testTreeRoot[0] = '\0';
+}
+
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+// VCP Command Spacing Tests
+// Dan Jackson, 2020.
+
+// The learned command interval (vcp.c) against a scripted backend: widened only by bus failures, not by a reply that a feature is unsupported,
+// shortened after a run of successes, and never shorter than the backend's interval (up to the MCCS 50 ms) after a set.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vcp.h"
+#include "test.h"
+
+#define TEST_INTERVAL 1000				// Backend's command interval (microseconds), short to keep the test quick
+
+typedef enum { TEST_OK, TEST_NAK, TEST_UNSUPPORTED } test_result_t;
+static test_result_t testResult = TEST_OK;
+
+static bool TestVcpGet(backend_device_t *device, uint8_t code, int *current, int *maximum)
+{
+	device->unsupported = (testResult == TEST_UNSUPPORTED);
+	if (testResult != TEST_OK) return false;
+	*current = 50;
+	*maximum = 100;
+	return code == VCP_BRIGHTNESS;
+}
+
+static bool TestVcpSet(backend_device_t *device, uint8_t code, int value)
+{
+	device->unsupported = (testResult == TEST_UNSUPPORTED);
+	return testResult == TEST_OK && code == VCP_BRIGHTNESS && value >= 0;
+}
+
+static void TestAdapt(void)
+{
+	backend_t backend = {0};
+	backend.name = "test";
+	backend.commandInterval = TEST_INTERVAL;
+	backend.vcpGet = TestVcpGet;
+	backend.vcpSet = TestVcpSet;
+	backend_device_t device = {0};
+	device.backend = &backend;
+	VcpTimingClear();
+
+	vcp_value_t value = { VCP_BRIGHTNESS };
+	TEST_EQUAL_INT(VcpInterval(&device), TEST_INTERVAL);
+	TEST_EQUAL_INT(VcpRead(&device, &value, 1), 1);
+	TEST_EQUAL_INT(value.current, 50);
+	TEST_EQUAL_INT(VcpInterval(&device), TEST_INTERVAL);
+
+	// A valid reply that the feature is unsupported leaves the spacing alone
+	testResult = TEST_UNSUPPORTED;
+	TEST_EQUAL_INT(VcpRead(&device, &value, 1), 0);
+	TEST_CHECK(!value.ok);
+	TEST_EQUAL_INT(VcpInterval(&device), TEST_INTERVAL);
+
+	// A NAK (or timeout, or corrupt reply) doubles it
+	testResult = TEST_NAK;
+	TEST_EQUAL_INT(VcpRead(&device, &value, 1), 0);
+	TEST_EQUAL_INT(VcpInterval(&device), 2 * TEST_INTERVAL);
+	value.current = 30;
+	TEST_EQUAL_INT(VcpWrite(&device, &value, 1), 0);
+	TEST_EQUAL_INT(VcpInterval(&device), 4 * TEST_INTERVAL);
+
+	// Runs of successes shorten it, down to a quarter of the backend's
+	testResult = TEST_OK;
+	for (int i = 0; i < 64 * 16; i++) VcpRead(&device, &value, 1);
+	TEST_EQUAL_INT(VcpInterval(&device), TEST_INTERVAL / 4);
+	TEST_EQUAL_INT(VcpNextInterval(&device), TEST_INTERVAL / 4);
+
+	// ...but a set is always followed by the backend's interval
+	value.current = 40;
+	TEST_EQUAL_INT(VcpWrite(&device, &value, 1), 1);
+	TEST_CHECK(value.ok);
+	TEST_EQUAL_INT(VcpInterval(&device), TEST_INTERVAL / 4);
+	TEST_EQUAL_INT(VcpNextInterval(&device), TEST_INTERVAL);
+	TEST_EQUAL_INT(VcpRead(&device, &value, 1), 1);
+	TEST_EQUAL_INT(VcpNextInterval(&device), TEST_INTERVAL / 4);
+}
+
+int main(void)
+{
+	TestAdapt();
+	return TestResult("vcp");
+}
@@ -0,0 +1,231 @@
+// Monitor Brightness - Span Tracing
+// Dan Jackson, 2020.
+
+// Each thread appends to its own fixed-size buffer, publishing the event count after each event is complete, so recording never blocks
+// (a lock is only taken the first time a thread records).  Events beyond a buffer's capacity are dropped (and counted).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "trace.h"
+#include "json.h"
+
+#define TRACE_BUFFER_EVENTS 8192
+#define TRACE_THREAD_NAME_LENGTH 32
+#define TRACE_INSTANT UINT64_MAX
+
+#if defined(_MSC_VER)
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#define TRACE_STORE_RELEASE(p, v) InterlockedExchange((volatile LONG *)(p), (LONG)(v))
+#define TRACE_LOAD_ACQUIRE(p) InterlockedCompareExchange((volatile LONG *)(p), 0, 0)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#define TRACE_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define TRACE_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#endif
+
+typedef struct
+{
+	const char *category;
+	const char *name;
+	uint64_t start;					// PlatformTimeMicroseconds()
+	uint64_t duration;				// TRACE_INSTANT for a marker
+	int result;
+	char id[TRACE_ID_LENGTH];		// Empty if none
+} trace_event_t;
+
+typedef struct _trace_buffer_t
+{
+	struct _trace_buffer_t *next;
+	int thread;						// Sequential id, from 1
+	char name[TRACE_THREAD_NAME_LENGTH];
+	volatile int32_t count;			// Written only by the owning thread
+	int dropped;
+	trace_event_t events[TRACE_BUFFER_EVENTS];
+} trace_buffer_t;
+
+static platform_mutex_t traceLock = PLATFORM_MUTEX_INIT;
+static volatile bool traceEnabled = false;
+static int traceGeneration = 0;		// Changed by each start, so stale per-thread buffers are replaced
+static uint64_t traceStart = 0;
+static char *traceFile = NULL;
+static trace_buffer_t *traceBuffers = NULL;
+static int traceThreads = 0;
+
+static TRACE_THREAD_LOCAL trace_buffer_t *threadBuffer = NULL;
+static TRACE_THREAD_LOCAL int threadGeneration = 0;
+
+// The calling thread's buffer (created on first use), NULL if not recording
+static trace_buffer_t *TraceBuffer(void)
+{
+	if (!traceEnabled) return NULL;
+	if (threadBuffer != NULL && threadGeneration == traceGeneration) return threadBuffer;
+
+	trace_buffer_t *buffer = (trace_buffer_t *)malloc(sizeof(trace_buffer_t));
+	if (buffer == NULL) return NULL;
+	buffer->name[0] = '\0';
+	buffer->count = 0;
+	buffer->dropped = 0;
+	PlatformMutexLock(&traceLock);
+	if (!traceEnabled)
+	{
+		PlatformMutexUnlock(&traceLock);
+		free(buffer);
+		return NULL;
+	}
+	buffer->thread = ++traceThreads;
+	buffer->next = traceBuffers;
+	traceBuffers = buffer;
+	threadGeneration = traceGeneration;
+	PlatformMutexUnlock(&traceLock);
+	threadBuffer = buffer;
+	return buffer;
+}
+
+bool TraceStart(const char *filename)
+{
+	PlatformMutexLock(&traceLock);
+	free(traceFile);
+	traceFile = (char *)malloc(strlen(filename) + 1);
+	if (traceFile == NULL)
+	{
+		PlatformMutexUnlock(&traceLock);
+		return false;
+	}
+	strcpy(traceFile, filename);
+	traceGeneration++;
+	traceThreads = 0;
+	traceStart = PlatformTimeMicroseconds();
+	traceEnabled = true;
+	PlatformMutexUnlock(&traceLock);
+	return true;
+}
+
+bool TraceEnabled(void)
+{
+	return traceEnabled;
+}
+
+void TraceThreadName(const char *name)
+{
+	trace_buffer_t *buffer = TraceBuffer();
+	if (buffer == NULL) return;
+	snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+}
+
+uint64_t TraceBegin(void)
+{
+	return traceEnabled ? PlatformTimeMicroseconds() : 0;
+}
+
+static void TraceRecord(uint64_t start, uint64_t duration, const char *category, const char *name, const char *id, int result)
+{
+	trace_buffer_t *buffer = TraceBuffer();
+	if (buffer == NULL) return;
+	int32_t count = buffer->count;
+	if (count >= TRACE_BUFFER_EVENTS)
+	{
+		buffer->dropped++;
+		return;
+	}
+	trace_event_t *event = &buffer->events[count];
+	event->category = category;
+	event->name = name;
+	event->start = start;
+	event->duration = duration;
+	event->result = result;
+	event->id[0] = '\0';
+	if (id != NULL)
+	{
+		size_t length = strlen(id);
+		if (length >= sizeof(event->id)) length = sizeof(event->id) - 1;
+		memcpy(event->id, id, length);
+		event->id[length] = '\0';
+	}
+	TRACE_STORE_RELEASE(&buffer->count, count + 1);
+}
+
+void TraceEnd(uint64_t start, const char *category, const char *name, const char *id, int result)
+{
+	if (start == 0) return;
+	TraceRecord(start, PlatformTimeMicroseconds() - start, category, name, id, result);
+}
+
+void TraceInstant(const char *category, const char *name, const char *id)
+{
+	if (!traceEnabled) return;
+	TraceRecord(PlatformTimeMicroseconds(), TRACE_INSTANT, category, name, id, 0);
+}
+
+bool TraceStop(void)
+{
+	PlatformMutexLock(&traceLock);
+	if (!traceEnabled)
+	{
+		PlatformMutexUnlock(&traceLock);
+		return false;
+	}
+	traceEnabled = false;
+
+	bool success = true;
+	FILE *fp = fopen(traceFile, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "ERROR: Cannot write trace: %s\n", traceFile);
+		success = false;
+	}
+
+	int dropped = 0;
+	bool first = true;
+	if (fp != NULL) fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (trace_buffer_t *buffer = traceBuffers; buffer != NULL; buffer = buffer->next)
+	{
+		int32_t count = TRACE_LOAD_ACQUIRE(&buffer->count);
+		dropped += buffer->dropped;
+		if (fp == NULL) continue;
+		if (buffer->name[0] != '\0')
+		{
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->thread);
+			JsonWriteString(fp, buffer->name);
+			fprintf(fp, "}}");
+			first = false;
+		}
+		for (int32_t i = 0; i < count; i++)
+		{
+			const trace_event_t *event = &buffer->events[i];
+			fprintf(fp, "%s{\"name\":", first ? "" : ",\n");
+			JsonWriteString(fp, event->name);
+			fprintf(fp, ",\"cat\":");
+			JsonWriteString(fp, event->category);
+			fprintf(fp, ",\"pid\":1,\"tid\":%d,\"ts\":%llu", buffer->thread, (unsigned long long)(event->start - traceStart));
+			if (event->duration == TRACE_INSTANT) fprintf(fp, ",\"ph\":\"i\",\"s\":\"t\",\"args\":{");
+			else fprintf(fp, ",\"ph\":\"X\",\"dur\":%llu,\"args\":{\"result\":%d%s", (unsigned long long)event->duration, event->result, event->id[0] != '\0' ? "," : "");
+			if (event->id[0] != '\0')
+			{
+				fprintf(fp, "\"id\":");
+				JsonWriteString(fp, event->id);
+			}
+			fprintf(fp, "}}");
+			first = false;
+		}
+	}
+	if (fp != NULL)
+	{
+		fprintf(fp, "\n],\"otherData\":{\"dropped\":%d}}\n", dropped);
+		fclose(fp);
+	}
+	if (dropped > 0) fprintf(stderr, "WARNING: %d trace events dropped (buffer full).\n", dropped);
+
+	while (traceBuffers != NULL)
+	{
+		trace_buffer_t *next = traceBuffers->next;
+		free(traceBuffers);
+		traceBuffers = next;
+	}
+	free(traceFile);
+	traceFile = NULL;
+	PlatformMutexUnlock(&traceLock);
+	return success;
+}
@@ -0,0 +1,23 @@
+// Monitor Brightness - Span Tracing
+// Dan Jackson, 2020.
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_ID_LENGTH 48
+
+// Spans and markers are recorded into a buffer per thread (without locking), and written as Chrome trace-event JSON (chrome://tracing, Perfetto)
+bool TraceStart(const char *filename);		// Start recording, the file is written by TraceStop()
+bool TraceStop(void);						// Write the file and stop recording: other threads must no longer be recording (e.g. at exit)
+bool TraceEnabled(void);
+void TraceThreadName(const char *name);		// Label the calling thread in the trace
+
+// Category and name must be string literals (they are not copied), the id (e.g. a monitor key) may be NULL
+uint64_t TraceBegin(void);	// Start of a span, 0 if not recording
+void TraceEnd(uint64_t start, const char *category, const char *name, const char *id, int result);
+void TraceInstant(const char *category, const char *name, const char *id);
+
+#endif
@@ -0,0 +1,258 @@
+// Monitor Brightness - VCP (MCCS Virtual Control Panel) features
+// Dan Jackson, 2020.
+
+// Features are accessed with individual Get/Set VCP Feature commands, rather than through the high-level brightness API (which may make extra round-trips).
+// DDC/CI requires a minimum interval between commands to the same monitor (e.g. 50 ms after a reply or a set), so a pass waits only as long as needed between commands.
+//
+// The interval each monitor actually needs varies: some drop commands or NAK at the nominal spacing, others accept commands much sooner.
+// Each device starts from the interval learned for its model (or the backend's), which is doubled after a command fails on the bus (a NAK,
+// timeout or corrupt reply), and shortened by an eighth after a run of successes (down to a fraction of the backend's).  Changes are recorded
+// by model, and can be persisted.  A reply that the feature is not supported also fails the command, but leaves the spacing unchanged.
+// However short the learned interval, a command after a set waits at least the MCCS minimum of 50 ms (or the backend's interval, if shorter).
+// Each command is made once per pass: a failure is retried by the caller (e.g. under the monitor policy), so retries are not multiplied across layers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "vcp.h"
+
+#define VCP_INTERVAL_DIVISOR 4			// Shortest learned interval, as a fraction of the backend's (12.5 ms for DDC/CI's 50 ms)
+#define VCP_SET_INTERVAL 50000			// MCCS: microseconds after a Set VCP Feature command before the next command
+#define VCP_INTERVAL_MULTIPLE 8			// Longest learned interval, as a multiple of the backend's
+#define VCP_ADAPT_SUCCESSES 16			// Consecutive successful commands before the interval is shortened
+#define VCP_MODEL_LENGTH 32
+
+typedef struct _vcp_timing_t
+{
+	char model[VCP_MODEL_LENGTH];		// e.g. ACM-1234
+	int interval;						// Microseconds
+	struct _vcp_timing_t *next;
+} vcp_timing_t;
+
+static platform_mutex_t timingLock = PLATFORM_MUTEX_INIT;
+static vcp_timing_t *timings = NULL;
+static char *timingFile = NULL;
+static bool timingChanged = false;
+
+// Model from the identity (manufacturer and product, e.g. "ACM-1234" from "ACM-1234-0001E240"), false if unknown
+static bool VcpModel(const backend_device_t *device, char *model)
+{
+	const char *separator = strchr(device->identity, '-');
+	if (separator != NULL) separator = strchr(separator + 1, '-');
+	size_t length = (separator != NULL) ? (size_t)(separator - device->identity) : strlen(device->identity);
+	if (length == 0 || length >= VCP_MODEL_LENGTH) return false;
+	memcpy(model, device->identity, length);
+	model[length] = '\0';
+	return true;
+}
+
+// (must hold the lock)
+static vcp_timing_t *VcpTimingFind(const char *model)
+{
+	for (vcp_timing_t *timing = timings; timing != NULL; timing = timing->next)
+	{
+		if (strcmp(timing->model, model) == 0) return timing;
+	}
+	return NULL;
+}
+
+// (must hold the lock, the model must fit VCP_MODEL_LENGTH)
+static void VcpTimingAdd(const char *model, int interval)
+{
+	vcp_timing_t *timing = VcpTimingFind(model);
+	if (timing == NULL)
+	{
+		timing = (vcp_timing_t *)calloc(1, sizeof(vcp_timing_t));
+		if (timing == NULL) return;
+		memcpy(timing->model, model, strlen(model) + 1);
+		timing->next = timings;
+		timings = timing;
+	}
+	timing->interval = interval;
+}
+
+int VcpInterval(backend_device_t *device)
+{
+	int base = device->backend->commandInterval;
+	if (base <= 0) return 0;
+	if (device->commandInterval <= 0)
+	{
+		char model[VCP_MODEL_LENGTH];
+		int interval = base;
+		PlatformMutexLock(&timingLock);
+		vcp_timing_t *timing = VcpModel(device, model) ? VcpTimingFind(model) : NULL;
+		if (timing != NULL) interval = timing->interval;
+		PlatformMutexUnlock(&timingLock);
+		if (interval < base / VCP_INTERVAL_DIVISOR) interval = base / VCP_INTERVAL_DIVISOR;
+		if (interval > base * VCP_INTERVAL_MULTIPLE) interval = base * VCP_INTERVAL_MULTIPLE;
+		device->commandInterval = interval;
+	}
+	return device->commandInterval;
+}
+
+// Adjust the device's interval from the result of a command
+static void VcpAdapt(backend_device_t *device, bool success)
+{
+	int base = device->backend->commandInterval;
+	if (base <= 0) return;
+	if (!success && device->unsupported) return;		// A valid reply: says nothing about the spacing
+	int interval = VcpInterval(device);
+	if (!success)
+	{
+		device->successCount = 0;
+		interval *= 2;
+		if (interval > base * VCP_INTERVAL_MULTIPLE) interval = base * VCP_INTERVAL_MULTIPLE;
+	}
+	else if (++device->successCount >= VCP_ADAPT_SUCCESSES)
+	{
+		device->successCount = 0;
+		interval -= interval / 8;
+		if (interval < base / VCP_INTERVAL_DIVISOR) interval = base / VCP_INTERVAL_DIVISOR;
+	}
+	if (interval == device->commandInterval) return;
+	device->commandInterval = interval;
+
+	char model[VCP_MODEL_LENGTH];
+	if (!VcpModel(device, model)) return;
+	PlatformMutexLock(&timingLock);
+	VcpTimingAdd(model, interval);
+	timingChanged = true;
+	PlatformMutexUnlock(&timingLock);
+}
+
+int VcpNextInterval(backend_device_t *device)
+{
+	int interval = VcpInterval(device);
+	int setInterval = (device->backend->commandInterval < VCP_SET_INTERVAL) ? device->backend->commandInterval : VCP_SET_INTERVAL;
+	if (device->lastCommandSet && interval < setInterval) interval = setInterval;
+	return interval;
+}
+
+// Wait until the device can accept another command
+static void VcpSpace(backend_device_t *device)
+{
+	int interval = VcpNextInterval(device);
+	if (interval <= 0 || device->lastCommand == 0) return;
+	uint64_t due = device->lastCommand + (uint64_t)interval;
+	uint64_t now = PlatformTimeMicroseconds();
+	if (due > now) PlatformSleepMicroseconds(due - now);
+}
+
+int VcpRead(backend_device_t *device, vcp_value_t *values, int count)
+{
+	int success = 0;
+	for (int i = 0; i < count; i++)
+	{
+		values[i].ok = false;
+		if (device->backend->vcpGet == NULL) continue;
+		VcpSpace(device);
+		device->unsupported = false;
+		values[i].ok = device->backend->vcpGet(device, values[i].code, &values[i].current, &values[i].maximum);
+		device->lastCommand = PlatformTimeMicroseconds();
+		device->lastCommandSet = false;
+		VcpAdapt(device, values[i].ok);
+		if (values[i].ok) success++;
+	}
+	return success;
+}
+
+int VcpWrite(backend_device_t *device, vcp_value_t *values, int count)
+{
+	int success = 0;
+	for (int i = 0; i < count; i++)
+	{
+		values[i].ok = false;
+		if (device->backend->vcpSet == NULL) continue;
+		VcpSpace(device);
+		device->unsupported = false;
+		values[i].ok = device->backend->vcpSet(device, values[i].code, values[i].current);
+		device->lastCommand = PlatformTimeMicroseconds();
+		device->lastCommandSet = true;
+		VcpAdapt(device, values[i].ok);
+		if (values[i].ok) success++;
+	}
+	return success;
+}
+
+const char *VcpName(uint8_t code)
+{
+	switch (code)
+	{
+		case VCP_BRIGHTNESS: return "brightness";
+		case VCP_CONTRAST: return "contrast";
+		case VCP_VOLUME: return "volume";
+		case VCP_POWER_MODE: return "power";
+		default: return "unknown";
+	}
+}
+
+bool VcpTimingLoad(const char *filename)
+{
+	PlatformMutexLock(&timingLock);
+	free(timingFile);
+	timingFile = NULL;
+	if (filename != NULL && (timingFile = (char *)malloc(strlen(filename) + 1)) != NULL) strcpy(timingFile, filename);
+	FILE *fp = (filename != NULL) ? fopen(filename, "r") : NULL;
+	if (fp == NULL)
+	{
+		PlatformMutexUnlock(&timingLock);
+		return false;
+	}
+
+	char line[VCP_MODEL_LENGTH + 32];
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		char *tab = strchr(line, '\t');
+		if (tab == NULL || tab == line || tab - line >= VCP_MODEL_LENGTH) continue;
+		*tab = '\0';
+		int interval = atoi(tab + 1);
+		if (interval <= 0) { fprintf(stderr, "WARNING: Invalid timing entry: %s\n", line); continue; }
+		VcpTimingAdd(line, interval);
+	}
+	fclose(fp);
+	timingChanged = false;
+	PlatformMutexUnlock(&timingLock);
+	return true;
+}
+
+bool VcpTimingSave(void)
+{
+	bool success = true;
+	PlatformMutexLock(&timingLock);
+	if (timingFile != NULL && timingChanged)
+	{
+		FILE *fp = fopen(timingFile, "w");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "ERROR: Cannot write timings: %s\n", timingFile);
+			success = false;
+		}
+		else
+		{
+			for (vcp_timing_t *timing = timings; timing != NULL; timing = timing->next)
+			{
+				fprintf(fp, "%s\t%d\n", timing->model, timing->interval);
+			}
+			fclose(fp);
+			timingChanged = false;
+		}
+	}
+	PlatformMutexUnlock(&timingLock);
+	return success;
+}
+
+void VcpTimingClear(void)
+{
+	PlatformMutexLock(&timingLock);
+	while (timings != NULL)
+	{
+		vcp_timing_t *next = timings->next;
+		free(timings);
+		timings = next;
+	}
+	timingChanged = false;
+	PlatformMutexUnlock(&timingLock);
+}
@@ -0,0 +1,43 @@
+// Monitor Brightness - VCP (MCCS Virtual Control Panel) features
+// Dan Jackson, 2020.
+
+#ifndef _VCP_H
+#define _VCP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "backend.h"
+
+#define VCP_BRIGHTNESS 0x10
+#define VCP_CONTRAST 0x12
+#define VCP_VOLUME 0x62
+#define VCP_POWER_MODE 0xD6				// 1 = on, 2 = standby, 3 = suspend, 4 = off, 5 = off (power button)
+
+#define VCP_MAX_FEATURES 16
+
+// Result for each feature of a pass
+typedef struct
+{
+	uint8_t code;
+	bool ok;
+	int current;
+	int maximum;
+} vcp_value_t;
+
+// Read each feature in one pass, spaced by the device's learned command interval (values[i].code must be set), returns the number read successfully
+int VcpRead(backend_device_t *device, vcp_value_t *values, int count);
+
+// Write each feature in one pass (values[i].code and .current must be set, .ok is updated), returns the number written successfully
+int VcpWrite(backend_device_t *device, vcp_value_t *values, int count);
+
+const char *VcpName(uint8_t code);
+
+// Command spacing learned for each monitor model (manufacturer and product, from the identity), optionally persisted to a file
+int VcpInterval(backend_device_t *device);			// Current spacing (microseconds), 0 if none is needed
+int VcpNextInterval(backend_device_t *device);		// Spacing before the next command: as VcpInterval(), but at least the MCCS 50 ms after a set
+bool VcpTimingLoad(const char *filename);			// Sets the file used by VcpTimingSave(), a missing file has no learned timings
+bool VcpTimingSave(void);							// Only writes if changed
+void VcpTimingClear(void);
+
+#endif